@@ -0,0 +1,129 @@
+#include "fast_boot.h"
+
+#include "hal/log.h"
+
+#include <cinttypes>
+#include <cstring>
+
+constexpr static const char *CHANNEL_KEY = "boot.ch";
+constexpr static const char *BSSID_HIGH_KEY = "boot.bssid_h";
+constexpr static const char *BSSID_LOW_KEY = "boot.bssid_l";
+constexpr static const char *DISCOVERY_KEY = "boot.disc";
+
+static const char *const PHASE_NAMES[] = {"setup", "network started", "entities", "network connected",
+                                          "mqtt connected", "first state"};
+static_assert(sizeof(PHASE_NAMES) / sizeof(PHASE_NAMES[0]) == static_cast<size_t>(BootPhase::COUNT),
+              "Every boot phase needs a name");
+
+FastBoot::FastBoot(hal::Clock &clock, SettingsStore &settings, hal::Network &network, mqtt::Client &mqtt_client,
+                   const FastBootOptions &options)
+    : m_clock(clock), m_settings(settings), m_network(network), m_mqtt(mqtt_client), m_options(options)
+{
+}
+
+void FastBoot::load_network()
+{
+    m_channel_setting = m_settings.add_int(CHANNEL_KEY, 0);
+    m_bssid_high_setting = m_settings.add_int(BSSID_HIGH_KEY, 0);
+    m_bssid_low_setting = m_settings.add_int(BSSID_LOW_KEY, 0);
+
+    m_cache.channel = m_settings.get_int(m_channel_setting);
+    const auto bssid_high = static_cast<uint32_t>(m_settings.get_int(m_bssid_high_setting));
+    const auto bssid_low = static_cast<uint32_t>(m_settings.get_int(m_bssid_low_setting));
+    for (size_t i = 0; i < 4; ++i)
+        m_cache.bssid[i] = static_cast<uint8_t>(bssid_high >> (24 - 8 * i));
+    m_cache.bssid[4] = static_cast<uint8_t>(bssid_low >> 8);
+    m_cache.bssid[5] = static_cast<uint8_t>(bssid_low);
+
+    if (!m_cache.valid())
+    {
+        ESP_LOGI(BOOT_LOG_TAG, "No cached network, scanning");
+        return;
+    }
+
+    ESP_LOGI(BOOT_LOG_TAG, "Joining cached network on channel %" PRIi32, m_cache.channel);
+    m_network.set_cache(m_cache);
+}
+
+void FastBoot::load_discovery()
+{
+    m_discovery_setting = m_settings.add_int(DISCOVERY_KEY, 0);
+    m_discovery = static_cast<uint32_t>(m_settings.get_int(m_discovery_setting));
+    m_mqtt.set_retained_discovery(m_discovery);
+}
+
+void FastBoot::mark(BootPhase phase)
+{
+    auto &phase_ms = m_phases_ms[static_cast<size_t>(phase)];
+    if (phase_ms == 0)
+        phase_ms = m_clock.millis();
+}
+
+bool FastBoot::loop()
+{
+    hal::NetworkCache cache;
+    if (m_network.get_cache(cache))
+    {
+        mark(BootPhase::NETWORK_CONNECTED);
+        if (!m_network_saved)
+            save_network(cache);
+    }
+    if (m_mqtt.is_connected())
+        mark(BootPhase::MQTT_CONNECTED);
+    if (m_mqtt.get_first_state_ms() != 0 && m_phases_ms[static_cast<size_t>(BootPhase::FIRST_STATE)] == 0)
+        m_phases_ms[static_cast<size_t>(BootPhase::FIRST_STATE)] = m_mqtt.get_first_state_ms();
+
+    const uint32_t announced = m_mqtt.get_announced_discovery();
+    if (!m_discovery_saved && announced != 0)
+        save_discovery(announced);
+
+    const bool complete = m_phases_ms[static_cast<size_t>(BootPhase::FIRST_STATE)] != 0;
+    if (!m_reported && (complete || m_clock.millis() >= m_options.report_timeout_ms))
+        report();
+
+    return !(m_reported && m_network_saved && m_discovery_saved);
+}
+
+void FastBoot::save_network(const hal::NetworkCache &cache)
+{
+    m_network_saved = true;
+    if (cache.channel == m_cache.channel && memcmp(cache.bssid, m_cache.bssid, sizeof(cache.bssid)) == 0)
+        return;
+
+    // Committed by the settings store together with anything else that changed
+    m_settings.set(m_channel_setting, cache.channel);
+    m_settings.set(m_bssid_high_setting,
+                   static_cast<int32_t>(uint32_t(cache.bssid[0]) << 24 | uint32_t(cache.bssid[1]) << 16 |
+                                        uint32_t(cache.bssid[2]) << 8 | cache.bssid[3]));
+    m_settings.set(m_bssid_low_setting, static_cast<int32_t>(uint32_t(cache.bssid[4]) << 8 | cache.bssid[5]));
+    m_cache = cache;
+}
+
+void FastBoot::save_discovery(uint32_t fingerprint)
+{
+    m_discovery_saved = true;
+    if (fingerprint == m_discovery)
+        return;
+
+    m_settings.set(m_discovery_setting, static_cast<int32_t>(fingerprint));
+    m_discovery = fingerprint;
+}
+
+void FastBoot::report()
+{
+    m_reported = true;
+    char message[256];
+    size_t length = static_cast<size_t>(snprintf(message, sizeof(message), "Boot phases:"));
+    for (size_t i = 0; i < static_cast<size_t>(BootPhase::COUNT) && length < sizeof(message); ++i)
+    {
+        const int written =
+            m_phases_ms[i] != 0
+                ? snprintf(message + length, sizeof(message) - length, " %s %" PRIu32 " ms,", PHASE_NAMES[i],
+                           m_phases_ms[i])
+                : snprintf(message + length, sizeof(message) - length, " %s missing,", PHASE_NAMES[i]);
+        length += static_cast<size_t>(written);
+    }
+    if (length < sizeof(message))
+        message[length - 1] = '\0';
+    ESP_LOGI(BOOT_LOG_TAG, "%s", message);
+}
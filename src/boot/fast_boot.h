@@ -0,0 +1,79 @@
+#pragma once
+
+#include "mqtt/client.h"
+#include "storage/settings_store.h"
+
+#include "hal/clock.h"
+#include "hal/network.h"
+
+#include <cstddef>
+#include <cstdint>
+
+constexpr const char *BOOT_LOG_TAG = "boot";
+
+enum class BootPhase : uint8_t
+{
+    // Marked from setup()
+    SETUP,
+    NETWORK_STARTED,
+    ENTITIES,
+    // Seen by loop()
+    NETWORK_CONNECTED,
+    MQTT_CONNECTED,
+    FIRST_STATE,
+    COUNT
+};
+
+struct FastBootOptions
+{
+    // Boot phases that did not complete by then are logged as missing
+    uint32_t report_timeout_ms = 60000;
+};
+
+// Keeps what the device learned on the last boot in the settings store, so the next one joins the access point without a scan and
+// does not announce unchanged entities again. Logs how long every boot phase took.
+class FastBoot final
+{
+  public:
+    // Settings it registers, the device checks them together with the ones of its entities
+    constexpr static const size_t SETTINGS = 4;
+
+    FastBoot(hal::Clock &clock, SettingsStore &settings, hal::Network &network, mqtt::Client &mqtt_client,
+             const FastBootOptions &options = FastBootOptions());
+    FastBoot(const FastBoot &) = delete;
+    FastBoot &operator=(const FastBoot &) = delete;
+
+    // Before the network is started, the NVS namespace must be open already
+    void load_network();
+    // Once all entities were added, before the client task runs
+    void load_discovery();
+
+    void mark(BootPhase phase);
+
+    // Watches the connection from the control task, returns false once the boot is complete and saved
+    bool loop();
+
+  private:
+    void save_network(const hal::NetworkCache &cache);
+    void save_discovery(uint32_t fingerprint);
+    void report();
+
+  private:
+    hal::Clock &m_clock;
+    SettingsStore &m_settings;
+    hal::Network &m_network;
+    mqtt::Client &m_mqtt;
+    const FastBootOptions m_options;
+
+    SettingHandle m_channel_setting = INVALID_SETTING_HANDLE;
+    SettingHandle m_bssid_high_setting = INVALID_SETTING_HANDLE;
+    SettingHandle m_bssid_low_setting = INVALID_SETTING_HANDLE;
+    SettingHandle m_discovery_setting = INVALID_SETTING_HANDLE;
+
+    hal::NetworkCache m_cache;
+    uint32_t m_discovery = 0;
+    bool m_network_saved = false;
+    bool m_discovery_saved = false;
+    bool m_reported = false;
+    uint32_t m_phases_ms[static_cast<size_t>(BootPhase::COUNT)] = {};
+};
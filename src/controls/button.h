@@ -1,42 +1,311 @@
-
 #pragma once
 
 #include "common.h"
+#include "gesture_recognizer.h"
 
-#include <Arduino.h>
+#include "hal/clock.h"
+#include "hal/gpio.h"
+#include "hal/log.h"
+#include "hal/task.h"
+#include "util/histogram.h"
+#include "util/spsc_queue.h"
 
+#include <algorithm>
+#include <cstddef>
 #include <functional>
 
+class ButtonEngine;
+
 class Button
 {
   public:
-    Button(int pin) : Pin(pin)
+    Button() = delete;
+    Button(const Button &) = delete;
+    Button &operator=(const Button &) = delete;
+
+    Button(ButtonEngine &engine, int pin, bool active_high = true,
+           const GestureOptions &options = GestureOptions());
+
+    void set_on_click(std::function<void()> on_click)
+    {
+        m_on_click = on_click;
+    }
+
+    void set_on_double_click(std::function<void()> on_double_click)
+    {
+        m_on_double_click = on_double_click;
+        m_gestures.set_double_click_enabled(on_double_click != nullptr);
+    }
+
+    void set_on_long_press(std::function<void()> on_long_press)
+    {
+        m_on_long_press = on_long_press;
+    }
+
+    void set_on_hold_repeat(std::function<void()> on_hold_repeat)
+    {
+        m_on_hold_repeat = on_hold_repeat;
+        m_gestures.set_hold_repeat_enabled(on_hold_repeat != nullptr);
+    }
+
+    const GestureRecognizer &get_gestures() const
+    {
+        return m_gestures;
+    }
+
+    const int Pin;
+    const bool ActiveHigh;
+
+  private:
+    friend class ButtonEngine;
+
+    void dispatch(Gesture gesture)
+    {
+        switch (gesture)
+        {
+        case Gesture::CLICK:
+            ESP_LOGI(CONTROLS_LOG_TAG, "Button GPIO %d click", Pin);
+            if (m_on_click != nullptr)
+                m_on_click();
+            break;
+        case Gesture::DOUBLE_CLICK:
+            ESP_LOGI(CONTROLS_LOG_TAG, "Button GPIO %d double-click", Pin);
+            if (m_on_double_click != nullptr)
+                m_on_double_click();
+            break;
+        case Gesture::LONG_PRESS:
+            ESP_LOGI(CONTROLS_LOG_TAG, "Button GPIO %d long press", Pin);
+            if (m_on_long_press != nullptr)
+                m_on_long_press();
+            break;
+        case Gesture::HOLD_REPEAT:
+            ESP_LOGD(CONTROLS_LOG_TAG, "Button GPIO %d hold repeat", Pin);
+            if (m_on_hold_repeat != nullptr)
+                m_on_hold_repeat();
+            break;
+        case Gesture::NONE:
+            break;
+        }
+    }
+
+  private:
+    GestureRecognizer m_gestures;
+    std::function<void()> m_on_click;
+    std::function<void()> m_on_double_click;
+    std::function<void()> m_on_long_press;
+    std::function<void()> m_on_hold_repeat;
+};
+
+// Serves all buttons from GPIO interrupts. The interrupt handler only timestamps the edge into a lock-free queue,
+// debouncing and gesture recognition run from loop(), which returns right away while no edge is queued and no gesture
+// timer is due, however many buttons are registered.
+class ButtonEngine final
+{
+  public:
+    constexpr static const size_t MAX_BUTTONS = 8;
+
+    ButtonEngine() = delete;
+    ButtonEngine(const ButtonEngine &) = delete;
+    ButtonEngine &operator=(const ButtonEngine &) = delete;
+
+    ButtonEngine(hal::Gpio &gpio, hal::Clock &clock) : m_gpio(gpio), m_clock(clock)
+    {
+    }
+
+    // Notified by the interrupt handler, so a sleeping control loop wakes up for the edge
+    void set_event(hal::Event &event)
+    {
+        m_event = &event;
+    }
+
+    // Pins must be configured as inputs before
+    void setup()
     {
+        const uint32_t now = m_clock.millis();
+        for (size_t i = 0; i < m_count; ++i)
+        {
+            Button &button = *m_buttons[i];
+            m_gpio.attach_interrupt(button.Pin, &ButtonEngine::on_interrupt, &m_bindings[i]);
+            m_levels[i] = static_cast<uint8_t>(m_gpio.digital_read(button.Pin));
+            button.m_gestures.reset(is_active(button, m_levels[i]), now);
+            ESP_LOGI(CONTROLS_LOG_TAG, "Button GPIO %d configured", button.Pin);
+        }
+    }
+
+    // After setup(), a press or release wakes the chip from light sleep. Edges during the wakeup may not reach the
+    // interrupt handler, so from then on loop() also compares the levels of the pins with the last edges.
+    void enable_wakeup()
+    {
+        for (size_t i = 0; i < m_count; ++i)
+        {
+            const Button &button = *m_buttons[i];
+            if (!m_gpio.enable_wakeup(button.Pin))
+                ESP_LOGW(CONTROLS_LOG_TAG, "Button GPIO %d can not wake the chip", button.Pin);
+        }
+        m_sync_levels = true;
     }
 
     void loop()
     {
-        auto value = digitalRead(Pin);
-        if (value != m_pin_value)
+        bool changed = false;
+        Edge edge;
+        while (m_edges.pop(edge))
+        {
+            Button &button = *m_buttons[edge.button];
+            m_levels[edge.button] = edge.level;
+            button.m_gestures.on_edge(is_active(button, edge.level), edge.time_ms);
+            m_edge_times_us[edge.button] = edge.time_us;
+            m_edge_pending[edge.button] = true;
+            changed = true;
+        }
+        if (m_sync_levels && sync_levels())
+            changed = true;
+
+        // Read after draining, so no queued edge is newer than now
+        const uint32_t now = m_clock.millis();
+        if (!changed && (!m_has_deadline || static_cast<int32_t>(now - m_deadline_ms) < 0))
+            return;
+
+        m_has_deadline = false;
+        for (size_t i = 0; i < m_count; ++i)
         {
-            ESP_LOGD(CONTROLS_LOG_TAG, "Button GPIO %d: %d -> %d", Pin, m_pin_value, value);
-            if (m_pin_value != -1 && value == 0 && m_on_click != nullptr)
+            Button &button = *m_buttons[i];
+            for (Gesture gesture = button.m_gestures.poll(now); gesture != Gesture::NONE;
+                 gesture = button.m_gestures.poll(now))
             {
-                ESP_LOGI(CONTROLS_LOG_TAG, "Button GPIO %d click", Pin);
-                m_on_click();
+                button.dispatch(gesture);
+                // Gestures completed by an edge, the handler has done its work, e.g. started a PWM fade
+                if (m_edge_pending[i])
+                {
+                    m_gesture_latency_us.add(m_clock.micros() - m_edge_times_us[i]);
+                    m_edge_pending[i] = false;
+                }
+            }
+            // An edge that settled without completing a gesture leaves the timed gestures that follow it out
+            if (!button.m_gestures.is_settling())
+                m_edge_pending[i] = false;
+
+            uint32_t deadline = 0;
+            if (button.m_gestures.get_deadline(deadline) &&
+                (!m_has_deadline || static_cast<int32_t>(deadline - m_deadline_ms) < 0))
+            {
+                m_deadline_ms = deadline;
+                m_has_deadline = true;
             }
-            m_pin_value = value;
         }
     }
 
-    void set_on_click(std::function<void()> on_click)
+    // How long loop() has nothing to do unless an edge arrives
+    uint32_t get_idle_ms(uint32_t max_ms) const
     {
-        m_on_click = on_click;
+        if (!m_edges.empty())
+            return 0;
+        if (!m_has_deadline)
+            return max_ms;
+
+        const int32_t remaining = static_cast<int32_t>(m_deadline_ms - m_clock.millis());
+        if (remaining <= 0)
+            return 0;
+        return std::min(static_cast<uint32_t>(remaining), max_ms);
     }
 
-    const int Pin;
+    // Edges lost because loop() did not drain the queue in time
+    size_t get_dropped_edges() const
+    {
+        return m_edges.get_dropped();
+    }
+
+    // From the interrupt of the edge that completed a gesture until its handler returned
+    Histogram<20> &get_gesture_latency_us()
+    {
+        return m_gesture_latency_us;
+    }
 
   private:
-    int m_pin_value = -1;
-    std::function<void()> m_on_click;
-};
\ No newline at end of file
+    friend class Button;
+
+    struct Edge
+    {
+        uint32_t time_ms;
+        uint32_t time_us;
+        uint8_t button;
+        uint8_t level;
+    };
+
+    struct Binding
+    {
+        ButtonEngine *engine;
+        uint8_t button;
+    };
+
+    // All GPIO interrupts are served by one handler on the device, so the queue has a single producer
+    static void on_interrupt(void *argument)
+    {
+        const Binding &binding = *static_cast<const Binding *>(argument);
+        ButtonEngine &engine = *binding.engine;
+        const Edge edge{engine.m_clock.millis(), engine.m_clock.micros(), binding.button,
+                        static_cast<uint8_t>(engine.m_gpio.digital_read(engine.m_buttons[binding.button]->Pin))};
+        engine.m_edges.push(edge);
+        if (engine.m_event)
+            engine.m_event->notify();
+    }
+
+    // Feeds the edges that did not reach the interrupt handler, the handler may still queue them later
+    bool sync_levels()
+    {
+        bool changed = false;
+        for (size_t i = 0; i < m_count; ++i)
+        {
+            Button &button = *m_buttons[i];
+            const auto level = static_cast<uint8_t>(m_gpio.digital_read(button.Pin));
+            if (level == m_levels[i])
+                continue;
+
+            m_levels[i] = level;
+            button.m_gestures.on_edge(is_active(button, level), m_clock.millis());
+            changed = true;
+        }
+        return changed;
+    }
+
+    static bool is_active(const Button &button, int level)
+    {
+        return (level != 0) == button.ActiveHigh;
+    }
+
+    bool add(Button &button)
+    {
+        if (m_count == MAX_BUTTONS)
+        {
+            ESP_LOGE(CONTROLS_LOG_TAG, "No free button slot for GPIO %d", button.Pin);
+            return false;
+        }
+
+        m_bindings[m_count] = Binding{this, static_cast<uint8_t>(m_count)};
+        m_buttons[m_count++] = &button;
+        return true;
+    }
+
+  private:
+    hal::Gpio &m_gpio;
+    hal::Clock &m_clock;
+    hal::Event *m_event = nullptr;
+    SpscQueue<Edge, 64> m_edges;
+    Button *m_buttons[MAX_BUTTONS] = {};
+    Binding m_bindings[MAX_BUTTONS] = {};
+    size_t m_count = 0;
+    bool m_has_deadline = false;
+    uint32_t m_deadline_ms = 0;
+    uint32_t m_edge_times_us[MAX_BUTTONS] = {};
+    bool m_edge_pending[MAX_BUTTONS] = {};
+    // Last level of every pin seen by loop()
+    uint8_t m_levels[MAX_BUTTONS] = {};
+    bool m_sync_levels = false;
+    Histogram<20> m_gesture_latency_us;
+};
+
+inline Button::Button(ButtonEngine &engine, int pin, bool active_high, const GestureOptions &options)
+    : Pin(pin), ActiveHigh(active_high), m_gestures(options)
+{
+    engine.add(*this);
+}
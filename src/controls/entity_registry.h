@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace registry_detail
+{
+
+template <typename T, typename = void> struct has_loop : std::false_type
+{
+};
+
+template <typename T> struct has_loop<T, std::void_t<decltype(std::declval<T &>().loop())>> : std::true_type
+{
+};
+
+} // namespace registry_detail
+
+// Compile-time list of the entities of the device. setup() and loop() are generated for exactly the listed types and
+// entities without a loop() cost nothing per iteration. The state and settings slots they declare are summed up, so
+// the device can check them together with every other owner against the fixed capacities at compile time.
+template <typename... Entities> class EntityRegistry final
+{
+  public:
+    constexpr static const size_t COUNT = sizeof...(Entities);
+    constexpr static const size_t STATE_SLOTS = (static_cast<size_t>(0) + ... + Entities::STATE_SLOTS);
+    constexpr static const size_t SETTINGS = (static_cast<size_t>(0) + ... + Entities::SETTINGS);
+    // loop() does nothing unless one of the entities has one
+    constexpr static const bool HAS_LOOP = (false || ... || registry_detail::has_loop<Entities>::value);
+
+    explicit EntityRegistry(Entities &...entities) : m_entities(entities...)
+    {
+    }
+
+    EntityRegistry(const EntityRegistry &) = delete;
+    EntityRegistry &operator=(const EntityRegistry &) = delete;
+
+    // In the listed order
+    void setup()
+    {
+        std::apply([](auto &...entity) { (entity.setup(), ...); }, m_entities);
+    }
+
+    void loop()
+    {
+        std::apply([](auto &...entity) { (loop_one(entity), ...); }, m_entities);
+    }
+
+    template <typename Function> void for_each(Function function)
+    {
+        std::apply([&function](auto &...entity) { (function(entity), ...); }, m_entities);
+    }
+
+  private:
+    template <typename Entity> static void loop_one(Entity &entity)
+    {
+        if constexpr (registry_detail::has_loop<Entity>::value)
+            entity.loop();
+    }
+
+  private:
+    std::tuple<Entities &...> m_entities;
+};
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <cstdint>
+
+enum class Gesture : uint8_t
+{
+    NONE,
+    CLICK,
+    DOUBLE_CLICK,
+    LONG_PRESS,
+    HOLD_REPEAT
+};
+
+struct GestureOptions
+{
+    // The contact must be quiet this long before a level change is accepted
+    uint32_t debounce_ms = 15;
+    // A second click within this window after a release is a double-click
+    uint32_t double_click_ms = 250;
+    uint32_t long_press_ms = 600;
+    // Hold-repeat period after the long press fired
+    uint32_t repeat_ms = 200;
+};
+
+// Turns timestamped raw edges of one button into debounced gestures. It has no dependencies on the hardware, so
+// recorded edge traces can be replayed through it on the host.
+class GestureRecognizer final
+{
+  public:
+    explicit GestureRecognizer(const GestureOptions &options = GestureOptions()) : m_options(options)
+    {
+    }
+
+    void reset(bool pressed, uint32_t now_ms)
+    {
+        m_raw = pressed;
+        m_pressed = pressed;
+        m_pending = false;
+        m_long_fired = pressed;
+        m_clicks = 0;
+        m_pressed_at_ms = now_ms;
+        m_released_at_ms = now_ms;
+    }
+
+    // A single click is reported as soon as the button is released unless double-clicks are detected, which delays it
+    // by the double-click window
+    void set_double_click_enabled(bool enabled)
+    {
+        m_double_click_enabled = enabled;
+    }
+
+    void set_hold_repeat_enabled(bool enabled)
+    {
+        m_hold_repeat_enabled = enabled;
+    }
+
+    // Records the raw level right after an edge
+    void on_edge(bool pressed, uint32_t time_ms)
+    {
+        m_raw = pressed;
+        m_raw_since_ms = time_ms;
+        m_pending = true;
+        ++m_edges;
+    }
+
+    // Advances to now_ms and returns the next recognized gesture, call it until it returns NONE
+    Gesture poll(uint32_t now_ms)
+    {
+        if (m_pending && elapsed(m_raw_since_ms, now_ms) >= m_options.debounce_ms)
+        {
+            m_pending = false;
+            if (m_raw == m_pressed)
+                ++m_glitches;
+            else
+            {
+                const Gesture gesture = m_raw ? on_press(m_raw_since_ms) : on_release(m_raw_since_ms);
+                if (gesture != Gesture::NONE)
+                    return gesture;
+            }
+        }
+
+        if (m_pressed && !m_long_fired && elapsed(m_pressed_at_ms, now_ms) >= m_options.long_press_ms)
+        {
+            m_long_fired = true;
+            m_clicks = 0;
+            m_next_repeat_ms = m_pressed_at_ms + m_options.long_press_ms + m_options.repeat_ms;
+            return Gesture::LONG_PRESS;
+        }
+
+        if (m_pressed && m_long_fired && m_hold_repeat_enabled && is_due(m_next_repeat_ms, now_ms))
+        {
+            m_next_repeat_ms += m_options.repeat_ms;
+            return Gesture::HOLD_REPEAT;
+        }
+
+        if (!m_pressed && m_clicks == 1 && elapsed(m_released_at_ms, now_ms) >= m_options.double_click_ms)
+        {
+            m_clicks = 0;
+            return Gesture::CLICK;
+        }
+
+        return Gesture::NONE;
+    }
+
+    // Returns false when nothing happens until the next edge, so the caller does not have to poll at all
+    bool get_deadline(uint32_t &deadline_ms) const
+    {
+        bool found = false;
+        auto consider = [&](uint32_t candidate) {
+            if (!found || static_cast<int32_t>(candidate - deadline_ms) < 0)
+                deadline_ms = candidate;
+            found = true;
+        };
+
+        if (m_pending)
+            consider(m_raw_since_ms + m_options.debounce_ms);
+        if (m_pressed && !m_long_fired)
+            consider(m_pressed_at_ms + m_options.long_press_ms);
+        if (m_pressed && m_long_fired && m_hold_repeat_enabled)
+            consider(m_next_repeat_ms);
+        if (!m_pressed && m_clicks == 1)
+            consider(m_released_at_ms + m_options.double_click_ms);
+
+        return found;
+    }
+
+    bool is_pressed() const
+    {
+        return m_pressed;
+    }
+
+    // An edge was recorded and the level has not been debounced yet
+    bool is_settling() const
+    {
+        return m_pending;
+    }
+
+    uint32_t get_edges() const
+    {
+        return m_edges;
+    }
+
+    // Edge bursts that settled back to the debounced level
+    uint32_t get_glitches() const
+    {
+        return m_glitches;
+    }
+
+  private:
+    static uint32_t elapsed(uint32_t since_ms, uint32_t now_ms)
+    {
+        return now_ms - since_ms;
+    }
+
+    static bool is_due(uint32_t deadline_ms, uint32_t now_ms)
+    {
+        return static_cast<int32_t>(now_ms - deadline_ms) >= 0;
+    }
+
+    Gesture on_press(uint32_t time_ms)
+    {
+        m_pressed = true;
+        m_pressed_at_ms = time_ms;
+        m_long_fired = false;
+
+        // poll() may run late, so a single click whose window already ended is reported before the new press
+        if (m_clicks == 1 && elapsed(m_released_at_ms, time_ms) >= m_options.double_click_ms)
+        {
+            m_clicks = 0;
+            return Gesture::CLICK;
+        }
+
+        return Gesture::NONE;
+    }
+
+    Gesture on_release(uint32_t time_ms)
+    {
+        m_pressed = false;
+        m_released_at_ms = time_ms;
+
+        // Releasing after a long press only ends the hold
+        if (m_long_fired)
+        {
+            m_long_fired = false;
+            return Gesture::NONE;
+        }
+
+        if (!m_double_click_enabled)
+            return Gesture::CLICK;
+
+        if (++m_clicks == 2)
+        {
+            m_clicks = 0;
+            return Gesture::DOUBLE_CLICK;
+        }
+
+        return Gesture::NONE;
+    }
+
+  private:
+    const GestureOptions m_options;
+    bool m_double_click_enabled = false;
+    bool m_hold_repeat_enabled = false;
+
+    bool m_raw = false;
+    bool m_pending = false;
+    uint32_t m_raw_since_ms = 0;
+
+    bool m_pressed = false;
+    bool m_long_fired = false;
+    uint8_t m_clicks = 0;
+    uint32_t m_pressed_at_ms = 0;
+    uint32_t m_released_at_ms = 0;
+    uint32_t m_next_repeat_ms = 0;
+
+    uint32_t m_edges = 0;
+    uint32_t m_glitches = 0;
+};
@@ -2,23 +2,39 @@
 
 #include "common.h"
 #include "mqtt/client.h"
+#include "storage/settings_store.h"
 
-#include <Preferences.h>
+#include "hal/log.h"
+#include "hal/pwm.h"
+#include "util/gamma.h"
 
-#include <esp_log.h>
+#include <algorithm>
+#include <cinttypes>
+#include <cstddef>
 
 constexpr const char *LIGHT_STATE_PREFERENCE_KEY = "st";
 constexpr const char *LIGHT_BRIGHTNESS_PREFERENCE_KEY = "bri";
 
+struct LightOutputOptions
+{
+    hal::PwmConfig pwm;
+    // Used when a command has no transition and for the button
+    uint32_t default_transition_ms = 250;
+};
+
 class Light
 {
   public:
+    constexpr static const size_t STATE_SLOTS = 2;
+    constexpr static const size_t SETTINGS = 2;
+
     Light() = delete;
     Light(const Light &) = delete;
     Light &operator=(const Light &) = delete;
 
-    Light(mqtt::Client &mqtt_client, Preferences &preferences, const std::string id, const std::string name, int pin)
-        : m_mqtt(mqtt_client), m_preferences(preferences), ID(id), Name(name), Pin(pin)
+    Light(mqtt::Client &mqtt_client, hal::Pwm &pwm, SettingsStore &settings, const std::string id,
+          const std::string name, int pin, const LightOutputOptions &options = LightOutputOptions())
+        : m_mqtt(mqtt_client), m_pwm(pwm), m_settings(settings), m_options(options), ID(id), Name(name), Pin(pin)
     {
     }
 
@@ -31,27 +47,41 @@ class Light
     {
         ESP_LOGD(CONTROLS_LOG_TAG, "Configuring LIGHT GPIO %d (%s)", Pin, ID.c_str());
 
-        m_state = m_preferences.getBool(get_preferences_key(LIGHT_STATE_PREFERENCE_KEY).c_str());
-        m_brightness =
-            m_preferences.getInt(get_preferences_key(LIGHT_BRIGHTNESS_PREFERENCE_KEY).c_str(), mqtt::brightness::MAX);
+        m_state_setting = m_settings.add_bool(get_preferences_key(LIGHT_STATE_PREFERENCE_KEY).c_str(), false);
+        m_brightness_setting =
+            m_settings.add_int(get_preferences_key(LIGHT_BRIGHTNESS_PREFERENCE_KEY).c_str(), mqtt::brightness::MAX);
+        m_state = m_settings.get_bool(m_state_setting);
+        m_brightness = m_settings.get_int(m_brightness_setting);
+
+        m_state_handle = m_mqtt.add_light(ID, Name, "light", std::bind(&Light::handle, this, std::placeholders::_1));
+        if (m_state_handle != mqtt::INVALID_STATE_HANDLE)
+            m_brightness_handle = static_cast<mqtt::StateHandle>(m_state_handle + 1);
+        m_mqtt.set(m_state_handle, m_state);
+        m_mqtt.set(m_brightness_handle, m_brightness);
 
-        m_mqtt.add_light(ID, Name, "light", std::bind(&Light::set_state, this, std::placeholders::_1),
-                         std::bind(&Light::set_brightness, this, std::placeholders::_1));
-        m_mqtt.set(ID, mqtt::prop::STATE, m_state);
-        m_mqtt.set(ID, mqtt::prop::BRIGHTNESS, m_brightness);
-        analogWrite(Pin, m_state ? m_brightness : 0);
+        m_channel = m_pwm.attach(Pin, m_options.pwm);
+        if (m_channel < 0)
+            ESP_LOGE(CONTROLS_LOG_TAG, "Light GPIO %d (%s) has no PWM channel", Pin, ID.c_str());
+        apply(0);
 
         ESP_LOGI(CONTROLS_LOG_TAG, "Light GPIO %d (%s) configured: state %d, brightness %d", Pin, ID.c_str(), m_state,
                  m_brightness);
     }
 
+    void handle(const mqtt::LightCommand &command)
+    {
+        const uint32_t transition_ms = command.has_transition ? command.transition_ms : m_options.default_transition_ms;
+        if (command.has_brightness)
+            update_brightness(command.brightness);
+        if (command.has_state)
+            update_state(command.state);
+        apply(transition_ms);
+    }
+
     void set_state(bool new_state)
     {
-        ESP_LOGI(CONTROLS_LOG_TAG, "Light GPIO %d (%s) state: %d -> %d", Pin, ID.c_str(), m_state, new_state);
-        m_state = new_state;
-        analogWrite(Pin, m_state ? m_brightness : 0);
-        m_mqtt.set(ID, mqtt::prop::STATE, m_state);
-        m_preferences.putBool(get_preferences_key(LIGHT_STATE_PREFERENCE_KEY).c_str(), m_state);
+        update_state(new_state);
+        apply(m_options.default_transition_ms);
     }
 
     void toggle()
@@ -61,12 +91,40 @@ class Light
 
     void set_brightness(int new_brightness)
     {
-        ESP_LOGI(CONTROLS_LOG_TAG, "Light GPIO %d (%s) brightness: %d -> %d", Pin, ID.c_str(), m_brightness,
+        update_brightness(new_brightness);
+        apply(m_options.default_transition_ms);
+    }
+
+  private:
+    void update_state(bool new_state)
+    {
+        ESP_LOGI(CONTROLS_LOG_TAG, "Light GPIO %d (%s) state: %d -> %d", Pin, ID.c_str(), m_state, new_state);
+        m_state = new_state;
+        m_mqtt.set(m_state_handle, m_state);
+        m_settings.set(m_state_setting, m_state);
+    }
+
+    // Dragging a slider sends a burst of these, they only update the output target and the state
+    void update_brightness(int new_brightness)
+    {
+        ESP_LOGD(CONTROLS_LOG_TAG, "Light GPIO %d (%s) brightness: %d -> %d", Pin, ID.c_str(), m_brightness,
                  new_brightness);
-        m_brightness = new_brightness;
-        analogWrite(Pin, m_state ? m_brightness : 0);
-        m_mqtt.set(ID, mqtt::prop::BRIGHTNESS, m_brightness);
-        m_preferences.putInt(get_preferences_key(LIGHT_BRIGHTNESS_PREFERENCE_KEY).c_str(), m_brightness);
+        m_brightness = std::min(std::max(new_brightness, mqtt::brightness::MIN), mqtt::brightness::MAX);
+        m_mqtt.set(m_brightness_handle, m_brightness);
+        m_settings.set(m_brightness_setting, static_cast<int32_t>(m_brightness));
+    }
+
+    // The hardware fades to the gamma corrected level, loop() is not involved
+    void apply(uint32_t transition_ms)
+    {
+        if (m_channel < 0)
+            return;
+
+        const uint8_t level = static_cast<uint8_t>(m_state ? m_brightness : 0);
+        const uint32_t duty = gamma_duty(level, m_options.pwm.resolution_bits);
+        ESP_LOGD(CONTROLS_LOG_TAG, "Light GPIO %d (%s) fade to %" PRIu32 " in %" PRIu32 " ms", Pin, ID.c_str(), duty,
+                 transition_ms);
+        m_pwm.fade(m_channel, duty, transition_ms);
     }
 
   public:
@@ -76,7 +134,14 @@ class Light
 
   private:
     mqtt::Client &m_mqtt;
-    Preferences &m_preferences;
+    hal::Pwm &m_pwm;
+    SettingsStore &m_settings;
+    const LightOutputOptions m_options;
+    SettingHandle m_state_setting = INVALID_SETTING_HANDLE;
+    SettingHandle m_brightness_setting = INVALID_SETTING_HANDLE;
+    mqtt::StateHandle m_state_handle = mqtt::INVALID_STATE_HANDLE;
+    mqtt::StateHandle m_brightness_handle = mqtt::INVALID_STATE_HANDLE;
+    int m_channel = -1;
 
     bool m_state = false;
     int m_brightness = mqtt::brightness::MAX;
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "common.h"
+#include "mqtt/client.h"
+
+#include "hal/gpio.h"
+#include "hal/log.h"
+
+#include <cstddef>
+
+class Switch
+{
+  public:
+    constexpr static const size_t STATE_SLOTS = 1;
+    constexpr static const size_t SETTINGS = 0;
+
+    Switch() = delete;
+    Switch(const Switch &) = delete;
+    Switch &operator=(const Switch &) = delete;
+
+    Switch(mqtt::Client &mqtt_client, hal::Gpio &gpio, const std::string id, const std::string name,
+           const std::string device_class, int pin, bool active_low = false)
+        : m_mqtt(mqtt_client), m_gpio(gpio), ID(id), Name(name), DeviceClass(device_class), Pin(pin),
+          ActiveLow(active_low)
+    {
+    }
+
+    void setup()
+    {
+        m_gpio.pin_mode(Pin, hal::PinMode::DIGITAL_OUTPUT);
+        m_state_handle =
+            m_mqtt.add_switch(ID, Name, DeviceClass, std::bind(&Switch::set_state, this, std::placeholders::_1));
+        set_state(false);
+
+        ESP_LOGI(CONTROLS_LOG_TAG, "Switch GPIO %d (%s) configured", Pin, ID.c_str());
+    }
+
+    void set_state(bool on)
+    {
+        ESP_LOGI(CONTROLS_LOG_TAG, "Switch GPIO %d (%s) %s", Pin, ID.c_str(), on ? mqtt::state::ON : mqtt::state::OFF);
+        m_state = on;
+        m_gpio.digital_write(Pin, on != ActiveLow ? 1 : 0);
+        m_mqtt.set(m_state_handle, m_state);
+    }
+
+    void toggle()
+    {
+        set_state(!m_state);
+    }
+
+  public:
+    const std::string ID;
+    const std::string Name;
+    const std::string DeviceClass;
+    const int Pin;
+    const bool ActiveLow;
+
+  private:
+    mqtt::Client &m_mqtt;
+    hal::Gpio &m_gpio;
+    mqtt::StateHandle m_state_handle = mqtt::INVALID_STATE_HANDLE;
+    bool m_state = false;
+};
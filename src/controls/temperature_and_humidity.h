@@ -2,75 +2,190 @@
 
 #include "common.h"
 #include "mqtt/client.h"
+#include "scheduler/scheduler.h"
 
-#include <DHT.h>
-
-#include <esp_log.h>
+#include "hal/climate_sensor.h"
+#include "hal/clock.h"
+#include "hal/log.h"
+#include "util/histogram.h"
+#include "util/sample_pipeline.h"
 
+#include <cinttypes>
 #include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+struct ClimateReadStats
+{
+    uint32_t reads = 0;
+    uint32_t failures = 0;
+    // From start_read() until the result is polled, reset by telemetry with every window
+    Histogram<20> latency_us;
+};
+
+// DHT22 ranges, stable readings are reported every 5 minutes and changes at most every 10 seconds
+inline SamplePipelineOptions make_temperature_pipeline_options()
+{
+    SamplePipelineOptions options;
+    options.min_value = -40;
+    options.max_value = 80;
+    options.max_step = 5;
+    options.deadband = 0.2f;
+    options.min_interval_ms = 10000;
+    options.max_interval_ms = 300000;
+    options.max_age_ms = 60000;
+    return options;
+}
+
+inline SamplePipelineOptions make_humidity_pipeline_options()
+{
+    SamplePipelineOptions options;
+    options.min_value = 0;
+    options.max_value = 100;
+    options.max_step = 10;
+    options.deadband = 1;
+    options.min_interval_ms = 10000;
+    options.max_interval_ms = 300000;
+    options.max_age_ms = 60000;
+    return options;
+}
 
 class TemperatureAndHumidity
 {
   public:
+    constexpr static const size_t STATE_SLOTS = 2;
+    constexpr static const size_t SETTINGS = 0;
+
     TemperatureAndHumidity() = delete;
     TemperatureAndHumidity(const TemperatureAndHumidity &) = delete;
     TemperatureAndHumidity &operator=(const TemperatureAndHumidity &) = delete;
 
-    TemperatureAndHumidity(mqtt::Client &mqtt_client, std::string temperature_id, std::string humidity_id,
-                           const std::string name, int pin)
-        : m_mqtt(mqtt_client), m_dht(pin, DHT22), TemperatureID(temperature_id), HumidityID(humidity_id), Name(name),
-          Pin(pin)
+    TemperatureAndHumidity(mqtt::Client &mqtt_client, hal::Clock &clock, Scheduler &scheduler,
+                           hal::ClimateSensor &sensor, std::string temperature_id, std::string humidity_id, const std::string name, int pin,
+                           const SamplePipelineOptions &temperature_options = make_temperature_pipeline_options(),
+                           const SamplePipelineOptions &humidity_options = make_humidity_pipeline_options())
+        : m_mqtt(mqtt_client), m_clock(clock), m_scheduler(scheduler), m_sensor(sensor), TemperatureID(temperature_id),
+          HumidityID(humidity_id), Name(name), Pin(pin), m_temperature(temperature_options),
+          m_humidity(humidity_options)
     {
     }
 
     void setup()
     {
-        m_mqtt.add_sensor(TemperatureID, Name + " Temperature", "temperature", "°C");
-        m_mqtt.add_sensor(HumidityID, Name + " Humidity", "humidity", "%");
-        m_dht.begin();
+        m_temperature_handle = m_mqtt.add_sensor(TemperatureID, Name + " Temperature", "temperature", "°C");
+        m_humidity_handle = m_mqtt.add_sensor(HumidityID, Name + " Humidity", "humidity", "%");
+        m_sensor.begin();
+        // DHT22 can not be sampled more often, the frame takes about 5 ms and is polled until it is complete
+        m_scheduler.add_periodic("climate_read", READ_INTERVAL_MS, [this]() { start_reading(); }, READ_DEADLINE_MS);
+        m_poll_task = m_scheduler.add_one_shot("climate_poll", [this]() { poll_reading(); }, READ_DEADLINE_MS);
         ESP_LOGI(CONTROLS_LOG_TAG, "Configured temperature and humidity sensor GPIO %d (%s, %s)", Pin,
                  TemperatureID.c_str(), HumidityID.c_str());
     }
 
-    void loop()
+    const ClimateReadStats &get_read_stats() const
     {
-        int now = millis();
-        if (now - m_last_update_ms < 1000)
+        return m_stats;
+    }
+
+    Histogram<20> &get_read_latency_us()
+    {
+        return m_stats.latency_us;
+    }
+
+    const SamplePipelineStats &get_temperature_stats() const
+    {
+        return m_temperature.get_stats();
+    }
+
+    const SamplePipelineStats &get_humidity_stats() const
+    {
+        return m_humidity.get_stats();
+    }
+
+  private:
+    constexpr static const uint32_t READ_INTERVAL_MS = 2000;
+    constexpr static const uint32_t READ_DEADLINE_MS = 20;
+    constexpr static const uint32_t POLL_INTERVAL_MS = 2;
+    constexpr static const uint32_t STATS_LOG_INTERVAL_MS = 300000;
+
+    void start_reading()
+    {
+        // A read that has not completed yet is still polled
+        if (m_reading || !m_sensor.start_read())
+            return;
+
+        m_read_started_us = m_clock.micros();
+        m_reading = true;
+        m_scheduler.schedule(m_poll_task, POLL_INTERVAL_MS);
+    }
+
+    void poll_reading()
+    {
+        hal::ClimateReading reading;
+        const auto status = m_sensor.poll(reading);
+        if (status == hal::ClimateReadStatus::BUSY)
         {
+            m_scheduler.schedule(m_poll_task, POLL_INTERVAL_MS);
             return;
         }
-        m_last_update_ms = now;
 
-        float temperature = m_dht.readTemperature();
-        if (std::abs(temperature - m_last_temperature) > 0.1)
+        m_reading = false;
+        ++m_stats.reads;
+        m_stats.latency_us.add(m_clock.micros() - m_read_started_us);
+        const uint32_t now = m_clock.millis();
+        if (status != hal::ClimateReadStatus::DONE)
+        {
+            ++m_stats.failures;
+            ESP_LOGW(CONTROLS_LOG_TAG, "Temperature and humidity GPIO %d read failed (%" PRIu32 " of %" PRIu32 ")", Pin,
+                     m_stats.failures, m_stats.reads);
+            reading = hal::ClimateReading();
+        }
+
+        report(m_temperature, m_temperature_handle, "Temperature", TemperatureID, reading.temperature, now);
+        report(m_humidity, m_humidity_handle, "Humidity", HumidityID, reading.humidity, now);
+
+        if (now - m_stats_logged_ms >= STATS_LOG_INTERVAL_MS)
         {
-            m_mqtt.set(TemperatureID, mqtt::prop::STATE, temperature);
-            if (m_last_temperature == -1)
-            {
-                ESP_LOGI(CONTROLS_LOG_TAG, "Temperature GPIO %d (%s): %.1f", Pin, TemperatureID.c_str(), temperature);
-            }
-            else
-            {
-                ESP_LOGI(CONTROLS_LOG_TAG, "Temperature GPIO %d (%s): %.1f -> %.1f", Pin, TemperatureID.c_str(),
-                         m_last_temperature, temperature);
-            }
-            m_last_temperature = temperature;
+            m_stats_logged_ms = now;
+            log_stats(m_temperature, "Temperature", TemperatureID);
+            log_stats(m_humidity, "Humidity", HumidityID);
         }
-        float humidity = m_dht.readHumidity();
-        if (std::abs(humidity - m_last_humidity) > 0.1)
+    }
+
+    void report(SamplePipeline &pipeline, mqtt::StateHandle handle, const char *quantity, const std::string &id,
+                float sample, uint32_t now_ms)
+    {
+        const bool had_value = pipeline.has_reported();
+        const float previous = pipeline.value();
+        switch (pipeline.add(sample, now_ms))
         {
-            m_mqtt.set(HumidityID, mqtt::prop::STATE, humidity);
-            if (m_last_humidity == -1)
-            {
-                ESP_LOGI(CONTROLS_LOG_TAG, "Humidity GPIO %d (%s): %.1f", Pin, HumidityID.c_str(), humidity);
-            }
-            else
-            {
-                ESP_LOGI(CONTROLS_LOG_TAG, "Humidity GPIO %d (%s): %.1f -> %.1f", Pin, HumidityID.c_str(),
-                         m_last_humidity, humidity);
-            }
-            m_last_humidity = humidity;
+        case SamplePipeline::Report::NONE:
+            return;
+        case SamplePipeline::Report::HEARTBEAT:
+            m_mqtt.mark_dirty(handle);
+            return;
+        case SamplePipeline::Report::CHANGE:
+        case SamplePipeline::Report::STALE:
+            break;
         }
+
+        m_mqtt.set(handle, pipeline.value());
+        const auto &stats = pipeline.get_stats();
+        if (had_value)
+            ESP_LOGI(CONTROLS_LOG_TAG, "%s GPIO %d (%s): %.1f -> %.1f (%" PRIu32 " reports of %" PRIu32 " samples)",
+                     quantity, Pin, id.c_str(), previous, pipeline.value(), stats.reports, stats.samples);
+        else
+            ESP_LOGI(CONTROLS_LOG_TAG, "%s GPIO %d (%s): %.1f", quantity, Pin, id.c_str(), pipeline.value());
+    }
+
+    void log_stats(const SamplePipeline &pipeline, const char *quantity, const std::string &id) const
+    {
+        const auto &stats = pipeline.get_stats();
+        ESP_LOGI(CONTROLS_LOG_TAG,
+                 "%s GPIO %d (%s): %" PRIu32 " samples, %" PRIu32 " invalid, %" PRIu32 " outliers, %" PRIu32
+                 " reports, %" PRIu32 " heartbeats",
+                 quantity, Pin, id.c_str(), stats.samples, stats.rejected_invalid, stats.rejected_outliers,
+                 stats.reports, stats.heartbeats);
     }
 
   public:
@@ -81,9 +196,17 @@ class TemperatureAndHumidity
 
   private:
     mqtt::Client &m_mqtt;
-    DHT m_dht;
+    hal::Clock &m_clock;
+    Scheduler &m_scheduler;
+    hal::ClimateSensor &m_sensor;
+    mqtt::StateHandle m_temperature_handle = mqtt::INVALID_STATE_HANDLE;
+    mqtt::StateHandle m_humidity_handle = mqtt::INVALID_STATE_HANDLE;
 
-    float m_last_temperature = -1;
-    float m_last_humidity = -1;
-    unsigned long m_last_update_ms = 0;
+    SamplePipeline m_temperature;
+    SamplePipeline m_humidity;
+    TaskId m_poll_task = INVALID_TASK_ID;
+    bool m_reading = false;
+    uint32_t m_read_started_us = 0;
+    uint32_t m_stats_logged_ms = 0;
+    ClimateReadStats m_stats;
 };
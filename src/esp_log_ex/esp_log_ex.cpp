@@ -1,72 +1,172 @@
 #include "esp_log_ex.h"
 
-#include <PubSubClient.h>
-#include <WiFi.h>
+#include "mqtt/client.h"
+#include "power/power_manager.h"
 
+#include "hal/task.h"
+
+#include <atomic>
+#include <cctype>
+#include <memory>
 #include <stdarg.h>
 #include <stdio.h>
 #include <string>
-#include <vector>
 
 constexpr const char *LOG_LOG_TAG = "log";
 
-std::vector<Appender> g_appenders;
-
-WiFiClient g_wifi;
-PubSubClient g_pubsub(g_wifi);
-
-std::string format_string(const char *format, va_list args)
+constexpr static const size_t LOG_RING_CAPACITY = 32;
+// While an appender still holds records it is flushed that often, otherwise the task only wakes up for new records
+constexpr static const uint32_t LOG_FLUSH_PERIOD_MS = 100;
+constexpr static const uint32_t LOG_IDLE_TIMEOUT_MS = 60000;
+constexpr static const uint32_t LOG_TASK_STACK_SIZE = 4096;
+constexpr static const unsigned int LOG_TASK_PRIORITY = 1;
+constexpr static const size_t MAX_APPENDERS = 4;
+constexpr static const size_t SPOOL_REPLAY_BATCHES = 1;
+constexpr static const uint32_t SPOOL_REPLAY_BYTES_PER_SECOND = 2048;
+
+static_assert(LogBatcher::MAX_BATCH_SIZE <= mqtt::LogLane::MESSAGE_SIZE, "A log batch must fit the MQTT log lane");
+static_assert(LogBatcher::MAX_BATCH_SIZE <= LogSpool::MAX_BATCH_SIZE, "A log batch must fit the spool");
+
+// The drain task already runs while appenders are added, so the array never moves and the count is published last
+Appender g_appenders[MAX_APPENDERS];
+Flusher g_flushers[MAX_APPENDERS];
+std::atomic<size_t> g_appender_count{0};
+
+std::unique_ptr<LogBatcher> g_mqtt_batcher;
+TokenBucket g_spool_replay_bucket(SPOOL_REPLAY_BYTES_PER_SECOND, LogSpool::PAGE_SIZE);
+
+LogRing<LOG_RING_CAPACITY> g_log_ring;
+hal::Event g_log_event;
+PowerManager *g_log_power = nullptr;
+OverflowPolicy g_overflow_policy = OverflowPolicy::DROP_OLDEST;
+std::atomic<uint32_t> g_truncated{0};
+
+static void format_record(LogRecord &record, const char *format, va_list args)
 {
-    va_list argsCopy;
-    va_copy(argsCopy, args);
-    int size = vsnprintf(nullptr, 0, format, argsCopy);
-    va_end(argsCopy);
+    record.timestamp_ms = esp_log_timestamp();
 
-    if (size < 0)
-        return std::string();
-
-    std::string result(static_cast<size_t>(size) + 1, '\0');
-    vsnprintf(&result[0], result.size(), format, args);
-    result.pop_back();
-
-    result.erase(result.find_last_not_of(" \t\n\r\f\v") + 1);
+    const int size = vsnprintf(record.text, sizeof(record.text), format, args);
+    size_t length = size < 0 ? 0 : static_cast<size_t>(size);
+    record.truncated = length >= sizeof(record.text);
+    if (record.truncated)
+    {
+        length = sizeof(record.text) - 1;
+        g_truncated.fetch_add(1, std::memory_order_relaxed);
+    }
 
-    return result;
+    while (length > 0 && isspace(static_cast<unsigned char>(record.text[length - 1])))
+        --length;
+    record.text[length] = '\0';
+    record.length = static_cast<uint16_t>(length);
 }
 
 static int custom_log_output(const char *format, va_list args)
 {
-    const auto message = format_string(format, args);
-    for (const auto &appender : g_appenders)
-        appender(message);
+    auto *slot = g_log_ring.claim(g_overflow_policy);
+    if (slot == nullptr)
+        return 0;
+
+    format_record(slot->record, format, args);
+    g_log_ring.commit(slot);
+    g_log_event.notify();
 
     return 0;
 }
 
-void initialize_log()
+static void log_task(void *)
 {
-    // https://community.platformio.org/t/redirect-esp32-log-messages-to-sd-card/33734/7
-    esp_log_set_vprintf(custom_log_output);
+    for (;;)
+    {
+        while (g_log_ring.consume([](const LogRecord &record) {
+            const size_t count = g_appender_count.load(std::memory_order_acquire);
+            for (size_t i = 0; i < count; ++i)
+                g_appenders[i](record);
+        }))
+        {
+        }
+
+        const uint32_t now = esp_log_timestamp();
+        const size_t count = g_appender_count.load(std::memory_order_acquire);
+        bool pending = false;
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (g_flushers[i] && g_flushers[i](now))
+                pending = true;
+        }
+
+        const uint32_t timeout_ms = pending ? LOG_FLUSH_PERIOD_MS : LOG_IDLE_TIMEOUT_MS;
+        if (g_log_power != nullptr)
+            g_log_power->idle(g_log_event, timeout_ms);
+        else
+            g_log_event.wait(timeout_ms);
+    }
 }
 
-void add_log_appender(Appender appender)
+void initialize_log(OverflowPolicy policy, PowerManager *power)
 {
-    g_appenders.push_back(std::move(appender));
+    g_overflow_policy = policy;
+    g_log_power = power;
+    if (power != nullptr)
+        power->add_task();
+    hal::start_task("log", log_task, nullptr, LOG_TASK_STACK_SIZE, LOG_TASK_PRIORITY);
+
+    // https://community.platformio.org/t/redirect-esp32-log-messages-to-sd-card/33734/7
+    esp_log_set_vprintf(custom_log_output);
 }
 
-void add_mqtt_log_appender(const std::string &device_id, const std::string &hostname, uint16_t port,
-                           const std::string &user, const std::string &password)
+void add_log_appender(Appender appender, Flusher flusher)
 {
-    ESP_LOGI(LOG_LOG_TAG, "Connecting to MQTT...");
-    g_pubsub.setServer(hostname.c_str(), port);
-    g_pubsub.setBufferSize(1024);
-    while (!g_pubsub.connect(device_id.c_str(), user.c_str(), password.c_str()))
+    const size_t count = g_appender_count.load(std::memory_order_relaxed);
+    if (count == MAX_APPENDERS)
     {
-        delay(500);
-        ESP_LOGI(LOG_LOG_TAG, "Waiting MQTT...");
+        ESP_LOGE(LOG_LOG_TAG, "Too many log appenders");
+        return;
     }
 
-    ESP_LOGI(LOG_LOG_TAG, "Connected to MQTT");
+    g_appenders[count] = std::move(appender);
+    g_flushers[count] = std::move(flusher);
+    g_appender_count.store(count + 1, std::memory_order_release);
+}
+
+void add_mqtt_log_appender(mqtt::Client &client, const std::string &topic, const LogBatcherOptions &options,
+                           LogSpool *spool)
+{
+    // Batches go through the state session as the lowest priority traffic, the appender only queues them
+    client.set_log_topic(topic);
+    g_mqtt_batcher.reset(new LogBatcher(options, [&client, spool](const uint8_t *data, size_t length) {
+        if (client.is_connected() && client.publish_log(reinterpret_cast<const char *>(data), length))
+            return LogSinkResult::SENT;
+        if (spool != nullptr && spool->append(data, length))
+            return LogSinkResult::STORED;
+        return LogSinkResult::REFUSED;
+    }));
+
+    add_log_appender([](const LogRecord &record) { g_mqtt_batcher->add(record, record.timestamp_ms); },
+                     [&client, spool](uint32_t now_ms) {
+                         g_mqtt_batcher->flush_if_due(now_ms);
+                         if (spool == nullptr)
+                             return !g_mqtt_batcher->empty();
+
+                         spool->flush_if_due();
+                         if (!client.is_connected() || spool->empty())
+                             return !g_mqtt_batcher->empty() || !spool->empty();
+
+                         spool->replay(
+                             [&client, now_ms](const uint8_t *data, size_t length) {
+                                 return g_spool_replay_bucket.consume(length, now_ms) &&
+                                        client.publish_log(reinterpret_cast<const char *>(data), length);
+                             },
+                             SPOOL_REPLAY_BATCHES);
+                         return true;
+                     });
+}
+
+LogStats get_log_stats()
+{
+    return {g_log_ring.get_written(), g_log_ring.get_dropped(), g_truncated.load(std::memory_order_relaxed)};
+}
 
-    add_log_appender([](const std::string &message) { g_pubsub.publish("logs/nosyna", message.c_str()); });
-}
\ No newline at end of file
+LogBatcherStats get_mqtt_log_stats()
+{
+    return g_mqtt_batcher ? g_mqtt_batcher->get_stats() : LogBatcherStats();
+}
@@ -1,13 +1,41 @@
 #pragma once
 
+#include "log_batcher.h"
+#include "log_record.h"
+#include "log_ring.h"
+#include "log_spool.h"
+
+#include "hal/log.h"
+
 #include <functional>
+#include <string>
+
+namespace mqtt
+{
+class Client;
+}
+
+class PowerManager;
+
+typedef std::function<void(const LogRecord &record)> Appender;
+// Called by the drain task after new records and, while it returns true because it still holds some, periodically
+typedef std::function<bool(uint32_t now_ms)> Flusher;
 
-#include <esp_log.h>
+struct LogStats
+{
+    uint32_t written;
+    uint32_t dropped;
+    uint32_t truncated;
+};
 
-typedef std::function<void(const std::string &message)> Appender;
+// Log calls only format into a lock-free ring, appenders run on a low priority task that drains it. The task sleeps
+// until a record comes in and waits through the power manager, if one is given.
+void initialize_log(OverflowPolicy policy = OverflowPolicy::DROP_OLDEST, PowerManager *power = nullptr);
 
-void initialize_log();
+void add_log_appender(Appender appender, Flusher flusher = nullptr);
+// Batches that cannot be sent while MQTT is down go to the spool, if one is given, and are replayed once it is back
+void add_mqtt_log_appender(mqtt::Client &client, const std::string &topic,
+                           const LogBatcherOptions &options = LogBatcherOptions(), LogSpool *spool = nullptr);
 
-void add_log_appender(Appender appender);
-void add_mqtt_log_appender(const std::string &device_id, const std::string &hostname, uint16_t port,
-                           const std::string &user, const std::string &password);
+LogStats get_log_stats();
+LogBatcherStats get_mqtt_log_stats();
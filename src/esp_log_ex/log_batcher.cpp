@@ -0,0 +1,163 @@
+#include "log_batcher.h"
+
+#include <cstring>
+
+struct ParsedLine
+{
+    char level;
+    const char *tag;
+    size_t tag_length;
+    const char *message;
+    size_t message_length;
+};
+
+// Splits "[color]L (timestamp) tag: message[reset]" as produced by the ESP_LOGx macros. Lines in any other format are
+// kept whole as the message with level '?'.
+static ParsedLine parse_line(const LogRecord &record)
+{
+    const char *begin = record.text;
+    const char *end = record.text + record.length;
+
+    if (begin < end && *begin == '\033')
+    {
+        const char *color_end = static_cast<const char *>(memchr(begin, 'm', end - begin));
+        if (color_end != nullptr)
+            begin = color_end + 1;
+    }
+    if (end - begin >= 4 && memcmp(end - 4, "\033[0m", 4) == 0)
+        end -= 4;
+
+    ParsedLine line = {'?', "", 0, begin, static_cast<size_t>(end - begin)};
+
+    const char *timestamp_end = end - begin > 3 && begin[1] == ' ' && begin[2] == '('
+                                    ? static_cast<const char *>(memchr(begin, ')', end - begin))
+                                    : nullptr;
+    if (timestamp_end == nullptr || end - timestamp_end < 2)
+        return line;
+
+    const char *tag = timestamp_end + 2;
+    const char *tag_end = tag;
+    while (tag_end + 1 < end && !(tag_end[0] == ':' && tag_end[1] == ' '))
+        ++tag_end;
+    if (tag_end + 1 >= end)
+        return line;
+
+    line.level = begin[0];
+    line.tag = tag;
+    line.tag_length = tag_end - tag;
+    line.message = tag_end + 2;
+    line.message_length = end - line.message;
+    return line;
+}
+
+static uint8_t *put_u16(uint8_t *out, uint16_t value)
+{
+    out[0] = static_cast<uint8_t>(value);
+    out[1] = static_cast<uint8_t>(value >> 8);
+    return out + 2;
+}
+
+static uint8_t *put_u32(uint8_t *out, uint32_t value)
+{
+    out = put_u16(out, static_cast<uint16_t>(value));
+    return put_u16(out, static_cast<uint16_t>(value >> 16));
+}
+
+LogBatcher::LogBatcher(const LogBatcherOptions &options, Sink sink)
+    : m_options(options), m_sink(sink), m_bucket(options.bytes_per_second, options.burst_bytes)
+{
+}
+
+size_t LogBatcher::encode(const LogRecord &record, uint8_t *buffer, size_t size) const
+{
+    if (m_options.encoding == LogEncoding::TEXT)
+    {
+        const size_t separator = m_length > 0 ? 1 : 0;
+        const size_t length = separator + record.length;
+        if (length > size)
+            return 0;
+
+        if (separator)
+            buffer[0] = '\n';
+        memcpy(buffer + separator, record.text, record.length);
+        return length;
+    }
+
+    const ParsedLine line = parse_line(record);
+    const size_t tag_length = line.tag_length > UINT8_MAX ? UINT8_MAX : line.tag_length;
+    const size_t header = m_length == 0 ? 3 : 0;
+    const size_t length = header + 4 + 1 + 1 + tag_length + 2 + line.message_length;
+    if (length > size)
+        return 0;
+
+    uint8_t *out = buffer;
+    if (header)
+    {
+        *out++ = 'N';
+        *out++ = 'L';
+        *out++ = BINARY_VERSION;
+    }
+    out = put_u32(out, record.timestamp_ms);
+    *out++ = static_cast<uint8_t>(line.level);
+    *out++ = static_cast<uint8_t>(tag_length);
+    memcpy(out, line.tag, tag_length);
+    out += tag_length;
+    out = put_u16(out, static_cast<uint16_t>(line.message_length));
+    memcpy(out, line.message, line.message_length);
+    return length;
+}
+
+void LogBatcher::add(const LogRecord &record, uint32_t now_ms)
+{
+    const size_t limit = m_options.max_batch_size < MAX_BATCH_SIZE ? m_options.max_batch_size : MAX_BATCH_SIZE;
+
+    size_t length = encode(record, m_batch + m_length, limit - m_length);
+    if (length == 0 && m_length > 0 && flush(now_ms))
+        length = encode(record, m_batch, limit);
+
+    if (length == 0)
+    {
+        ++m_stats.dropped_records;
+        return;
+    }
+
+    if (m_length == 0)
+        m_batch_started_ms = now_ms;
+    m_length += length;
+    ++m_batch_records;
+}
+
+void LogBatcher::flush_if_due(uint32_t now_ms)
+{
+    if (m_length > 0 && now_ms - m_batch_started_ms >= m_options.max_delay_ms)
+        flush(now_ms);
+}
+
+bool LogBatcher::flush(uint32_t now_ms)
+{
+    // Tokens are only taken for batches that left the device, a refused or stored batch costs nothing
+    if (m_bucket.available(now_ms) < m_length)
+    {
+        ++m_stats.throttled;
+        return false;
+    }
+
+    switch (m_sink(m_batch, m_length))
+    {
+    case LogSinkResult::REFUSED:
+        return false;
+    case LogSinkResult::SENT:
+        m_bucket.consume(m_length, now_ms);
+        m_stats.bytes += m_length;
+        break;
+    case LogSinkResult::STORED:
+        m_stats.stored_bytes += m_length;
+        break;
+    }
+
+    ++m_stats.batches;
+    m_stats.records += m_batch_records;
+    m_length = 0;
+    m_batch_records = 0;
+    return true;
+}
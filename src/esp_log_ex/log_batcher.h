@@ -0,0 +1,95 @@
+#pragma once
+
+#include "log_record.h"
+
+#include "util/token_bucket.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+enum class LogEncoding : uint8_t
+{
+    // Log lines separated by '\n'
+    TEXT,
+    // "NL" + version byte, then per record: u32 timestamp, u8 level, u8 tag length, tag, u16 message length, message.
+    // Integers are little endian, tools/decode_logs.py turns it back into text.
+    BINARY
+};
+
+struct LogBatcherOptions
+{
+    LogEncoding encoding = LogEncoding::BINARY;
+    // A batch is sent when it would exceed this size or when its oldest record is this old
+    size_t max_batch_size = 768;
+    uint32_t max_delay_ms = 2000;
+    // Bytes per second that may leave the device and the burst allowance on top of it
+    uint32_t bytes_per_second = 1024;
+    uint32_t burst_bytes = 4096;
+};
+
+// What the sink did with a batch
+enum class LogSinkResult : uint8_t
+{
+    // Not accepted, the batch is retried later
+    REFUSED,
+    // Left the device, counts against the rate limit
+    SENT,
+    // Kept on the device for later, e.g. spooled to flash while offline
+    STORED
+};
+
+struct LogBatcherStats
+{
+    uint32_t batches;
+    uint32_t records;
+    // Bytes that left the device
+    uint32_t bytes;
+    uint32_t stored_bytes;
+    uint32_t dropped_records;
+    uint32_t throttled;
+};
+
+// Coalesces log records into batches and hands them to the sink within the byte rate limit
+class LogBatcher final
+{
+  public:
+    // A batch fits a LogSpool page together with its length prefix
+    constexpr static const size_t MAX_BATCH_SIZE = 1022;
+    constexpr static const uint8_t BINARY_VERSION = 1;
+
+    typedef std::function<LogSinkResult(const uint8_t *data, size_t length)> Sink;
+
+    LogBatcher(const LogBatcherOptions &options, Sink sink);
+
+    LogBatcher(const LogBatcher &) = delete;
+    LogBatcher &operator=(const LogBatcher &) = delete;
+
+    void add(const LogRecord &record, uint32_t now_ms);
+    void flush_if_due(uint32_t now_ms);
+
+    bool empty() const
+    {
+        return m_length == 0;
+    }
+
+    LogBatcherStats get_stats() const
+    {
+        return m_stats;
+    }
+
+  private:
+    size_t encode(const LogRecord &record, uint8_t *buffer, size_t size) const;
+    bool flush(uint32_t now_ms);
+
+  private:
+    const LogBatcherOptions m_options;
+    const Sink m_sink;
+    TokenBucket m_bucket;
+
+    uint8_t m_batch[MAX_BATCH_SIZE];
+    size_t m_length = 0;
+    uint32_t m_batch_records = 0;
+    uint32_t m_batch_started_ms = 0;
+    LogBatcherStats m_stats = {};
+};
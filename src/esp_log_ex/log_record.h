@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+constexpr static const size_t LOG_RECORD_TEXT_SIZE = 200;
+
+// Formatted log line as it is passed to appenders, longer lines are cut at LOG_RECORD_TEXT_SIZE - 1 characters
+struct LogRecord
+{
+    uint32_t timestamp_ms;
+    uint16_t length;
+    bool truncated;
+    char text[LOG_RECORD_TEXT_SIZE];
+};
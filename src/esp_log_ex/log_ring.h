@@ -0,0 +1,140 @@
+#pragma once
+
+#include "log_record.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+enum class OverflowPolicy : uint8_t
+{
+    DROP_OLDEST,
+    DROP_NEWEST
+};
+
+// Bounded lock-free queue of log records (Vyukov's sequence per slot algorithm). Any number of threads may log, one
+// consumer drains. Producers format straight into the claimed slot, so a record is never copied on the hot path.
+template <size_t CAPACITY> class LogRing
+{
+    static_assert(CAPACITY >= 2 && (CAPACITY & (CAPACITY - 1)) == 0, "LogRing capacity must be a power of two");
+
+  public:
+    struct Slot
+    {
+        LogRecord record;
+
+      private:
+        friend class LogRing;
+        std::atomic<size_t> sequence;
+        size_t position;
+    };
+
+    LogRing()
+    {
+        for (size_t i = 0; i < CAPACITY; ++i)
+            m_slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    LogRing(const LogRing &) = delete;
+    LogRing &operator=(const LogRing &) = delete;
+
+    // Returns a slot to fill and pass to commit(), or nullptr if the record has to be dropped
+    Slot *claim(OverflowPolicy policy)
+    {
+        for (int attempt = 0; attempt < MAX_CLAIM_ATTEMPTS; ++attempt)
+        {
+            Slot *slot = try_claim();
+            if (slot != nullptr)
+                return slot;
+
+            if (policy == OverflowPolicy::DROP_NEWEST || !discard_oldest())
+                break;
+        }
+
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    void commit(Slot *slot)
+    {
+        slot->sequence.store(slot->position + 1, std::memory_order_release);
+        m_written.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Calls consumer for the oldest committed record, returns false if there is none
+    template <typename Consumer> bool consume(Consumer consumer)
+    {
+        size_t position = m_dequeue_position.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Slot &slot = m_slots[position & (CAPACITY - 1)];
+            const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            const intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+            if (difference < 0)
+                return false;
+
+            if (difference == 0 &&
+                m_dequeue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+            {
+                consumer(static_cast<const LogRecord &>(slot.record));
+                slot.sequence.store(position + CAPACITY, std::memory_order_release);
+                return true;
+            }
+
+            if (difference > 0)
+                position = m_dequeue_position.load(std::memory_order_relaxed);
+        }
+    }
+
+    uint32_t get_written() const
+    {
+        return m_written.load(std::memory_order_relaxed);
+    }
+
+    uint32_t get_dropped() const
+    {
+        return m_dropped.load(std::memory_order_relaxed);
+    }
+
+  private:
+    constexpr static const int MAX_CLAIM_ATTEMPTS = 4;
+
+    Slot *try_claim()
+    {
+        size_t position = m_enqueue_position.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Slot &slot = m_slots[position & (CAPACITY - 1)];
+            const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            const intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+            if (difference < 0)
+                return nullptr;
+
+            if (difference == 0 &&
+                m_enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+            {
+                slot.position = position;
+                return &slot;
+            }
+
+            if (difference > 0)
+                position = m_enqueue_position.load(std::memory_order_relaxed);
+        }
+    }
+
+    bool discard_oldest()
+    {
+        if (!consume([](const LogRecord &) {}))
+            return false;
+
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+  private:
+    Slot m_slots[CAPACITY];
+    std::atomic<size_t> m_enqueue_position{0};
+    std::atomic<size_t> m_dequeue_position{0};
+    std::atomic<uint32_t> m_written{0};
+    std::atomic<uint32_t> m_dropped{0};
+};
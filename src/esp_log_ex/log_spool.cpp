@@ -0,0 +1,223 @@
+#include "log_spool.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <sys/stat.h>
+
+constexpr static const char *SEGMENT_SUFFIX = ".seg";
+
+LogSpool::LogSpool(hal::Clock &clock, const std::string &directory, const LogSpoolOptions &options)
+    : m_clock(clock), m_directory(directory), m_options(options)
+{
+}
+
+void LogSpool::make_path(uint32_t segment, char *path, size_t size) const
+{
+    snprintf(path, size, "%s/%08x%s", m_directory.c_str(), static_cast<unsigned int>(segment), SEGMENT_SUFFIX);
+}
+
+bool LogSpool::open()
+{
+    mkdir(m_directory.c_str(), 0755);
+
+    DIR *dir = opendir(m_directory.c_str());
+    if (dir == nullptr)
+        return false;
+
+    bool found = false;
+    while (const dirent *entry = readdir(dir))
+    {
+        char *end = nullptr;
+        const unsigned long segment = strtoul(entry->d_name, &end, 16);
+        if (end == entry->d_name || strcmp(end, SEGMENT_SUFFIX) != 0)
+            continue;
+
+        if (!found || segment < m_first)
+            m_first = segment;
+        if (!found || segment > m_last)
+            m_last = segment;
+        found = true;
+    }
+    closedir(dir);
+
+    if (found)
+    {
+        char path[128];
+        make_path(m_last, path, sizeof(path));
+        struct stat info;
+        m_last_size = stat(path, &info) == 0 ? info.st_size : 0;
+    }
+
+    m_opened = true;
+    return true;
+}
+
+bool LogSpool::append(const uint8_t *data, size_t length)
+{
+    if (!m_opened || length == 0 || length > MAX_BATCH_SIZE)
+        return false;
+
+    if (m_page_length + 2 + length > PAGE_SIZE)
+        flush();
+
+    if (m_page_length == 0)
+        m_page_started_ms = m_clock.millis();
+
+    m_page[m_page_length++] = static_cast<uint8_t>(length);
+    m_page[m_page_length++] = static_cast<uint8_t>(length >> 8);
+    memcpy(m_page + m_page_length, data, length);
+    m_page_length += length;
+
+    ++m_stats.appended_batches;
+    m_stats.payload_bytes += length;
+    return true;
+}
+
+void LogSpool::flush_if_due()
+{
+    if (m_page_length > 0 && m_clock.millis() - m_page_started_ms >= m_options.flush_delay_ms)
+        flush();
+}
+
+void LogSpool::flush()
+{
+    if (m_page_read >= m_page_length)
+    {
+        m_page_length = 0;
+        m_page_read = 0;
+        return;
+    }
+
+    // Batches already replayed from RAM are not written
+    const size_t length = m_page_length - m_page_read;
+    if (m_last_size > 0 && m_last_size + length > m_options.segment_size)
+    {
+        ++m_last;
+        m_last_size = 0;
+        while (m_last - m_first >= m_options.max_segments)
+        {
+            remove_segment(m_first);
+            ++m_stats.dropped_segments;
+        }
+    }
+
+    char path[128];
+    make_path(m_last, path, sizeof(path));
+
+    const uint32_t started = m_clock.micros();
+    FILE *file = fopen(path, "ab");
+    const size_t written = file != nullptr ? fwrite(m_page + m_page_read, 1, length, file) : 0;
+    if (file != nullptr)
+        fclose(file);
+    m_stats.flash_write_us += m_clock.micros() - started;
+
+    ++m_stats.flash_writes;
+    m_stats.flash_bytes += written;
+    m_last_size += written;
+    m_page_length = 0;
+    m_page_read = 0;
+}
+
+void LogSpool::remove_segment(uint32_t segment)
+{
+    char path[128];
+    make_path(segment, path, sizeof(path));
+    remove(path);
+
+    if (segment == m_first)
+    {
+        ++m_first;
+        m_read_offset = 0;
+    }
+}
+
+bool LogSpool::segments_empty() const
+{
+    return m_first == m_last && m_read_offset >= m_last_size;
+}
+
+bool LogSpool::empty() const
+{
+    return m_page_read >= m_page_length && segments_empty();
+}
+
+bool LogSpool::read_batch(size_t &length)
+{
+    char path[128];
+    make_path(m_first, path, sizeof(path));
+    FILE *file = fopen(path, "rb");
+    if (file == nullptr)
+        return false;
+
+    uint8_t header[2];
+    bool ok = fseek(file, static_cast<long>(m_read_offset), SEEK_SET) == 0 && fread(header, 1, 2, file) == 2;
+    if (ok)
+    {
+        length = header[0] | (header[1] << 8);
+        ok = length <= sizeof(m_read_buffer) && fread(m_read_buffer, 1, length, file) == length;
+    }
+    fclose(file);
+
+    return ok;
+}
+
+size_t LogSpool::replay(const Sink &sink, size_t max_batches)
+{
+    if (!m_opened)
+        return 0;
+
+    // The page in RAM is replayed in place once the segments are drained, so reconnecting never writes a partial page
+    size_t sent = 0;
+    while (sent < max_batches && !empty())
+    {
+        if (segments_empty())
+        {
+            const size_t length = m_page[m_page_read] | (m_page[m_page_read + 1] << 8);
+            if (!sink(m_page + m_page_read + 2, length))
+                break;
+
+            m_page_read += 2 + length;
+            if (m_page_read >= m_page_length)
+            {
+                m_page_length = 0;
+                m_page_read = 0;
+            }
+        }
+        else
+        {
+            size_t length = 0;
+            if (!read_batch(length))
+            {
+                // End of the segment, or a torn write at the end of it after a reset
+                if (m_first == m_last)
+                {
+                    remove_segment(m_first);
+                    m_first = m_last;
+                    m_last_size = 0;
+                }
+                else
+                    remove_segment(m_first);
+                continue;
+            }
+
+            if (!sink(m_read_buffer, length))
+                break;
+
+            m_read_offset += 2 + length;
+        }
+        ++m_stats.replayed_batches;
+        ++sent;
+    }
+
+    // Nothing replayed must survive a reboot, so the segment goes away as soon as it is drained
+    if (m_first == m_last && m_last_size > 0 && m_read_offset >= m_last_size)
+    {
+        remove_segment(m_first);
+        m_first = m_last;
+        m_last_size = 0;
+    }
+
+    return sent;
+}
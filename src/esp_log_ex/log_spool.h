@@ -0,0 +1,89 @@
+#pragma once
+
+#include "hal/clock.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+struct LogSpoolOptions
+{
+    // The spool keeps at most max_segments * segment_size bytes and drops the oldest segment beyond that
+    size_t segment_size = 16 * 1024;
+    size_t max_segments = 8;
+    // Appends are collected in RAM and written a page at a time, or after flush_delay_ms
+    uint32_t flush_delay_ms = 10000;
+};
+
+struct LogSpoolStats
+{
+    uint32_t appended_batches;
+    uint32_t replayed_batches;
+    uint32_t dropped_segments;
+    uint32_t payload_bytes;
+    // Bytes that went to flash and the time it took, flash_bytes / payload_bytes is the write amplification of the
+    // framing and partial pages (the file system adds its own on top)
+    uint32_t flash_writes;
+    uint32_t flash_bytes;
+    uint32_t flash_write_us;
+};
+
+// Append-only circular log of batches on the file system, one file per segment named by its sequence number. Whole
+// segments are deleted once they are replayed or when the spool overflows, so flash is never rewritten in place.
+class LogSpool final
+{
+  public:
+    constexpr static const size_t PAGE_SIZE = 1024;
+    constexpr static const size_t MAX_BATCH_SIZE = PAGE_SIZE - 2;
+
+    typedef std::function<bool(const uint8_t *data, size_t length)> Sink;
+
+    LogSpool(hal::Clock &clock, const std::string &directory, const LogSpoolOptions &options = LogSpoolOptions());
+
+    LogSpool(const LogSpool &) = delete;
+    LogSpool &operator=(const LogSpool &) = delete;
+
+    // Picks up segments left from before the reboot
+    bool open();
+
+    bool append(const uint8_t *data, size_t length);
+    void flush_if_due();
+    void flush();
+
+    bool empty() const;
+
+    // Hands spooled batches to the sink oldest first and stops at the first one it refuses. Returns the number sent.
+    size_t replay(const Sink &sink, size_t max_batches);
+
+    LogSpoolStats get_stats() const
+    {
+        return m_stats;
+    }
+
+  private:
+    void make_path(uint32_t segment, char *path, size_t size) const;
+    void remove_segment(uint32_t segment);
+    bool segments_empty() const;
+    bool read_batch(size_t &length);
+
+  private:
+    hal::Clock &m_clock;
+    const std::string m_directory;
+    const LogSpoolOptions m_options;
+    bool m_opened = false;
+
+    // Segments m_first..m_last exist, m_last is the one being written
+    uint32_t m_first = 0;
+    uint32_t m_last = 0;
+    size_t m_last_size = 0;
+    size_t m_read_offset = 0;
+
+    uint8_t m_page[PAGE_SIZE];
+    size_t m_page_length = 0;
+    size_t m_page_read = 0;
+    uint32_t m_page_started_ms = 0;
+
+    uint8_t m_read_buffer[PAGE_SIZE];
+    LogSpoolStats m_stats = {};
+};
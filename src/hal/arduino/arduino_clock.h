@@ -0,0 +1,34 @@
+#pragma once
+
+#include "hal/clock.h"
+
+#include <Arduino.h>
+
+namespace hal
+{
+
+class ArduinoClock final : public Clock
+{
+  public:
+    uint32_t millis() override
+    {
+        return ::millis();
+    }
+
+    uint32_t micros() override
+    {
+        return ::micros();
+    }
+
+    uint32_t cycles() override
+    {
+        return ESP.getCycleCount();
+    }
+
+    void delay(uint32_t ms) override
+    {
+        ::delay(ms);
+    }
+};
+
+} // namespace hal
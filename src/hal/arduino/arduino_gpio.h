@@ -0,0 +1,100 @@
+#pragma once
+
+#include "hal/gpio.h"
+
+#include <Arduino.h>
+#include <driver/gpio.h>
+#include <esp_attr.h>
+#include <esp_sleep.h>
+#include <hal/gpio_ll.h>
+
+#include <cstdint>
+
+namespace hal
+{
+
+class ArduinoGpio final : public Gpio
+{
+  public:
+    void pin_mode(int pin, PinMode mode) override
+    {
+        switch (mode)
+        {
+        case PinMode::DIGITAL_INPUT:
+            pinMode(pin, INPUT);
+            break;
+        case PinMode::DIGITAL_OUTPUT:
+            pinMode(pin, OUTPUT);
+            break;
+        case PinMode::INPUT_PULL_UP:
+            pinMode(pin, INPUT_PULLUP);
+            break;
+        case PinMode::INPUT_PULL_DOWN:
+            pinMode(pin, INPUT_PULLDOWN);
+            break;
+        }
+    }
+
+    int digital_read(int pin) override
+    {
+        return digitalRead(pin);
+    }
+
+    void digital_write(int pin, int value) override
+    {
+        digitalWrite(pin, value);
+    }
+
+    void analog_write(int pin, int value) override
+    {
+        analogWrite(pin, value);
+    }
+
+    void attach_interrupt(int pin, InterruptHandler handler, void *argument) override
+    {
+        auto &binding = m_bindings[pin];
+        binding.gpio = static_cast<gpio_num_t>(pin);
+        binding.handler = handler;
+        binding.argument = argument;
+        attachInterruptArg(pin, handler, argument, CHANGE);
+    }
+
+    // Light sleep only wakes on a level, so the pin gets a level interrupt for the opposite of its current level that
+    // every interrupt flips. It still fires once per edge while awake and the pad stays a digital GPIO, unlike the RTC
+    // wakeups that leave it switched to RTC IO after the first sleep.
+    bool enable_wakeup(int pin) override
+    {
+        if (pin < 0 || pin >= GPIO_PIN_COUNT || m_bindings[pin].handler == nullptr)
+            return false;
+
+        const auto gpio = static_cast<gpio_num_t>(pin);
+        // A change between the read and the setup fires right away, so no edge is lost
+        const bool high = gpio_get_level(gpio) != 0;
+        detachInterrupt(pin);
+        attachInterruptArg(pin, &ArduinoGpio::on_level_interrupt, &m_bindings[pin], high ? ONLOW : ONHIGH);
+        if (gpio_wakeup_enable(gpio, high ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL) != ESP_OK)
+            return false;
+        return esp_sleep_enable_gpio_wakeup() == ESP_OK;
+    }
+
+  private:
+    struct Binding
+    {
+        gpio_num_t gpio = GPIO_NUM_NC;
+        InterruptHandler handler = nullptr;
+        void *argument = nullptr;
+    };
+
+    static void IRAM_ATTR on_level_interrupt(void *argument)
+    {
+        const Binding &binding = *static_cast<const Binding *>(argument);
+        const bool high = gpio_ll_get_level(&GPIO, binding.gpio) != 0;
+        gpio_ll_set_intr_type(&GPIO, binding.gpio, high ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL);
+        binding.handler(binding.argument);
+    }
+
+  private:
+    Binding m_bindings[GPIO_PIN_COUNT];
+};
+
+} // namespace hal
@@ -0,0 +1,221 @@
+#include "esp_mqtt_transport.h"
+
+#include "hal/log.h"
+#include "hal/task.h"
+#include "util/spsc_queue.h"
+
+#include <mqtt_client.h>
+
+#include <atomic>
+#include <cstring>
+#include <string>
+
+namespace hal
+{
+
+constexpr static const char *TRANSPORT_LOG_TAG = "mqtt_transport";
+
+// connect() waits this long for CONNACK, keep it short so one connect attempt stalls loop() only briefly
+constexpr static const uint32_t CONNECT_TIMEOUT_MS = 2000;
+// The outbound queue publishes unacknowledged messages again itself, the outbox of esp-mqtt must not do it as well
+constexpr static const int RETRANSMIT_TIMEOUT_MS = 60 * 60 * 1000;
+// Inbound messages are commands and Home Assistant status updates, longer ones are dropped
+constexpr static const size_t MAX_INBOUND_TOPIC_LENGTH = 127;
+constexpr static const size_t MAX_INBOUND_PAYLOAD_LENGTH = 255;
+
+struct InboundMessage
+{
+    char topic[MAX_INBOUND_TOPIC_LENGTH + 1];
+    uint8_t payload[MAX_INBOUND_PAYLOAD_LENGTH + 1];
+    uint16_t length;
+};
+
+struct EspMqttTransport::Impl
+{
+    static void on_event(void *argument, esp_event_base_t base, int32_t event_id, void *event_data);
+    // Runs in the esp-mqtt task
+    void handle(const esp_mqtt_event_t &event);
+
+    uint16_t buffer_size = 0;
+    std::string hostname;
+    uint16_t port = 0;
+    esp_mqtt_client_handle_t client = nullptr;
+    MqttCallback callback;
+    MqttAckCallback ack_callback;
+
+    std::atomic<bool> connected{false};
+    // Notified when a connect attempt succeeded or failed
+    Event connect_done;
+    // Filled by the esp-mqtt task and drained by loop()
+    SpscQueue<InboundMessage, 8> inbound;
+    SpscQueue<uint16_t, 16> acks;
+};
+
+void EspMqttTransport::Impl::on_event(void *argument, esp_event_base_t, int32_t, void *event_data)
+{
+    static_cast<Impl *>(argument)->handle(*static_cast<esp_mqtt_event_handle_t>(event_data));
+}
+
+void EspMqttTransport::Impl::handle(const esp_mqtt_event_t &event)
+{
+    switch (event.event_id)
+    {
+    case MQTT_EVENT_CONNECTED:
+        connected.store(true);
+        connect_done.notify();
+        break;
+    case MQTT_EVENT_DISCONNECTED:
+    case MQTT_EVENT_ERROR:
+        connected.store(false);
+        connect_done.notify();
+        break;
+    case MQTT_EVENT_PUBLISHED:
+        if (!acks.push(static_cast<uint16_t>(event.msg_id)))
+            ESP_LOGW(TRANSPORT_LOG_TAG, "Acknowledgement of packet %d dropped", event.msg_id);
+        break;
+    case MQTT_EVENT_DATA:
+    {
+        // Payloads larger than the buffer arrive in fragments
+        const size_t topic_length = static_cast<size_t>(event.topic_len);
+        const size_t length = static_cast<size_t>(event.data_len);
+        if (event.total_data_len != event.data_len || topic_length > MAX_INBOUND_TOPIC_LENGTH ||
+            length > MAX_INBOUND_PAYLOAD_LENGTH)
+        {
+            ESP_LOGW(TRANSPORT_LOG_TAG, "Inbound message of %d bytes is too long", event.total_data_len);
+            break;
+        }
+
+        InboundMessage message;
+        memcpy(message.topic, event.topic, topic_length);
+        message.topic[topic_length] = '\0';
+        memcpy(message.payload, event.data, length);
+        message.length = static_cast<uint16_t>(length);
+        if (!inbound.push(message))
+            ESP_LOGW(TRANSPORT_LOG_TAG, "Inbound message on '%s' dropped", message.topic);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+EspMqttTransport::EspMqttTransport(uint16_t buffer_size) : m_impl(new Impl)
+{
+    m_impl->buffer_size = buffer_size;
+}
+
+EspMqttTransport::~EspMqttTransport()
+{
+    if (m_impl->client != nullptr)
+        esp_mqtt_client_destroy(m_impl->client);
+}
+
+void EspMqttTransport::set_server(const char *hostname, uint16_t port)
+{
+    m_impl->hostname = hostname;
+    m_impl->port = port;
+}
+
+void EspMqttTransport::set_callback(MqttCallback callback)
+{
+    m_impl->callback = callback;
+}
+
+void EspMqttTransport::set_ack_callback(MqttAckCallback callback)
+{
+    m_impl->ack_callback = callback;
+}
+
+bool EspMqttTransport::connect(const char *client_id, const char *user, const char *password)
+{
+    // Every attempt starts a clean session, messages that were not acknowledged are published again by the caller
+    if (m_impl->client != nullptr)
+    {
+        esp_mqtt_client_destroy(m_impl->client);
+        m_impl->client = nullptr;
+    }
+    m_impl->connected.store(false);
+
+    esp_mqtt_client_config_t config = {};
+    config.host = m_impl->hostname.c_str();
+    config.port = m_impl->port;
+    config.transport = MQTT_TRANSPORT_OVER_TCP;
+    config.client_id = client_id;
+    config.username = user;
+    config.password = password;
+    config.buffer_size = m_impl->buffer_size;
+    // Reconnects are driven by the caller with its own backoff
+    config.disable_auto_reconnect = true;
+    config.message_retransmit_timeout = RETRANSMIT_TIMEOUT_MS;
+
+    m_impl->client = esp_mqtt_client_init(&config);
+    if (m_impl->client == nullptr)
+    {
+        ESP_LOGE(TRANSPORT_LOG_TAG, "Creating the MQTT client failed");
+        return false;
+    }
+    esp_mqtt_client_register_event(m_impl->client, MQTT_EVENT_ANY, &Impl::on_event, m_impl.get());
+
+    // A notification left from the previous connection must not end this attempt
+    m_impl->connect_done.wait(0);
+    if (esp_mqtt_client_start(m_impl->client) != ESP_OK)
+        return false;
+
+    m_impl->connect_done.wait(CONNECT_TIMEOUT_MS);
+    if (m_impl->connected.load())
+        return true;
+
+    esp_mqtt_client_stop(m_impl->client);
+    return false;
+}
+
+bool EspMqttTransport::connected()
+{
+    return m_impl->connected.load();
+}
+
+void EspMqttTransport::loop()
+{
+    InboundMessage message;
+    while (m_impl->inbound.pop(message))
+    {
+        if (m_impl->callback)
+            m_impl->callback(message.topic, message.payload, message.length);
+    }
+
+    uint16_t packet_id = 0;
+    while (m_impl->acks.pop(packet_id))
+    {
+        if (m_impl->ack_callback)
+            m_impl->ack_callback(packet_id);
+    }
+}
+
+bool EspMqttTransport::publish(const char *topic, const uint8_t *payload, size_t length, bool retained)
+{
+    if (!m_impl->connected.load())
+        return false;
+
+    return esp_mqtt_client_publish(m_impl->client, topic, reinterpret_cast<const char *>(payload),
+                                   static_cast<int>(length), 0, retained) >= 0;
+}
+
+uint16_t EspMqttTransport::publish_reliable(const char *topic, const uint8_t *payload, size_t length, bool retained)
+{
+    if (!m_impl->connected.load())
+        return 0;
+
+    const int packet_id = esp_mqtt_client_publish(m_impl->client, topic, reinterpret_cast<const char *>(payload),
+                                                  static_cast<int>(length), 1, retained);
+    return packet_id > 0 ? static_cast<uint16_t>(packet_id) : 0;
+}
+
+bool EspMqttTransport::subscribe(const char *topic)
+{
+    if (!m_impl->connected.load())
+        return false;
+
+    return esp_mqtt_client_subscribe(m_impl->client, topic, 0) >= 0;
+}
+
+} // namespace hal
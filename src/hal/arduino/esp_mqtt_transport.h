@@ -0,0 +1,35 @@
+#pragma once
+
+#include "hal/mqtt_transport.h"
+
+#include <memory>
+
+namespace hal
+{
+
+// esp-mqtt client of the IDF, which runs the connection in a task of its own. Its events are handed over to loop(),
+// so callbacks run in the task that drives the transport, and connect() waits for the broker like a blocking client.
+class EspMqttTransport final : public MqttTransport
+{
+  public:
+    EspMqttTransport(uint16_t buffer_size);
+    ~EspMqttTransport();
+
+    void set_server(const char *hostname, uint16_t port) override;
+    void set_callback(MqttCallback callback) override;
+    void set_ack_callback(MqttAckCallback callback) override;
+
+    bool connect(const char *client_id, const char *user, const char *password) override;
+    bool connected() override;
+    void loop() override;
+
+    bool publish(const char *topic, const uint8_t *payload, size_t length, bool retained) override;
+    uint16_t publish_reliable(const char *topic, const uint8_t *payload, size_t length, bool retained) override;
+    bool subscribe(const char *topic) override;
+
+  private:
+    struct Impl;
+    std::unique_ptr<Impl> m_impl;
+};
+
+} // namespace hal
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "hal/nvs.h"
+
+#include <nvs.h>
+
+namespace hal
+{
+
+// Uses the NVS API directly instead of Preferences, which commits after every put. Values are stored with the same
+// types as Preferences did, so existing settings stay readable.
+class EspNvs final : public Nvs
+{
+  public:
+    ~EspNvs()
+    {
+        if (m_open)
+            nvs_close(m_handle);
+    }
+
+    bool begin(const char *name)
+    {
+        m_open = nvs_open(name, NVS_READWRITE, &m_handle) == ESP_OK;
+        return m_open;
+    }
+
+    bool get_bool(const char *key, bool default_value) override
+    {
+        uint8_t value = 0;
+        return m_open && nvs_get_u8(m_handle, key, &value) == ESP_OK ? value != 0 : default_value;
+    }
+
+    int32_t get_int(const char *key, int32_t default_value) override
+    {
+        int32_t value = 0;
+        return m_open && nvs_get_i32(m_handle, key, &value) == ESP_OK ? value : default_value;
+    }
+
+    void put_bool(const char *key, bool value) override
+    {
+        if (m_open)
+            nvs_set_u8(m_handle, key, value ? 1 : 0);
+    }
+
+    void put_int(const char *key, int32_t value) override
+    {
+        if (m_open)
+            nvs_set_i32(m_handle, key, value);
+    }
+
+    bool commit() override
+    {
+        return m_open && nvs_commit(m_handle) == ESP_OK;
+    }
+
+  private:
+    nvs_handle_t m_handle = 0;
+    bool m_open = false;
+};
+
+} // namespace hal
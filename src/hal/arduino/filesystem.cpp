@@ -0,0 +1,20 @@
+#include "hal/filesystem.h"
+
+#include <LittleFS.h>
+
+namespace hal
+{
+
+constexpr static const char *ROOT = "/littlefs";
+
+bool mount_filesystem()
+{
+    return LittleFS.begin(true, ROOT);
+}
+
+const char *filesystem_root()
+{
+    return ROOT;
+}
+
+} // namespace hal
@@ -0,0 +1,308 @@
+#include "hal/firmware.h"
+
+#include "hal/log.h"
+
+#include <Arduino.h>
+#include <HTTPClient.h>
+#include <WiFi.h>
+#include <esp32/rom/miniz.h>
+#include <esp_ota_ops.h>
+#include <mbedtls/sha256.h>
+
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+
+namespace hal
+{
+
+constexpr static const char *FIRMWARE_LOG_TAG = "firmware";
+
+FirmwareState get_firmware_state()
+{
+    esp_ota_img_states_t state = ESP_OTA_IMG_UNDEFINED;
+    if (esp_ota_get_state_partition(esp_ota_get_running_partition(), &state) == ESP_OK &&
+        state == ESP_OTA_IMG_PENDING_VERIFY)
+        return FirmwareState::PENDING_VERIFY;
+    return FirmwareState::VALID;
+}
+
+bool get_running_firmware_digest(uint8_t (&digest)[FIRMWARE_SHA256_SIZE])
+{
+    return esp_partition_get_sha256(esp_ota_get_running_partition(), digest) == ESP_OK;
+}
+
+void confirm_firmware()
+{
+    esp_ota_mark_app_valid_cancel_rollback();
+}
+
+void reject_firmware()
+{
+    esp_ota_mark_app_invalid_rollback_and_reboot();
+    // Only returns if there is no image to go back to
+    esp_restart();
+}
+
+void restart()
+{
+    esp_restart();
+}
+
+struct FirmwareWriter::Impl
+{
+    const esp_partition_t *partition = nullptr;
+    esp_ota_handle_t handle = 0;
+    bool open = false;
+    mbedtls_sha256_context sha;
+    uint32_t image_size = 0;
+    uint32_t written = 0;
+
+    // ROM inflate with a circular dictionary, only allocated for compressed images
+    tinfl_decompressor inflator;
+    uint8_t *window = nullptr;
+    size_t window_size = 0;
+    size_t window_position = 0;
+    bool inflated = false;
+
+    bool output(const uint8_t *data, size_t size)
+    {
+        if (written + size > image_size)
+        {
+            ESP_LOGE(FIRMWARE_LOG_TAG, "Image is larger than the %" PRIu32 " bytes announced", image_size);
+            return false;
+        }
+
+        mbedtls_sha256_update(&sha, data, size);
+        written += size;
+        const esp_err_t error = esp_ota_write(handle, data, size);
+        if (error != ESP_OK)
+            ESP_LOGE(FIRMWARE_LOG_TAG, "Writing the image failed: %s", esp_err_to_name(error));
+        return error == ESP_OK;
+    }
+
+    bool inflate(const uint8_t *data, size_t size)
+    {
+        for (;;)
+        {
+            size_t in_bytes = size;
+            size_t out_bytes = window_size - window_position;
+            const tinfl_status status =
+                tinfl_decompress(&inflator, data, &in_bytes, window, window + window_position, &out_bytes,
+                                 TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_HAS_MORE_INPUT);
+            data += in_bytes;
+            size -= in_bytes;
+
+            if (out_bytes > 0 && !output(window + window_position, out_bytes))
+                return false;
+            window_position = (window_position + out_bytes) & (window_size - 1);
+
+            if (status == TINFL_STATUS_DONE)
+            {
+                inflated = true;
+                return size == 0;
+            }
+            if (status < TINFL_STATUS_DONE)
+            {
+                ESP_LOGE(FIRMWARE_LOG_TAG, "Image is not a valid zlib stream (%d)", static_cast<int>(status));
+                return false;
+            }
+            if (status == TINFL_STATUS_NEEDS_MORE_INPUT && size == 0)
+                return true;
+        }
+    }
+
+    void release()
+    {
+        if (open)
+            esp_ota_abort(handle);
+        open = false;
+        free(window);
+        window = nullptr;
+        mbedtls_sha256_free(&sha);
+    }
+};
+
+FirmwareWriter::FirmwareWriter() : m_impl(new Impl)
+{
+    mbedtls_sha256_init(&m_impl->sha);
+}
+
+FirmwareWriter::~FirmwareWriter()
+{
+    m_impl->release();
+}
+
+bool FirmwareWriter::begin(uint32_t image_size, uint8_t window_bits)
+{
+    m_impl->release();
+    m_impl->partition = esp_ota_get_next_update_partition(nullptr);
+    if (m_impl->partition == nullptr || image_size > m_impl->partition->size)
+    {
+        ESP_LOGE(FIRMWARE_LOG_TAG, "No app partition for an image of %" PRIu32 " bytes", image_size);
+        return false;
+    }
+
+    if (window_bits > 0)
+    {
+        m_impl->window_size = static_cast<size_t>(1) << window_bits;
+        m_impl->window = static_cast<uint8_t *>(malloc(m_impl->window_size));
+        if (m_impl->window == nullptr)
+        {
+            ESP_LOGE(FIRMWARE_LOG_TAG, "No memory for a %u byte inflate window",
+                     static_cast<unsigned int>(m_impl->window_size));
+            return false;
+        }
+        tinfl_init(&m_impl->inflator);
+    }
+    m_impl->window_position = 0;
+    m_impl->inflated = false;
+
+    // Erases as much of the partition as the image needs
+    const esp_err_t error = esp_ota_begin(m_impl->partition, image_size, &m_impl->handle);
+    if (error != ESP_OK)
+    {
+        ESP_LOGE(FIRMWARE_LOG_TAG, "Starting the update failed: %s", esp_err_to_name(error));
+        m_impl->release();
+        return false;
+    }
+
+    m_impl->open = true;
+    m_impl->image_size = image_size;
+    m_impl->written = 0;
+    mbedtls_sha256_init(&m_impl->sha);
+    mbedtls_sha256_starts(&m_impl->sha, 0);
+    ESP_LOGI(FIRMWARE_LOG_TAG, "Writing %" PRIu32 " bytes to partition %s", image_size, m_impl->partition->label);
+    return true;
+}
+
+bool FirmwareWriter::write(const uint8_t *data, size_t size)
+{
+    if (!m_impl->open)
+        return false;
+    if (m_impl->window == nullptr)
+        return m_impl->output(data, size);
+    if (m_impl->inflated)
+        return size == 0;
+    return m_impl->inflate(data, size);
+}
+
+bool FirmwareWriter::finish(const uint8_t (&sha256)[FIRMWARE_SHA256_SIZE])
+{
+    if (!m_impl->open)
+        return false;
+
+    uint8_t actual[FIRMWARE_SHA256_SIZE];
+    mbedtls_sha256_finish(&m_impl->sha, actual);
+    if ((m_impl->window != nullptr && !m_impl->inflated) || m_impl->written != m_impl->image_size)
+    {
+        ESP_LOGE(FIRMWARE_LOG_TAG, "Image is incomplete: %" PRIu32 " of %" PRIu32 " bytes", m_impl->written,
+                 m_impl->image_size);
+        m_impl->release();
+        return false;
+    }
+    if (memcmp(actual, sha256, sizeof(actual)) != 0)
+    {
+        ESP_LOGE(FIRMWARE_LOG_TAG, "Image hash does not match");
+        m_impl->release();
+        return false;
+    }
+
+    // Also checks the image header and its own checksum
+    m_impl->open = false;
+    esp_err_t error = esp_ota_end(m_impl->handle);
+    if (error == ESP_OK)
+        error = esp_ota_set_boot_partition(m_impl->partition);
+    m_impl->release();
+    if (error != ESP_OK)
+    {
+        ESP_LOGE(FIRMWARE_LOG_TAG, "Activating the image failed: %s", esp_err_to_name(error));
+        return false;
+    }
+
+    ESP_LOGI(FIRMWARE_LOG_TAG, "Partition %s boots next", m_impl->partition->label);
+    return true;
+}
+
+void FirmwareWriter::abort()
+{
+    m_impl->release();
+}
+
+uint32_t FirmwareWriter::get_written() const
+{
+    return m_impl->written;
+}
+
+struct HttpDownload::Impl
+{
+    WiFiClient client;
+    HTTPClient http;
+    WiFiClient *stream = nullptr;
+    // -1 while the server sends no length
+    int remaining = -1;
+};
+
+HttpDownload::HttpDownload() : m_impl(new Impl)
+{
+}
+
+HttpDownload::~HttpDownload()
+{
+    close();
+}
+
+bool HttpDownload::open(const char *url)
+{
+    close();
+    if (!m_impl->http.begin(m_impl->client, url))
+        return false;
+
+    // An HTTP/1.1 server may send the body chunked, read() would then hand the chunk framing to the image
+    m_impl->http.useHTTP10(true);
+    const int status = m_impl->http.GET();
+    if (status != HTTP_CODE_OK)
+    {
+        ESP_LOGW(FIRMWARE_LOG_TAG, "GET %s failed: %d", url, status);
+        m_impl->http.end();
+        return false;
+    }
+
+    m_impl->stream = m_impl->http.getStreamPtr();
+    m_impl->remaining = m_impl->http.getSize();
+    return true;
+}
+
+int HttpDownload::read(uint8_t *buffer, size_t size, uint32_t timeout_ms)
+{
+    if (m_impl->stream == nullptr || m_impl->remaining == 0)
+        return -1;
+
+    const uint32_t started = millis();
+    while (m_impl->stream->available() == 0)
+    {
+        if (!m_impl->stream->connected())
+            return -1;
+        if (millis() - started >= timeout_ms)
+            return 0;
+        delay(1);
+    }
+
+    if (m_impl->remaining > 0 && size > static_cast<size_t>(m_impl->remaining))
+        size = static_cast<size_t>(m_impl->remaining);
+    const int read = m_impl->stream->read(buffer, size);
+    if (read > 0 && m_impl->remaining > 0)
+        m_impl->remaining -= read;
+    return read;
+}
+
+void HttpDownload::close()
+{
+    if (m_impl->stream == nullptr)
+        return;
+
+    m_impl->stream = nullptr;
+    m_impl->http.end();
+}
+
+} // namespace hal
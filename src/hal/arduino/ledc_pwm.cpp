@@ -0,0 +1,201 @@
+#include "ledc_pwm.h"
+
+#include "hal/log.h"
+
+#include <driver/ledc.h>
+#include <esp_timer.h>
+
+#include <algorithm>
+#include <cinttypes>
+
+namespace hal
+{
+
+constexpr static const char *PWM_LOG_TAG = "pwm";
+constexpr static const ledc_mode_t SPEED_MODE = LEDC_HIGH_SPEED_MODE;
+
+int LedcPwm::get_timer(const PwmConfig &config)
+{
+    for (size_t i = 0; i < TIMERS; ++i)
+    {
+        const auto &timer = m_timers[i];
+        if (timer.used && timer.config.frequency_hz == config.frequency_hz &&
+            timer.config.resolution_bits == config.resolution_bits)
+            return static_cast<int>(i);
+    }
+
+    for (size_t i = 0; i < TIMERS; ++i)
+    {
+        if (m_timers[i].used)
+            continue;
+
+        ledc_timer_config_t timer_config = {};
+        timer_config.speed_mode = SPEED_MODE;
+        timer_config.duty_resolution = static_cast<ledc_timer_bit_t>(config.resolution_bits);
+        timer_config.timer_num = static_cast<ledc_timer_t>(i);
+        timer_config.freq_hz = config.frequency_hz;
+        timer_config.clk_cfg = LEDC_AUTO_CLK;
+        const esp_err_t error = ledc_timer_config(&timer_config);
+        if (error != ESP_OK)
+        {
+            ESP_LOGE(PWM_LOG_TAG, "LEDC timer %" PRIu32 " Hz, %d bits failed: %s", config.frequency_hz,
+                     config.resolution_bits, esp_err_to_name(error));
+            return -1;
+        }
+
+        m_timers[i].used = true;
+        m_timers[i].config = config;
+        return static_cast<int>(i);
+    }
+
+    return -1;
+}
+
+int LedcPwm::attach(int pin, const PwmConfig &config)
+{
+    if (!m_fade_installed)
+    {
+        m_fade_installed = ledc_fade_func_install(0) == ESP_OK;
+        if (!m_fade_installed)
+            ESP_LOGW(PWM_LOG_TAG, "LEDC fade is not available, levels are set right away");
+        // Also keeps the chip out of automatic light sleep, fails without CONFIG_PM_ENABLE where nothing scales
+        if (esp_pm_lock_create(ESP_PM_APB_FREQ_MAX, 0, "ledc", &m_clock_lock) != ESP_OK)
+            m_clock_lock = nullptr;
+    }
+
+    size_t channel = 0;
+    while (channel < CHANNELS && m_channels[channel].used)
+        ++channel;
+    const int timer = channel < CHANNELS ? get_timer(config) : -1;
+    if (timer < 0)
+    {
+        ESP_LOGE(PWM_LOG_TAG, "No free LEDC channel or timer for GPIO %d", pin);
+        return -1;
+    }
+
+    ledc_channel_config_t channel_config = {};
+    channel_config.gpio_num = pin;
+    channel_config.speed_mode = SPEED_MODE;
+    channel_config.channel = static_cast<ledc_channel_t>(channel);
+    channel_config.intr_type = LEDC_INTR_DISABLE;
+    channel_config.timer_sel = static_cast<ledc_timer_t>(timer);
+    channel_config.duty = 0;
+    channel_config.hpoint = 0;
+    const esp_err_t error = ledc_channel_config(&channel_config);
+    if (error != ESP_OK)
+    {
+        ESP_LOGE(PWM_LOG_TAG, "LEDC channel for GPIO %d failed: %s", pin, esp_err_to_name(error));
+        return -1;
+    }
+
+    m_channels[channel].used = true;
+    ESP_LOGI(PWM_LOG_TAG, "GPIO %d on LEDC channel %u, timer %d (%" PRIu32 " Hz, %d bits)", pin,
+             static_cast<unsigned int>(channel), timer, config.frequency_hz, config.resolution_bits);
+    return static_cast<int>(channel);
+}
+
+void LedcPwm::fade(int channel, uint32_t duty, uint32_t duration_ms)
+{
+    if (channel < 0 || static_cast<size_t>(channel) >= CHANNELS || !m_channels[channel].used)
+        return;
+
+    auto &state = m_channels[channel];
+    if (esp_timer_get_time() < state.fade_end_us)
+    {
+        if (!state.pending)
+            ++m_pending;
+        state.pending = true;
+        state.pending_duty = duty;
+        state.pending_duration_ms = duration_ms;
+        return;
+    }
+
+    start(channel, duty, duration_ms);
+}
+
+void LedcPwm::loop()
+{
+    if (m_pending == 0 && m_clock_release_us == 0)
+        return;
+
+    const int64_t now = esp_timer_get_time();
+    for (size_t i = 0; i < CHANNELS; ++i)
+    {
+        auto &state = m_channels[i];
+        if (!state.pending || now < state.fade_end_us)
+            continue;
+
+        state.pending = false;
+        --m_pending;
+        start(static_cast<int>(i), state.pending_duty, state.pending_duration_ms);
+    }
+    update_clock_lock(now);
+}
+
+uint32_t LedcPwm::get_idle_ms(uint32_t max_ms) const
+{
+    if (m_pending == 0 && m_clock_release_us == 0)
+        return max_ms;
+
+    const int64_t now = esp_timer_get_time();
+    int64_t idle_us = static_cast<int64_t>(max_ms) * 1000;
+    if (m_clock_release_us != 0)
+        idle_us = std::min(idle_us, m_clock_release_us - now);
+    for (const auto &state : m_channels)
+    {
+        if (state.pending)
+            idle_us = std::min(idle_us, state.fade_end_us - now);
+    }
+
+    // Rounded up, so loop() does not wake before the fade ended
+    return idle_us > 0 ? static_cast<uint32_t>((idle_us + 999) / 1000) : 0;
+}
+
+void LedcPwm::start(int channel, uint32_t duty, uint32_t duration_ms)
+{
+    const auto ledc_channel = static_cast<ledc_channel_t>(channel);
+    auto &state = m_channels[channel];
+    state.duty = duty;
+    const int64_t now = esp_timer_get_time();
+    if (duration_ms == 0 || !m_fade_installed)
+    {
+        // Taken before a channel lights up
+        state.fade_end_us = 0;
+        update_clock_lock(now);
+        ledc_set_duty(SPEED_MODE, ledc_channel, duty);
+        ledc_update_duty(SPEED_MODE, ledc_channel);
+        return;
+    }
+
+    // One extra millisecond covers the last fade step
+    state.fade_end_us = now + (static_cast<int64_t>(duration_ms) + 1) * 1000;
+    update_clock_lock(now);
+    ledc_set_fade_with_time(SPEED_MODE, ledc_channel, duty, static_cast<int>(duration_ms));
+    ledc_fade_start(SPEED_MODE, ledc_channel, LEDC_FADE_NO_WAIT);
+}
+
+void LedcPwm::update_clock_lock(int64_t now_us)
+{
+    bool lit = false;
+    int64_t fade_end_us = 0;
+    for (const auto &state : m_channels)
+    {
+        if (state.duty > 0 || state.pending)
+            lit = true;
+        else if (state.fade_end_us > fade_end_us)
+            fade_end_us = state.fade_end_us;
+    }
+
+    const bool needed = lit || now_us < fade_end_us;
+    m_clock_release_us = !lit && needed ? fade_end_us : 0;
+    if (m_clock_lock == nullptr || needed == m_clock_locked)
+        return;
+
+    if (needed)
+        esp_pm_lock_acquire(m_clock_lock);
+    else
+        esp_pm_lock_release(m_clock_lock);
+    m_clock_locked = needed;
+}
+
+} // namespace hal
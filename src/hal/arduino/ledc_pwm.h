@@ -0,0 +1,65 @@
+#pragma once
+
+#include "hal/pwm.h"
+
+#include <esp_pm.h>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace hal
+{
+
+// PWM on the ESP32 LEDC peripheral, fades are run by its hardware fade unit. The driver blocks a new fade on a channel
+// until the running one ended, so fades requested meanwhile are kept and only the latest one is started from loop().
+// The high speed channels run from the APB clock, which frequency scaling changes and light sleep stops, so a power
+// management lock holds it at full speed while any channel is lit or fading.
+class LedcPwm final : public Pwm
+{
+  public:
+    // High speed channels and timers
+    constexpr static const size_t CHANNELS = 8;
+    constexpr static const size_t TIMERS = 4;
+
+    int attach(int pin, const PwmConfig &config) override;
+    void fade(int channel, uint32_t duty, uint32_t duration_ms) override;
+
+    // Costs nothing unless a fade is waiting or the clock can be released after a fade to dark
+    void loop();
+    // Until loop() has a waiting fade to start or the clock to release
+    uint32_t get_idle_ms(uint32_t max_ms) const;
+
+  private:
+    struct Channel
+    {
+        bool used = false;
+        uint32_t duty = 0;
+        bool pending = false;
+        uint32_t pending_duty = 0;
+        uint32_t pending_duration_ms = 0;
+        int64_t fade_end_us = 0;
+    };
+
+    struct Timer
+    {
+        bool used = false;
+        PwmConfig config;
+    };
+
+    int get_timer(const PwmConfig &config);
+    void start(int channel, uint32_t duty, uint32_t duration_ms);
+    void update_clock_lock(int64_t now_us);
+
+  private:
+    Channel m_channels[CHANNELS];
+    Timer m_timers[TIMERS];
+    size_t m_pending = 0;
+    bool m_fade_installed = false;
+    // Null without power management, the clock then never changes
+    esp_pm_lock_handle_t m_clock_lock = nullptr;
+    bool m_clock_locked = false;
+    // Set while only fades to dark hold the clock, when the last one ends
+    int64_t m_clock_release_us = 0;
+};
+
+} // namespace hal
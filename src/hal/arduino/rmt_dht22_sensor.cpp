@@ -0,0 +1,154 @@
+#include "rmt_dht22_sensor.h"
+
+#include "hal/dht22_decoder.h"
+#include "hal/log.h"
+
+#include <driver/gpio.h>
+#include <driver/rmt.h>
+#include <esp_timer.h>
+#include <freertos/ringbuf.h>
+
+namespace hal
+{
+
+constexpr static const char *DHT22_LOG_TAG = "dht22";
+
+// The sensor wakes up on a low pulse of at least 1 ms
+constexpr static const uint64_t START_SIGNAL_US = 1100;
+// A whole frame takes about 5 ms
+constexpr static const int64_t TIMEOUT_US = 20000;
+// With 1 us ticks, no edge for this long ends the capture, the longest pulse of a frame is 80 us
+constexpr static const uint16_t IDLE_THRESHOLD_US = 200;
+// In APB clock ticks, suppresses glitches shorter than ~1 us
+constexpr static const uint8_t FILTER_TICKS = 100;
+constexpr static const size_t RINGBUFFER_SIZE = 512;
+
+RmtDht22Sensor::RmtDht22Sensor(int pin, int rmt_channel) : m_pin(pin), m_channel(rmt_channel)
+{
+}
+
+RmtDht22Sensor::~RmtDht22Sensor()
+{
+    if (m_timer != nullptr)
+        esp_timer_delete(static_cast<esp_timer_handle_t>(m_timer));
+    if (m_ringbuffer != nullptr)
+        rmt_driver_uninstall(static_cast<rmt_channel_t>(m_channel));
+}
+
+void RmtDht22Sensor::begin()
+{
+    const auto pin = static_cast<gpio_num_t>(m_pin);
+    const auto channel = static_cast<rmt_channel_t>(m_channel);
+
+    rmt_config_t config = RMT_DEFAULT_CONFIG_RX(pin, channel);
+    config.clk_div = 80;
+    config.rx_config.idle_threshold = IDLE_THRESHOLD_US;
+    config.rx_config.filter_en = true;
+    config.rx_config.filter_ticks_thresh = FILTER_TICKS;
+
+    esp_err_t error = rmt_config(&config);
+    if (error == ESP_OK)
+        error = rmt_driver_install(channel, RINGBUFFER_SIZE, 0);
+    RingbufHandle_t ringbuffer = nullptr;
+    if (error == ESP_OK)
+        error = rmt_get_ringbuf_handle(channel, &ringbuffer);
+    if (error != ESP_OK)
+    {
+        ESP_LOGE(DHT22_LOG_TAG, "RMT channel %d setup for GPIO %d failed: %s", m_channel, m_pin, esp_err_to_name(error));
+        return;
+    }
+
+    // The RMT input stays routed while the pin is also driven as open drain output for the start signal
+    gpio_set_pull_mode(pin, GPIO_PULLUP_ONLY);
+    gpio_set_direction(pin, GPIO_MODE_INPUT_OUTPUT_OD);
+    gpio_set_level(pin, 1);
+
+    esp_timer_create_args_t timer_args = {};
+    timer_args.callback = &RmtDht22Sensor::on_start_signal_end;
+    timer_args.arg = this;
+    timer_args.name = DHT22_LOG_TAG;
+    esp_timer_handle_t timer = nullptr;
+    error = esp_timer_create(&timer_args, &timer);
+    if (error != ESP_OK)
+    {
+        ESP_LOGE(DHT22_LOG_TAG, "Timer setup for GPIO %d failed: %s", m_pin, esp_err_to_name(error));
+        return;
+    }
+
+    m_ringbuffer = ringbuffer;
+    m_timer = timer;
+}
+
+bool RmtDht22Sensor::start_read()
+{
+    if (m_timer == nullptr || m_state.load() != State::IDLE)
+        return false;
+
+    gpio_set_level(static_cast<gpio_num_t>(m_pin), 0);
+    m_started_at_us = esp_timer_get_time();
+    m_state.store(State::START_SIGNAL);
+    esp_timer_start_once(static_cast<esp_timer_handle_t>(m_timer), START_SIGNAL_US);
+    return true;
+}
+
+void RmtDht22Sensor::on_start_signal_end(void *argument)
+{
+    auto &sensor = *static_cast<RmtDht22Sensor *>(argument);
+
+    // The capture starts while the line is still low, the decoder skips everything before the data bits
+    sensor.m_state.store(State::RECEIVING);
+    rmt_rx_start(static_cast<rmt_channel_t>(sensor.m_channel), true);
+    gpio_set_level(static_cast<gpio_num_t>(sensor.m_pin), 1);
+}
+
+ClimateReadStatus RmtDht22Sensor::poll(ClimateReading &reading)
+{
+    switch (m_state.load())
+    {
+    case State::IDLE:
+        return ClimateReadStatus::IDLE;
+    case State::START_SIGNAL:
+        return ClimateReadStatus::BUSY;
+    case State::RECEIVING:
+        break;
+    }
+
+    const auto ringbuffer = static_cast<RingbufHandle_t>(m_ringbuffer);
+    size_t size = 0;
+    const auto *items = static_cast<const rmt_item32_t *>(xRingbufferReceive(ringbuffer, &size, 0));
+    if (items == nullptr)
+    {
+        if (esp_timer_get_time() - m_started_at_us < TIMEOUT_US)
+            return ClimateReadStatus::BUSY;
+
+        ESP_LOGD(DHT22_LOG_TAG, "GPIO %d: no response", m_pin);
+        finish();
+        return ClimateReadStatus::FAILED;
+    }
+
+    Dht22Decoder decoder;
+    for (size_t i = 0; i < size / sizeof(rmt_item32_t); ++i)
+    {
+        decoder.add(items[i].level0, items[i].duration0);
+        decoder.add(items[i].level1, items[i].duration1);
+    }
+    vRingbufferReturnItem(ringbuffer, const_cast<rmt_item32_t *>(items));
+    finish();
+
+    if (!decoder.finish(reading))
+    {
+        ESP_LOGD(DHT22_LOG_TAG, "GPIO %d: invalid frame of %u items", m_pin,
+                 static_cast<unsigned int>(size / sizeof(rmt_item32_t)));
+        return ClimateReadStatus::FAILED;
+    }
+
+    return ClimateReadStatus::DONE;
+}
+
+void RmtDht22Sensor::finish()
+{
+    rmt_rx_stop(static_cast<rmt_channel_t>(m_channel));
+    m_state.store(State::IDLE);
+}
+
+} // namespace hal
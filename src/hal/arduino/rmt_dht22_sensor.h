@@ -0,0 +1,43 @@
+#pragma once
+
+#include "hal/climate_sensor.h"
+
+#include <atomic>
+#include <cstdint>
+
+namespace hal
+{
+
+// DHT22 driver that does not block or disable interrupts. The start pulse is ended by a one-shot esp_timer, the RMT
+// peripheral captures the response frame, and poll() only decodes it once it is complete.
+class RmtDht22Sensor final : public ClimateSensor
+{
+  public:
+    RmtDht22Sensor(int pin, int rmt_channel = 0);
+    ~RmtDht22Sensor();
+
+    void begin() override;
+    bool start_read() override;
+    ClimateReadStatus poll(ClimateReading &reading) override;
+
+  private:
+    enum class State : uint8_t
+    {
+        IDLE,
+        START_SIGNAL,
+        RECEIVING
+    };
+
+    static void on_start_signal_end(void *argument);
+    void finish();
+
+  private:
+    const int m_pin;
+    const int m_channel;
+    void *m_ringbuffer = nullptr;
+    void *m_timer = nullptr;
+    std::atomic<State> m_state{State::IDLE};
+    int64_t m_started_at_us = 0;
+};
+
+} // namespace hal
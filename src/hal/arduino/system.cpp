@@ -0,0 +1,33 @@
+#include "hal/system.h"
+
+#include <Arduino.h>
+#include <esp_pm.h>
+
+namespace hal
+{
+
+HeapStats get_heap_stats()
+{
+    HeapStats stats;
+    stats.free_bytes = ESP.getFreeHeap();
+    stats.min_free_bytes = ESP.getMinFreeHeap();
+    stats.largest_free_block = ESP.getMaxAllocHeap();
+    return stats;
+}
+
+uint32_t cpu_frequency_mhz()
+{
+    return ESP.getCpuFreqMHz();
+}
+
+// Needs CONFIG_PM_ENABLE and CONFIG_FREERTOS_USE_TICKLESS_IDLE, esp_pm_configure() fails without them
+bool configure_power(const PowerConfig &config)
+{
+    esp_pm_config_esp32_t pm_config;
+    pm_config.max_freq_mhz = static_cast<int>(config.max_cpu_mhz);
+    pm_config.min_freq_mhz = static_cast<int>(config.min_cpu_mhz);
+    pm_config.light_sleep_enable = config.light_sleep;
+    return esp_pm_configure(&pm_config) == ESP_OK;
+}
+
+} // namespace hal
@@ -0,0 +1,58 @@
+#include "hal/task.h"
+
+#include <Arduino.h>
+
+namespace hal
+{
+
+void start_task(const char *name, TaskFunction function, void *argument, uint32_t stack_size, unsigned int priority,
+                int core)
+{
+    xTaskCreatePinnedToCore(function, name, stack_size, argument, priority, nullptr,
+                            core == ANY_CORE ? tskNO_AFFINITY : core);
+}
+
+void end_task()
+{
+    vTaskDelete(nullptr);
+}
+
+void sleep_ms(uint32_t ms)
+{
+    vTaskDelay(pdMS_TO_TICKS(ms));
+}
+
+struct Event::Impl
+{
+    SemaphoreHandle_t semaphore;
+};
+
+Event::Event() : m_impl(new Impl)
+{
+    m_impl->semaphore = xSemaphoreCreateBinary();
+}
+
+Event::~Event()
+{
+    vSemaphoreDelete(m_impl->semaphore);
+}
+
+bool Event::wait(uint32_t timeout_ms)
+{
+    return xSemaphoreTake(m_impl->semaphore, pdMS_TO_TICKS(timeout_ms)) == pdTRUE;
+}
+
+void IRAM_ATTR Event::notify()
+{
+    if (!xPortInIsrContext())
+    {
+        xSemaphoreGive(m_impl->semaphore);
+        return;
+    }
+
+    BaseType_t woken = pdFALSE;
+    xSemaphoreGiveFromISR(m_impl->semaphore, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+} // namespace hal
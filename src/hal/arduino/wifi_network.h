@@ -0,0 +1,115 @@
+#pragma once
+
+#include "hal/log.h"
+#include "hal/network.h"
+
+#include <WiFi.h>
+
+#include <cstring>
+#include <string>
+
+namespace hal
+{
+
+constexpr const char *NETWORK_LOG_TAG = "network";
+
+// Station that joins with the cached channel and BSSID of the last connection when it has them, so the access point is
+// found without a scan. The address still comes from DHCP.
+class WifiNetwork final : public Network
+{
+  public:
+    // Covers the association and the DHCP exchange
+    constexpr static const uint32_t FAST_JOIN_TIMEOUT_MS = 5000;
+
+    WifiNetwork(const std::string &hostname, const char *ssid, const char *password)
+        : m_hostname(hostname), m_ssid(ssid), m_password(password)
+    {
+    }
+
+    void set_cache(const NetworkCache &cache) override
+    {
+        m_cache = cache;
+    }
+
+    bool get_cache(NetworkCache &cache) override
+    {
+        const uint8_t *bssid = WiFi.BSSID();
+        if (WiFi.status() != WL_CONNECTED || bssid == nullptr)
+            return false;
+
+        cache.channel = WiFi.channel();
+        memcpy(cache.bssid, bssid, sizeof(cache.bssid));
+        return true;
+    }
+
+    void begin() override
+    {
+        WiFi.setHostname(m_hostname.c_str());
+        WiFi.mode(WIFI_STA);
+        WiFi.setAutoReconnect(true);
+        if (m_cache.valid())
+        {
+            // The access point on its channel, no scan
+            WiFi.begin(m_ssid, m_password, m_cache.channel, m_cache.bssid);
+            m_fast_join = true;
+            m_fast_join_started_ms = millis();
+        }
+        else
+            WiFi.begin(m_ssid, m_password);
+        m_started = true;
+        apply_power_save();
+    }
+
+    void loop() override
+    {
+        if (!m_fast_join)
+            return;
+
+        if (WiFi.status() == WL_CONNECTED)
+            m_fast_join = false;
+        else if (millis() - m_fast_join_started_ms >= FAST_JOIN_TIMEOUT_MS)
+        {
+            ESP_LOGW(NETWORK_LOG_TAG, "Joining with the cached access point failed, scanning");
+            reconnect();
+        }
+    }
+
+    bool connected() override
+    {
+        return WiFi.status() == WL_CONNECTED;
+    }
+
+    // The access point may have changed, so this always scans
+    void reconnect() override
+    {
+        m_fast_join = false;
+        WiFi.disconnect();
+        WiFi.begin(m_ssid, m_password);
+    }
+
+    // The modem sleeps between DTIM beacons by default, power save sleeps for the listen interval of the station
+    void set_power_save(bool enabled) override
+    {
+        m_power_save = enabled;
+        if (m_started)
+            apply_power_save();
+    }
+
+  private:
+    void apply_power_save()
+    {
+        WiFi.setSleep(m_power_save ? WIFI_PS_MAX_MODEM : WIFI_PS_MIN_MODEM);
+    }
+
+  private:
+    const std::string m_hostname;
+    const char *m_ssid;
+    const char *m_password;
+    bool m_power_save = false;
+    bool m_started = false;
+    NetworkCache m_cache;
+    bool m_fast_join = false;
+    uint32_t m_fast_join_started_ms = 0;
+};
+
+} // namespace hal
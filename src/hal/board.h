@@ -0,0 +1,16 @@
+#pragma once
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+
+namespace hal
+{
+
+#ifdef ARDUINO_BOARD
+constexpr const char *BOARD_NAME = ARDUINO_BOARD;
+#else
+constexpr const char *BOARD_NAME = "native";
+#endif
+
+} // namespace hal
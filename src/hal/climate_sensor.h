@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+namespace hal
+{
+
+struct ClimateReading
+{
+    float temperature = NAN;
+    float humidity = NAN;
+};
+
+enum class ClimateReadStatus : uint8_t
+{
+    IDLE,
+    BUSY,
+    DONE,
+    FAILED
+};
+
+// Asynchronous sensor, one transaction reads both values
+class ClimateSensor
+{
+  public:
+    virtual ~ClimateSensor() = default;
+
+    virtual void begin() = 0;
+
+    // Returns false while the previous transaction is still running
+    virtual bool start_read() = 0;
+
+    // Never blocks. DONE and FAILED are reported once and end the transaction, IDLE means none is running.
+    virtual ClimateReadStatus poll(ClimateReading &reading) = 0;
+};
+
+} // namespace hal
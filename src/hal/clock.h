@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+
+namespace hal
+{
+
+class Clock
+{
+  public:
+    virtual ~Clock() = default;
+
+    virtual uint32_t millis() = 0;
+    virtual uint32_t micros() = 0;
+    // CPU cycle counter, cheaper than micros() and wraps after a few seconds
+    virtual uint32_t cycles() = 0;
+    virtual void delay(uint32_t ms) = 0;
+};
+
+} // namespace hal
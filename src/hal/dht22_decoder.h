@@ -0,0 +1,61 @@
+#pragma once
+
+#include "hal/climate_sensor.h"
+
+#include <cstdint>
+
+namespace hal
+{
+
+// Decodes a DHT22 / AM2302 frame from the captured line levels. Every bit is a 50 us low pulse followed by a high
+// pulse of ~27 us for 0 or ~70 us for 1, the 40 data bits are the last high pulses of the frame, so a capture that
+// starts late or includes the 80 us response pulse still decodes.
+class Dht22Decoder final
+{
+  public:
+    constexpr static const uint32_t ONE_THRESHOLD_US = 48;
+    constexpr static const uint32_t MAX_PULSE_US = 120;
+    constexpr static const unsigned int FRAME_BITS = 40;
+
+    void reset()
+    {
+        m_bits = 0;
+        m_count = 0;
+    }
+
+    void add(bool level, uint32_t duration_us)
+    {
+        // Zero and overlong durations are the idle line around the frame
+        if (!level || duration_us == 0 || duration_us > MAX_PULSE_US)
+            return;
+
+        m_bits = (m_bits << 1) | (duration_us > ONE_THRESHOLD_US ? 1 : 0);
+        ++m_count;
+    }
+
+    bool finish(ClimateReading &reading) const
+    {
+        if (m_count < FRAME_BITS)
+            return false;
+
+        uint8_t bytes[5];
+        for (int i = 0; i < 5; ++i)
+            bytes[i] = static_cast<uint8_t>(m_bits >> (8 * (4 - i)));
+
+        if (static_cast<uint8_t>(bytes[0] + bytes[1] + bytes[2] + bytes[3]) != bytes[4])
+            return false;
+
+        reading.humidity = ((bytes[0] << 8) | bytes[1]) * 0.1f;
+        reading.temperature = (((bytes[2] & 0x7f) << 8) | bytes[3]) * 0.1f;
+        if (bytes[2] & 0x80)
+            reading.temperature = -reading.temperature;
+
+        return true;
+    }
+
+  private:
+    uint64_t m_bits = 0;
+    unsigned int m_count = 0;
+};
+
+} // namespace hal
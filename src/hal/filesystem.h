@@ -0,0 +1,11 @@
+#pragma once
+
+namespace hal
+{
+
+// Mounts the data partition (LittleFS on the device, formatted on first use). Files are then accessed with stdio
+// under filesystem_root() on both the device and the native build.
+bool mount_filesystem();
+const char *filesystem_root();
+
+} // namespace hal
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace hal
+{
+
+constexpr static const size_t FIRMWARE_SHA256_SIZE = 32;
+
+enum class FirmwareState : uint8_t
+{
+    // Confirmed, or the bootloader does not roll back
+    VALID,
+    // First boot of a new image, the bootloader rolls back unless it is confirmed
+    PENDING_VERIFY
+};
+
+FirmwareState get_firmware_state();
+// Digest the build appended to the running image, false if it has none
+bool get_running_firmware_digest(uint8_t (&digest)[FIRMWARE_SHA256_SIZE]);
+// Keeps the running image
+void confirm_firmware();
+// Boots the previous image, does not return
+void reject_firmware();
+// Does not return
+void restart();
+
+// Streams an image into the inactive app partition, decompressing a zlib stream on the way. The hash covers the
+// decompressed image, finish() only makes the partition bootable if it matches.
+class FirmwareWriter final
+{
+  public:
+    FirmwareWriter();
+    ~FirmwareWriter();
+    FirmwareWriter(const FirmwareWriter &) = delete;
+    FirmwareWriter &operator=(const FirmwareWriter &) = delete;
+
+    // A window of 0 bits means the data is not compressed. False if there is no partition the image fits into.
+    bool begin(uint32_t image_size, uint8_t window_bits);
+    bool write(const uint8_t *data, size_t size);
+    bool finish(const uint8_t (&sha256)[FIRMWARE_SHA256_SIZE]);
+    void abort();
+
+    // Decompressed bytes written so far
+    uint32_t get_written() const;
+
+  private:
+    struct Impl;
+    std::unique_ptr<Impl> m_impl;
+};
+
+// HTTP GET whose body is read in chunks
+class HttpDownload final
+{
+  public:
+    HttpDownload();
+    ~HttpDownload();
+    HttpDownload(const HttpDownload &) = delete;
+    HttpDownload &operator=(const HttpDownload &) = delete;
+
+    // False unless the server answered with 200
+    bool open(const char *url);
+    // Bytes read, 0 if none arrived within the timeout and -1 once the body ended or the connection broke
+    int read(uint8_t *buffer, size_t size, uint32_t timeout_ms);
+    void close();
+
+  private:
+    struct Impl;
+    std::unique_ptr<Impl> m_impl;
+};
+
+} // namespace hal
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+
+namespace hal
+{
+
+enum class PinMode : uint8_t
+{
+    DIGITAL_INPUT,
+    DIGITAL_OUTPUT,
+    INPUT_PULL_UP,
+    INPUT_PULL_DOWN
+};
+
+// Runs in interrupt context on the device, must not block
+typedef void (*InterruptHandler)(void *argument);
+
+class Gpio
+{
+  public:
+    virtual ~Gpio() = default;
+
+    virtual void pin_mode(int pin, PinMode mode) = 0;
+    virtual int digital_read(int pin) = 0;
+    virtual void digital_write(int pin, int value) = 0;
+    virtual void analog_write(int pin, int value) = 0;
+
+    // The handler is called on both edges
+    virtual void attach_interrupt(int pin, InterruptHandler handler, void *argument) = 0;
+    // After attach_interrupt(), any change of the pin wakes the chip from light sleep and still reaches the handler.
+    // False if the pin can not.
+    virtual bool enable_wakeup(int pin) = 0;
+};
+
+} // namespace hal
@@ -0,0 +1,43 @@
+#pragma once
+
+#ifdef ARDUINO
+
+#include <esp_log.h>
+
+#else
+
+// Stand-in for the ESP-IDF log macros on the native build. Output goes through the same replaceable vprintf hook as
+// on the device, so esp_log_ex works unchanged.
+
+#include <cstdarg>
+#include <cstdint>
+
+#ifndef LOG_LOCAL_LEVEL
+#define LOG_LOCAL_LEVEL 3
+#endif
+
+typedef int (*vprintf_like_t)(const char *, va_list);
+
+vprintf_like_t esp_log_set_vprintf(vprintf_like_t func);
+uint32_t esp_log_timestamp();
+
+namespace hal
+{
+int log_printf(const char *format, ...) __attribute__((format(printf, 1, 2)));
+} // namespace hal
+
+#define NOSYNA_NATIVE_LOG(level, letter, tag, format, ...)                                                             \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (LOG_LOCAL_LEVEL >= level)                                                                                  \
+            hal::log_printf(letter " (%u) %s: " format "\n", static_cast<unsigned int>(esp_log_timestamp()), tag,     \
+                            ##__VA_ARGS__);                                                                            \
+    } while (0)
+
+#define ESP_LOGE(tag, format, ...) NOSYNA_NATIVE_LOG(1, "E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) NOSYNA_NATIVE_LOG(2, "W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) NOSYNA_NATIVE_LOG(3, "I", tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) NOSYNA_NATIVE_LOG(4, "D", tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) NOSYNA_NATIVE_LOG(5, "V", tag, format, ##__VA_ARGS__)
+
+#endif
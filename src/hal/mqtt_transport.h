@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+namespace hal
+{
+
+typedef std::function<void(char *topic, uint8_t *payload, unsigned int length)> MqttCallback;
+// Called when the broker acknowledged a message published with publish_reliable()
+typedef std::function<void(uint16_t packet_id)> MqttAckCallback;
+
+class MqttTransport
+{
+  public:
+    virtual ~MqttTransport() = default;
+
+    virtual void set_server(const char *hostname, uint16_t port) = 0;
+    virtual void set_callback(MqttCallback callback) = 0;
+    virtual void set_ack_callback(MqttAckCallback callback) = 0;
+
+    virtual bool connect(const char *client_id, const char *user, const char *password) = 0;
+    virtual bool connected() = 0;
+    // Inbound messages and acknowledgements are only delivered from here
+    virtual void loop() = 0;
+
+    // QoS 0, true once the message was handed to the connection
+    virtual bool publish(const char *topic, const uint8_t *payload, size_t length, bool retained) = 0;
+    // QoS 1, returns the packet id its acknowledgement is reported with and 0 if the message could not be sent. The
+    // caller publishes it again if the acknowledgement does not arrive in time.
+    virtual uint16_t publish_reliable(const char *topic, const uint8_t *payload, size_t length, bool retained) = 0;
+    virtual bool subscribe(const char *topic) = 0;
+};
+
+} // namespace hal
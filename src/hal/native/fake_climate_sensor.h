@@ -0,0 +1,66 @@
+#pragma once
+
+#include "hal/climate_sensor.h"
+
+#include <cmath>
+
+namespace hal
+{
+
+// Completes a transaction on the first poll() after start_read()
+class FakeClimateSensor final : public ClimateSensor
+{
+  public:
+    void begin() override
+    {
+    }
+
+    bool start_read() override
+    {
+        if (m_busy)
+            return false;
+
+        m_busy = true;
+        ++m_reads;
+        return true;
+    }
+
+    ClimateReadStatus poll(ClimateReading &reading) override
+    {
+        if (!m_busy)
+            return ClimateReadStatus::IDLE;
+
+        m_busy = false;
+        if (m_fail)
+            return ClimateReadStatus::FAILED;
+
+        reading.temperature = m_temperature;
+        reading.humidity = m_humidity;
+        return ClimateReadStatus::DONE;
+    }
+
+    void set(float temperature, float humidity)
+    {
+        m_temperature = temperature;
+        m_humidity = humidity;
+    }
+
+    void set_fail(bool fail)
+    {
+        m_fail = fail;
+    }
+
+    unsigned int get_reads() const
+    {
+        return m_reads;
+    }
+
+  private:
+    float m_temperature = NAN;
+    float m_humidity = NAN;
+    bool m_fail = false;
+    bool m_busy = false;
+    unsigned int m_reads = 0;
+};
+
+} // namespace hal
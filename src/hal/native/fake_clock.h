@@ -0,0 +1,47 @@
+#pragma once
+
+#include "hal/clock.h"
+#include "hal/system.h"
+
+namespace hal
+{
+
+class FakeClock final : public Clock
+{
+  public:
+    uint32_t millis() override
+    {
+        return static_cast<uint32_t>(m_now_us / 1000);
+    }
+
+    uint32_t micros() override
+    {
+        return static_cast<uint32_t>(m_now_us);
+    }
+
+    // Counts at FAKE_CPU_FREQUENCY_MHZ
+    uint32_t cycles() override
+    {
+        return static_cast<uint32_t>(m_now_us * FAKE_CPU_FREQUENCY_MHZ);
+    }
+
+    void delay(uint32_t ms) override
+    {
+        advance(ms);
+    }
+
+    void advance(uint32_t ms)
+    {
+        m_now_us += static_cast<uint64_t>(ms) * 1000;
+    }
+
+    void advance_us(uint32_t us)
+    {
+        m_now_us += us;
+    }
+
+  private:
+    uint64_t m_now_us = 0;
+};
+
+} // namespace hal
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "hal/firmware.h"
+
+namespace hal
+{
+
+// What the native firmware functions were asked to do. reject_firmware() and restart() return there.
+struct FakeFirmwareCalls
+{
+    unsigned int confirms = 0;
+    unsigned int rejects = 0;
+    unsigned int restarts = 0;
+};
+
+// The state the running image reports, also clears the calls
+void set_fake_firmware_state(FirmwareState state);
+const FakeFirmwareCalls &get_fake_firmware_calls();
+
+} // namespace hal
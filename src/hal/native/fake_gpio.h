@@ -0,0 +1,84 @@
+#pragma once
+
+#include "hal/gpio.h"
+
+namespace hal
+{
+
+class FakeGpio final : public Gpio
+{
+  public:
+    constexpr static const int PIN_COUNT = 40;
+
+    void pin_mode(int pin, PinMode mode) override
+    {
+        m_modes[pin] = mode;
+    }
+
+    int digital_read(int pin) override
+    {
+        return m_values[pin];
+    }
+
+    void digital_write(int pin, int value) override
+    {
+        m_values[pin] = value;
+    }
+
+    void analog_write(int pin, int value) override
+    {
+        m_values[pin] = value;
+        ++m_analog_writes;
+    }
+
+    void attach_interrupt(int pin, InterruptHandler handler, void *argument) override
+    {
+        m_handlers[pin] = handler;
+        m_arguments[pin] = argument;
+    }
+
+    bool enable_wakeup(int pin) override
+    {
+        m_wakeups[pin] = true;
+        return m_handlers[pin] != nullptr;
+    }
+
+    // Changes an input level and runs its interrupt handler like an edge on the device would
+    void set_input(int pin, int value)
+    {
+        const bool changed = m_values[pin] != value;
+        m_values[pin] = value;
+        if (changed && m_handlers[pin] != nullptr)
+            m_handlers[pin](m_arguments[pin]);
+    }
+
+    int get_value(int pin) const
+    {
+        return m_values[pin];
+    }
+
+    PinMode get_mode(int pin) const
+    {
+        return m_modes[pin];
+    }
+
+    unsigned int get_analog_writes() const
+    {
+        return m_analog_writes;
+    }
+
+    bool is_wakeup_enabled(int pin) const
+    {
+        return m_wakeups[pin];
+    }
+
+  private:
+    PinMode m_modes[PIN_COUNT] = {};
+    int m_values[PIN_COUNT] = {};
+    InterruptHandler m_handlers[PIN_COUNT] = {};
+    void *m_arguments[PIN_COUNT] = {};
+    bool m_wakeups[PIN_COUNT] = {};
+    unsigned int m_analog_writes = 0;
+};
+
+} // namespace hal
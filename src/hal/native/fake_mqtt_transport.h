@@ -0,0 +1,181 @@
+#pragma once
+
+#include "hal/mqtt_transport.h"
+
+#include <algorithm>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace hal
+{
+
+// Broker stand-in that records everything the client sends and lets the caller inject inbound messages, make publishes
+// fail and hold QoS 1 acknowledgements back. Acknowledgements are delivered from loop() like on the device.
+class FakeMqttTransport final : public MqttTransport
+{
+  public:
+    struct Message
+    {
+        std::string topic;
+        std::string payload;
+        bool retained;
+        // 0 for QoS 0
+        uint16_t packet_id = 0;
+    };
+
+    void set_server(const char *hostname, uint16_t port) override
+    {
+        m_hostname = hostname;
+        m_port = port;
+    }
+
+    void set_callback(MqttCallback callback) override
+    {
+        m_callback = callback;
+    }
+
+    void set_ack_callback(MqttAckCallback callback) override
+    {
+        m_ack_callback = callback;
+    }
+
+    bool connect(const char *client_id, const char *, const char *) override
+    {
+        ++m_connects;
+        m_client_id = client_id;
+        m_connected = m_accept_connections;
+        return m_connected;
+    }
+
+    bool connected() override
+    {
+        return m_connected;
+    }
+
+    void loop() override
+    {
+        if (!m_hold_acks)
+            ack_all();
+    }
+
+    bool publish(const char *topic, const uint8_t *payload, size_t length, bool retained) override
+    {
+        if (!m_connected || m_fail_publishes)
+            return false;
+
+        m_published.push_back({topic, std::string(reinterpret_cast<const char *>(payload), length), retained});
+        return true;
+    }
+
+    uint16_t publish_reliable(const char *topic, const uint8_t *payload, size_t length, bool retained) override
+    {
+        if (!publish(topic, payload, length, retained))
+            return 0;
+
+        if (++m_packet_id == 0)
+            m_packet_id = 1;
+        m_published.back().packet_id = m_packet_id;
+        m_unacknowledged.push_back(m_packet_id);
+        return m_packet_id;
+    }
+
+    bool subscribe(const char *topic) override
+    {
+        m_subscriptions.insert(topic);
+        return m_connected;
+    }
+
+    void deliver(const std::string &topic, const std::string &payload)
+    {
+        std::string topic_copy = topic;
+        std::string payload_copy = payload;
+        m_callback(&topic_copy[0], reinterpret_cast<uint8_t *>(&payload_copy[0]), payload_copy.size());
+    }
+
+    void set_accept_connections(bool accept)
+    {
+        m_accept_connections = accept;
+    }
+
+    // Acknowledgements that were held back are lost with the connection
+    void drop_connection()
+    {
+        m_connected = false;
+        m_unacknowledged.clear();
+    }
+
+    // The connection stays up, but nothing can be written
+    void set_fail_publishes(bool fail)
+    {
+        m_fail_publishes = fail;
+    }
+
+    // Acknowledgements wait for ack() or ack_all() instead of the next loop()
+    void set_hold_acks(bool hold)
+    {
+        m_hold_acks = hold;
+    }
+
+    void ack(uint16_t packet_id)
+    {
+        m_unacknowledged.erase(std::remove(m_unacknowledged.begin(), m_unacknowledged.end(), packet_id),
+                               m_unacknowledged.end());
+        if (m_ack_callback)
+            m_ack_callback(packet_id);
+    }
+
+    void ack_all()
+    {
+        const auto unacknowledged = m_unacknowledged;
+        m_unacknowledged.clear();
+        for (const auto packet_id : unacknowledged)
+        {
+            if (m_ack_callback)
+                m_ack_callback(packet_id);
+        }
+    }
+
+    const std::vector<uint16_t> &get_unacknowledged() const
+    {
+        return m_unacknowledged;
+    }
+
+    const std::vector<Message> &get_published() const
+    {
+        return m_published;
+    }
+
+    void clear_published()
+    {
+        m_published.clear();
+    }
+
+    const std::set<std::string> &get_subscriptions() const
+    {
+        return m_subscriptions;
+    }
+
+    unsigned int get_connects() const
+    {
+        return m_connects;
+    }
+
+  private:
+    MqttCallback m_callback;
+    MqttAckCallback m_ack_callback;
+    bool m_fail_publishes = false;
+    bool m_hold_acks = false;
+    uint16_t m_packet_id = 0;
+    std::vector<uint16_t> m_unacknowledged;
+    std::string m_hostname;
+    uint16_t m_port = 0;
+    std::string m_client_id;
+    bool m_connected = false;
+    bool m_accept_connections = true;
+    unsigned int m_connects = 0;
+    std::vector<Message> m_published;
+    std::set<std::string> m_subscriptions;
+};
+
+} // namespace hal
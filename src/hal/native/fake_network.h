@@ -0,0 +1,73 @@
+#pragma once
+
+#include "hal/network.h"
+
+namespace hal
+{
+
+class FakeNetwork final : public Network
+{
+  public:
+    void set_cache(const NetworkCache &cache) override
+    {
+        m_cache = cache;
+    }
+
+    bool get_cache(NetworkCache &cache) override
+    {
+        if (!m_connected)
+            return false;
+        cache = m_cache;
+        return true;
+    }
+
+    void begin() override
+    {
+        m_connected = m_available;
+    }
+
+    void loop() override
+    {
+    }
+
+    bool connected() override
+    {
+        return m_connected;
+    }
+
+    void reconnect() override
+    {
+        ++m_reconnects;
+        m_connected = m_available;
+    }
+
+    void set_power_save(bool enabled) override
+    {
+        m_power_save = enabled;
+    }
+
+    void set_available(bool available)
+    {
+        m_available = available;
+        m_connected = available;
+    }
+
+    unsigned int get_reconnects() const
+    {
+        return m_reconnects;
+    }
+
+    bool get_power_save() const
+    {
+        return m_power_save;
+    }
+
+  private:
+    bool m_available = true;
+    bool m_connected = false;
+    unsigned int m_reconnects = 0;
+    bool m_power_save = false;
+    NetworkCache m_cache;
+};
+
+} // namespace hal
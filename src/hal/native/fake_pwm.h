@@ -0,0 +1,67 @@
+#pragma once
+
+#include "hal/pwm.h"
+
+#include <vector>
+
+namespace hal
+{
+
+// Records the fade schedule, fades complete instantly
+class FakePwm final : public Pwm
+{
+  public:
+    constexpr static const int CHANNELS = 16;
+
+    struct Fade
+    {
+        int channel;
+        uint32_t duty;
+        uint32_t duration_ms;
+    };
+
+    int attach(int pin, const PwmConfig &config) override
+    {
+        if (m_count == CHANNELS)
+            return -1;
+
+        m_pins[m_count] = pin;
+        m_configs[m_count] = config;
+        return m_count++;
+    }
+
+    void fade(int channel, uint32_t duty, uint32_t duration_ms) override
+    {
+        m_duties[channel] = duty;
+        m_fades.push_back(Fade{channel, duty, duration_ms});
+    }
+
+    uint32_t get_duty(int channel) const
+    {
+        return m_duties[channel];
+    }
+
+    int get_pin(int channel) const
+    {
+        return m_pins[channel];
+    }
+
+    const PwmConfig &get_config(int channel) const
+    {
+        return m_configs[channel];
+    }
+
+    const std::vector<Fade> &get_fades() const
+    {
+        return m_fades;
+    }
+
+  private:
+    int m_count = 0;
+    int m_pins[CHANNELS] = {};
+    PwmConfig m_configs[CHANNELS] = {};
+    uint32_t m_duties[CHANNELS] = {};
+    std::vector<Fade> m_fades;
+};
+
+} // namespace hal
@@ -0,0 +1,22 @@
+#include "hal/filesystem.h"
+
+#include <cstdlib>
+#include <sys/stat.h>
+
+namespace hal
+{
+
+// NOSYNA_DATA_DIR points the native build to another directory, e.g. a temporary one per test
+const char *filesystem_root()
+{
+    const char *root = getenv("NOSYNA_DATA_DIR");
+    return root != nullptr ? root : "nosyna_data";
+}
+
+bool mount_filesystem()
+{
+    mkdir(filesystem_root(), 0755);
+    return true;
+}
+
+} // namespace hal
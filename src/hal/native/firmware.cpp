@@ -0,0 +1,110 @@
+#include "hal/native/fake_firmware.h"
+
+namespace hal
+{
+
+// The native build runs a single image, updates always fail and restarts are only counted
+
+static FirmwareState g_state = FirmwareState::VALID;
+static FakeFirmwareCalls g_calls;
+
+void set_fake_firmware_state(FirmwareState state)
+{
+    g_state = state;
+    g_calls = FakeFirmwareCalls();
+}
+
+const FakeFirmwareCalls &get_fake_firmware_calls()
+{
+    return g_calls;
+}
+
+FirmwareState get_firmware_state()
+{
+    return g_state;
+}
+
+bool get_running_firmware_digest(uint8_t (&)[FIRMWARE_SHA256_SIZE])
+{
+    return false;
+}
+
+void confirm_firmware()
+{
+    g_state = FirmwareState::VALID;
+    ++g_calls.confirms;
+}
+
+void reject_firmware()
+{
+    ++g_calls.rejects;
+}
+
+void restart()
+{
+    ++g_calls.restarts;
+}
+
+struct FirmwareWriter::Impl
+{
+};
+
+FirmwareWriter::FirmwareWriter() : m_impl(new Impl)
+{
+}
+
+FirmwareWriter::~FirmwareWriter()
+{
+}
+
+bool FirmwareWriter::begin(uint32_t, uint8_t)
+{
+    return false;
+}
+
+bool FirmwareWriter::write(const uint8_t *, size_t)
+{
+    return false;
+}
+
+bool FirmwareWriter::finish(const uint8_t (&)[FIRMWARE_SHA256_SIZE])
+{
+    return false;
+}
+
+void FirmwareWriter::abort()
+{
+}
+
+uint32_t FirmwareWriter::get_written() const
+{
+    return 0;
+}
+
+struct HttpDownload::Impl
+{
+};
+
+HttpDownload::HttpDownload() : m_impl(new Impl)
+{
+}
+
+HttpDownload::~HttpDownload()
+{
+}
+
+bool HttpDownload::open(const char *)
+{
+    return false;
+}
+
+int HttpDownload::read(uint8_t *, size_t, uint32_t)
+{
+    return -1;
+}
+
+void HttpDownload::close()
+{
+}
+
+} // namespace hal
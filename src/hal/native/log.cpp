@@ -0,0 +1,34 @@
+#include "hal/log.h"
+
+#include <chrono>
+#include <cstdio>
+
+static vprintf_like_t g_vprintf = vprintf;
+
+vprintf_like_t esp_log_set_vprintf(vprintf_like_t func)
+{
+    const auto previous = g_vprintf;
+    g_vprintf = func;
+    return previous;
+}
+
+uint32_t esp_log_timestamp()
+{
+    static const auto start = std::chrono::steady_clock::now();
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count());
+}
+
+namespace hal
+{
+
+int log_printf(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    const int result = g_vprintf(format, args);
+    va_end(args);
+    return result;
+}
+
+} // namespace hal
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "hal/nvs.h"
+
+#include <map>
+#include <string>
+
+namespace hal
+{
+
+class MemoryNvs final : public Nvs
+{
+  public:
+    bool get_bool(const char *key, bool default_value) override
+    {
+        const auto p = m_values.find(key);
+        return p == m_values.end() ? default_value : p->second != 0;
+    }
+
+    int32_t get_int(const char *key, int32_t default_value) override
+    {
+        const auto p = m_values.find(key);
+        return p == m_values.end() ? default_value : p->second;
+    }
+
+    void put_bool(const char *key, bool value) override
+    {
+        m_values[key] = value ? 1 : 0;
+        ++m_writes;
+    }
+
+    void put_int(const char *key, int32_t value) override
+    {
+        m_values[key] = value;
+        ++m_writes;
+    }
+
+    bool commit() override
+    {
+        ++m_commits;
+        return !m_fail_commits;
+    }
+
+    unsigned int get_writes() const
+    {
+        return m_writes;
+    }
+
+    unsigned int get_commits() const
+    {
+        return m_commits;
+    }
+
+    void set_fail_commits(bool fail)
+    {
+        m_fail_commits = fail;
+    }
+
+  private:
+    std::map<std::string, int32_t> m_values;
+    unsigned int m_writes = 0;
+    unsigned int m_commits = 0;
+    bool m_fail_commits = false;
+};
+
+} // namespace hal
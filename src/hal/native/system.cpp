@@ -0,0 +1,21 @@
+#include "hal/system.h"
+
+namespace hal
+{
+
+HeapStats get_heap_stats()
+{
+    return HeapStats();
+}
+
+uint32_t cpu_frequency_mhz()
+{
+    return FAKE_CPU_FREQUENCY_MHZ;
+}
+
+bool configure_power(const PowerConfig &)
+{
+    return false;
+}
+
+} // namespace hal
@@ -0,0 +1,58 @@
+#include "hal/task.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace hal
+{
+
+void start_task(const char *, TaskFunction function, void *argument, uint32_t, unsigned int, int)
+{
+    std::thread(function, argument).detach();
+}
+
+void end_task()
+{
+}
+
+void sleep_ms(uint32_t ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+struct Event::Impl
+{
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool notified = false;
+};
+
+Event::Event() : m_impl(new Impl)
+{
+}
+
+Event::~Event()
+{
+}
+
+bool Event::wait(uint32_t timeout_ms)
+{
+    std::unique_lock<std::mutex> lock(m_impl->mutex);
+    const bool notified = m_impl->condition.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                                                     [this]() { return m_impl->notified; });
+    m_impl->notified = false;
+    return notified;
+}
+
+void Event::notify()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_impl->mutex);
+        m_impl->notified = true;
+    }
+    m_impl->condition.notify_one();
+}
+
+} // namespace hal
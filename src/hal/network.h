@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+
+namespace hal
+{
+
+// What the station needs to join its access point again without a scan. The address always comes from DHCP, so the
+// lease is renewed as usual.
+struct NetworkCache
+{
+    int32_t channel = 0;
+    uint8_t bssid[6] = {};
+
+    bool valid() const
+    {
+        return channel != 0;
+    }
+};
+
+class Network
+{
+  public:
+    virtual ~Network() = default;
+
+    // Before begin(). The next begin() joins with the cache and falls back to a scan if that fails.
+    virtual void set_cache(const NetworkCache &cache) = 0;
+    // Parameters of the current connection, false while there is none
+    virtual bool get_cache(NetworkCache &cache) = 0;
+
+    virtual void begin() = 0;
+    // Only called by the task that drives the connection, falls back to a scan when the cached join fails
+    virtual void loop() = 0;
+    // A plain status check, safe from any task
+    virtual bool connected() = 0;
+    virtual void reconnect() = 0;
+    // Modem sleep between beacons, trades command latency for current
+    virtual void set_power_save(bool enabled) = 0;
+};
+
+} // namespace hal
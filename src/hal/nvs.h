@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+
+namespace hal
+{
+
+// Values written with put_* may be buffered until commit()
+class Nvs
+{
+  public:
+    virtual ~Nvs() = default;
+
+    virtual bool get_bool(const char *key, bool default_value) = 0;
+    virtual int32_t get_int(const char *key, int32_t default_value) = 0;
+    virtual void put_bool(const char *key, bool value) = 0;
+    virtual void put_int(const char *key, int32_t value) = 0;
+    virtual bool commit() = 0;
+};
+
+} // namespace hal
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+
+namespace hal
+{
+
+struct PwmConfig
+{
+    uint32_t frequency_hz = 5000;
+    uint8_t resolution_bits = 13;
+};
+
+class Pwm
+{
+  public:
+    virtual ~Pwm() = default;
+
+    // Returns the channel driving the pin, or -1 if none is available
+    virtual int attach(int pin, const PwmConfig &config) = 0;
+
+    // Moves the duty to the target within duration_ms without using the CPU, 0 sets it right away
+    virtual void fade(int channel, uint32_t duty, uint32_t duration_ms) = 0;
+};
+
+} // namespace hal
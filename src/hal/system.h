@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+
+namespace hal
+{
+
+// The native build has no heap statistics and its fake clock counts cycles at this frequency
+constexpr static const uint32_t FAKE_CPU_FREQUENCY_MHZ = 240;
+
+struct HeapStats
+{
+    uint32_t free_bytes = 0;
+    // Lowest free heap since boot
+    uint32_t min_free_bytes = 0;
+    // Largest single allocation that can succeed, far below free_bytes when the heap is fragmented
+    uint32_t largest_free_block = 0;
+};
+
+struct PowerConfig
+{
+    uint32_t max_cpu_mhz = 240;
+    uint32_t min_cpu_mhz = 80;
+    // The chip light sleeps whenever every task waits, wakeups come from timers, GPIOs and the WiFi
+    bool light_sleep = true;
+};
+
+HeapStats get_heap_stats();
+uint32_t cpu_frequency_mhz();
+// Frequency scaling and automatic light sleep, false where the SDK was built without power management
+bool configure_power(const PowerConfig &config);
+
+} // namespace hal
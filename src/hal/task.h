@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+namespace hal
+{
+
+typedef void (*TaskFunction)(void *argument);
+
+constexpr static const int ANY_CORE = -1;
+
+// FreeRTOS task on the device, detached std::thread on the native build where priority and core are ignored
+void start_task(const char *name, TaskFunction function, void *argument, uint32_t stack_size, unsigned int priority,
+                int core = ANY_CORE);
+
+// Called last by a task function, a FreeRTOS task must not return
+void end_task();
+
+void sleep_ms(uint32_t ms);
+
+// Lets a task sleep until a timeout or until something happens for it. A notify() while the task is not waiting makes
+// the next wait() return right away.
+class Event final
+{
+  public:
+    Event();
+    ~Event();
+    Event(const Event &) = delete;
+    Event &operator=(const Event &) = delete;
+
+    // Returns false on timeout
+    bool wait(uint32_t timeout_ms);
+    // Safe from other tasks and interrupt handlers
+    void notify();
+
+  private:
+    struct Impl;
+    std::unique_ptr<Impl> m_impl;
+};
+
+} // namespace hal
@@ -1,46 +1,154 @@
 #include "config.h"
 #include "secrets.h"
 
+#include "boot/fast_boot.h"
 #include "controls/button.h"
 #include "controls/common.h"
+#include "controls/entity_registry.h"
 #include "controls/light.h"
+#include "controls/switch.h"
 #include "controls/temperature_and_humidity.h"
 
 #include "esp_log_ex/esp_log_ex.h"
+#include "hal/arduino/arduino_clock.h"
+#include "hal/arduino/arduino_gpio.h"
+#include "hal/arduino/esp_mqtt_transport.h"
+#include "hal/arduino/esp_nvs.h"
+#include "hal/arduino/ledc_pwm.h"
+#include "hal/arduino/rmt_dht22_sensor.h"
+#include "hal/arduino/wifi_network.h"
+#include "hal/filesystem.h"
+#include "hal/system.h"
+#include "hal/task.h"
 #include "mqtt/client.h"
+#include "ota/ota_updater.h"
+#include "power/power_manager.h"
+#include "scheduler/scheduler.h"
+#include "storage/settings_store.h"
+#include "telemetry/loop_profiler.h"
+#include "telemetry/telemetry.h"
 
 #include <ArduinoOTA.h>
-#include <PubSubClient.h>
 #include <WiFi.h>
 
+#include <atomic>
+
 constexpr const char *NOSYNA_LOG_TAG = "nosyna";
 
 constexpr static const char *LED_LIGHT_ID = "led";
 constexpr static const char *BUILTIN_LED_ID = "builtin_led";
 constexpr static const char *TEMPERATURE_SENSOR_ID = "temperature";
 constexpr static const char *HUMIDITY_SENSOR_ID = "humidity";
+// PER_ENTITY publishes bare values on a topic per entity instead of one JSON object for the device
+constexpr static const mqtt::StateLayout MQTT_STATE_LAYOUT = mqtt::StateLayout::SHARED;
+// POWER_SAVE light sleeps between deadlines, for battery powered devices
+constexpr static const PowerMode POWER_MODE = PowerMode::PERFORMANCE;
+
+// MQTT and OTA run on the core of the WiFi stack, the Arduino loop() with the controls keeps the other one
+constexpr static const int NETWORK_TASK_CORE = 0;
+constexpr static const uint32_t NETWORK_TASK_STACK_SIZE = 8192;
+constexpr static const unsigned int NETWORK_TASK_PRIORITY = 1;
+
+// Periods of the control tasks
+constexpr static const uint32_t SETTINGS_PERIOD_MS = 100;
+constexpr static const uint32_t ENTITIES_PERIOD_MS = 10;
+constexpr static const uint32_t TELEMETRY_PERIOD_MS = 100;
+constexpr static const uint32_t BOOT_PERIOD_MS = 10;
+constexpr static const uint32_t OTA_PERIOD_MS = 1000;
+constexpr static const uint32_t SUMMARY_PERIOD_MS = 100;
 
 std::string get_device_mac();
 
+// With rollback enabled in the bootloader, a new image stays unconfirmed until OtaUpdater has seen it connect
+extern "C" bool verifyRollbackLater()
+{
+    return true;
+}
+
+PowerOptions make_power_options()
+{
+    PowerOptions options;
+    options.mode = POWER_MODE;
+    return options;
+}
+
 const std::string g_mac = get_device_mac();
 const std::string g_device_id = "nosyna-" + g_mac;
 const std::string g_device_name = "Nosyna (" + g_mac + ")";
-mqtt::Client g_mqtt_client(MQTT_USERNAME, MQTT_PASSWORD, MQTT_HOSTNAME, MQTT_PORT, g_device_id, g_device_name);
-Preferences g_preferences;
 
-Light g_led(g_mqtt_client, g_preferences, LED_LIGHT_ID, "External LED", LED_GPIO);
-Button g_button(BUTTON_GPIO);
-TemperatureAndHumidity g_temperature_and_humidity(g_mqtt_client, TEMPERATURE_SENSOR_ID, HUMIDITY_SENSOR_ID,
-                                                  "Sensor T&H", TEMPERATURE_AND_HUMIDITY_GPIO);
+hal::ArduinoClock g_clock;
+hal::ArduinoGpio g_gpio;
+hal::EspNvs g_nvs;
+hal::LedcPwm g_pwm;
+// Larger publishes are written in parts, the buffer holds inbound commands and small publishes
+hal::EspMqttTransport g_mqtt_transport(512);
+hal::WifiNetwork g_network(g_device_id, WIFI_SSID, WIFI_PASSWORD);
+hal::RmtDht22Sensor g_climate_sensor(TEMPERATURE_AND_HUMIDITY_GPIO);
+// Wakes the control loop for button edges and MQTT commands
+hal::Event g_control_event;
+Scheduler g_scheduler(g_clock);
+PowerManager g_power(g_clock, g_network, make_power_options());
+
+mqtt::Client g_mqtt_client(g_mqtt_transport, g_network, g_clock, MQTT_USERNAME, MQTT_PASSWORD, MQTT_HOSTNAME,
+                           MQTT_PORT, g_device_id, g_device_name);
+SettingsStore g_settings(g_nvs, g_clock);
+LogSpool g_log_spool(g_clock, std::string(hal::filesystem_root()) + "/logs");
+
+Light g_led(g_mqtt_client, g_pwm, g_settings, LED_LIGHT_ID, "External LED", LED_GPIO);
+ButtonEngine g_buttons(g_gpio, g_clock);
+Button g_button(g_buttons, BUTTON_GPIO);
+TemperatureAndHumidity g_temperature_and_humidity(g_mqtt_client, g_clock, g_scheduler, g_climate_sensor,
+                                                  TEMPERATURE_SENSOR_ID, HUMIDITY_SENSOR_ID, "Sensor T&H",
+                                                  TEMPERATURE_AND_HUMIDITY_GPIO);
+// The built-in LED of the board is lit while the pin is low
+Switch g_builtin_led(g_mqtt_client, g_gpio, BUILTIN_LED_ID, "Built-in LED", "outlet", LED_BUILTIN, true);
+
+EntityRegistry<TemperatureAndHumidity, Switch, Light> g_entities(g_temperature_and_humidity, g_builtin_led, g_led);
+
+LoopProfiler g_control_profiler(g_clock, "control");
+LoopProfiler g_network_profiler(g_clock, "network");
+Telemetry g_telemetry(g_mqtt_client, g_clock);
+FastBoot g_fast_boot(g_clock, g_settings, g_network, g_mqtt_client);
+TaskId g_boot_task = INVALID_TASK_ID;
+TaskId g_summary_task = INVALID_TASK_ID;
+OtaUpdater g_ota(g_clock, g_mqtt_client, OTA_URL);
+
+// Telemetry adds its diagnostic sensors after the entities and FastBoot its settings, all share the fixed stores
+static_assert(decltype(g_entities)::STATE_SLOTS + Telemetry::STATE_SLOTS <= mqtt::StateStore::MAX_SLOTS,
+              "Entities and telemetry need more state slots than available");
+static_assert(decltype(g_entities)::SETTINGS + FastBoot::SETTINGS <= SettingsStore::MAX_SETTINGS,
+              "Entities and fast boot need more settings than available");
+
+struct ControlStages
+{
+    LoopStage commands;
+    LoopStage buttons;
+    LoopStage pwm;
+    LoopStage scheduler;
+} g_control_stages;
+
+struct NetworkStages
+{
+    LoopStage ota;
+    LoopStage mqtt;
+} g_network_stages;
+
+// Set by the network task when an OTA update starts, the settings belong to the control task
+std::atomic<bool> g_flush_settings{false};
 
 void setup_log()
 {
-    initialize_log();
-    add_log_appender([](const std::string &message) { Serial.println(message.c_str()); });
+    initialize_log(OverflowPolicy::DROP_OLDEST, &g_power);
+    add_log_appender([](const LogRecord &record) { Serial.println(record.text); });
 
     esp_log_level_set(NOSYNA_LOG_TAG, ESP_LOG_INFO);
     esp_log_level_set(CONTROLS_LOG_TAG, ESP_LOG_INFO);
     esp_log_level_set(MQTT_LOG_TAG, ESP_LOG_INFO);
+    esp_log_level_set(TELEMETRY_LOG_TAG, ESP_LOG_INFO);
+    esp_log_level_set(SCHEDULER_LOG_TAG, ESP_LOG_INFO);
+    esp_log_level_set(POWER_LOG_TAG, ESP_LOG_INFO);
+    esp_log_level_set(BOOT_LOG_TAG, ESP_LOG_INFO);
+    esp_log_level_set(OTA_LOG_TAG, ESP_LOG_INFO);
     esp_log_level_set("*", ESP_LOG_INFO);
 }
 
@@ -62,20 +170,11 @@ void setup_serial()
     Serial.begin(115200);
 }
 
-void setup_wifi(const char *ssid, const char *password)
+void setup_wifi(const char *ssid)
 {
-    WiFi.setHostname(g_device_id.c_str());
-    WiFi.mode(WIFI_STA);
-    WiFi.begin(ssid, password);
-
+    // The connection is completed in the background, mqtt::Client::loop() waits for it
     ESP_LOGI(NOSYNA_LOG_TAG, "Connecting to WIFI '%s'...", ssid);
-    while (WiFi.status() != WL_CONNECTED)
-    {
-        delay(500);
-        ESP_LOGI(NOSYNA_LOG_TAG, "Waiting WIFI...");
-    }
-
-    ESP_LOGI(NOSYNA_LOG_TAG, "Connected to WiFI: SSID='%s', IP=%s", ssid, WiFi.localIP().toString().c_str());
+    g_network.begin();
 }
 
 void setup_ota(const std::string &device_name)
@@ -86,7 +185,11 @@ void setup_ota(const std::string &device_name)
     ArduinoOTA.setPort(3232);
     // ArduinoOTA.setPassword("passwd");
 
-    ArduinoOTA.onStart([]() { ESP_LOGI(NOSYNA_LOG_TAG, "Start OTA update: command=%d", ArduinoOTA.getCommand()); });
+    ArduinoOTA.onStart([]() {
+        ESP_LOGI(NOSYNA_LOG_TAG, "Start OTA update: command=%d", ArduinoOTA.getCommand());
+        // The device restarts after the update
+        g_flush_settings.store(true);
+    });
     auto last_percent = std::make_shared<unsigned int>(-1);
     ArduinoOTA.onProgress([last_percent](unsigned int progress, unsigned int total) {
         unsigned int percent = 100 * progress / total;
@@ -97,73 +200,168 @@ void setup_ota(const std::string &device_name)
         }
     });
     ArduinoOTA.onEnd([]() { ESP_LOGI(NOSYNA_LOG_TAG, "OTA finisted"); });
-    ArduinoOTA.onError([](ota_error_t error) { ESP_LOGI(NOSYNA_LOG_TAG, "OTA error: error=%d"); });
+    ArduinoOTA.onError([](ota_error_t error) { ESP_LOGE(NOSYNA_LOG_TAG, "OTA error: error=%d", error); });
 
     ArduinoOTA.begin();
 
+    // Images pulled from the server are written in the background, the settings are saved before the restart
+    g_ota.set_on_restart([]() { g_settings.flush(); });
+    g_ota.setup();
+
     ESP_LOGI(NOSYNA_LOG_TAG, "OTA configured");
 }
 
 void setup_pins()
 {
-    pinMode(LED_BUILTIN, OUTPUT);
-    pinMode(LED_GPIO, OUTPUT);
     pinMode(BUTTON_GPIO, INPUT_PULLDOWN);
 }
 
 void setup_entities()
 {
-    g_temperature_and_humidity.setup();
-    g_mqtt_client.add_switch(BUILTIN_LED_ID, "Built-in LED", "outlet", [](bool on) {
-        if (on)
-        {
-            ESP_LOGI(NOSYNA_LOG_TAG, "Built-in LED ON");
-            digitalWrite(LED_BUILTIN, LOW);
-            g_mqtt_client.set(BUILTIN_LED_ID, mqtt::prop::STATE, true);
-        }
-        else
-        {
-            ESP_LOGI(NOSYNA_LOG_TAG, "Built-in LED OFF");
-            digitalWrite(LED_BUILTIN, HIGH);
-            g_mqtt_client.set(BUILTIN_LED_ID, mqtt::prop::STATE, false);
-        }
-    });
-
-    g_led.setup();
+    g_entities.setup();
 
     g_button.set_on_click([]() { g_led.toggle(); });
+    g_buttons.set_event(g_control_event);
+    g_buttons.setup();
+    if (g_power.get_mode() == PowerMode::POWER_SAVE)
+        g_buttons.enable_wakeup();
 }
 
 void log_device_summary()
 {
     std::string message;
-    message += "Device " + g_device_name + " is configured:\n";
+    message += "Device " + g_device_name + " is connected:\n";
     message += " - Board: " + std::string(ARDUINO_BOARD) + "\n";
     message += " - IP: " + std::string(WiFi.localIP().toString().c_str()) + "\n";
     message += " - MAC: " + std::string(WiFi.macAddress().c_str()) + "\n";
-    message += " - Flash memory: " + std::to_string(ESP.getFlashChipSize() / 1024) + " KB";
+    message += " - Flash memory: " + std::to_string(ESP.getFlashChipSize() / 1024) + " KB\n";
+    const auto heap = hal::get_heap_stats();
+    message += " - Heap: " + std::to_string(heap.free_bytes / 1024) + " KB free, " +
+               std::to_string(heap.largest_free_block / 1024) + " KB largest block";
     ESP_LOGI(NOSYNA_LOG_TAG, "%s", message.c_str());
 }
 
+void setup_scheduler()
+{
+    g_scheduler.add_periodic("settings", SETTINGS_PERIOD_MS, []() {
+        if (g_flush_settings.exchange(false))
+            g_settings.flush();
+        g_settings.loop();
+    });
+    if constexpr (decltype(g_entities)::HAS_LOOP)
+        g_scheduler.add_periodic("entities", ENTITIES_PERIOD_MS, []() { g_entities.loop(); });
+    g_scheduler.add_periodic("telemetry", TELEMETRY_PERIOD_MS, []() { g_telemetry.loop(); });
+    g_boot_task = g_scheduler.add_periodic("boot", BOOT_PERIOD_MS, []() {
+        if (!g_fast_boot.loop())
+            g_scheduler.cancel(g_boot_task);
+    });
+    g_scheduler.add_periodic("ota", OTA_PERIOD_MS, []() { g_ota.loop(); });
+    // WiFi connects in the background, the address is only known from then on. The network belongs to the network
+    // task, the client state can be read from here.
+    g_summary_task = g_scheduler.add_periodic("summary", SUMMARY_PERIOD_MS, []() {
+        if (!g_mqtt_client.is_connected())
+            return;
+        log_device_summary();
+        g_scheduler.cancel(g_summary_task);
+    });
+    ESP_LOGI(NOSYNA_LOG_TAG, "Scheduler runs %u tasks", static_cast<unsigned int>(g_scheduler.get_task_count()));
+}
+
+void setup_telemetry()
+{
+    g_control_stages.commands = g_control_profiler.add_stage("commands");
+    g_control_stages.buttons = g_control_profiler.add_stage("buttons");
+    g_control_stages.pwm = g_control_profiler.add_stage("pwm");
+    g_control_stages.scheduler = g_control_profiler.add_stage("scheduler");
+    g_network_stages.ota = g_network_profiler.add_stage("ota");
+    g_network_stages.mqtt = g_network_profiler.add_stage("mqtt");
+
+    g_telemetry.add_profiler(g_control_profiler);
+    g_telemetry.add_profiler(g_network_profiler);
+    g_telemetry.add_latency("button_latency", "Button latency", g_buttons.get_gesture_latency_us());
+    g_telemetry.add_latency("climate_read_latency", "Climate read latency",
+                            g_temperature_and_humidity.get_read_latency_us());
+    g_telemetry.add_counter("climate_read_failures", "Climate read failures",
+                            g_temperature_and_humidity.get_read_stats().failures);
+    g_telemetry.set_scheduler(g_scheduler);
+    g_telemetry.set_power_manager(g_power);
+    g_telemetry.setup();
+}
+
+void network_task(void *)
+{
+    for (;;)
+    {
+        g_network_profiler.start();
+        ArduinoOTA.handle();
+        g_network_profiler.mark(g_network_stages.ota);
+        g_mqtt_client.loop();
+        g_network_profiler.mark(g_network_stages.mqtt);
+        // Lets the idle task of the core run, an inbound command waits one poll interval at most
+        g_power.idle(g_power.get_network_poll_ms());
+    }
+}
+
+void start_network_task()
+{
+    // From here on the entities only reach the client through its queues
+    g_mqtt_client.enable_control_queues(&g_control_event);
+    g_power.add_task();
+    hal::start_task("network", network_task, nullptr, NETWORK_TASK_STACK_SIZE, NETWORK_TASK_PRIORITY,
+                    NETWORK_TASK_CORE);
+    ESP_LOGI(NOSYNA_LOG_TAG, "Network task started on core %d, controls run on core %d", NETWORK_TASK_CORE,
+             xPortGetCoreID());
+}
+
 void setup()
 {
+    g_fast_boot.mark(BootPhase::SETUP);
     setup_log();
     setup_serial();
-    setup_wifi(WIFI_SSID, WIFI_PASSWORD);
+    // The control task waits through the power manager as well
+    g_power.add_task();
+    g_power.setup();
+    g_nvs.begin("nosyna");
+    g_fast_boot.load_network();
+    setup_wifi(WIFI_SSID);
+    g_fast_boot.mark(BootPhase::NETWORK_STARTED);
 
-    add_mqtt_log_appender(g_device_id, MQTT_HOSTNAME, MQTT_PORT, MQTT_USERNAME, MQTT_PASSWORD);
+    if (hal::mount_filesystem() && g_log_spool.open())
+        add_mqtt_log_appender(g_mqtt_client, "logs/nosyna", LogBatcherOptions(), &g_log_spool);
+    else
+        add_mqtt_log_appender(g_mqtt_client, "logs/nosyna");
+    g_mqtt_client.set_state_layout(MQTT_STATE_LAYOUT);
     g_mqtt_client.setup();
-    g_preferences.begin("nosyna");
     setup_ota(g_device_name.c_str());
     setup_pins();
     setup_entities();
-    log_device_summary();
+    setup_telemetry();
+    // Every entity is added, so the discovery fingerprint is final
+    g_fast_boot.load_discovery();
+    g_fast_boot.mark(BootPhase::ENTITIES);
+    setup_scheduler();
+    start_network_task();
 }
 
+// Control task, the network runs in network_task()
 void loop()
 {
-    ArduinoOTA.handle();
-    g_mqtt_client.loop();
-    g_button.loop();
-    g_temperature_and_humidity.loop();
+    g_control_profiler.start();
+    g_mqtt_client.dispatch_commands();
+    g_control_profiler.mark(g_control_stages.commands);
+    g_buttons.loop();
+    g_control_profiler.mark(g_control_stages.buttons);
+    g_pwm.loop();
+    g_control_profiler.mark(g_control_stages.pwm);
+    g_scheduler.run();
+    g_control_profiler.mark(g_control_stages.scheduler);
+
+    // Sleeps until the next task, gesture timer or queued fade is due, edges and commands wake the loop earlier. With
+    // POWER_SAVE the chip light sleeps while the network task waits as well.
+    const uint32_t idle_ms = g_pwm.get_idle_ms(g_buttons.get_idle_ms(g_scheduler.get_idle_ms()));
+    if (idle_ms > 0)
+    {
+        g_control_profiler.stop();
+        g_power.idle(g_control_event, idle_ms);
+    }
 }
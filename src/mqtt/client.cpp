@@ -1,33 +1,88 @@
 #include "client.h"
+#include "json_writer.h"
+
+#include "hal/board.h"
+#include "hal/log.h"
+#include "util/fnv.h"
+#include "util/parse.h"
 
 #include <ArduinoJson.h>
-#include <PubSubClient.h>
-#include <WiFi.h>
-#include <esp_log.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cctype>
+#include <cmath>
+#include <cstring>
 
 constexpr const char *HOME_ASSISTANT_STATUS = "homeassistant/status";
 
+// Bounds the backlog that is sent after (re)connect, so a single loop() never floods the link
+constexpr static const size_t MAX_PUBLISHES_PER_LOOP = 4;
+// Queued messages per class, the rest waits in the state store, the discovery list and the log lane
+constexpr static const size_t MAX_QUEUED_DISCOVERY = 2;
+constexpr static const size_t MAX_QUEUED_LOGS = 2;
+constexpr static const size_t MAX_QUEUED_ENTITY_STATES = 4;
+// Longest bare value, e.g. "-214748364.8"
+constexpr static const size_t MAX_RAW_STATE_LENGTH = 16;
+
+// Retained full state, so subscribers that missed a delta catch up even if they do not ask for it
+constexpr static const uint32_t SNAPSHOT_INTERVAL_MS = 15 * 60 * 1000;
+
+// Keys for coalescing in the outbound queue, per-entity states use one per state slot and discovery one per entity
+constexpr static const uint16_t STATE_KEY = 1;
+constexpr static const uint16_t ENTITY_STATE_KEY_BASE = 0x100;
+constexpr static const uint16_t DISCOVERY_KEY_BASE = 0x200;
+
 namespace mqtt
 {
 
-struct Client::Impl
+inline std::string make_sensor_discovery_topic(const std::string &component, const std::string &device_id,
+                                               const std::string &control_id)
 {
-    Impl() : m_pubsub(m_wifi)
-    {
-    }
+    return "homeassistant/" + component + "/" + device_id + "/" + control_id + "/config";
+}
 
-    ~Impl()
-    {
-    }
+// Home Assistant sends its birth message as "online"
+static bool equals_ignore_case(std::string_view text, std::string_view expected)
+{
+    return text.size() == expected.size() &&
+           std::equal(text.begin(), text.end(), expected.begin(),
+                      [](char a, char b) { return tolower(static_cast<unsigned char>(a)) == tolower(b); });
+}
+
+inline std::string make_device_prefix(const std::string &device_id)
+{
+    return "nosyna/" + device_id + "/";
+}
+
+inline std::string make_set_topic(const std::string &device_id, const std::string &control_id)
+{
+    return "nosyna/" + device_id + "/" + control_id + "/set";
+}
+
+inline std::string make_state_topic(const std::string &device_id)
+{
+    return "nosyna/" + device_id + "/state";
+}
+
+inline std::string make_entity_state_topic(const std::string &device_id, const std::string &control_id,
+                                           const char *property)
+{
+    return "nosyna/" + device_id + "/" + control_id + "/" + property;
+}
 
-    WiFiClient m_wifi;
-    PubSubClient m_pubsub;
-};
+inline std::string make_snapshot_request_topic(const std::string &device_id)
+{
+    return "nosyna/" + device_id + "/state/get";
+}
 
-Client::Client(const std::string &user, const std::string &password, const std::string &hostname, uint16_t port,
-               const std::string &device_id, const std::string &device_name)
-    : m_impl(new Impl), m_user(user), m_password(password), m_hostname(hostname), m_port(port), m_device_id(device_id),
-      m_device_name(device_name)
+Client::Client(hal::MqttTransport &transport, hal::Network &network, hal::Clock &clock, const std::string &user,
+               const std::string &password, const std::string &hostname, uint16_t port, const std::string &device_id,
+               const std::string &device_name)
+    : m_transport(transport), m_clock(clock), m_router(make_device_prefix(device_id)), m_user(user),
+      m_password(password), m_hostname(hostname), m_port(port),
+      m_device_id(device_id), m_device_name(device_name), m_state_topic(make_state_topic(device_id)),
+      m_connection(transport, network, clock, m_device_id, m_user, m_password)
 {
 }
 
@@ -35,260 +90,683 @@ Client::~Client()
 {
 }
 
-void Client::connect()
+void Client::on_connected()
 {
-    ESP_LOGI(MQTT_LOG_TAG, "Connecting to MQTT (%s) ...", m_hostname.c_str());
-    while (!m_impl->m_pubsub.connect(m_hostname.c_str(), m_user.c_str(), m_password.c_str()))
+    for (const auto &filter : m_router.get_filters())
+        m_transport.subscribe(filter.c_str());
+
+    // Everything published before the link went down is announced again in bounded chunks from loop(), so the
+    // queued copies are outdated. Logs are kept.
+    m_queue.clear(Priority::ACK);
+    m_queue.clear(Priority::STATE);
+    m_queue.clear(Priority::DISCOVERY);
+    m_ack_pending = false;
+    m_discovery_pending = 0;
+    m_snapshot_pending = true;
+
+    // The retained discovery of the previous boot is still what Home Assistant would get
+    if (m_first_connection && !m_discovery.empty() && m_retained_discovery == get_discovery_fingerprint())
     {
-        delay(500);
-        ESP_LOGI(MQTT_LOG_TAG, "Waiting MQTT...");
+        ESP_LOGI(MQTT_LOG_TAG, "Discovery of %u entities is retained from an earlier boot",
+                 static_cast<unsigned int>(m_discovery.size()));
+        m_discovery_pending = m_discovery.size();
     }
+    m_first_connection = false;
+}
 
-    subscribe(HOME_ASSISTANT_STATUS, [this](const std::string &status) {
-        ESP_LOGI(MQTT_LOG_TAG, "Home Assistant went %s", status.c_str());
-        if (status == availability::ONLINE)
-        {
-            m_dirty_values = m_values;
-        }
-    });
-
-    ESP_LOGI(MQTT_LOG_TAG, "Connected to MQTT");
+void Client::on_disconnected()
+{
+    ESP_LOGW(MQTT_LOG_TAG, "Disconnected from MQTT with %u messages queued",
+             static_cast<unsigned int>(m_queue.depth()));
+    m_queue.on_disconnected();
 }
 
 void Client::callback(char *topic, uint8_t *payload, unsigned int length)
 {
-    const std::string str(reinterpret_cast<const char *>(payload), length);
+    m_received.fetch_add(1, std::memory_order_relaxed);
+    const std::string_view message(reinterpret_cast<const char *>(payload), length);
+    if (m_router.dispatch(topic, message) == 0)
+    {
+        ESP_LOGW(MQTT_LOG_TAG, "Received unexpected subscrition from topic '%s': %.*s", topic,
+                 static_cast<int>(length), message.data());
+        return;
+    }
+
+    ESP_LOGD(MQTT_LOG_TAG, "Received subscrition from topic '%s': %.*s", topic, static_cast<int>(length),
+             message.data());
+    // Queued commands are answered once the control task reports them done
+    if (!m_control_queues)
+        m_ack_pending = true;
+}
+
+uint8_t Client::add_command_handler(CommandHandler handler)
+{
+    m_command_handlers.push_back(handler);
+    return static_cast<uint8_t>(m_command_handlers.size() - 1);
+}
 
-    auto p = m_subscriptions.find(topic);
-    if (p == m_subscriptions.end())
+void Client::run_command(uint8_t handler, const LightCommand &command)
+{
+    if (!m_control_queues)
     {
-        ESP_LOGW(MQTT_LOG_TAG, "Received unexpected subscrition from topic '%s': %s", topic, str.c_str());
+        m_command_handlers[handler](command);
         return;
     }
 
-    ESP_LOGD(MQTT_LOG_TAG, "Received subscrition from topic '%s': %s", topic, str.c_str());
-    const auto &handler = p->second;
-    handler(str);
+    if (!m_commands.push(ControlCommand{handler, command}))
+        ESP_LOGW(MQTT_LOG_TAG, "Command dropped, the control task is behind");
+    else if (m_command_event)
+        m_command_event->notify();
 }
 
-bool Client::publish(const std::string &topic, const std::string &payload, const std::string &prettyPayload)
+void Client::enable_control_queues(hal::Event *command_event)
 {
-    if (m_impl->m_pubsub.publish(topic.c_str(), payload.c_str()))
+    m_command_event = command_event;
+    m_control_queues = true;
+}
+
+void Client::dispatch_commands()
+{
+    ControlCommand command;
+    while (m_commands.pop(command))
     {
-        ESP_LOGD(MQTT_LOG_TAG, "Publish to topic '%s':\n%s\n", topic.c_str(),
-                 prettyPayload.empty() ? payload.c_str() : prettyPayload.c_str());
-        return true;
+        m_command_handlers[command.handler](command.command);
+        push_update(ControlUpdate::Kind::COMMAND_DONE, INVALID_STATE_HANDLE);
     }
-    else
+}
+
+void Client::push_update(ControlUpdate::Kind kind, StateHandle handle, int32_t int_value, float float_value)
+{
+    if (!m_updates.push(ControlUpdate{kind, handle, int_value, float_value}))
+        ESP_LOGW(MQTT_LOG_TAG, "State update dropped, the client task is behind");
+}
+
+void Client::apply_updates()
+{
+    ControlUpdate update;
+    while (m_updates.pop(update))
     {
-        ESP_LOGE(MQTT_LOG_TAG, "Publish to topic '%s' failed:\n%s\n", topic.c_str(),
-                 prettyPayload.empty() ? payload.c_str() : prettyPayload.c_str());
-        return true;
+        switch (update.kind)
+        {
+        case ControlUpdate::Kind::BOOL:
+            m_states.set(update.handle, update.int_value != 0);
+            break;
+        case ControlUpdate::Kind::INT:
+            m_states.set(update.handle, static_cast<int>(update.int_value));
+            break;
+        case ControlUpdate::Kind::FLOAT:
+            m_states.set(update.handle, update.float_value);
+            break;
+        case ControlUpdate::Kind::MARK_DIRTY:
+            m_states.mark_dirty(update.handle);
+            break;
+        case ControlUpdate::Kind::SNAPSHOT:
+            m_snapshot_pending = true;
+            break;
+        case ControlUpdate::Kind::COMMAND_DONE:
+            m_ack_pending = true;
+            break;
+        }
     }
 }
 
-bool Client::subscribe(const std::string &topic, std::function<void(const std::string &)> handler)
+bool Client::subscribe(const std::string &topic, TopicHandler handler)
 {
-    if (m_subscriptions.find(topic) != m_subscriptions.end())
+    if (!m_router.add(topic, handler))
     {
-        ESP_LOGW(MQTT_LOG_TAG, "Subscription '%s' already exists", topic.c_str());
+        ESP_LOGW(MQTT_LOG_TAG, "Subscription '%s' already exists or is invalid", topic.c_str());
         return false;
     }
 
-    m_subscriptions[topic] = handler;
-    m_impl->m_pubsub.subscribe(topic.c_str());
+    if (m_connection.is_connected())
+        m_transport.subscribe(topic.c_str());
 
     return true;
 }
 
+StateHandle Client::add_state(const std::string &id, const char *property)
+{
+    const StateHandle handle = m_states.add(id, property);
+    if (handle != INVALID_STATE_HANDLE && handle >= m_entity_state_topics.size())
+        m_entity_state_topics.push_back(make_entity_state_topic(m_device_id, id, property));
+
+    return handle;
+}
+
+void Client::set_state_layout(StateLayout layout)
+{
+    if (!m_discovery.empty())
+        ESP_LOGW(MQTT_LOG_TAG, "State layout changed after entities were announced");
+    m_state_layout = layout;
+}
+
 void Client::loop()
 {
-    if (!m_impl->m_pubsub.connected())
+    // States keep accumulating while the connection is down
+    apply_updates();
+
+    switch (m_connection.step())
     {
-        ESP_LOGI(MQTT_LOG_TAG, "Connection lost, reconnecting...");
-        connect();
+    case Connection::Event::CONNECTED:
+        m_reconnects.store(m_connection.get_stats().reconnects, std::memory_order_relaxed);
+        on_connected();
+        break;
+    case Connection::Event::DISCONNECTED:
+        on_disconnected();
+        break;
+    case Connection::Event::NONE:
+        break;
     }
 
-    m_impl->m_pubsub.loop();
-    send_pending_states();
+    if (!m_connection.is_connected())
+        return;
+
+    m_transport.loop();
+
+    const uint32_t now = m_clock.millis();
+    queue_pending_states(now);
+    queue_pending_discovery(now);
+    queue_pending_logs(now);
+    const size_t sent = m_queue.send(m_transport, MAX_PUBLISHES_PER_LOOP, now);
+    m_published.fetch_add(static_cast<uint32_t>(sent), std::memory_order_relaxed);
 }
 
 void Client::setup()
 {
     ESP_LOGI(MQTT_LOG_TAG, "Configuring MQTT...");
-    m_impl->m_pubsub.setBufferSize(1024);
-    m_impl->m_pubsub.setServer(m_hostname.c_str(), m_port);
-    m_impl->m_pubsub.setCallback(
+    m_transport.set_server(m_hostname.c_str(), m_port);
+    m_transport.set_callback(
         std::bind(&Client::callback, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
-    connect();
-    ESP_LOGI(MQTT_LOG_TAG, "Configured MQTT");
+    m_transport.set_ack_callback([this](uint16_t packet_id) { m_queue.on_ack(packet_id, m_clock.millis()); });
+
+    subscribe(HOME_ASSISTANT_STATUS, [this](std::string_view, std::string_view status) {
+        ESP_LOGI(MQTT_LOG_TAG, "Home Assistant went %.*s", static_cast<int>(status.size()), status.data());
+        if (equals_ignore_case(status, availability::ONLINE))
+        {
+            // Home Assistant may have lost the retained discovery messages together with the broker
+            m_discovery_pending = 0;
+            m_snapshot_pending = true;
+        }
+    });
+    // Subscribers that see a gap in the state sequence ask for the full state
+    subscribe(make_snapshot_request_topic(m_device_id),
+              [this](std::string_view, std::string_view) { m_snapshot_pending = true; });
+
+    ESP_LOGI(MQTT_LOG_TAG, "Configured MQTT, connection is established from loop()");
 }
 
-void fill_device_info(JsonDocument &parentJson, const std::string device_name, const std::string &device_id)
+bool Client::publish_log(const char *message, size_t length)
 {
-    JsonObject device = parentJson.createNestedObject("device");
-    device["name"] = device_name;
-    device["model"] = ARDUINO_BOARD;
-    device["sw_version"] = "0.0.1";
-    device["manufacturer"] = "Vadym";
+    if (m_log_topic.empty())
+        return false;
 
-    JsonArray identifiers = device.createNestedArray("identifiers");
-    identifiers.add(device_id);
+    return m_logs.push(message, length);
 }
 
-std::string to_json(const JsonDocument &payload)
+void Client::set_log_topic(const std::string &topic)
 {
-    std::string str;
-    serializeJson(payload, str);
-    return str;
+    m_log_topic = topic;
 }
 
-std::string to_pretty_json(const JsonDocument &payload)
+uint32_t Client::get_dropped_logs() const
 {
-    std::string str;
-    serializeJsonPretty(payload, str);
-    return str;
+    return m_logs.get_dropped();
 }
 
-inline std::string make_sensor_discovery_topic(const std::string &component, const std::string &device_id,
-                                               const std::string &control_id)
+bool Client::is_connected() const
 {
-    return "homeassistant/" + component + "/" + device_id + "/" + control_id + "/config";
+    return m_connection.is_connected();
 }
 
-inline std::string make_set_topic(const std::string &device_id, const std::string &control_id)
+const ConnectionStats &Client::get_connection_stats() const
 {
-    return "nosyna/" + device_id + "/" + control_id + "/set";
+    return m_connection.get_stats();
 }
 
-inline std::string make_set_topic(const std::string &device_id, const std::string &control_id,
-                                  const std::string &subtopic)
+const OutboundStats &Client::get_outbound_stats() const
 {
-    return "nosyna/" + device_id + "/" + control_id + "/" + subtopic + "/set";
+    return m_queue.get_stats();
 }
 
-inline std::string make_state_topic(const std::string &device_id)
+const StatePublishStats &Client::get_state_stats() const
 {
-    return "nosyna/" + device_id + "/state";
+    return m_state_stats;
+}
+
+size_t Client::get_outbound_depth() const
+{
+    return m_queue.depth();
+}
+
+static void write_device_info(JsonWriter &json, const std::string &device_name, const std::string &device_id)
+{
+    json.begin_object("device")
+        .add("name", device_name)
+        .add("model", hal::BOARD_NAME)
+        .add("sw_version", "0.0.1")
+        .add("manufacturer", "Vadym")
+        .begin_array("identifiers")
+        .add(nullptr, device_id)
+        .end_array()
+        .end_object();
+}
+
+void Client::write_state_topic(JsonWriter &json, const std::string &id)
+{
+    if (m_state_layout == StateLayout::PER_ENTITY)
+        json.add("state_topic", make_entity_state_topic(m_device_id, id, prop::STATE));
+    else
+        json.add("state_topic", m_state_topic).add("value_template", "{{ value_json." + id + "_state | is_defined }}");
 }
 
-void Client::add_sensor(const std::string &id, const std::string &name, const std::string &device_class,
-                        const std::string &unit_of_measurement)
+StateHandle Client::add_sensor(const std::string &id, const std::string &name, const std::string &device_class,
+                               const std::string &unit_of_measurement)
 {
-    StaticJsonDocument<1000> payload;
-    payload["name"] = name;
-    payload["device_class"] = device_class;
-    payload["state_topic"] = "nosyna/" + m_device_id + "/state";
-    payload["unique_id"] = m_device_id + "-" + id;
-    payload["value_template"] = "{{ value_json." + id + "_state | is_defined }}";
+    std::string payload;
+    JsonWriter json(payload);
+    json.begin_object().add("name", name).add("device_class", device_class).add("unique_id", m_device_id + "-" + id);
+    write_state_topic(json, id);
     if (!unit_of_measurement.empty())
-        payload["unit_of_measurement"] = unit_of_measurement;
+        json.add("unit_of_measurement", unit_of_measurement);
+    write_device_info(json, m_device_name, m_device_id);
+    json.end_object();
 
-    fill_device_info(payload, m_device_name, m_device_id);
+    announce(make_sensor_discovery_topic("sensor", m_device_id, id), std::move(payload));
+    return add_state(id, prop::STATE);
+}
 
-    const auto discoveryTopic = make_sensor_discovery_topic("sensor", m_device_id, id);
-    publish(discoveryTopic, to_json(payload), to_pretty_json(payload));
+StateHandle Client::add_diagnostic_sensor(const std::string &id, const std::string &name, const char *device_class,
+                                          const char *unit_of_measurement, const char *state_class)
+{
+    std::string payload;
+    JsonWriter json(payload);
+    json.begin_object()
+        .add("name", name)
+        .add("unique_id", m_device_id + "-" + id)
+        .add("entity_category", "diagnostic")
+        .add("state_class", state_class);
+    if (device_class != nullptr)
+        json.add("device_class", device_class);
+    if (unit_of_measurement != nullptr)
+        json.add("unit_of_measurement", unit_of_measurement);
+    write_state_topic(json, id);
+    write_device_info(json, m_device_name, m_device_id);
+    json.end_object();
+
+    announce(make_sensor_discovery_topic("sensor", m_device_id, id), std::move(payload));
+    return add_state(id, prop::STATE);
 }
 
-void Client::add_switch(const std::string &id, const std::string &name, const std::string &device_class,
-                        std::function<void(bool on)> handler)
+StateHandle Client::add_switch(const std::string &id, const std::string &name, const std::string &device_class,
+                               std::function<void(bool on)> handler)
 {
     const std::string command_topic = make_set_topic(m_device_id, id);
-    StaticJsonDocument<1000> payload;
-    payload["name"] = name;
-    payload["device_class"] = device_class;
-    payload["state_topic"] = make_state_topic(m_device_id);
-    payload["command_topic"] = command_topic;
-    payload["unique_id"] = m_device_id + "-" + id;
-    payload["value_template"] = "{{ value_json." + id + "_state | is_defined }}";
-    payload["payload_on"] = state::ON;
-    payload["payload_off"] = state::OFF;
-    payload["state_on"] = state::ON;
-    payload["state_off"] = state::OFF;
+    std::string payload;
+    JsonWriter json(payload);
+    json.begin_object()
+        .add("name", name)
+        .add("device_class", device_class)
+        .add("command_topic", command_topic)
+        .add("unique_id", m_device_id + "-" + id)
+        .add("payload_on", state::ON)
+        .add("payload_off", state::OFF)
+        .add("state_on", state::ON)
+        .add("state_off", state::OFF);
+    write_state_topic(json, id);
+    write_device_info(json, m_device_name, m_device_id);
+    json.end_object();
+
+    announce(make_sensor_discovery_topic("switch", m_device_id, id), std::move(payload));
+    const StateHandle handle = add_state(id, prop::STATE);
+    const uint8_t command_handler =
+        add_command_handler([handler](const LightCommand &command) { handler(command.state); });
+    subscribe(command_topic, [this, command_handler](std::string_view, std::string_view value) {
+        LightCommand command;
+        command.has_state = true;
+        command.state = value == state::ON;
+        run_command(command_handler, command);
+    });
+
+    return handle;
+}
+
+// Commands are sent as one JSON object, so a state change, a brightness and a transition arrive together
+constexpr static const char *LIGHT_COMMAND_ON_TEMPLATE =
+    "{\"state\":\"ON\""
+    "{%- if brightness is defined -%},\"brightness\":{{ brightness }}{%- endif -%}"
+    "{%- if transition is defined -%},\"transition\":{{ transition }}{%- endif -%}}";
+constexpr static const char *LIGHT_COMMAND_OFF_TEMPLATE =
+    "{\"state\":\"OFF\""
+    "{%- if transition is defined -%},\"transition\":{{ transition }}{%- endif -%}}";
+
+static bool parse_light_command(std::string_view payload, LightCommand &command)
+{
+    // Plain ON / OFF as sent by the previous discovery schema
+    if (payload == state::ON || payload == state::OFF)
+    {
+        command.has_state = true;
+        command.state = payload == state::ON;
+        return true;
+    }
+
+    StaticJsonDocument<128> json;
+    if (deserializeJson(json, payload.data(), payload.size()))
+        return false;
 
-    fill_device_info(payload, m_device_name, m_device_id);
+    const JsonVariantConst state = json[prop::STATE];
+    if (state.is<const char *>())
+    {
+        command.has_state = true;
+        command.state = strcmp(state.as<const char *>(), state::ON) == 0;
+    }
 
-    const auto discoveryTopic = make_sensor_discovery_topic("switch", m_device_id, id);
+    const JsonVariantConst brightness = json[prop::BRIGHTNESS];
+    if (brightness.is<int>())
+    {
+        command.has_brightness = true;
+        command.brightness = std::min(std::max(brightness.as<int>(), brightness::MIN), brightness::MAX);
+    }
 
-    publish(discoveryTopic, to_json(payload), to_pretty_json(payload));
-    auto string_handler = [handler](const std::string &value) { handler(value == state::ON); };
-    subscribe(command_topic, string_handler);
+    // Home Assistant sends seconds
+    const JsonVariantConst transition = json["transition"];
+    if (transition.is<float>() && transition.as<float>() >= 0)
+    {
+        command.has_transition = true;
+        command.transition_ms = static_cast<uint32_t>(lroundf(transition.as<float>() * 1000));
+    }
 
-    handler(false);
+    return command.has_state || command.has_brightness;
 }
 
-void Client::add_light(const std::string &id, const std::string &name, const std::string &device_class,
-                       std::function<void(bool on)> state_handler, std::function<void(int value)> brightness_handler)
+StateHandle Client::add_light(const std::string &id, const std::string &name, const std::string &device_class,
+                              std::function<void(const LightCommand &command)> handler)
 {
     const std::string command_topic = make_set_topic(m_device_id, id);
-    const std::string brightness_topic = make_set_topic(m_device_id, id, "brightness");
-    StaticJsonDocument<1000> payload;
-    payload["unique_id"] = m_device_id + "-" + id;
-    payload["name"] = name;
-    payload["device_class"] = device_class;
+    const std::string brightness_command_topic = make_set_topic(m_device_id, id + "/" + prop::BRIGHTNESS);
+    std::string payload;
+    JsonWriter json(payload);
+    json.begin_object()
+        .add("unique_id", m_device_id + "-" + id)
+        .add("name", name)
+        .add("device_class", device_class)
+        .add("command_topic", command_topic);
+    if (m_state_layout == StateLayout::PER_ENTITY)
+    {
+        // The default schema reads bare values, brightness is commanded on its own topic and has no transition
+        json.add("state_topic", make_entity_state_topic(m_device_id, id, prop::STATE))
+            .add("brightness_state_topic", make_entity_state_topic(m_device_id, id, prop::BRIGHTNESS))
+            .add("brightness_command_topic", brightness_command_topic)
+            .add("payload_on", state::ON)
+            .add("payload_off", state::OFF);
+    }
+    else
+    {
+        json.add("schema", "template")
+            .add("state_topic", m_state_topic)
+            .add("state_template", "{{ 'on' if value_json." + id + "_state == 'ON' else 'off' }}")
+            .add("brightness_template", "{{ value_json." + id + "_brightness | is_defined }}")
+            .add("command_on_template", LIGHT_COMMAND_ON_TEMPLATE)
+            .add("command_off_template", LIGHT_COMMAND_OFF_TEMPLATE);
+    }
+    write_device_info(json, m_device_name, m_device_id);
+    json.end_object();
 
-    payload["state_topic"] = make_state_topic(m_device_id);
-    payload["command_topic"] = command_topic;
-    payload["state_value_template"] = "{{ value_json." + id + "_state | is_defined }}";
+    announce(make_sensor_discovery_topic("light", m_device_id, id), std::move(payload));
+    StateHandle handle = add_state(id, prop::STATE);
+    if (add_state(id, prop::BRIGHTNESS) != handle + 1)
+    {
+        ESP_LOGE(MQTT_LOG_TAG, "Light '%s' got no adjacent brightness slot", id.c_str());
+        handle = INVALID_STATE_HANDLE;
+    }
+    const uint8_t command_handler = add_command_handler(handler);
+    subscribe(command_topic, [this, command_handler](std::string_view topic, std::string_view value) {
+        LightCommand command;
+        if (parse_light_command(value, command))
+            run_command(command_handler, command);
+        else
+            ESP_LOGW(MQTT_LOG_TAG, "Invalid light command on '%.*s': %.*s", static_cast<int>(topic.size()),
+                     topic.data(), static_cast<int>(value.size()), value.data());
+    });
+    if (m_state_layout != StateLayout::PER_ENTITY)
+        return handle;
+
+    subscribe(brightness_command_topic, [this, command_handler](std::string_view topic, std::string_view value) {
+        LightCommand command;
+        command.has_brightness = parse_int(value, command.brightness);
+        if (command.has_brightness)
+        {
+            command.brightness = std::min(std::max(command.brightness, brightness::MIN), brightness::MAX);
+            run_command(command_handler, command);
+        }
+        else
+            ESP_LOGW(MQTT_LOG_TAG, "Invalid brightness on '%.*s': %.*s", static_cast<int>(topic.size()), topic.data(),
+                     static_cast<int>(value.size()), value.data());
+    });
 
-    payload["brightness_state_topic"] = make_state_topic(m_device_id);
-    payload["brightness_command_topic"] = brightness_topic;
-    payload["brightness_value_template"] = "{{ value_json." + id + "_brightness | is_defined }}";
+    return handle;
+}
 
-    payload["payload_on"] = state::ON;
-    payload["payload_off"] = state::OFF;
-    payload["brightness_scale"] = std::to_string(brightness::MAX);
+StateHandle Client::find_state(const std::string &id, const char *property) const
+{
+    return m_states.find(id, property);
+}
 
-    fill_device_info(payload, m_device_name, m_device_id);
+void Client::set(StateHandle handle, int value)
+{
+    if (m_control_queues)
+        push_update(ControlUpdate::Kind::INT, handle, value);
+    else
+        m_states.set(handle, value);
+}
 
-    const auto discoveryTopic = make_sensor_discovery_topic("light", m_device_id, id);
+void Client::set(StateHandle handle, bool value)
+{
+    if (m_control_queues)
+        push_update(ControlUpdate::Kind::BOOL, handle, value ? 1 : 0);
+    else
+        m_states.set(handle, value);
+}
 
-    publish(discoveryTopic, to_json(payload), to_pretty_json(payload));
-    subscribe(command_topic, [state_handler](const std::string &value) { state_handler(value == state::ON); });
-    subscribe(brightness_topic,
-              [brightness_handler](const std::string &value) { brightness_handler(std::stoi(value)); });
+void Client::set(StateHandle handle, float value)
+{
+    if (m_control_queues)
+        push_update(ControlUpdate::Kind::FLOAT, handle, 0, value);
+    else
+        m_states.set(handle, value);
 }
 
-void Client::set(const std::string &id, const std::string &property, const std::string &value)
+void Client::mark_dirty(StateHandle handle)
 {
-    const auto key = id + "_" + property;
+    if (m_control_queues)
+        push_update(ControlUpdate::Kind::MARK_DIRTY, handle);
+    else
+        m_states.mark_dirty(handle);
+}
 
-    const auto p = m_values.find(key);
-    if (p != m_values.end() && p->second == value)
-        return;
+void Client::request_snapshot()
+{
+    if (m_control_queues)
+        push_update(ControlUpdate::Kind::SNAPSHOT, INVALID_STATE_HANDLE);
+    else
+        m_snapshot_pending = true;
+}
 
-    m_values[key] = value;
-    m_dirty_values[key] = value;
+// The slots are fixed once the entities are added, so they can be looked up from the control task
+void Client::set(const std::string &id, const char *property, int value)
+{
+    set(m_states.find(id, property), value);
+}
+
+void Client::set(const std::string &id, const char *property, bool value)
+{
+    set(m_states.find(id, property), value);
+}
+
+void Client::set(const std::string &id, const char *property, float value)
+{
+    set(m_states.find(id, property), value);
+}
+
+void Client::announce(std::string topic, std::string payload)
+{
+    m_discovery.emplace_back(std::move(topic), std::move(payload));
 }
 
-void Client::set(const std::string &id, const std::string &property, int value)
+uint32_t Client::get_discovery_fingerprint() const
 {
-    set(id, property, std::to_string(value));
+    uint32_t hash = FNV_OFFSET_BASIS;
+    for (const auto &discovery : m_discovery)
+        hash = fnv1a(discovery.second, fnv1a(discovery.first, hash));
+    return hash;
 }
 
-void Client::set(const std::string &id, const std::string &property, bool value)
+void Client::set_retained_discovery(uint32_t fingerprint)
 {
-    set(id, property, std::string(value ? state::ON : state::OFF));
+    m_retained_discovery = fingerprint;
 }
 
-void Client::set(const std::string &id, const std::string &property, float value)
+void Client::queue_pending_discovery(uint32_t now_ms)
 {
-    int rounded = int(value * 10);
-    set(id, property, std::to_string(rounded / 10) + "." + std::to_string(rounded % 10));
+    while (m_discovery_pending < m_discovery.size() && m_queue.depth(Priority::DISCOVERY) < MAX_QUEUED_DISCOVERY)
+    {
+        const auto &discovery = m_discovery[m_discovery_pending];
+        // Retained, so Home Assistant finds the entities after its own restart even before it announces itself
+        if (!m_queue.enqueue(Priority::DISCOVERY, static_cast<uint16_t>(DISCOVERY_KEY_BASE + m_discovery_pending),
+                             discovery.first.c_str(), discovery.second.data(), discovery.second.size(), true, true,
+                             now_ms))
+            return;
+        ++m_discovery_pending;
+    }
+
+    if (m_first_discovery_ms == 0 && !m_discovery.empty() && m_discovery_pending == m_discovery.size() &&
+        m_queue.depth(Priority::DISCOVERY) == 0)
+    {
+        m_first_discovery_ms = now_ms;
+        m_announced_discovery.store(get_discovery_fingerprint(), std::memory_order_relaxed);
+        ESP_LOGI(MQTT_LOG_TAG, "Announced %u entities %" PRIu32 " ms after boot",
+                 static_cast<unsigned int>(m_discovery.size()), m_first_discovery_ms);
+    }
 }
 
 void Client::send_pending_states()
 {
-    if (m_dirty_values.empty())
+    const uint32_t now = m_clock.millis();
+    queue_pending_states(now);
+    const size_t sent = m_queue.send(m_transport, MAX_PUBLISHES_PER_LOOP, now);
+    m_published.fetch_add(static_cast<uint32_t>(sent), std::memory_order_relaxed);
+}
+
+void Client::queue_pending_states(uint32_t now_ms)
+{
+    // A state message that was given up leaves subscribers behind until the next snapshot
+    const auto &stats = m_queue.get_stats();
+    const uint32_t state_drops = stats.dropped[static_cast<size_t>(Priority::ACK)] +
+                                 stats.dropped[static_cast<size_t>(Priority::STATE)];
+    if (state_drops != m_state_drops)
+    {
+        m_state_drops = state_drops;
+        m_snapshot_pending = true;
+    }
+    if (now_ms - m_last_snapshot_ms >= SNAPSHOT_INTERVAL_MS)
+        m_snapshot_pending = true;
+
+    // Home Assistant ignores states of entities it does not know yet, only the answer to a command may overtake the
+    // (re)announcement
+    const bool announcing = m_discovery_pending < m_discovery.size() || m_queue.depth(Priority::DISCOVERY) > 0;
+    if (announcing && !m_ack_pending)
+        return;
+
+    if (m_state_layout == StateLayout::PER_ENTITY)
+        queue_entity_states(now_ms);
+    else
+        queue_shared_state(now_ms);
+}
+
+void Client::queue_shared_state(uint32_t now_ms)
+{
+    // Changes keep accumulating in the state store while a state message is queued or waits for its
+    // acknowledgement, so superseded values of a key are never sent
+    if ((!m_snapshot_pending && !m_states.has_dirty()) || m_queue.depth(Priority::ACK) > 0 ||
+        m_queue.depth(Priority::STATE) > 0)
+        return;
+
+    // The snapshot is retained, so it is also what new subscribers start from
+    const bool snapshot = m_snapshot_pending;
+    const uint32_t started_us = m_clock.micros();
+    const size_t length = snapshot ? m_states.write_snapshot() : m_states.write_dirty();
+    m_state_stats.encode_us.add(m_clock.micros() - started_us);
+    if (length == 0)
+        return;
+
+    const Priority priority = m_ack_pending ? Priority::ACK : Priority::STATE;
+    if (!m_queue.enqueue(priority, STATE_KEY, m_state_topic.c_str(), m_states.payload(), length, snapshot, true,
+                         now_ms))
+    {
+        // The sequence number is used up, so the next payload has to be a snapshot
+        m_states.restore_written();
+        m_snapshot_pending = true;
         return;
+    }
+
+    ++m_state_stats.messages;
+    m_state_stats.bytes += m_state_topic.size() + length;
+    if (m_first_state_ms.load(std::memory_order_relaxed) == 0)
+        m_first_state_ms.store(now_ms, std::memory_order_relaxed);
+    m_ack_pending = false;
+    if (snapshot)
+    {
+        m_snapshot_pending = false;
+        m_last_snapshot_ms = now_ms;
+    }
+}
+
+void Client::queue_entity_states(uint32_t now_ms)
+{
+    // Every value is retained on its own topic, so a snapshot is just every value once more
+    if (m_snapshot_pending)
+    {
+        m_states.mark_all_dirty();
+        m_snapshot_pending = false;
+        m_last_snapshot_ms = now_ms;
+    }
+
+    // A value that changes again while it is queued replaces the queued one
+    const Priority priority = m_ack_pending ? Priority::ACK : Priority::STATE;
+    while (m_queue.depth(Priority::ACK) + m_queue.depth(Priority::STATE) < MAX_QUEUED_ENTITY_STATES)
+    {
+        const StateHandle handle = m_states.take_dirty();
+        if (handle == INVALID_STATE_HANDLE)
+            return;
+
+        char payload[MAX_RAW_STATE_LENGTH];
+        const uint32_t started_us = m_clock.micros();
+        const size_t length = m_states.write_raw(handle, payload, sizeof(payload));
+        m_state_stats.encode_us.add(m_clock.micros() - started_us);
+
+        const auto &topic = m_entity_state_topics[handle];
+        if (!m_queue.enqueue(priority, static_cast<uint16_t>(ENTITY_STATE_KEY_BASE + handle), topic.c_str(), payload,
+                             length, true, true, now_ms))
+        {
+            m_states.mark_dirty(handle);
+            return;
+        }
 
-    StaticJsonDocument<1000> payload;
-    for (const auto &p : m_dirty_values)
-        payload[p.first] = p.second;
-    m_dirty_values.clear();
+        ++m_state_stats.messages;
+        m_state_stats.bytes += topic.size() + length;
+        if (m_first_state_ms.load(std::memory_order_relaxed) == 0)
+            m_first_state_ms.store(now_ms, std::memory_order_relaxed);
+        m_ack_pending = false;
+    }
+}
 
-    const std::string stateTopic = make_state_topic(m_device_id);
-    publish(stateTopic, to_json(payload), to_pretty_json(payload));
+void Client::queue_pending_logs(uint32_t now_ms)
+{
+    // Logs only get what is left after everything else and are published with QoS 0
+    char message[LogLane::MESSAGE_SIZE];
+    size_t length = 0;
+    while (m_queue.depth(Priority::LOG) < MAX_QUEUED_LOGS && m_logs.pop(message, length))
+        m_queue.enqueue(Priority::LOG, OutboundQueue::NO_KEY, m_log_topic.c_str(), message, length, false, false,
+                        now_ms);
 }
 
-} // namespace mqtt
\ No newline at end of file
+} // namespace mqtt
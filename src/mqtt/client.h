@@ -1,56 +1,253 @@
 #pragma once
 
+#include "connection.h"
 #include "constants.h"
+#include "log_lane.h"
+#include "outbound_queue.h"
+#include "state_store.h"
+#include "topic_router.h"
 
+#include "hal/clock.h"
+#include "hal/mqtt_transport.h"
+#include "hal/network.h"
+#include "hal/task.h"
+#include "util/histogram.h"
+#include "util/spsc_queue.h"
+
+#include <atomic>
 #include <functional>
-#include <memory>
 #include <string>
-#include <unordered_map>
+#include <utility>
+#include <vector>
 
 constexpr const char *MQTT_LOG_TAG = "mqtt";
 
 namespace mqtt
 {
 
+class JsonWriter;
+
+// Command of a light with the Home Assistant template schema, every field is optional
+struct LightCommand
+{
+    bool has_state = false;
+    bool state = false;
+    bool has_brightness = false;
+    int brightness = 0;
+    bool has_transition = false;
+    uint32_t transition_ms = 0;
+};
+
+// Where states are published, the discovery config follows it
+enum class StateLayout
+{
+    // One JSON object on nosyna/<device>/state with sequenced deltas and retained snapshots
+    SHARED,
+    // Bare retained values on nosyna/<device>/<entity>/<property>, Home Assistant needs no templates for them
+    PER_ENTITY
+};
+
+struct StatePublishStats
+{
+    uint32_t messages = 0;
+    // Topic and payload of every queued state message
+    uint32_t bytes = 0;
+    // Time to serialize one state message
+    Histogram<16> encode_us;
+};
+
 class Client final
 {
   public:
-    Client(const std::string &user, const std::string &password, const std::string &hostname, uint16_t port,
-           const std::string &device_id, const std::string &device_name);
+    Client(hal::MqttTransport &transport, hal::Network &network, hal::Clock &clock, const std::string &user,
+           const std::string &password, const std::string &hostname, uint16_t port, const std::string &device_id,
+           const std::string &device_name);
     ~Client();
 
     void setup();
     void loop();
 
-    void add_sensor(const std::string &id, const std::string &name, const std::string &device_class,
-                    const std::string &unit_of_measurement = "");
-    void add_switch(const std::string &id, const std::string &name, const std::string &device_class,
-                    std::function<void(bool on)> handler);
-    void add_light(const std::string &id, const std::string &name, const std::string &device_class,
-                   std::function<void(bool on)> state_handler, std::function<void(int value)> brightness_handler);
+    // Lets loop() run in a task of its own. From then on set(), mark_dirty() and request_snapshot() may only be called
+    // from the control task, which also calls dispatch_commands() to run the command handlers of the entities. Both
+    // directions cross through lock-free queues. The event is notified for every queued command.
+    void enable_control_queues(hal::Event *command_event = nullptr);
+    void dispatch_commands();
+
+    // Has to be chosen before entities are added
+    void set_state_layout(StateLayout layout);
+
+    // Every entity returns the handle of its state slot, so updates need no lookup by name. A light also gets the
+    // brightness slot right after it.
+    StateHandle add_sensor(const std::string &id, const std::string &name, const std::string &device_class,
+                           const std::string &unit_of_measurement = "");
+    // Sensor in the diagnostic category of the device, device class and unit may be null
+    StateHandle add_diagnostic_sensor(const std::string &id, const std::string &name, const char *device_class,
+                                      const char *unit_of_measurement, const char *state_class);
+    StateHandle add_switch(const std::string &id, const std::string &name, const std::string &device_class,
+                           std::function<void(bool on)> handler);
+    StateHandle add_light(const std::string &id, const std::string &name, const std::string &device_class,
+                          std::function<void(const LightCommand &command)> handler);
+
+    StateHandle find_state(const std::string &id, const char *property) const;
+
+    void set(StateHandle handle, int value);
+    void set(StateHandle handle, bool value);
+    void set(StateHandle handle, float value);
+
+    void set(const std::string &id, const char *property, int value);
+    void set(const std::string &id, const char *property, bool value);
+    void set(const std::string &id, const char *property, float value);
 
-    void set(const std::string &id, const std::string &property, const std::string &value);
-    void set(const std::string &id, const std::string &property, int value);
-    void set(const std::string &id, const std::string &property, bool value);
-    void set(const std::string &id, const std::string &property, float value);
+    // Publishes the current value again, e.g. as a heartbeat
+    void mark_dirty(StateHandle handle);
+    // Publishes every state as a retained snapshot with the next state message, states are sent as deltas otherwise
+    void request_snapshot();
 
     void send_pending_states();
 
+    // Queues a log message for the shared session. Never blocks on the network and returns false if it was dropped.
+    bool publish_log(const char *message, size_t length);
+    void set_log_topic(const std::string &topic);
+    uint32_t get_dropped_logs() const;
+
+    bool is_connected() const;
+    const ConnectionStats &get_connection_stats() const;
+    const OutboundStats &get_outbound_stats() const;
+    const StatePublishStats &get_state_stats() const;
+
+    // Safe to read from any task
+    uint32_t get_published_count() const
+    {
+        return m_published.load(std::memory_order_relaxed);
+    }
+
+    uint32_t get_received_count() const
+    {
+        return m_received.load(std::memory_order_relaxed);
+    }
+
+    uint32_t get_reconnect_count() const
+    {
+        return m_reconnects.load(std::memory_order_relaxed);
+    }
+
+    // Updates and commands lost because the other task did not drain its queue in time
+    size_t get_dropped_control_messages() const
+    {
+        return m_updates.get_dropped() + m_commands.get_dropped();
+    }
+    size_t get_outbound_depth() const;
+
+    // Milliseconds from boot until all entities were announced the first time, 0 until then
+    uint32_t get_first_discovery_ms() const
+    {
+        return m_first_discovery_ms;
+    }
+
+    // Milliseconds from boot until the first state message was queued, 0 until then. Safe to read from any task.
+    uint32_t get_first_state_ms() const
+    {
+        return m_first_state_ms.load(std::memory_order_relaxed);
+    }
+
+    // Hash of every discovery topic and payload, changes with any entity. Valid once all entities are added.
+    uint32_t get_discovery_fingerprint() const;
+    // Before loop() runs: the fingerprint of the discovery the broker retains from an earlier boot. If it matches,
+    // the first connection skips the announcement, later ones and Home Assistant coming online still announce.
+    void set_retained_discovery(uint32_t fingerprint);
+    // Fingerprint of the last complete announcement, 0 until then. Safe to read from any task.
+    uint32_t get_announced_discovery() const
+    {
+        return m_announced_discovery.load(std::memory_order_relaxed);
+    }
+
   private:
-    bool publish(const std::string &topic, const std::string &payload, const std::string &prettyPayload = "");
-    bool subscribe(const std::string &topic, std::function<void(const std::string &)> handler);
+    typedef std::function<void(const LightCommand &command)> CommandHandler;
+
+    // Sent from the control task to the client task
+    struct ControlUpdate
+    {
+        enum class Kind : uint8_t
+        {
+            BOOL,
+            INT,
+            FLOAT,
+            MARK_DIRTY,
+            SNAPSHOT,
+            // The handlers of a command are done, their states are the answer to it
+            COMMAND_DONE
+        };
+
+        Kind kind;
+        StateHandle handle;
+        int32_t int_value;
+        float float_value;
+    };
+
+    // Sent from the client task to the control task
+    struct ControlCommand
+    {
+        uint8_t handler;
+        LightCommand command;
+    };
 
-    void connect();
+    bool subscribe(const std::string &topic, TopicHandler handler);
+    uint8_t add_command_handler(CommandHandler handler);
+    void run_command(uint8_t handler, const LightCommand &command);
+    void push_update(ControlUpdate::Kind kind, StateHandle handle, int32_t int_value = 0, float float_value = 0);
+    void apply_updates();
+    StateHandle add_state(const std::string &id, const char *property);
+    void write_state_topic(JsonWriter &json, const std::string &id);
+
+    // Discovery payloads are rendered once when an entity is added and kept for every (re)announcement
+    void announce(std::string topic, std::string payload);
+    // Move pending work into the outbound queue, each of them keeps only a few messages queued
+    void queue_pending_discovery(uint32_t now_ms);
+    void queue_pending_states(uint32_t now_ms);
+    void queue_shared_state(uint32_t now_ms);
+    void queue_entity_states(uint32_t now_ms);
+    void queue_pending_logs(uint32_t now_ms);
+
+    void on_connected();
+    void on_disconnected();
     void callback(char *topic, uint8_t *payload, unsigned int length);
 
   private:
-    struct Impl;
-    std::unique_ptr<Impl> m_impl;
+    hal::MqttTransport &m_transport;
+    hal::Clock &m_clock;
 
-    std::unordered_map<std::string, std::string> m_values;
-    std::unordered_map<std::string, std::string> m_dirty_values;
+    OutboundQueue m_queue;
+    StateLayout m_state_layout = StateLayout::SHARED;
+    StateStore m_states;
+    // Indexed by state handle, only used with StateLayout::PER_ENTITY
+    std::vector<std::string> m_entity_state_topics;
+    StatePublishStats m_state_stats;
+    std::atomic<uint32_t> m_published{0};
+    std::atomic<uint32_t> m_received{0};
+    std::atomic<uint32_t> m_reconnects{0};
 
-    std::unordered_map<std::string, std::function<void(const std::string &)>> m_subscriptions;
+    bool m_control_queues = false;
+    hal::Event *m_command_event = nullptr;
+    std::vector<CommandHandler> m_command_handlers;
+    SpscQueue<ControlUpdate, 64> m_updates;
+    SpscQueue<ControlCommand, 16> m_commands;
+    // A command was received, its resulting state goes out before anything else
+    bool m_ack_pending = false;
+    bool m_snapshot_pending = false;
+    uint32_t m_last_snapshot_ms = 0;
+    // Given up state messages seen so far
+    uint32_t m_state_drops = 0;
+    LogLane m_logs;
+    std::string m_log_topic;
+    std::vector<std::pair<std::string, std::string>> m_discovery;
+    size_t m_discovery_pending = 0;
+    uint32_t m_first_discovery_ms = 0;
+    uint32_t m_retained_discovery = 0;
+    bool m_first_connection = true;
+    std::atomic<uint32_t> m_announced_discovery{0};
+    std::atomic<uint32_t> m_first_state_ms{0};
+
+    TopicRouter m_router;
 
     std::string m_user;
     std::string m_password;
@@ -58,6 +255,9 @@ class Client final
     uint16_t m_port = 0;
     std::string m_device_id;
     std::string m_device_name;
+    std::string m_state_topic;
+
+    Connection m_connection;
 };
 
 } // namespace mqtt
\ No newline at end of file
@@ -0,0 +1,108 @@
+#include "connection.h"
+
+#include "client.h"
+
+#include "hal/log.h"
+#include "util/fnv.h"
+
+#include <cinttypes>
+
+namespace mqtt
+{
+
+constexpr static const uint32_t RETRY_INITIAL_MS = 500;
+constexpr static const uint32_t RETRY_MAX_MS = 60000;
+constexpr static const uint32_t NETWORK_RESTART_MS = 30000;
+
+// The backoff is seeded from the client id, so that devices coming back after the same outage spread their retries
+Connection::Connection(hal::MqttTransport &transport, hal::Network &network, hal::Clock &clock,
+                       const std::string &client_id, const std::string &user, const std::string &password)
+    : m_transport(transport), m_network(network), m_clock(clock), m_client_id(client_id), m_user(user),
+      m_password(password), m_backoff(RETRY_INITIAL_MS, RETRY_MAX_MS, fnv1a(client_id))
+{
+}
+
+Connection::Event Connection::step()
+{
+    const uint32_t now = m_clock.millis();
+
+    m_network.loop();
+    if (!m_network.connected())
+    {
+        const bool was_connected = m_state == State::CONNECTED;
+        if (m_state != State::WAITING_NETWORK)
+        {
+            ESP_LOGW(MQTT_LOG_TAG, "Network lost");
+            m_state = State::WAITING_NETWORK;
+            m_network_lost_ms = now;
+        }
+        else if (now - m_network_lost_ms >= NETWORK_RESTART_MS)
+        {
+            ESP_LOGW(MQTT_LOG_TAG, "Network is down for %" PRIu32 " ms, restarting it", now - m_network_lost_ms);
+            m_network.reconnect();
+            m_network_lost_ms = now;
+            ++m_stats.network_restarts;
+        }
+        return was_connected ? Event::DISCONNECTED : Event::NONE;
+    }
+
+    switch (m_state)
+    {
+    case State::CONNECTED:
+        if (m_transport.connected())
+            return Event::NONE;
+        ESP_LOGW(MQTT_LOG_TAG, "Connection lost, reconnecting...");
+        m_backoff.reset();
+        m_next_attempt_ms = now;
+        m_state = State::WAITING_RETRY;
+        return Event::DISCONNECTED;
+
+    case State::WAITING_NETWORK:
+        ESP_LOGI(MQTT_LOG_TAG, "Network is up");
+        m_backoff.reset();
+        m_next_attempt_ms = now;
+        m_state = State::WAITING_RETRY;
+        return Event::NONE;
+
+    case State::WAITING_RETRY:
+        if (static_cast<int32_t>(now - m_next_attempt_ms) < 0)
+            return Event::NONE;
+        return try_connect(now) ? Event::CONNECTED : Event::NONE;
+    }
+
+    return Event::NONE;
+}
+
+bool Connection::try_connect(uint32_t now)
+{
+    ESP_LOGI(MQTT_LOG_TAG, "Connecting to MQTT as '%s' ...", m_client_id.c_str());
+
+    ++m_stats.attempts;
+    const bool connected = m_transport.connect(m_client_id.c_str(), m_user.c_str(), m_password.c_str());
+    const uint32_t finished = m_clock.millis();
+    m_stats.connect_latency_ms.add(finished - now);
+
+    if (!connected)
+    {
+        ++m_stats.failures;
+        const uint32_t delay = m_backoff.next_delay();
+        m_next_attempt_ms = finished + delay;
+        ESP_LOGW(MQTT_LOG_TAG, "MQTT connect failed in %" PRIu32 " ms, next attempt in %" PRIu32 " ms", finished - now,
+                 delay);
+        return false;
+    }
+
+    if (m_was_connected)
+        ++m_stats.reconnects;
+    m_was_connected = true;
+    m_state = State::CONNECTED;
+
+    ESP_LOGI(MQTT_LOG_TAG,
+             "Connected to MQTT in %" PRIu32 " ms (attempts %" PRIu32 ", failures %" PRIu32 ", reconnects %" PRIu32
+             ", p90 %" PRIu32 " ms)",
+             finished - now, m_stats.attempts, m_stats.failures, m_stats.reconnects,
+             m_stats.connect_latency_ms.percentile(90));
+    return true;
+}
+
+} // namespace mqtt
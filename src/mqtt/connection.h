@@ -0,0 +1,83 @@
+#pragma once
+
+#include "hal/clock.h"
+#include "hal/mqtt_transport.h"
+#include "hal/network.h"
+#include "util/backoff.h"
+#include "util/histogram.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace mqtt
+{
+
+struct ConnectionStats
+{
+    uint32_t attempts = 0;
+    uint32_t failures = 0;
+    uint32_t reconnects = 0;
+    uint32_t network_restarts = 0;
+    // Milliseconds spent inside a single connect attempt
+    Histogram<16> connect_latency_ms;
+};
+
+// Drives the network and the MQTT session without blocking: every step() does at most one connect attempt and
+// failed attempts are retried with exponential backoff and jitter
+class Connection final
+{
+  public:
+    enum class Event
+    {
+        NONE,
+        CONNECTED,
+        DISCONNECTED
+    };
+
+    Connection(hal::MqttTransport &transport, hal::Network &network, hal::Clock &clock, const std::string &client_id,
+               const std::string &user, const std::string &password);
+
+    Connection(const Connection &) = delete;
+    Connection &operator=(const Connection &) = delete;
+
+    Event step();
+
+    bool is_connected() const
+    {
+        return m_state == State::CONNECTED;
+    }
+
+    const ConnectionStats &get_stats() const
+    {
+        return m_stats;
+    }
+
+  private:
+    enum class State
+    {
+        WAITING_NETWORK,
+        WAITING_RETRY,
+        CONNECTED
+    };
+
+    bool try_connect(uint32_t now);
+
+  private:
+    hal::MqttTransport &m_transport;
+    hal::Network &m_network;
+    hal::Clock &m_clock;
+    const std::string &m_client_id;
+    const std::string &m_user;
+    const std::string &m_password;
+
+    // Read by other tasks through is_connected()
+    std::atomic<State> m_state{State::WAITING_NETWORK};
+    Backoff m_backoff;
+    uint32_t m_next_attempt_ms = 0;
+    uint32_t m_network_lost_ms = 0;
+    bool m_was_connected = false;
+    ConnectionStats m_stats;
+};
+
+} // namespace mqtt
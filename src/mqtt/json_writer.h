@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+namespace mqtt
+{
+
+// Appends compact JSON to a string, used for payloads that are rendered once
+class JsonWriter final
+{
+  public:
+    constexpr static const unsigned int MAX_DEPTH = 16;
+
+    explicit JsonWriter(std::string &out) : m_out(out)
+    {
+    }
+
+    JsonWriter &begin_object(const char *key = nullptr)
+    {
+        return open(key, '{');
+    }
+
+    JsonWriter &end_object()
+    {
+        return close('}');
+    }
+
+    JsonWriter &begin_array(const char *key = nullptr)
+    {
+        return open(key, '[');
+    }
+
+    JsonWriter &end_array()
+    {
+        return close(']');
+    }
+
+    // A null key adds an array element
+    JsonWriter &add(const char *key, const char *value)
+    {
+        write_key(key);
+        write_string(value);
+        return *this;
+    }
+
+    JsonWriter &add(const char *key, const std::string &value)
+    {
+        return add(key, value.c_str());
+    }
+
+    JsonWriter &add(const char *key, int value)
+    {
+        write_key(key);
+        char buffer[12];
+        snprintf(buffer, sizeof(buffer), "%d", value);
+        m_out += buffer;
+        return *this;
+    }
+
+    JsonWriter &add(const char *key, bool value)
+    {
+        write_key(key);
+        m_out += value ? "true" : "false";
+        return *this;
+    }
+
+  private:
+    JsonWriter &open(const char *key, char bracket)
+    {
+        write_key(key);
+        m_out += bracket;
+        ++m_depth;
+        m_has_items &= ~(1u << m_depth);
+        return *this;
+    }
+
+    JsonWriter &close(char bracket)
+    {
+        m_out += bracket;
+        --m_depth;
+        return *this;
+    }
+
+    void write_key(const char *key)
+    {
+        const uint32_t bit = 1u << m_depth;
+        if (m_has_items & bit)
+            m_out += ',';
+        m_has_items |= bit;
+
+        if (key != nullptr)
+        {
+            write_string(key);
+            m_out += ':';
+        }
+    }
+
+    void write_string(const char *value)
+    {
+        m_out += '"';
+        for (const char *p = value; *p != '\0'; ++p)
+        {
+            const unsigned char c = static_cast<unsigned char>(*p);
+            if (c == '"' || c == '\\')
+            {
+                m_out += '\\';
+                m_out += *p;
+            }
+            else if (c < 0x20)
+            {
+                char escaped[7];
+                snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                m_out += escaped;
+            }
+            else
+                m_out += *p;
+        }
+        m_out += '"';
+    }
+
+  private:
+    std::string &m_out;
+    unsigned int m_depth = 0;
+    // One bit per nesting level, set once the level has an item and the next one needs a separator
+    uint32_t m_has_items = 0;
+};
+
+} // namespace mqtt
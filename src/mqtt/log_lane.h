@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+
+namespace mqtt
+{
+
+// Bounded queue of log batches that share the MQTT session with state traffic. It is filled from the logging
+// thread and drained by Client::loop() only when the state traffic is done, messages that do not fit are dropped.
+class LogLane final
+{
+  public:
+    constexpr static const size_t SLOTS = 4;
+    constexpr static const size_t MESSAGE_SIZE = 1024;
+
+    // A binary batch can not be cut, so a message longer than MESSAGE_SIZE is rejected as a whole
+    bool push(const char *message, size_t length)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_size == SLOTS || length > MESSAGE_SIZE)
+        {
+            ++m_dropped;
+            return false;
+        }
+
+        auto &slot = m_slots[(m_head + m_size) % SLOTS];
+        slot.length = length;
+        memcpy(slot.message, message, slot.length);
+        ++m_size;
+        return true;
+    }
+
+    // Copies the oldest message into the buffer of MESSAGE_SIZE bytes, returns false if there is nothing to send
+    bool pop(char *buffer, size_t &length)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_size == 0)
+            return false;
+
+        const auto &slot = m_slots[m_head];
+        memcpy(buffer, slot.message, slot.length);
+        length = slot.length;
+        m_head = (m_head + 1) % SLOTS;
+        --m_size;
+        return true;
+    }
+
+    uint32_t get_dropped() const
+    {
+        return m_dropped;
+    }
+
+  private:
+    struct Slot
+    {
+        char message[MESSAGE_SIZE];
+        size_t length;
+    };
+
+    std::mutex m_mutex;
+    Slot m_slots[SLOTS];
+    size_t m_head = 0;
+    size_t m_size = 0;
+    uint32_t m_dropped = 0;
+};
+
+} // namespace mqtt
@@ -0,0 +1,250 @@
+#include "outbound_queue.h"
+
+#include "client.h"
+
+#include "hal/log.h"
+
+namespace mqtt
+{
+
+// Most messages are small states, discovery documents grow their buffer once
+constexpr static const size_t INITIAL_PAYLOAD_CAPACITY = 128;
+
+OutboundQueue::OutboundQueue()
+{
+    for (auto &message : m_messages)
+        message.payload.reserve(INITIAL_PAYLOAD_CAPACITY);
+}
+
+OutboundQueue::Message *OutboundQueue::find_free(Priority priority)
+{
+    Message *victim = nullptr;
+    for (auto &message : m_messages)
+    {
+        if (!message.used)
+            return &message;
+
+        if (message.in_flight || message.priority <= priority)
+            continue;
+        if (victim == nullptr || message.priority > victim->priority ||
+            (message.priority == victim->priority && message.sequence < victim->sequence))
+            victim = &message;
+    }
+
+    if (victim != nullptr)
+    {
+        ++m_stats.dropped[static_cast<size_t>(victim->priority)];
+        release(*victim);
+    }
+
+    return victim;
+}
+
+bool OutboundQueue::enqueue(Priority priority, uint16_t key, const char *topic, const char *payload, size_t length,
+                            bool retained, bool reliable, uint32_t now_ms)
+{
+    Message *message = nullptr;
+    if (key != NO_KEY)
+    {
+        for (auto &queued : m_messages)
+        {
+            if (queued.used && !queued.in_flight && queued.key == key)
+            {
+                message = &queued;
+                ++m_stats.coalesced;
+                break;
+            }
+        }
+    }
+
+    if (message == nullptr)
+    {
+        message = find_free(priority);
+        if (message == nullptr)
+        {
+            ++m_stats.dropped[static_cast<size_t>(priority)];
+            return false;
+        }
+
+        message->used = true;
+        message->sequence = m_sequence++;
+        message->enqueued_ms = now_ms;
+        ++m_depth;
+        ++m_depths[static_cast<size_t>(priority)];
+        if (m_depth > m_stats.max_depth)
+            m_stats.max_depth = m_depth;
+    }
+    else if (message->priority != priority)
+    {
+        --m_depths[static_cast<size_t>(message->priority)];
+        ++m_depths[static_cast<size_t>(priority)];
+    }
+
+    message->priority = priority;
+    message->key = key;
+    message->topic = topic;
+    message->payload.assign(payload, length);
+    message->retained = retained;
+    message->reliable = reliable;
+    message->attempts = 0;
+    ++m_stats.enqueued;
+    return true;
+}
+
+OutboundQueue::Message *OutboundQueue::next_to_send(uint32_t now_ms)
+{
+    Message *next = nullptr;
+    for (auto &message : m_messages)
+    {
+        if (!message.used)
+            continue;
+
+        // Messages in flight are only due again when their acknowledgement is overdue
+        if (message.in_flight)
+        {
+            if (now_ms - message.sent_ms < RETRY_TIMEOUT_MS)
+                continue;
+        }
+        else if (message.reliable && m_in_flight >= MAX_IN_FLIGHT)
+            continue;
+
+        if (next == nullptr || message.priority < next->priority ||
+            (message.priority == next->priority && message.sequence < next->sequence))
+            next = &message;
+    }
+
+    return next;
+}
+
+size_t OutboundQueue::send(hal::MqttTransport &transport, size_t budget, uint32_t now_ms)
+{
+    size_t sent = 0;
+    while (sent < budget)
+    {
+        Message *message = next_to_send(now_ms);
+        if (message == nullptr)
+            break;
+
+        const Result result = publish(transport, *message, now_ms);
+        if (result == Result::FAILED)
+            break;
+        if (result == Result::PUBLISHED)
+            ++sent;
+    }
+
+    return sent;
+}
+
+OutboundQueue::Result OutboundQueue::publish(hal::MqttTransport &transport, Message &message, uint32_t now_ms)
+{
+    if (message.in_flight)
+    {
+        // The acknowledgement did not arrive in time
+        message.in_flight = false;
+        --m_in_flight;
+        ++message.attempts;
+    }
+
+    if (message.attempts >= MAX_ATTEMPTS)
+    {
+        ESP_LOGW(MQTT_LOG_TAG, "Dropped message to '%s' after %d attempts", message.topic, message.attempts);
+        ++m_stats.dropped[static_cast<size_t>(message.priority)];
+        release(message);
+        return Result::DROPPED;
+    }
+    if (message.attempts > 0)
+        ++m_stats.retries;
+
+    const auto *payload = reinterpret_cast<const uint8_t *>(message.payload.data());
+    const size_t length = message.payload.size();
+
+    // Log messages are published without logging the publish itself, otherwise every one would produce another
+    const bool quiet = message.priority == Priority::LOG;
+    if (!quiet)
+        ESP_LOGD(MQTT_LOG_TAG, "Publish to topic '%s' (attempt %d): %.*s", message.topic, message.attempts + 1,
+                 static_cast<int>(length), message.payload.c_str());
+
+    uint16_t packet_id = 0;
+    bool published = false;
+    if (message.reliable)
+    {
+        packet_id = transport.publish_reliable(message.topic, payload, length, message.retained);
+        published = packet_id != 0;
+    }
+    else
+        published = transport.publish(message.topic, payload, length, message.retained);
+    if (!published)
+    {
+        // Stays queued and is tried again with the next send()
+        ++message.attempts;
+        if (!quiet)
+            ESP_LOGE(MQTT_LOG_TAG, "Publish to topic '%s' failed", message.topic);
+        return Result::FAILED;
+    }
+
+    ++m_stats.sent;
+    if (!message.reliable)
+    {
+        m_stats.latency_ms.add(now_ms - message.enqueued_ms);
+        release(message);
+        return Result::PUBLISHED;
+    }
+
+    // Stays queued until the broker acknowledged it
+    message.in_flight = true;
+    message.packet_id = packet_id;
+    message.sent_ms = now_ms;
+    ++m_in_flight;
+    return Result::PUBLISHED;
+}
+
+void OutboundQueue::on_ack(uint16_t packet_id, uint32_t now_ms)
+{
+    for (auto &message : m_messages)
+    {
+        if (message.used && message.in_flight && message.packet_id == packet_id)
+        {
+            ++m_stats.acked;
+            m_stats.latency_ms.add(now_ms - message.enqueued_ms);
+            release(message);
+            return;
+        }
+    }
+}
+
+void OutboundQueue::clear(Priority priority)
+{
+    for (auto &message : m_messages)
+    {
+        if (message.used && message.priority == priority)
+            release(message);
+    }
+}
+
+void OutboundQueue::on_disconnected()
+{
+    for (auto &message : m_messages)
+    {
+        if (message.used && message.in_flight)
+        {
+            message.in_flight = false;
+            --m_in_flight;
+        }
+    }
+}
+
+void OutboundQueue::release(Message &message)
+{
+    if (message.in_flight)
+        --m_in_flight;
+    --m_depth;
+    --m_depths[static_cast<size_t>(message.priority)];
+
+    // Keeps the payload capacity for the next message
+    message.payload.clear();
+    message.used = false;
+    message.in_flight = false;
+    message.topic = nullptr;
+}
+
+} // namespace mqtt
@@ -0,0 +1,134 @@
+#pragma once
+
+#include "hal/mqtt_transport.h"
+#include "util/histogram.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace mqtt
+{
+
+// Lower values are sent first
+enum class Priority : uint8_t
+{
+    ACK,
+    STATE,
+    DISCOVERY,
+    LOG,
+    COUNT
+};
+
+constexpr static const size_t PRIORITY_COUNT = static_cast<size_t>(Priority::COUNT);
+
+struct OutboundStats
+{
+    uint32_t enqueued = 0;
+    uint32_t sent = 0;
+    uint32_t acked = 0;
+    // Publishes that failed or were not acknowledged in time and were made again
+    uint32_t retries = 0;
+    uint32_t coalesced = 0;
+    // Rejected when full, evicted by more important messages or given up after too many attempts
+    uint32_t dropped[PRIORITY_COUNT] = {};
+    size_t max_depth = 0;
+    // From enqueue until the broker acknowledged it, or until it was handed to the connection for QoS 0
+    Histogram<16> latency_ms;
+};
+
+// Bounded queue of outbound messages. Messages are sent by priority and in order within a priority. QoS 1 messages
+// stay queued until the broker acknowledged them and are published again if the acknowledgement does not arrive within
+// RETRY_TIMEOUT_MS, QoS 0 messages until the transport took them. A message is given up after MAX_ATTEMPTS. Payload
+// buffers are reused, so the steady state does not allocate. Topics are not copied and must outlive the message.
+class OutboundQueue final
+{
+  public:
+    constexpr static const size_t CAPACITY = 12;
+    constexpr static const size_t MAX_IN_FLIGHT = 4;
+    constexpr static const uint32_t RETRY_TIMEOUT_MS = 5000;
+    constexpr static const uint8_t MAX_ATTEMPTS = 5;
+    // No coalescing
+    constexpr static const uint16_t NO_KEY = 0;
+
+    OutboundQueue();
+    OutboundQueue(const OutboundQueue &) = delete;
+    OutboundQueue &operator=(const OutboundQueue &) = delete;
+
+    // A message with the same key that was not sent yet is replaced. If the queue is full, the oldest message of a
+    // less important priority that is not in flight is dropped to make room, otherwise the message is rejected and
+    // false is returned. Reliable messages are published with QoS 1.
+    bool enqueue(Priority priority, uint16_t key, const char *topic, const char *payload, size_t length, bool retained,
+                 bool reliable, uint32_t now_ms);
+
+    // Publishes up to budget messages, returns how many were published. Messages given up on are not counted.
+    size_t send(hal::MqttTransport &transport, size_t budget, uint32_t now_ms);
+
+    void on_ack(uint16_t packet_id, uint32_t now_ms);
+
+    // Drops queued and in flight messages of the priority, e.g. when they are superseded after a reconnect
+    void clear(Priority priority);
+    // Messages in flight are published again on the next connection
+    void on_disconnected();
+
+    size_t in_flight() const
+    {
+        return m_in_flight;
+    }
+
+    size_t depth() const
+    {
+        return m_depth;
+    }
+
+    size_t depth(Priority priority) const
+    {
+        return m_depths[static_cast<size_t>(priority)];
+    }
+
+    const OutboundStats &get_stats() const
+    {
+        return m_stats;
+    }
+
+  private:
+    enum class Result : uint8_t
+    {
+        PUBLISHED,
+        FAILED,
+        DROPPED
+    };
+
+    struct Message
+    {
+        bool used = false;
+        bool in_flight = false;
+        bool retained = false;
+        bool reliable = false;
+        Priority priority = Priority::LOG;
+        // Publishes that failed or were not acknowledged
+        uint8_t attempts = 0;
+        uint16_t key = NO_KEY;
+        uint16_t packet_id = 0;
+        uint32_t sequence = 0;
+        uint32_t enqueued_ms = 0;
+        uint32_t sent_ms = 0;
+        const char *topic = nullptr;
+        std::string payload;
+    };
+
+    Message *find_free(Priority priority);
+    Message *next_to_send(uint32_t now_ms);
+    Result publish(hal::MqttTransport &transport, Message &message, uint32_t now_ms);
+    void release(Message &message);
+
+  private:
+    Message m_messages[CAPACITY];
+    size_t m_depth = 0;
+    size_t m_depths[PRIORITY_COUNT] = {};
+    size_t m_in_flight = 0;
+    uint32_t m_sequence = 0;
+    OutboundStats m_stats;
+};
+
+} // namespace mqtt
@@ -0,0 +1,238 @@
+#include "state_store.h"
+
+#include "client.h"
+#include "constants.h"
+
+#include "hal/log.h"
+
+#include <cinttypes>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace mqtt
+{
+
+constexpr static const int32_t NAN_VALUE = INT32_MIN;
+
+// Longest header, "{" and the closing "}"
+constexpr static const size_t MAX_HEADER_LENGTH = sizeof("{\"seq\":4294967295,\"snapshot\":true}") - 1;
+// Separator, quotes and colon around the key and the longest value ("-214748364.8")
+constexpr static const size_t MAX_ENTRY_OVERHEAD = 4 + 12;
+
+StateStore::StateStore() : m_snapshot_bound(MAX_HEADER_LENGTH)
+{
+}
+
+StateHandle StateStore::add(const std::string &id, const char *property)
+{
+    const auto existing = find(id, property);
+    if (existing != INVALID_STATE_HANDLE)
+        return existing;
+
+    if (m_count == MAX_SLOTS)
+    {
+        ESP_LOGE(MQTT_LOG_TAG, "No free state slot for '%s_%s'", id.c_str(), property);
+        return INVALID_STATE_HANDLE;
+    }
+
+    if (id.size() + 1 + strlen(property) > MAX_KEY_LENGTH)
+    {
+        ESP_LOGE(MQTT_LOG_TAG, "State key '%s_%s' is too long", id.c_str(), property);
+        return INVALID_STATE_HANDLE;
+    }
+
+    const size_t entry_bound = id.size() + 1 + strlen(property) + MAX_ENTRY_OVERHEAD;
+    if (m_snapshot_bound + entry_bound >= BUFFER_SIZE)
+    {
+        ESP_LOGE(MQTT_LOG_TAG, "State '%s_%s' would not fit into a snapshot", id.c_str(), property);
+        return INVALID_STATE_HANDLE;
+    }
+    m_snapshot_bound += entry_bound;
+
+    auto &slot = m_slots[m_count];
+    snprintf(slot.key, sizeof(slot.key), "%s_%s", id.c_str(), property);
+    slot.type = Type::INT;
+    slot.assigned = false;
+    slot.value = 0;
+
+    return static_cast<StateHandle>(m_count++);
+}
+
+StateHandle StateStore::find(const std::string &id, const char *property) const
+{
+    for (size_t i = 0; i < m_count; ++i)
+    {
+        const char *key = m_slots[i].key;
+        if (strncmp(key, id.c_str(), id.size()) == 0 && key[id.size()] == '_' &&
+            strcmp(key + id.size() + 1, property) == 0)
+            return static_cast<StateHandle>(i);
+    }
+
+    return INVALID_STATE_HANDLE;
+}
+
+void StateStore::assign(StateHandle handle, Type type, int32_t value)
+{
+    if (handle >= m_count)
+    {
+        ESP_LOGW(MQTT_LOG_TAG, "Unknown state handle %d", handle);
+        return;
+    }
+
+    auto &slot = m_slots[handle];
+    if (slot.assigned && slot.type == type && slot.value == value)
+        return;
+
+    slot.type = type;
+    slot.value = value;
+    slot.assigned = true;
+    m_dirty |= 1u << handle;
+}
+
+void StateStore::set(StateHandle handle, bool value)
+{
+    assign(handle, Type::BOOL, value ? 1 : 0);
+}
+
+void StateStore::set(StateHandle handle, int value)
+{
+    assign(handle, Type::INT, value);
+}
+
+void StateStore::set(StateHandle handle, float value)
+{
+    assign(handle, Type::FLOAT, std::isnan(value) ? NAN_VALUE : static_cast<int32_t>(lroundf(value * 10)));
+}
+
+void StateStore::mark_dirty(StateHandle handle)
+{
+    if (handle < m_count && m_slots[handle].assigned)
+        m_dirty |= 1u << handle;
+}
+
+void StateStore::mark_all_dirty()
+{
+    for (size_t i = 0; i < m_count; ++i)
+    {
+        if (m_slots[i].assigned)
+            m_dirty |= 1u << i;
+    }
+}
+
+StateHandle StateStore::take_dirty()
+{
+    for (size_t i = 0; i < m_count; ++i)
+    {
+        const uint32_t bit = 1u << i;
+        if (m_dirty & bit)
+        {
+            m_dirty &= ~bit;
+            return static_cast<StateHandle>(i);
+        }
+    }
+
+    return INVALID_STATE_HANDLE;
+}
+
+size_t StateStore::write_raw(StateHandle handle, char *buffer, size_t size) const
+{
+    if (handle >= m_count)
+        return 0;
+
+    const auto &slot = m_slots[handle];
+    int written = 0;
+    switch (slot.type)
+    {
+    case Type::BOOL:
+        written = snprintf(buffer, size, "%s", slot.value ? state::ON : state::OFF);
+        break;
+    case Type::INT:
+        written = snprintf(buffer, size, "%d", static_cast<int>(slot.value));
+        break;
+    case Type::FLOAT:
+        // Home Assistant sets the state to unknown
+        if (slot.value == NAN_VALUE)
+            written = snprintf(buffer, size, "None");
+        else
+            written = snprintf(buffer, size, "%s%d.%d", slot.value < 0 ? "-" : "",
+                               static_cast<int>(std::abs(slot.value) / 10), static_cast<int>(std::abs(slot.value) % 10));
+        break;
+    }
+
+    return written < 0 || static_cast<size_t>(written) >= size ? 0 : static_cast<size_t>(written);
+}
+
+int StateStore::write_value(const Slot &slot, char *buffer, size_t size) const
+{
+    switch (slot.type)
+    {
+    case Type::BOOL:
+        return snprintf(buffer, size, "\"%s\":\"%s\"", slot.key, slot.value ? state::ON : state::OFF);
+    case Type::INT:
+        return snprintf(buffer, size, "\"%s\":%d", slot.key, static_cast<int>(slot.value));
+    case Type::FLOAT:
+        if (slot.value == NAN_VALUE)
+            return snprintf(buffer, size, "\"%s\":null", slot.key);
+        return snprintf(buffer, size, "\"%s\":%s%d.%d", slot.key, slot.value < 0 ? "-" : "",
+                        static_cast<int>(std::abs(slot.value) / 10), static_cast<int>(std::abs(slot.value) % 10));
+    }
+
+    return 0;
+}
+
+size_t StateStore::write_dirty()
+{
+    return write(m_dirty, false);
+}
+
+size_t StateStore::write_snapshot()
+{
+    uint32_t assigned = 0;
+    for (size_t i = 0; i < m_count; ++i)
+    {
+        if (m_slots[i].assigned)
+            assigned |= 1u << i;
+    }
+
+    return write(assigned, true);
+}
+
+size_t StateStore::write(uint32_t mask, bool snapshot)
+{
+    const char *header = snapshot ? "{\"seq\":%" PRIu32 ",\"snapshot\":true" : "{\"seq\":%" PRIu32;
+    size_t length = static_cast<size_t>(snprintf(m_buffer, BUFFER_SIZE, header, m_sequence + 1));
+    const uint32_t dirty = m_dirty;
+
+    for (size_t i = 0; i < m_count; ++i)
+    {
+        const uint32_t bit = 1u << i;
+        if ((mask & bit) == 0)
+            continue;
+
+        // Keep room for the separator and the closing brace
+        const size_t available = BUFFER_SIZE - length - 2;
+        const int written = write_value(m_slots[i], m_buffer + length + 1, available);
+        if (written < 0 || static_cast<size_t>(written) >= available)
+            break;
+
+        m_buffer[length] = ',';
+        length += 1 + written;
+        m_dirty &= ~bit;
+    }
+
+    // Only slots that were dirty before have to be restored if the payload is not published
+    m_written = dirty & ~m_dirty;
+    if (!snapshot && m_written == 0)
+        return 0;
+
+    m_buffer[length++] = '}';
+    m_buffer[length] = '\0';
+    ++m_sequence;
+
+    return length;
+}
+
+} // namespace mqtt
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace mqtt
+{
+
+typedef uint8_t StateHandle;
+constexpr static const StateHandle INVALID_STATE_HANDLE = 0xff;
+
+// Fixed set of typed state slots that are registered once together with entities. Updates only touch the slot value
+// and the dirty mask, and dirty slots are serialized into the preallocated buffer, so the steady state publishing path
+// does not allocate.
+//
+// Every payload carries a sequence number. Deltas only hold the dirty slots, snapshots hold every assigned slot and
+// are marked with "snapshot":true, so a subscriber that sees a gap in the sequence can wait for or request the next
+// snapshot. Slots are only accepted while a snapshot of all of them is guaranteed to fit into the buffer.
+class StateStore final
+{
+  public:
+    constexpr static const size_t MAX_SLOTS = 32;
+    constexpr static const size_t MAX_KEY_LENGTH = 48;
+    constexpr static const size_t BUFFER_SIZE = 1024;
+
+    StateStore();
+    StateStore(const StateStore &) = delete;
+    StateStore &operator=(const StateStore &) = delete;
+
+    StateHandle add(const std::string &id, const char *property);
+    StateHandle find(const std::string &id, const char *property) const;
+
+    void set(StateHandle handle, bool value);
+    void set(StateHandle handle, int value);
+    void set(StateHandle handle, float value);
+
+    bool has_dirty() const
+    {
+        return m_dirty != 0;
+    }
+
+    // Publishes the slot again even if its value did not change
+    void mark_dirty(StateHandle handle);
+    void mark_all_dirty();
+
+    // Writes dirty slots as one JSON object into the internal buffer and clears their dirty bits. Slots that do not
+    // fit stay dirty for the next call. Returns the payload length, 0 if nothing was written.
+    size_t write_dirty();
+    // Writes every assigned slot straight from the slots and clears all dirty bits. Returns the payload length.
+    size_t write_snapshot();
+
+    // Clears the dirty bit of the first dirty slot and returns it, INVALID_STATE_HANDLE if there is none
+    StateHandle take_dirty();
+    // Writes the bare value of a slot as used on per-entity topics. Returns the length, 0 if it does not fit.
+    size_t write_raw(StateHandle handle, char *buffer, size_t size) const;
+
+    // Marks the slots of the last written payload dirty again, e.g. when it could not be published
+    void restore_written()
+    {
+        m_dirty |= m_written;
+    }
+
+    // Sequence number of the last written payload
+    uint32_t get_sequence() const
+    {
+        return m_sequence;
+    }
+
+    const char *payload() const
+    {
+        return m_buffer;
+    }
+
+  private:
+    enum class Type : uint8_t
+    {
+        BOOL,
+        INT,
+        FLOAT
+    };
+
+    struct Slot
+    {
+        char key[MAX_KEY_LENGTH + 1];
+        Type type;
+        bool assigned;
+        // Floats are kept in tenths, which is the published precision
+        int32_t value;
+    };
+
+    void assign(StateHandle handle, Type type, int32_t value);
+    int write_value(const Slot &slot, char *buffer, size_t size) const;
+    size_t write(uint32_t mask, bool snapshot);
+
+  private:
+    Slot m_slots[MAX_SLOTS];
+    size_t m_count = 0;
+    uint32_t m_dirty = 0;
+    uint32_t m_written = 0;
+    uint32_t m_sequence = 0;
+    // Longest possible snapshot of the registered slots
+    size_t m_snapshot_bound;
+    char m_buffer[BUFFER_SIZE];
+};
+
+} // namespace mqtt
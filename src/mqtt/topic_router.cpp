@@ -0,0 +1,173 @@
+#include "topic_router.h"
+
+namespace mqtt
+{
+
+constexpr static const uint16_t ROOT = 0;
+constexpr static const uint16_t DEVICE_ROOT = 1;
+
+static std::string_view next_level(std::string_view &rest, bool &at_end)
+{
+    const size_t separator = rest.find('/');
+    if (separator == std::string_view::npos)
+    {
+        const std::string_view level = rest;
+        rest = std::string_view();
+        at_end = true;
+        return level;
+    }
+
+    const std::string_view level = rest.substr(0, separator);
+    rest.remove_prefix(separator + 1);
+    return level;
+}
+
+// True if the filter can match topics under the prefix, which then also have to be matched against the root trie
+static bool overlaps_prefix(std::string_view filter, std::string_view prefix)
+{
+    if (prefix.empty())
+        return false;
+    if (prefix.back() == '/')
+        prefix.remove_suffix(1);
+
+    bool filter_end = false;
+    bool prefix_end = false;
+    while (!prefix_end)
+    {
+        if (filter_end)
+            return false;
+        const auto level = next_level(filter, filter_end);
+        const auto prefix_level = next_level(prefix, prefix_end);
+        if (level == "#")
+            return true;
+        if (level != "+" && level != prefix_level)
+            return false;
+    }
+
+    // Device topics have at least one level after the prefix
+    return !filter_end;
+}
+
+TopicRouter::TopicRouter(const std::string &device_prefix) : m_device_prefix(device_prefix), m_nodes(2)
+{
+}
+
+uint16_t TopicRouter::get_child(uint16_t parent, std::string_view level)
+{
+    uint16_t *special = level == "+" ? &m_nodes[parent].single_level
+                        : level == "#" ? &m_nodes[parent].multi_level
+                                       : nullptr;
+    if (special != nullptr && *special != NONE)
+        return *special;
+
+    if (special == nullptr)
+    {
+        for (const auto child : m_nodes[parent].children)
+        {
+            if (m_nodes[child].level == level)
+                return child;
+        }
+    }
+
+    const auto child = static_cast<uint16_t>(m_nodes.size());
+    m_nodes.emplace_back();
+    m_nodes.back().level = std::string(level);
+    // The vector may have been reallocated
+    if (level == "+")
+        m_nodes[parent].single_level = child;
+    else if (level == "#")
+        m_nodes[parent].multi_level = child;
+    else
+        m_nodes[parent].children.push_back(child);
+
+    return child;
+}
+
+bool TopicRouter::add(const std::string &filter, TopicHandler handler)
+{
+    if (filter.empty() || m_nodes.size() >= NONE - 1)
+        return false;
+
+    const bool device_topic = !m_device_prefix.empty() && filter.size() > m_device_prefix.size() &&
+                              filter.compare(0, m_device_prefix.size(), m_device_prefix) == 0;
+    std::string_view rest(filter);
+    if (device_topic)
+        rest.remove_prefix(m_device_prefix.size());
+
+    uint16_t node = device_topic ? DEVICE_ROOT : ROOT;
+    bool at_end = false;
+    while (!at_end)
+    {
+        const auto level = next_level(rest, at_end);
+        // Wildcards must span a whole level and '#' must be the last one
+        if ((level.size() > 1 && level.find_first_of("+#") != std::string_view::npos) || (level == "#" && !at_end))
+            return false;
+        node = get_child(node, level);
+    }
+
+    if (m_nodes[node].handler != NONE)
+        return false;
+
+    if (!device_topic && overlaps_prefix(filter, m_device_prefix))
+        m_root_overlaps_device = true;
+    m_nodes[node].handler = static_cast<uint16_t>(m_handlers.size());
+    m_handlers.push_back(std::move(handler));
+    m_filters.push_back(filter);
+    return true;
+}
+
+size_t TopicRouter::dispatch(std::string_view topic, std::string_view payload) const
+{
+    size_t matched = 0;
+    if (!m_device_prefix.empty() && topic.size() > m_device_prefix.size() &&
+        topic.compare(0, m_device_prefix.size(), m_device_prefix) == 0)
+    {
+        match(DEVICE_ROOT, topic, topic.substr(m_device_prefix.size()), false, payload, matched);
+        if (!m_root_overlaps_device)
+            return matched;
+    }
+
+    match(ROOT, topic, topic, false, payload, matched);
+    return matched;
+}
+
+void TopicRouter::match(uint16_t node, std::string_view topic, std::string_view rest, bool at_end,
+                        std::string_view payload, size_t &matched) const
+{
+    const Node &current = m_nodes[node];
+
+    // '#' also matches the parent level itself, but wildcards at the root never match '$' topics
+    if (current.multi_level != NONE && !(node == ROOT && !topic.empty() && topic[0] == '$'))
+        call(current.multi_level, topic, payload, matched);
+
+    if (at_end)
+    {
+        call(node, topic, payload, matched);
+        return;
+    }
+
+    const auto level = next_level(rest, at_end);
+    for (const auto child : current.children)
+    {
+        if (m_nodes[child].level == level)
+        {
+            match(child, topic, rest, at_end, payload, matched);
+            break;
+        }
+    }
+
+    if (current.single_level != NONE && !(node == ROOT && !level.empty() && level[0] == '$'))
+        match(current.single_level, topic, rest, at_end, payload, matched);
+}
+
+void TopicRouter::call(uint16_t node, std::string_view topic, std::string_view payload, size_t &matched) const
+{
+    const auto handler = m_nodes[node].handler;
+    if (handler == NONE)
+        return;
+
+    m_handlers[handler](topic, payload);
+    ++matched;
+}
+
+} // namespace mqtt
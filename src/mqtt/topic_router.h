@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace mqtt
+{
+
+typedef std::function<void(std::string_view topic, std::string_view payload)> TopicHandler;
+
+// Dispatches inbound messages through a trie of topic levels that is built once when subscribing. Topics under the
+// device prefix are matched without it, so a command is one prefix comparison plus a few short level comparisons,
+// and nothing is allocated. Filters support the MQTT '+' and '#' wildcards.
+class TopicRouter final
+{
+  public:
+    explicit TopicRouter(const std::string &device_prefix);
+
+    TopicRouter(const TopicRouter &) = delete;
+    TopicRouter &operator=(const TopicRouter &) = delete;
+
+    // Returns false if the filter is invalid or already has a handler
+    bool add(const std::string &filter, TopicHandler handler);
+
+    // Returns the number of handlers that were called
+    size_t dispatch(std::string_view topic, std::string_view payload) const;
+
+    const std::vector<std::string> &get_filters() const
+    {
+        return m_filters;
+    }
+
+  private:
+    constexpr static const uint16_t NONE = 0xffff;
+
+    struct Node
+    {
+        std::string level;
+        std::vector<uint16_t> children;
+        uint16_t single_level = NONE;
+        uint16_t multi_level = NONE;
+        uint16_t handler = NONE;
+    };
+
+    uint16_t get_child(uint16_t parent, std::string_view level);
+    void match(uint16_t node, std::string_view topic, std::string_view rest, bool at_end, std::string_view payload,
+               size_t &matched) const;
+    void call(uint16_t node, std::string_view topic, std::string_view payload, size_t &matched) const;
+
+  private:
+    const std::string m_device_prefix;
+    std::vector<Node> m_nodes;
+    std::vector<TopicHandler> m_handlers;
+    std::vector<std::string> m_filters;
+    // Some filter outside the device prefix, like "nosyna/+/led/set", also matches device topics
+    bool m_root_overlaps_device = false;
+};
+
+} // namespace mqtt
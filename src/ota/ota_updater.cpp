@@ -0,0 +1,179 @@
+#include "ota_updater.h"
+
+#include "hal/log.h"
+#include "hal/task.h"
+
+#include <cinttypes>
+#include <cstring>
+
+constexpr static const char OTA_MAGIC[4] = {'N', 'O', 'T', 'A'};
+// Read buffer on the stack of the download task
+constexpr static const size_t CHUNK_SIZE = 1024;
+constexpr static const uint32_t PROGRESS_STEP_PERCENT = 10;
+
+static uint32_t read_le32(const uint8_t *data)
+{
+    return uint32_t(data[0]) | uint32_t(data[1]) << 8 | uint32_t(data[2]) << 16 | uint32_t(data[3]) << 24;
+}
+
+bool OtaImageHeader::parse(const uint8_t *data, size_t size, OtaImageHeader &header)
+{
+    if (size < SIZE || memcmp(data, OTA_MAGIC, sizeof(OTA_MAGIC)) != 0 || data[4] != VERSION)
+        return false;
+
+    // The inflater needs a window of at least 2^8 and the ring buffer holds at most 2^15
+    header.window_bits = data[5];
+    if (header.window_bits != 0 && (header.window_bits < 8 || header.window_bits > 15))
+        return false;
+
+    header.image_size = read_le32(data + 8);
+    memcpy(header.sha256, data + 12, sizeof(header.sha256));
+    memcpy(header.app_digest, data + 44, sizeof(header.app_digest));
+    return header.image_size > 0;
+}
+
+OtaUpdater::OtaUpdater(hal::Clock &clock, mqtt::Client &mqtt_client, const std::string &url,
+                       const OtaOptions &options)
+    : m_clock(clock), m_mqtt(mqtt_client), m_url(url), m_options(options)
+{
+}
+
+void OtaUpdater::setup()
+{
+    m_verifying = hal::get_firmware_state() == hal::FirmwareState::PENDING_VERIFY;
+    if (m_verifying)
+        ESP_LOGW(OTA_LOG_TAG, "New image is kept once it connects to MQTT within %" PRIu32 " ms",
+                 m_options.validation_timeout_ms);
+    m_next_check_ms = m_clock.millis() + m_options.first_check_ms;
+    ESP_LOGI(OTA_LOG_TAG, "Images are pulled from %s every %" PRIu32 " ms", m_url.c_str(),
+             m_options.check_interval_ms);
+}
+
+void OtaUpdater::loop()
+{
+    const uint32_t now = m_clock.millis();
+    if (m_verifying)
+    {
+        if (m_mqtt.is_connected())
+        {
+            m_verifying = false;
+            hal::confirm_firmware();
+            ESP_LOGI(OTA_LOG_TAG, "New image connected to MQTT after %" PRIu32 " ms and is kept", now);
+        }
+        else if (now >= m_options.validation_timeout_ms)
+        {
+            ESP_LOGE(OTA_LOG_TAG, "New image did not connect to MQTT, rolling back");
+            if (m_on_restart != nullptr)
+                m_on_restart();
+            hal::reject_firmware();
+        }
+        // No update on top of an image that may still be rolled back
+        return;
+    }
+
+    switch (m_state.load())
+    {
+    case OtaState::DOWNLOADING:
+        return;
+    case OtaState::READY:
+        ESP_LOGI(OTA_LOG_TAG, "Restarting into the new image");
+        if (m_on_restart != nullptr)
+            m_on_restart();
+        hal::restart();
+        return;
+    case OtaState::IDLE:
+    case OtaState::FAILED:
+        break;
+    }
+
+    if (static_cast<int32_t>(now - m_next_check_ms) < 0 || !m_mqtt.is_connected())
+        return;
+
+    m_next_check_ms = now + m_options.check_interval_ms;
+    m_state.store(OtaState::DOWNLOADING);
+    hal::start_task("ota", download_task, this, m_options.task_stack_size, m_options.task_priority,
+                    m_options.task_core);
+}
+
+void OtaUpdater::download_task(void *argument)
+{
+    auto &updater = *static_cast<OtaUpdater *>(argument);
+    const uint32_t started = updater.m_clock.millis();
+    const OtaState state = updater.download();
+    if (state == OtaState::READY)
+        ESP_LOGI(OTA_LOG_TAG, "Image written and verified in %" PRIu32 " ms", updater.m_clock.millis() - started);
+    // Stored last, loop() may restart right after
+    updater.m_state.store(state);
+    hal::end_task();
+}
+
+OtaState OtaUpdater::download()
+{
+    hal::HttpDownload http;
+    if (!http.open(m_url.c_str()))
+        return OtaState::FAILED;
+
+    OtaImageHeader header;
+    if (!read_header(http, header))
+    {
+        ESP_LOGE(OTA_LOG_TAG, "Image header is missing or invalid");
+        return OtaState::FAILED;
+    }
+
+    uint8_t running[hal::FIRMWARE_SHA256_SIZE];
+    if (hal::get_running_firmware_digest(running) && memcmp(running, header.app_digest, sizeof(running)) == 0)
+    {
+        ESP_LOGD(OTA_LOG_TAG, "Running image is up to date");
+        return OtaState::IDLE;
+    }
+
+    hal::FirmwareWriter writer;
+    ESP_LOGI(OTA_LOG_TAG, "Downloading an image of %" PRIu32 " bytes, window of %u bits", header.image_size,
+             static_cast<unsigned int>(header.window_bits));
+    if (!writer.begin(header.image_size, header.window_bits))
+        return OtaState::FAILED;
+
+    uint8_t buffer[CHUNK_SIZE];
+    uint32_t next_percent = PROGRESS_STEP_PERCENT;
+    for (;;)
+    {
+        const int read = http.read(buffer, sizeof(buffer), m_options.read_timeout_ms);
+        if (read < 0)
+            break;
+        if (read == 0)
+        {
+            ESP_LOGE(OTA_LOG_TAG, "Download stalled after %" PRIu32 " bytes", writer.get_written());
+            writer.abort();
+            return OtaState::FAILED;
+        }
+        if (!writer.write(buffer, static_cast<size_t>(read)))
+        {
+            writer.abort();
+            return OtaState::FAILED;
+        }
+
+        const uint32_t percent = static_cast<uint32_t>(uint64_t(writer.get_written()) * 100 / header.image_size);
+        if (percent >= next_percent)
+        {
+            ESP_LOGI(OTA_LOG_TAG, "OTA %" PRIu32 "%%", percent);
+            next_percent = percent - percent % PROGRESS_STEP_PERCENT + PROGRESS_STEP_PERCENT;
+        }
+    }
+
+    http.close();
+    return writer.finish(header.sha256) ? OtaState::READY : OtaState::FAILED;
+}
+
+bool OtaUpdater::read_header(hal::HttpDownload &http, OtaImageHeader &header)
+{
+    uint8_t data[OtaImageHeader::SIZE];
+    size_t size = 0;
+    while (size < sizeof(data))
+    {
+        const int read = http.read(data + size, sizeof(data) - size, m_options.read_timeout_ms);
+        if (read <= 0)
+            return false;
+        size += static_cast<size_t>(read);
+    }
+    return OtaImageHeader::parse(data, size, header);
+}
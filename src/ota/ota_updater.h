@@ -0,0 +1,97 @@
+#pragma once
+
+#include "mqtt/client.h"
+
+#include "hal/clock.h"
+#include "hal/firmware.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+constexpr const char *OTA_LOG_TAG = "ota";
+
+// Header tools/pack_ota.py puts in front of the image, all numbers little endian
+struct OtaImageHeader
+{
+    constexpr static const size_t SIZE = 76;
+    constexpr static const uint8_t VERSION = 1;
+
+    // Of the zlib stream that follows, 0 if the image is not compressed
+    uint8_t window_bits = 0;
+    // Of the decompressed image
+    uint32_t image_size = 0;
+    uint8_t sha256[hal::FIRMWARE_SHA256_SIZE] = {};
+    // Digest the build appended to the image, compared with the running one
+    uint8_t app_digest[hal::FIRMWARE_SHA256_SIZE] = {};
+
+    static bool parse(const uint8_t *data, size_t size, OtaImageHeader &header);
+};
+
+enum class OtaState : uint8_t
+{
+    IDLE,
+    DOWNLOADING,
+    // Written and verified, the device restarts into it
+    READY,
+    FAILED
+};
+
+struct OtaOptions
+{
+    uint32_t first_check_ms = 60000;
+    uint32_t check_interval_ms = 3600000;
+    // A new image that does not reach the broker by then is rolled back
+    uint32_t validation_timeout_ms = 300000;
+    // The download is abandoned if the server sends nothing for that long
+    uint32_t read_timeout_ms = 10000;
+    uint32_t task_stack_size = 6144;
+    unsigned int task_priority = 1;
+    int task_core = 0;
+};
+
+// Pulls compressed images from a local HTTP server. A background task streams the download through the inflater
+// into the inactive app partition, so neither the controls nor MQTT wait for the flash. After a restart into the new
+// image, it is only kept once it connected to the broker, otherwise the bootloader goes back to the previous one.
+class OtaUpdater final
+{
+  public:
+    OtaUpdater(hal::Clock &clock, mqtt::Client &mqtt_client, const std::string &url,
+               const OtaOptions &options = OtaOptions());
+    OtaUpdater(const OtaUpdater &) = delete;
+    OtaUpdater &operator=(const OtaUpdater &) = delete;
+
+    // Called from loop() right before the restart into a new image
+    void set_on_restart(std::function<void()> on_restart)
+    {
+        m_on_restart = on_restart;
+    }
+
+    void setup();
+    // From the control task
+    void loop();
+
+    OtaState get_state() const
+    {
+        return m_state.load();
+    }
+
+  private:
+    static void download_task(void *argument);
+    OtaState download();
+    bool read_header(hal::HttpDownload &http, OtaImageHeader &header);
+
+  private:
+    hal::Clock &m_clock;
+    mqtt::Client &m_mqtt;
+    const std::string m_url;
+    const OtaOptions m_options;
+    std::function<void()> m_on_restart;
+
+    bool m_verifying = false;
+    uint32_t m_next_check_ms = 0;
+    // Written by the download task until it ends
+    std::atomic<OtaState> m_state{OtaState::IDLE};
+};
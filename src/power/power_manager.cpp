@@ -0,0 +1,93 @@
+#include "power_manager.h"
+
+#include "hal/log.h"
+
+#include <algorithm>
+#include <cinttypes>
+
+PowerManager::PowerManager(hal::Clock &clock, hal::Network &network, const PowerOptions &options)
+    : m_clock(clock), m_network(network), m_options(options)
+{
+}
+
+void PowerManager::setup()
+{
+    m_window_started_us = m_clock.micros();
+    if (m_options.mode == PowerMode::PERFORMANCE)
+    {
+        ESP_LOGI(POWER_LOG_TAG, "Power mode: performance");
+        return;
+    }
+
+    if (!hal::configure_power(m_options.config))
+    {
+        ESP_LOGW(POWER_LOG_TAG, "Power management is not available, staying in performance mode");
+        return;
+    }
+
+    m_network.set_power_save(true);
+    m_mode = PowerMode::POWER_SAVE;
+    ESP_LOGI(POWER_LOG_TAG, "Power mode: power save, %" PRIu32 "-%" PRIu32 " MHz, light sleep %s",
+             m_options.config.min_cpu_mhz, m_options.config.max_cpu_mhz, m_options.config.light_sleep ? "on" : "off");
+}
+
+void PowerManager::add_task()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_tasks;
+}
+
+bool PowerManager::idle(hal::Event &event, uint32_t timeout_ms)
+{
+    begin_idle();
+    const bool notified = event.wait(timeout_ms);
+    end_idle();
+    return notified;
+}
+
+void PowerManager::idle(uint32_t timeout_ms)
+{
+    begin_idle();
+    hal::sleep_ms(timeout_ms);
+    end_idle();
+}
+
+void PowerManager::begin_idle()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (++m_idle_tasks == m_tasks)
+        m_idle_started_us = m_clock.micros();
+}
+
+void PowerManager::end_idle()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_idle_tasks-- == m_tasks)
+    {
+        const uint32_t now = m_clock.micros();
+        // Only the part of the sleep within the current window
+        m_asleep_us += std::min(now - m_idle_started_us, now - m_window_started_us);
+        ++m_wakeups;
+    }
+}
+
+PowerStats PowerManager::take_stats()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const uint32_t now = m_clock.micros();
+    const uint32_t window_us = now - m_window_started_us;
+    // Called from a task that does not wait through the manager while all others wait, the sleep so far belongs to
+    // this window and end_idle() only adds the rest
+    if (m_tasks > 0 && m_idle_tasks == m_tasks)
+        m_asleep_us += std::min(now - m_idle_started_us, window_us);
+
+    PowerStats stats;
+    stats.window_ms = window_us / 1000;
+    stats.awake_ms = (window_us - std::min(m_asleep_us, window_us)) / 1000;
+    stats.wakeups = m_wakeups;
+
+    m_window_started_us = now;
+    m_asleep_us = 0;
+    m_wakeups = 0;
+    return stats;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "hal/clock.h"
+#include "hal/network.h"
+#include "hal/system.h"
+#include "hal/task.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+constexpr const char *POWER_LOG_TAG = "power";
+
+enum class PowerMode : uint8_t
+{
+    // Full clock, the network task polls every millisecond
+    PERFORMANCE,
+    // Frequency scaling, automatic light sleep and WiFi modem sleep, for battery powered devices
+    POWER_SAVE
+};
+
+struct PowerOptions
+{
+    PowerMode mode = PowerMode::PERFORMANCE;
+    // Only used with POWER_SAVE
+    hal::PowerConfig config;
+    // How long the network task sleeps between polls, commands wait up to that long
+    uint32_t performance_poll_ms = 1;
+    uint32_t power_save_poll_ms = 20;
+};
+
+// Current draw proxies of one window
+struct PowerStats
+{
+    uint32_t window_ms = 0;
+    // Time with at least one task running
+    uint32_t awake_ms = 0;
+    // Times a task started running while all were waiting
+    uint32_t wakeups = 0;
+};
+
+// Applies the power mode and tracks how long every task waits. The chip can only light sleep while all of them wait,
+// so that time and the number of wakeups from it compare the modes without measuring the current.
+class PowerManager final
+{
+  public:
+    PowerManager(hal::Clock &clock, hal::Network &network, const PowerOptions &options = PowerOptions());
+    PowerManager(const PowerManager &) = delete;
+    PowerManager &operator=(const PowerManager &) = delete;
+
+    // Before the network is started. Falls back to PERFORMANCE if the SDK has no power management.
+    void setup();
+
+    // Every task that waits through the manager is added once before it runs
+    void add_task();
+
+    // Waits for the event or the timeout, returns false on timeout
+    bool idle(hal::Event &event, uint32_t timeout_ms);
+    void idle(uint32_t timeout_ms);
+    // Around a wait of another kind
+    void begin_idle();
+    void end_idle();
+
+    // The stats since the previous call
+    PowerStats take_stats();
+
+    PowerMode get_mode() const
+    {
+        return m_mode;
+    }
+
+    uint32_t get_network_poll_ms() const
+    {
+        return m_mode == PowerMode::POWER_SAVE ? m_options.power_save_poll_ms : m_options.performance_poll_ms;
+    }
+
+  private:
+    hal::Clock &m_clock;
+    hal::Network &m_network;
+    const PowerOptions m_options;
+    PowerMode m_mode = PowerMode::PERFORMANCE;
+
+    // Tasks run on both cores
+    std::mutex m_mutex;
+    size_t m_tasks = 0;
+    size_t m_idle_tasks = 0;
+    uint32_t m_idle_started_us = 0;
+    uint32_t m_window_started_us = 0;
+    // All tasks waited that long in the current window
+    uint32_t m_asleep_us = 0;
+    uint32_t m_wakeups = 0;
+};
@@ -0,0 +1,235 @@
+#include "scheduler.h"
+
+#include "hal/log.h"
+
+#include <cinttypes>
+
+Scheduler::Scheduler(hal::Clock &clock) : m_clock(clock), m_current_ms(clock.millis())
+{
+    for (auto &level : m_slots)
+    {
+        for (auto &slot : level)
+            slot = INVALID_TASK_ID;
+    }
+}
+
+TaskId Scheduler::add(const char *name, ScheduledFunction function, uint32_t period_ms, uint32_t deadline_ms)
+{
+    if (m_task_count == MAX_TASKS)
+    {
+        ESP_LOGE(SCHEDULER_LOG_TAG, "No free task slot for '%s'", name);
+        return INVALID_TASK_ID;
+    }
+
+    auto &task = m_tasks[m_task_count];
+    task.name = name;
+    task.function = function;
+    task.period_ms = period_ms;
+    task.deadline_ms = deadline_ms;
+    return static_cast<TaskId>(m_task_count++);
+}
+
+TaskId Scheduler::add_periodic(const char *name, uint32_t period_ms, ScheduledFunction function, uint32_t deadline_ms)
+{
+    if (period_ms == 0)
+        period_ms = 1;
+    const TaskId task = add(name, function, period_ms, deadline_ms ? deadline_ms : period_ms);
+    if (task != INVALID_TASK_ID)
+        schedule(task, period_ms);
+    return task;
+}
+
+TaskId Scheduler::add_one_shot(const char *name, ScheduledFunction function, uint32_t deadline_ms)
+{
+    return add(name, function, 0, deadline_ms);
+}
+
+void Scheduler::schedule(TaskId task, uint32_t delay_ms)
+{
+    if (task >= m_task_count)
+        return;
+
+    unlink(task);
+    m_tasks[task].cancelled = false;
+    m_tasks[task].expires_ms = m_clock.millis() + delay_ms;
+    arm(task);
+}
+
+void Scheduler::cancel(TaskId task)
+{
+    if (task >= m_task_count)
+        return;
+
+    unlink(task);
+    m_tasks[task].cancelled = true;
+}
+
+void Scheduler::arm(TaskId id)
+{
+    // Never into a tick that was processed already
+    auto &task = m_tasks[id];
+    if (static_cast<int32_t>(task.expires_ms - m_current_ms) <= 0)
+        task.expires_ms = m_current_ms + 1;
+    insert(id);
+}
+
+void Scheduler::insert(TaskId id)
+{
+    auto &task = m_tasks[id];
+    // The lowest level whose span holds the remaining time
+    const uint32_t remaining = task.expires_ms - m_current_ms;
+    size_t level = 0;
+    while (level < LEVELS - 1 && remaining >= (uint32_t(1) << (SLOT_BITS * (level + 1))))
+        ++level;
+
+    const size_t slot = (task.expires_ms >> (SLOT_BITS * level)) & (SLOTS - 1);
+    task.level = static_cast<uint8_t>(level);
+    task.slot = static_cast<uint8_t>(slot);
+    task.previous = INVALID_TASK_ID;
+    task.next = m_slots[level][slot];
+    if (task.next != INVALID_TASK_ID)
+        m_tasks[task.next].previous = id;
+    m_slots[level][slot] = id;
+    m_occupied[level] |= uint64_t(1) << slot;
+    task.armed = true;
+}
+
+void Scheduler::unlink(TaskId id)
+{
+    auto &task = m_tasks[id];
+    if (!task.armed)
+        return;
+
+    if (task.previous != INVALID_TASK_ID)
+        m_tasks[task.previous].next = task.next;
+    else
+        m_slots[task.level][task.slot] = task.next;
+    if (task.next != INVALID_TASK_ID)
+        m_tasks[task.next].previous = task.previous;
+    if (m_slots[task.level][task.slot] == INVALID_TASK_ID)
+        m_occupied[task.level] &= ~(uint64_t(1) << task.slot);
+
+    task.armed = false;
+}
+
+void Scheduler::cascade(size_t level)
+{
+    // Tasks of the slot that starts now move down to the levels below, those due now into the slot of this tick
+    const size_t slot = (m_current_ms >> (SLOT_BITS * level)) & (SLOTS - 1);
+    TaskId id = m_slots[level][slot];
+    m_slots[level][slot] = INVALID_TASK_ID;
+    m_occupied[level] &= ~(uint64_t(1) << slot);
+    while (id != INVALID_TASK_ID)
+    {
+        const TaskId next = m_tasks[id].next;
+        m_tasks[id].armed = false;
+        insert(id);
+        id = next;
+    }
+}
+
+void Scheduler::advance_to(uint32_t now_ms)
+{
+    while (static_cast<int32_t>(now_ms - m_current_ms) > 0)
+    {
+        if ((m_occupied[0] | m_occupied[1] | m_occupied[2] | m_occupied[3]) == 0)
+        {
+            m_current_ms = now_ms;
+            return;
+        }
+
+        // Nothing expires on level 0 before the next boundary, skip to it
+        const uint32_t boundary = (m_current_ms | (SLOTS - 1)) + 1;
+        if (m_occupied[0] == 0)
+            m_current_ms = static_cast<int32_t>(now_ms - boundary) >= 0 ? boundary : now_ms;
+        else
+            ++m_current_ms;
+
+        if ((m_current_ms & (SLOTS - 1)) == 0)
+        {
+            for (size_t level = 1; level < LEVELS; ++level)
+            {
+                cascade(level);
+                if (((m_current_ms >> (SLOT_BITS * level)) & (SLOTS - 1)) != 0)
+                    break;
+            }
+        }
+
+        const size_t slot = m_current_ms & (SLOTS - 1);
+        while (m_slots[0][slot] != INVALID_TASK_ID)
+        {
+            const TaskId id = m_slots[0][slot];
+            unlink(id);
+            execute(id);
+        }
+    }
+}
+
+void Scheduler::execute(TaskId id)
+{
+    auto &task = m_tasks[id];
+    const uint32_t due_ms = task.expires_ms;
+    const uint32_t started_us = m_clock.micros();
+    const uint32_t lateness_ms = m_clock.millis() - due_ms;
+
+    task.function();
+
+    const uint32_t finished_ms = m_clock.millis();
+    ++task.stats.runs;
+    task.stats.runtime_us.add(m_clock.micros() - started_us);
+    task.stats.lateness_ms.add(lateness_ms);
+    if (finished_ms - due_ms > task.deadline_ms)
+    {
+        ++task.stats.deadline_misses;
+        ESP_LOGD(SCHEDULER_LOG_TAG, "Task '%s' missed its deadline by %" PRIu32 " ms", task.name,
+                 finished_ms - due_ms - task.deadline_ms);
+    }
+
+    // The function may have armed or cancelled the task itself
+    if (task.period_ms == 0 || task.armed || task.cancelled)
+        return;
+
+    // Stays on the grid of the period, periods that passed completely are skipped
+    uint32_t next_ms = due_ms + task.period_ms;
+    if (static_cast<int32_t>(next_ms - finished_ms) <= 0)
+    {
+        const uint32_t skipped = (finished_ms - due_ms) / task.period_ms;
+        task.stats.deadline_misses += skipped;
+        next_ms = due_ms + (skipped + 1) * task.period_ms;
+    }
+    task.expires_ms = next_ms;
+    arm(id);
+}
+
+void Scheduler::run()
+{
+    advance_to(m_clock.millis());
+}
+
+uint32_t Scheduler::get_idle_ms()
+{
+    const uint32_t now = m_clock.millis();
+    uint32_t idle = MAX_IDLE_MS;
+    for (size_t i = 0; i < m_task_count; ++i)
+    {
+        const auto &task = m_tasks[i];
+        if (!task.armed)
+            continue;
+
+        const int32_t remaining = static_cast<int32_t>(task.expires_ms - now);
+        if (remaining <= 0)
+            return 0;
+        if (static_cast<uint32_t>(remaining) < idle)
+            idle = static_cast<uint32_t>(remaining);
+    }
+
+    return idle;
+}
+
+uint32_t Scheduler::get_deadline_misses() const
+{
+    uint32_t misses = 0;
+    for (size_t i = 0; i < m_task_count; ++i)
+        misses += m_tasks[i].stats.deadline_misses;
+    return misses;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "hal/clock.h"
+#include "util/histogram.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+constexpr const char *SCHEDULER_LOG_TAG = "scheduler";
+
+typedef uint8_t TaskId;
+constexpr static const TaskId INVALID_TASK_ID = 0xff;
+
+typedef std::function<void()> ScheduledFunction;
+
+struct ScheduledTaskStats
+{
+    uint32_t runs = 0;
+    // Runs that finished later than their deadline after the time they were due, including skipped periods
+    uint32_t deadline_misses = 0;
+    Histogram<20> runtime_us;
+    // From the time the task was due until it started, the jitter of periodic tasks
+    Histogram<16> lateness_ms;
+};
+
+// Runs periodic and one-shot tasks of one loop from a hierarchical timer wheel with millisecond ticks. The wheel only
+// touches the slots that expire, however many tasks are armed, and get_idle_ms() tells the loop how long it may
+// sleep. Times are compared modulo 2^32, so the wrap of millis() after 49 days is harmless.
+class Scheduler final
+{
+  public:
+    constexpr static const size_t MAX_TASKS = 16;
+    // Four levels of 64 slots cover 2^24 ms, more than 4 hours
+    constexpr static const size_t LEVELS = 4;
+    constexpr static const size_t SLOT_BITS = 6;
+    constexpr static const size_t SLOTS = 1 << SLOT_BITS;
+    // Returned by get_idle_ms() when no task is armed
+    constexpr static const uint32_t MAX_IDLE_MS = 1000;
+
+    Scheduler(hal::Clock &clock);
+    Scheduler(const Scheduler &) = delete;
+    Scheduler &operator=(const Scheduler &) = delete;
+
+    // First run one period from now. A deadline of 0 is the period. The name is not copied.
+    TaskId add_periodic(const char *name, uint32_t period_ms, ScheduledFunction function, uint32_t deadline_ms = 0);
+    // Armed with schedule()
+    TaskId add_one_shot(const char *name, ScheduledFunction function, uint32_t deadline_ms);
+
+    // (Re)arms the task, a delay of 0 runs it with the next tick. Tasks may schedule and cancel themselves.
+    void schedule(TaskId task, uint32_t delay_ms);
+    void cancel(TaskId task);
+
+    // Runs every task that is due
+    void run();
+    // Milliseconds until the next task is due, 0 if one is due already
+    uint32_t get_idle_ms();
+
+    size_t get_task_count() const
+    {
+        return m_task_count;
+    }
+
+    const char *get_name(TaskId task) const
+    {
+        return m_tasks[task].name;
+    }
+
+    const ScheduledTaskStats &get_stats(TaskId task) const
+    {
+        return m_tasks[task].stats;
+    }
+
+    uint32_t get_deadline_misses() const;
+
+  private:
+    struct Task
+    {
+        const char *name = nullptr;
+        ScheduledFunction function;
+        uint32_t period_ms = 0;
+        uint32_t deadline_ms = 0;
+        uint32_t expires_ms = 0;
+        bool armed = false;
+        // Keeps a periodic task that cancels itself from being armed again
+        bool cancelled = false;
+        uint8_t level = 0;
+        uint8_t slot = 0;
+        TaskId previous = INVALID_TASK_ID;
+        TaskId next = INVALID_TASK_ID;
+        ScheduledTaskStats stats;
+    };
+
+    TaskId add(const char *name, ScheduledFunction function, uint32_t period_ms, uint32_t deadline_ms);
+    void arm(TaskId task);
+    void insert(TaskId task);
+    void unlink(TaskId task);
+    void advance_to(uint32_t now_ms);
+    void cascade(size_t level);
+    void execute(TaskId task);
+
+  private:
+    hal::Clock &m_clock;
+    Task m_tasks[MAX_TASKS];
+    size_t m_task_count = 0;
+    TaskId m_slots[LEVELS][SLOTS];
+    // Occupied slots of each level
+    uint64_t m_occupied[LEVELS] = {};
+    // Every tick up to this one was processed
+    uint32_t m_current_ms;
+};
@@ -0,0 +1,172 @@
+#include "settings_store.h"
+
+#include "hal/log.h"
+
+#include <cinttypes>
+#include <cstring>
+
+SettingsStore::SettingsStore(hal::Nvs &nvs, hal::Clock &clock, const SettingsStoreOptions &options)
+    : m_nvs(nvs), m_clock(clock), m_options(options)
+{
+}
+
+SettingHandle SettingsStore::add(const char *key, Type type, int32_t default_value)
+{
+    if (m_count == MAX_SETTINGS)
+    {
+        ESP_LOGE(STORAGE_LOG_TAG, "No free setting slot for '%s'", key);
+        return INVALID_SETTING_HANDLE;
+    }
+
+    if (strlen(key) > MAX_KEY_LENGTH)
+    {
+        ESP_LOGE(STORAGE_LOG_TAG, "Setting key '%s' is too long", key);
+        return INVALID_SETTING_HANDLE;
+    }
+
+    auto &setting = m_settings[m_count];
+    strcpy(setting.key, key);
+    setting.type = type;
+    setting.value = type == Type::BOOL ? m_nvs.get_bool(key, default_value != 0) : m_nvs.get_int(key, default_value);
+    setting.stored = setting.value;
+    setting.writes = 0;
+
+    return static_cast<SettingHandle>(m_count++);
+}
+
+SettingHandle SettingsStore::add_bool(const char *key, bool default_value)
+{
+    return add(key, Type::BOOL, default_value ? 1 : 0);
+}
+
+SettingHandle SettingsStore::add_int(const char *key, int32_t default_value)
+{
+    return add(key, Type::INT, default_value);
+}
+
+bool SettingsStore::get_bool(SettingHandle handle) const
+{
+    return handle < m_count && m_settings[handle].value != 0;
+}
+
+int32_t SettingsStore::get_int(SettingHandle handle) const
+{
+    return handle < m_count ? m_settings[handle].value : 0;
+}
+
+const char *SettingsStore::get_key(SettingHandle handle) const
+{
+    return handle < m_count ? m_settings[handle].key : "";
+}
+
+uint32_t SettingsStore::get_writes(SettingHandle handle) const
+{
+    return handle < m_count ? m_settings[handle].writes : 0;
+}
+
+void SettingsStore::set(SettingHandle handle, bool value)
+{
+    assign(handle, Type::BOOL, value ? 1 : 0);
+}
+
+void SettingsStore::set(SettingHandle handle, int32_t value)
+{
+    assign(handle, Type::INT, value);
+}
+
+void SettingsStore::assign(SettingHandle handle, Type type, int32_t value)
+{
+    if (handle >= m_count || m_settings[handle].type != type)
+    {
+        ESP_LOGW(STORAGE_LOG_TAG, "Unknown setting handle %d", handle);
+        return;
+    }
+
+    auto &setting = m_settings[handle];
+    if (setting.value == value)
+        return;
+
+    const uint32_t now = m_clock.millis();
+    if (m_dirty == 0)
+        m_first_change_ms = now;
+    m_last_change_ms = now;
+
+    setting.value = value;
+    ++m_stats.changes;
+    ++m_changes_since_commit;
+
+    // Changing a setting back before the commit needs no write at all
+    const uint32_t bit = 1u << handle;
+    if (setting.value == setting.stored)
+        m_dirty &= ~bit;
+    else
+        m_dirty |= bit;
+}
+
+void SettingsStore::loop()
+{
+    if (m_dirty == 0)
+        return;
+
+    const uint32_t now = m_clock.millis();
+    if (m_committed && now - m_last_commit_ms < m_options.min_commit_interval_ms)
+        return;
+    if (now - m_last_change_ms < m_options.idle_delay_ms && now - m_first_change_ms < m_options.max_delay_ms)
+        return;
+
+    flush();
+}
+
+bool SettingsStore::flush()
+{
+    if (m_dirty == 0)
+        return true;
+
+    uint32_t written = 0;
+    for (size_t i = 0; i < m_count; ++i)
+    {
+        if ((m_dirty & (1u << i)) == 0)
+            continue;
+
+        const auto &setting = m_settings[i];
+        if (setting.type == Type::BOOL)
+            m_nvs.put_bool(setting.key, setting.value != 0);
+        else
+            m_nvs.put_int(setting.key, setting.value);
+        ++written;
+    }
+
+    const uint32_t now = m_clock.millis();
+    m_committed = true;
+    m_last_commit_ms = now;
+    m_first_change_ms = now;
+    if (!m_nvs.commit())
+    {
+        // Everything stays dirty and is retried after the commit interval
+        ++m_stats.failed_commits;
+        ESP_LOGE(STORAGE_LOG_TAG, "Commit of %" PRIu32 " settings failed", written);
+        return false;
+    }
+
+    for (size_t i = 0; i < m_count; ++i)
+    {
+        if ((m_dirty & (1u << i)) == 0)
+            continue;
+
+        auto &setting = m_settings[i];
+        setting.stored = setting.value;
+        ++setting.writes;
+        ESP_LOGD(STORAGE_LOG_TAG, "Setting '%s' = %d (%" PRIu32 " writes)", setting.key, static_cast<int>(setting.value),
+                 setting.writes);
+    }
+
+    m_dirty = 0;
+    m_stats.key_writes += written;
+    ++m_stats.commits;
+    m_stats.writes_avoided += m_changes_since_commit > written ? m_changes_since_commit - written : 0;
+    m_changes_since_commit = 0;
+    ESP_LOGI(STORAGE_LOG_TAG, "Committed %" PRIu32 " settings (%" PRIu32 " writes avoided so far)", written,
+             m_stats.writes_avoided);
+
+    return true;
+}
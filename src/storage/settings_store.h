@@ -0,0 +1,110 @@
+#pragma once
+
+#include "hal/clock.h"
+#include "hal/nvs.h"
+
+#include <cstddef>
+#include <cstdint>
+
+constexpr const char *STORAGE_LOG_TAG = "storage";
+
+typedef uint8_t SettingHandle;
+constexpr static const SettingHandle INVALID_SETTING_HANDLE = 0xff;
+
+struct SettingsStoreOptions
+{
+    // Dirty settings are committed once nothing changed for this long
+    uint32_t idle_delay_ms = 1000;
+    // While changes keep coming they are committed after this long at the latest
+    uint32_t max_delay_ms = 10000;
+    // Bounds the commit frequency whatever the controls do
+    uint32_t min_commit_interval_ms = 5000;
+};
+
+struct SettingsStoreStats
+{
+    uint32_t changes = 0;
+    uint32_t key_writes = 0;
+    uint32_t commits = 0;
+    uint32_t failed_commits = 0;
+    // Every change used to be a write and a commit of its own
+    uint32_t writes_avoided = 0;
+};
+
+// Write-behind cache for the settings of the controls. Settings are registered once with their NVS key, reads and
+// writes only touch RAM, and changed settings are written and committed together from loop() or flush().
+class SettingsStore final
+{
+  public:
+    constexpr static const size_t MAX_SETTINGS = 16;
+    // Limit of the NVS key length
+    constexpr static const size_t MAX_KEY_LENGTH = 15;
+
+    SettingsStore(hal::Nvs &nvs, hal::Clock &clock, const SettingsStoreOptions &options = SettingsStoreOptions());
+    SettingsStore(const SettingsStore &) = delete;
+    SettingsStore &operator=(const SettingsStore &) = delete;
+
+    // Registers a setting and loads its stored value, so the NVS namespace must be open already
+    SettingHandle add_bool(const char *key, bool default_value);
+    SettingHandle add_int(const char *key, int32_t default_value);
+
+    bool get_bool(SettingHandle handle) const;
+    int32_t get_int(SettingHandle handle) const;
+
+    void set(SettingHandle handle, bool value);
+    void set(SettingHandle handle, int32_t value);
+
+    void loop();
+
+    // Commits dirty settings right away, e.g. before an OTA update restarts the device
+    bool flush();
+
+    bool has_dirty() const
+    {
+        return m_dirty != 0;
+    }
+
+    const char *get_key(SettingHandle handle) const;
+    uint32_t get_writes(SettingHandle handle) const;
+
+    const SettingsStoreStats &get_stats() const
+    {
+        return m_stats;
+    }
+
+  private:
+    enum class Type : uint8_t
+    {
+        BOOL,
+        INT
+    };
+
+    struct Setting
+    {
+        char key[MAX_KEY_LENGTH + 1];
+        Type type;
+        int32_t value;
+        int32_t stored;
+        uint32_t writes;
+    };
+
+    SettingHandle add(const char *key, Type type, int32_t default_value);
+    void assign(SettingHandle handle, Type type, int32_t value);
+
+  private:
+    hal::Nvs &m_nvs;
+    hal::Clock &m_clock;
+    const SettingsStoreOptions m_options;
+
+    Setting m_settings[MAX_SETTINGS];
+    size_t m_count = 0;
+    uint32_t m_dirty = 0;
+    uint32_t m_changes_since_commit = 0;
+
+    uint32_t m_first_change_ms = 0;
+    uint32_t m_last_change_ms = 0;
+    bool m_committed = false;
+    uint32_t m_last_commit_ms = 0;
+
+    SettingsStoreStats m_stats;
+};
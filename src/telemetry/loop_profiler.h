@@ -0,0 +1,129 @@
+#pragma once
+
+#include "hal/clock.h"
+#include "util/histogram.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+typedef uint8_t LoopStage;
+constexpr static const LoopStage INVALID_LOOP_STAGE = 0xff;
+
+// Cycles spent in every stage of a loop and the period of the whole loop, collected in windows. Marks only read the
+// cycle counter and add to a histogram, the cycles spent in them are counted as overhead.
+//
+// Only the task that runs the loop touches the current window. Another task reads a finished window with
+// request_window() and take_window(): the loop hands the window over at its next start(), so reading needs no lock.
+class LoopProfiler final
+{
+  public:
+    constexpr static const size_t MAX_STAGES = 8;
+    // Up to 2^27 cycles, more than half a second at 240 MHz
+    typedef Histogram<28> CycleHistogram;
+
+    struct Window
+    {
+        CycleHistogram stages[MAX_STAGES];
+        CycleHistogram loop;
+        uint64_t overhead_cycles = 0;
+    };
+
+    // The name is not copied
+    LoopProfiler(hal::Clock &clock, const char *name) : m_clock(clock), Name(name)
+    {
+    }
+
+    LoopProfiler(const LoopProfiler &) = delete;
+    LoopProfiler &operator=(const LoopProfiler &) = delete;
+
+    // Stages are added before the loop runs, the name is not copied
+    LoopStage add_stage(const char *name)
+    {
+        if (m_stage_count == MAX_STAGES)
+            return INVALID_LOOP_STAGE;
+
+        m_stage_names[m_stage_count] = name;
+        return static_cast<LoopStage>(m_stage_count++);
+    }
+
+    // Called first thing in every loop
+    void start()
+    {
+        const uint32_t now = m_clock.cycles();
+        if (m_running)
+            m_current.loop.add(now - m_loop_started);
+        m_loop_started = now;
+        m_running = true;
+
+        if (m_requested.load(std::memory_order_acquire))
+        {
+            m_finished = m_current;
+            m_current = Window();
+            m_requested.store(false, std::memory_order_relaxed);
+            m_ready.store(true, std::memory_order_release);
+        }
+
+        m_last = m_clock.cycles();
+        m_current.overhead_cycles += m_last - now;
+    }
+
+    // Called when a stage is done, the stage started with the previous mark or start()
+    void mark(LoopStage stage)
+    {
+        const uint32_t now = m_clock.cycles();
+        if (stage < m_stage_count)
+            m_current.stages[stage].add(now - m_last);
+
+        m_last = m_clock.cycles();
+        m_current.overhead_cycles += m_last - now;
+    }
+
+    // Called before the loop sleeps, the loop then ends here instead of at the next start()
+    void stop()
+    {
+        const uint32_t now = m_clock.cycles();
+        if (m_running)
+            m_current.loop.add(now - m_loop_started);
+        m_running = false;
+        m_current.overhead_cycles += m_clock.cycles() - now;
+    }
+
+    // Ends the current window at the next start() of the loop
+    void request_window()
+    {
+        m_ready.store(false, std::memory_order_relaxed);
+        m_requested.store(true, std::memory_order_release);
+    }
+
+    // The finished window once the loop handed it over, nullptr until then. Valid until the next request_window().
+    const Window *take_window() const
+    {
+        return m_ready.load(std::memory_order_acquire) ? &m_finished : nullptr;
+    }
+
+    size_t get_stage_count() const
+    {
+        return m_stage_count;
+    }
+
+    const char *get_stage_name(LoopStage stage) const
+    {
+        return m_stage_names[stage];
+    }
+
+  private:
+    hal::Clock &m_clock;
+    const char *m_stage_names[MAX_STAGES] = {};
+    size_t m_stage_count = 0;
+    Window m_current;
+    Window m_finished;
+    std::atomic<bool> m_requested{false};
+    std::atomic<bool> m_ready{false};
+    bool m_running = false;
+    uint32_t m_loop_started = 0;
+    uint32_t m_last = 0;
+
+  public:
+    const char *const Name;
+};
@@ -0,0 +1,263 @@
+#include "telemetry.h"
+
+#include "hal/log.h"
+#include "hal/system.h"
+
+#include <cinttypes>
+#include <string>
+
+// Percentile of the loop and latency histograms that is published
+constexpr static const unsigned int PERCENTILE = 99;
+
+// Home Assistant expects the greek mu
+constexpr static const char *MICROSECONDS = "μs";
+
+Telemetry::Telemetry(mqtt::Client &mqtt_client, hal::Clock &clock, const TelemetryOptions &options)
+    : m_mqtt(mqtt_client), m_clock(clock), m_options(options)
+{
+    for (auto &profiler : m_profilers)
+    {
+        for (auto &handle : profiler.stage_handles)
+            handle = mqtt::INVALID_STATE_HANDLE;
+    }
+}
+
+void Telemetry::add_profiler(LoopProfiler &profiler)
+{
+    if (m_profiler_count == MAX_PROFILERS)
+    {
+        ESP_LOGE(TELEMETRY_LOG_TAG, "No free profiler slot for '%s'", profiler.Name);
+        return;
+    }
+
+    m_profilers[m_profiler_count++].profiler = &profiler;
+}
+
+void Telemetry::add_latency(const char *id, const char *name, LatencyHistogram &histogram_us)
+{
+    if (m_latency_count == MAX_LATENCIES)
+    {
+        ESP_LOGE(TELEMETRY_LOG_TAG, "No free latency slot for '%s'", id);
+        return;
+    }
+
+    auto &latency = m_latencies[m_latency_count++];
+    latency.id = id;
+    latency.name = name;
+    latency.histogram_us = &histogram_us;
+}
+
+void Telemetry::add_counter(const char *id, const char *name, const uint32_t &counter)
+{
+    if (m_counter_count == MAX_COUNTERS)
+    {
+        ESP_LOGE(TELEMETRY_LOG_TAG, "No free counter slot for '%s'", id);
+        return;
+    }
+
+    auto &entry = m_counters[m_counter_count++];
+    entry.id = id;
+    entry.name = name;
+    entry.counter = &counter;
+}
+
+void Telemetry::set_scheduler(Scheduler &scheduler)
+{
+    m_scheduler = &scheduler;
+}
+
+void Telemetry::set_power_manager(PowerManager &power)
+{
+    m_power = &power;
+}
+
+static mqtt::StateHandle add_sensor(mqtt::Client &mqtt_client, const std::string &id, const std::string &name,
+                                    const char *device_class, const char *unit_of_measurement, const char *state_class)
+{
+    return mqtt_client.add_diagnostic_sensor(id, name, device_class, unit_of_measurement, state_class);
+}
+
+void Telemetry::setup()
+{
+    size_t stages = 0;
+    for (size_t i = 0; i < m_profiler_count; ++i)
+    {
+        auto &profiler = m_profilers[i];
+        const std::string name = profiler.profiler->Name;
+        profiler.loop_handle =
+            add_sensor(m_mqtt, "loop_" + name, "Loop " + name + " p99", "duration", MICROSECONDS, "measurement");
+        for (size_t stage = 0; stage < profiler.profiler->get_stage_count(); ++stage)
+        {
+            if (stages == MAX_STAGES)
+            {
+                ESP_LOGE(TELEMETRY_LOG_TAG, "No free stage slot for loop '%s'", name.c_str());
+                break;
+            }
+            ++stages;
+
+            const std::string stage_name = profiler.profiler->get_stage_name(static_cast<LoopStage>(stage));
+            profiler.stage_handles[stage] = add_sensor(m_mqtt, "loop_" + stage_name, "Loop " + stage_name + " p99",
+                                                       "duration", MICROSECONDS, "measurement");
+        }
+    }
+
+    for (size_t i = 0; i < m_latency_count; ++i)
+    {
+        auto &latency = m_latencies[i];
+        latency.handle = add_sensor(m_mqtt, latency.id, std::string(latency.name) + " p99", "duration", MICROSECONDS,
+                                    "measurement");
+    }
+
+    for (size_t i = 0; i < m_counter_count; ++i)
+    {
+        auto &counter = m_counters[i];
+        counter.handle = add_sensor(m_mqtt, counter.id, counter.name, nullptr, nullptr, "total_increasing");
+    }
+
+    m_heap_free_handle = add_sensor(m_mqtt, "heap_free", "Heap free", "data_size", "B", "measurement");
+    m_heap_min_free_handle = add_sensor(m_mqtt, "heap_min_free", "Heap min free", "data_size", "B", "measurement");
+    m_heap_largest_block_handle =
+        add_sensor(m_mqtt, "heap_largest_block", "Heap largest block", "data_size", "B", "measurement");
+    m_published_handle = add_sensor(m_mqtt, "mqtt_published", "MQTT published", nullptr, nullptr, "total_increasing");
+    m_received_handle = add_sensor(m_mqtt, "mqtt_received", "MQTT received", nullptr, nullptr, "total_increasing");
+    m_reconnects_handle =
+        add_sensor(m_mqtt, "mqtt_reconnects", "MQTT reconnects", nullptr, nullptr, "total_increasing");
+    if (m_scheduler)
+        m_deadline_misses_handle =
+            add_sensor(m_mqtt, "deadline_misses", "Deadline misses", nullptr, nullptr, "total_increasing");
+    if (m_power)
+    {
+        m_awake_ratio_handle = add_sensor(m_mqtt, "awake_ratio", "Awake ratio", nullptr, "%", "measurement");
+        m_wakeups_handle = add_sensor(m_mqtt, "wakeups", "Wakeups", nullptr, "1/s", "measurement");
+    }
+
+    m_window_started_ms = m_clock.millis();
+    for (size_t i = 0; i < m_profiler_count; ++i)
+        m_profilers[i].profiler->request_window();
+    m_collecting = true;
+    ESP_LOGI(TELEMETRY_LOG_TAG, "Telemetry of %u loops is published every %" PRIu32 " ms",
+             static_cast<unsigned int>(m_profiler_count), m_options.interval_ms);
+}
+
+void Telemetry::loop()
+{
+    if (m_collecting)
+    {
+        // Every loop hands its window over at its next start
+        bool pending = false;
+        for (size_t i = 0; i < m_profiler_count; ++i)
+        {
+            auto &profiler = m_profilers[i];
+            if (profiler.published)
+                continue;
+
+            const auto *window = profiler.profiler->take_window();
+            if (window == nullptr)
+                pending = true;
+            else
+                publish_profiler(profiler, *window);
+        }
+
+        if (pending)
+            return;
+        m_collecting = false;
+    }
+
+    const uint32_t now = m_clock.millis();
+    if (now - m_window_started_ms < m_options.interval_ms)
+        return;
+
+    publish_device();
+    m_window_started_ms = now;
+    for (size_t i = 0; i < m_profiler_count; ++i)
+    {
+        m_profilers[i].published = false;
+        m_profilers[i].profiler->request_window();
+    }
+    m_collecting = true;
+}
+
+void Telemetry::publish_profiler(Profiler &profiler, const LoopProfiler::Window &window)
+{
+    profiler.published = true;
+    // The first window only covers the time since setup() and is not published
+    if (profiler.loop_handle == mqtt::INVALID_STATE_HANDLE || window.loop.count() == 0)
+        return;
+
+    const uint32_t cycles_per_us = hal::cpu_frequency_mhz() ? hal::cpu_frequency_mhz() : 1;
+    m_mqtt.set(profiler.loop_handle, static_cast<int>(window.loop.percentile(PERCENTILE) / cycles_per_us));
+    for (size_t i = 0; i < profiler.profiler->get_stage_count(); ++i)
+    {
+        if (profiler.stage_handles[i] == mqtt::INVALID_STATE_HANDLE)
+            continue;
+        const uint32_t stage_us = window.stages[i].percentile(PERCENTILE) / cycles_per_us;
+        m_mqtt.set(profiler.stage_handles[i], static_cast<int>(stage_us));
+    }
+
+    // Per mille of the loop time spent in the profiler itself
+    const uint64_t loop_cycles = window.loop.sum();
+    const uint32_t overhead = loop_cycles ? static_cast<uint32_t>(window.overhead_cycles * 1000 / loop_cycles) : 0;
+    ESP_LOGD(TELEMETRY_LOG_TAG,
+             "Loop %s: %" PRIu32 " loops, p99 %" PRIu32 " us, max %" PRIu32 " us, profiler overhead %" PRIu32
+             " per mille",
+             profiler.profiler->Name, window.loop.count(), window.loop.percentile(PERCENTILE) / cycles_per_us,
+             window.loop.max() / cycles_per_us, overhead);
+}
+
+void Telemetry::publish_device()
+{
+    // Values are only sent when they changed, so a quiet device publishes little more than the counters
+    for (size_t i = 0; i < m_latency_count; ++i)
+    {
+        auto &latency = m_latencies[i];
+        if (latency.histogram_us->count() > 0)
+            m_mqtt.set(latency.handle, static_cast<int>(latency.histogram_us->percentile(PERCENTILE)));
+        latency.histogram_us->reset();
+    }
+    for (size_t i = 0; i < m_counter_count; ++i)
+        m_mqtt.set(m_counters[i].handle, static_cast<int>(*m_counters[i].counter));
+
+    const auto heap = hal::get_heap_stats();
+    m_mqtt.set(m_heap_free_handle, static_cast<int>(heap.free_bytes));
+    m_mqtt.set(m_heap_min_free_handle, static_cast<int>(heap.min_free_bytes));
+    m_mqtt.set(m_heap_largest_block_handle, static_cast<int>(heap.largest_free_block));
+
+    m_mqtt.set(m_published_handle, static_cast<int>(m_mqtt.get_published_count()));
+    m_mqtt.set(m_received_handle, static_cast<int>(m_mqtt.get_received_count()));
+    m_mqtt.set(m_reconnects_handle, static_cast<int>(m_mqtt.get_reconnect_count()));
+    ESP_LOGD(TELEMETRY_LOG_TAG, "Heap %" PRIu32 " B free, %" PRIu32 " B min free, %" PRIu32 " B largest block",
+             heap.free_bytes, heap.min_free_bytes, heap.largest_free_block);
+    if (m_scheduler)
+        publish_scheduler();
+    if (m_power)
+        publish_power();
+}
+
+void Telemetry::publish_scheduler()
+{
+    m_mqtt.set(m_deadline_misses_handle, static_cast<int>(m_scheduler->get_deadline_misses()));
+    for (TaskId task = 0; task < m_scheduler->get_task_count(); ++task)
+    {
+        const auto &stats = m_scheduler->get_stats(task);
+        ESP_LOGD(TELEMETRY_LOG_TAG,
+                 "Task %s: %" PRIu32 " runs, %" PRIu32 " deadline misses, p99 %" PRIu32 " us, max %" PRIu32
+                 " us, p99 lateness %" PRIu32 " ms",
+                 m_scheduler->get_name(task), stats.runs, stats.deadline_misses,
+                 stats.runtime_us.percentile(PERCENTILE), stats.runtime_us.max(),
+                 stats.lateness_ms.percentile(PERCENTILE));
+    }
+}
+
+void Telemetry::publish_power()
+{
+    const auto stats = m_power->take_stats();
+    if (stats.window_ms == 0)
+        return;
+
+    const float awake_ratio = 100.0f * static_cast<float>(stats.awake_ms) / static_cast<float>(stats.window_ms);
+    const float wakeups = 1000.0f * static_cast<float>(stats.wakeups) / static_cast<float>(stats.window_ms);
+    m_mqtt.set(m_awake_ratio_handle, awake_ratio);
+    m_mqtt.set(m_wakeups_handle, wakeups);
+    ESP_LOGD(TELEMETRY_LOG_TAG, "Awake %" PRIu32 " of %" PRIu32 " ms, %" PRIu32 " wakeups", stats.awake_ms,
+             stats.window_ms, stats.wakeups);
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "loop_profiler.h"
+#include "mqtt/client.h"
+#include "power/power_manager.h"
+#include "scheduler/scheduler.h"
+
+#include "hal/clock.h"
+#include "util/histogram.h"
+
+#include <cstddef>
+#include <cstdint>
+
+constexpr const char *TELEMETRY_LOG_TAG = "telemetry";
+
+typedef Histogram<20> LatencyHistogram;
+
+struct TelemetryOptions
+{
+    // Length of a window, the loop histograms only cover the last one
+    uint32_t interval_ms = 60000;
+};
+
+// Publishes loop timings, heap usage and MQTT counters of the device as Home Assistant diagnostic sensors. Runs in
+// the control task together with the entities, profilers of other tasks are read through their windows.
+class Telemetry final
+{
+  public:
+    constexpr static const size_t MAX_PROFILERS = 2;
+    // Stages of all profilers together, later ones are not published
+    constexpr static const size_t MAX_STAGES = 6;
+    constexpr static const size_t MAX_LATENCIES = 2;
+    constexpr static const size_t MAX_COUNTERS = 2;
+    // Heap, MQTT, scheduler and power sensors
+    constexpr static const size_t DEVICE_STATE_SLOTS = 9;
+    // Most state slots the diagnostic sensors take, the device checks them together with its entities
+    constexpr static const size_t STATE_SLOTS =
+        MAX_PROFILERS + MAX_STAGES + MAX_LATENCIES + MAX_COUNTERS + DEVICE_STATE_SLOTS;
+
+    Telemetry(mqtt::Client &mqtt_client, hal::Clock &clock, const TelemetryOptions &options = TelemetryOptions());
+    Telemetry(const Telemetry &) = delete;
+    Telemetry &operator=(const Telemetry &) = delete;
+
+    // Profilers with all their stages and latencies are added before setup(). Latencies are recorded in microseconds
+    // by the control task and reset with every window.
+    void add_profiler(LoopProfiler &profiler);
+    void add_latency(const char *id, const char *name, LatencyHistogram &histogram_us);
+    // Counters are owned by the control task and published as totals
+    void add_counter(const char *id, const char *name, const uint32_t &counter);
+    // Publishes the deadline misses of all its tasks, their runtimes are logged
+    void set_scheduler(Scheduler &scheduler);
+    // Publishes the awake ratio and the wakeups of every window
+    void set_power_manager(PowerManager &power);
+
+    void setup();
+    void loop();
+
+  private:
+    struct Profiler
+    {
+        LoopProfiler *profiler = nullptr;
+        bool published = false;
+        mqtt::StateHandle loop_handle = mqtt::INVALID_STATE_HANDLE;
+        mqtt::StateHandle stage_handles[LoopProfiler::MAX_STAGES];
+    };
+
+    struct Latency
+    {
+        const char *id = nullptr;
+        const char *name = nullptr;
+        LatencyHistogram *histogram_us = nullptr;
+        mqtt::StateHandle handle = mqtt::INVALID_STATE_HANDLE;
+    };
+
+    struct Counter
+    {
+        const char *id = nullptr;
+        const char *name = nullptr;
+        const uint32_t *counter = nullptr;
+        mqtt::StateHandle handle = mqtt::INVALID_STATE_HANDLE;
+    };
+
+    void publish_profiler(Profiler &profiler, const LoopProfiler::Window &window);
+    void publish_device();
+    void publish_scheduler();
+    void publish_power();
+
+  private:
+    mqtt::Client &m_mqtt;
+    hal::Clock &m_clock;
+    const TelemetryOptions m_options;
+    uint32_t m_window_started_ms = 0;
+    // Windows were requested and not all of them are published yet
+    bool m_collecting = false;
+
+    Profiler m_profilers[MAX_PROFILERS];
+    size_t m_profiler_count = 0;
+    Latency m_latencies[MAX_LATENCIES];
+    size_t m_latency_count = 0;
+    Counter m_counters[MAX_COUNTERS];
+    size_t m_counter_count = 0;
+    Scheduler *m_scheduler = nullptr;
+    PowerManager *m_power = nullptr;
+
+    mqtt::StateHandle m_heap_free_handle = mqtt::INVALID_STATE_HANDLE;
+    mqtt::StateHandle m_heap_min_free_handle = mqtt::INVALID_STATE_HANDLE;
+    mqtt::StateHandle m_heap_largest_block_handle = mqtt::INVALID_STATE_HANDLE;
+    mqtt::StateHandle m_published_handle = mqtt::INVALID_STATE_HANDLE;
+    mqtt::StateHandle m_received_handle = mqtt::INVALID_STATE_HANDLE;
+    mqtt::StateHandle m_reconnects_handle = mqtt::INVALID_STATE_HANDLE;
+    mqtt::StateHandle m_deadline_misses_handle = mqtt::INVALID_STATE_HANDLE;
+    mqtt::StateHandle m_awake_ratio_handle = mqtt::INVALID_STATE_HANDLE;
+    mqtt::StateHandle m_wakeups_handle = mqtt::INVALID_STATE_HANDLE;
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+
+// Exponential backoff with equal jitter: every delay is picked from [d/2, d] and d doubles up to the maximum
+class Backoff
+{
+  public:
+    Backoff(uint32_t initial_ms, uint32_t max_ms, uint32_t seed)
+        : m_initial_ms(initial_ms), m_max_ms(max_ms), m_delay_ms(initial_ms), m_random(seed ? seed : 1)
+    {
+    }
+
+    void reset()
+    {
+        m_delay_ms = m_initial_ms;
+    }
+
+    uint32_t next_delay()
+    {
+        const uint32_t half = m_delay_ms / 2;
+        const uint32_t delay = half + next_random() % (m_delay_ms - half + 1);
+        m_delay_ms = m_delay_ms > m_max_ms / 2 ? m_max_ms : m_delay_ms * 2;
+        return delay;
+    }
+
+  private:
+    uint32_t next_random()
+    {
+        // xorshift32
+        m_random ^= m_random << 13;
+        m_random ^= m_random >> 17;
+        m_random ^= m_random << 5;
+        return m_random;
+    }
+
+  private:
+    const uint32_t m_initial_ms;
+    const uint32_t m_max_ms;
+    uint32_t m_delay_ms;
+    uint32_t m_random;
+};
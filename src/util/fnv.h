@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+constexpr static const uint32_t FNV_OFFSET_BASIS = 2166136261u;
+constexpr static const uint32_t FNV_PRIME = 16777619u;
+
+// 32 bit FNV-1a, pass the previous hash to continue it over several strings
+inline uint32_t fnv1a(const std::string &value, uint32_t hash = FNV_OFFSET_BASIS)
+{
+    for (const char c : value)
+        hash = (hash ^ static_cast<uint8_t>(c)) * FNV_PRIME;
+    return hash;
+}
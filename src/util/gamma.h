@@ -0,0 +1,49 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace gamma_detail
+{
+
+constexpr double fifth_root(double x)
+{
+    if (x <= 0)
+        return 0;
+
+    double root = x < 1 ? 1 : x;
+    for (int i = 0; i < 32; ++i)
+        root -= (root - x / (root * root * root * root)) / 5;
+    return root;
+}
+
+// x^2.2 without std::pow, which is not constexpr
+constexpr double gamma_2_2(double x)
+{
+    return x * x * fifth_root(x);
+}
+
+constexpr std::array<uint16_t, 256> make_gamma_table()
+{
+    std::array<uint16_t, 256> table{};
+    for (size_t i = 0; i < table.size(); ++i)
+        table[i] = static_cast<uint16_t>(gamma_2_2(i / 255.0) * 65535 + 0.5);
+    return table;
+}
+
+} // namespace gamma_detail
+
+// Perceived brightness 0..255 to linear 16 bit duty, computed at compile time
+constexpr static const std::array<uint16_t, 256> GAMMA_TABLE = gamma_detail::make_gamma_table();
+
+static_assert(GAMMA_TABLE[0] == 0 && GAMMA_TABLE[255] == 65535, "Gamma table must span the full range");
+
+// Scales a gamma corrected brightness to the duty range of the given PWM resolution, any brightness above zero
+// stays visible
+constexpr uint32_t gamma_duty(uint8_t brightness, uint8_t resolution_bits)
+{
+    const uint32_t max_duty = (1u << resolution_bits) - 1;
+    const uint32_t duty = (static_cast<uint32_t>(GAMMA_TABLE[brightness]) * max_duty + 32767) / 65535;
+    return brightness > 0 && duty == 0 ? 1 : duty;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Histogram with power of two buckets: bucket 0 counts zeros, bucket i counts values in [2^(i-1), 2^i)
+template <size_t BUCKETS> class Histogram
+{
+    static_assert(BUCKETS >= 2 && BUCKETS <= 32, "Histogram supports 2 to 32 buckets");
+
+  public:
+    void add(uint32_t value)
+    {
+        size_t bucket = 0;
+        while (bucket < BUCKETS - 1 && (value >> bucket) != 0)
+            ++bucket;
+
+        ++m_counts[bucket];
+        ++m_count;
+        m_sum += value;
+        if (value > m_max)
+            m_max = value;
+    }
+
+    void reset()
+    {
+        *this = Histogram();
+    }
+
+    // Upper bound of the bucket that contains the given percentile
+    uint32_t percentile(unsigned int percent) const
+    {
+        if (m_count == 0)
+            return 0;
+
+        const uint64_t target = (static_cast<uint64_t>(m_count) * percent + 99) / 100;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKETS; ++i)
+        {
+            seen += m_counts[i];
+            if (seen >= target)
+            {
+                const uint32_t bound = i == BUCKETS - 1 ? m_max : (uint32_t(1) << i) - 1;
+                return bound < m_max ? bound : m_max;
+            }
+        }
+
+        return m_max;
+    }
+
+    uint32_t count() const
+    {
+        return m_count;
+    }
+
+    uint32_t bucket(size_t index) const
+    {
+        return m_counts[index];
+    }
+
+    uint32_t max() const
+    {
+        return m_max;
+    }
+
+    uint64_t sum() const
+    {
+        return m_sum;
+    }
+
+    uint32_t mean() const
+    {
+        return m_count ? static_cast<uint32_t>(m_sum / m_count) : 0;
+    }
+
+  private:
+    uint32_t m_counts[BUCKETS] = {};
+    uint32_t m_count = 0;
+    uint64_t m_sum = 0;
+    uint32_t m_max = 0;
+};
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <charconv>
+#include <string_view>
+
+// Parses a whole payload as a decimal integer without allocating, surrounding whitespace is ignored
+inline bool parse_int(std::string_view text, int &value)
+{
+    while (!text.empty() && (text.front() == ' ' || text.front() == '\t'))
+        text.remove_prefix(1);
+    while (!text.empty() && (text.back() == ' ' || text.back() == '\t' || text.back() == '\r' || text.back() == '\n'))
+        text.remove_suffix(1);
+
+    const char *end = text.data() + text.size();
+    const auto result = std::from_chars(text.data(), end, value);
+    return result.ec == std::errc() && result.ptr == end && !text.empty();
+}
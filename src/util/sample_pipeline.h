@@ -0,0 +1,188 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+struct SamplePipelineOptions
+{
+    // Odd number of samples for the median filter, 1 disables it
+    uint8_t median_window = 5;
+    // Weight of a new median in the exponential moving average, 1 disables smoothing
+    float ema_alpha = 0.5f;
+    // Samples outside the plausible range are rejected
+    float min_value = -INFINITY;
+    float max_value = INFINITY;
+    // Samples further than this from the filtered value are rejected as outliers, unless they persist
+    float max_step = INFINITY;
+    // A filtered value is reported when it moved at least this far from the last report
+    float deadband = 0;
+    // Changes are reported at most this often
+    uint32_t min_interval_ms = 0;
+    // The value is reported again after this long even if it did not change, 0 disables the heartbeat
+    uint32_t max_interval_ms = 0;
+    // NaN is reported once when there was no valid sample for this long, 0 disables it
+    uint32_t max_age_ms = 0;
+};
+
+struct SamplePipelineStats
+{
+    uint32_t samples = 0;
+    uint32_t rejected_invalid = 0;
+    uint32_t rejected_outliers = 0;
+    uint32_t reports = 0;
+    uint32_t heartbeats = 0;
+};
+
+// Filters raw sensor samples and decides when the result is worth publishing
+class SamplePipeline final
+{
+  public:
+    constexpr static const size_t MAX_MEDIAN_WINDOW = 9;
+    // Consecutive outliers are accepted as a real step change
+    constexpr static const uint8_t MAX_CONSECUTIVE_OUTLIERS = 3;
+
+    enum class Report : uint8_t
+    {
+        NONE,
+        CHANGE,
+        HEARTBEAT,
+        STALE
+    };
+
+    explicit SamplePipeline(const SamplePipelineOptions &options) : m_options(options)
+    {
+        if (m_options.median_window == 0)
+            m_options.median_window = 1;
+        if (m_options.median_window > MAX_MEDIAN_WINDOW)
+            m_options.median_window = MAX_MEDIAN_WINDOW;
+    }
+
+    // Returns what has to be reported, value() is the value to publish then
+    Report add(float sample, uint32_t now_ms)
+    {
+        ++m_stats.samples;
+
+        if (!accept(sample))
+        {
+            if (m_options.max_age_ms != 0 && m_has_valid && !std::isnan(m_reported) &&
+                now_ms - m_valid_at_ms >= m_options.max_age_ms)
+                return report(Report::STALE, NAN, now_ms);
+            return Report::NONE;
+        }
+
+        m_valid_at_ms = now_ms;
+        m_has_valid = true;
+        filter(sample);
+
+        if (!m_has_reported || std::isnan(m_reported))
+            return report(Report::CHANGE, m_value, now_ms);
+
+        const uint32_t since_report = now_ms - m_reported_at_ms;
+        if (since_report < m_options.min_interval_ms)
+            return Report::NONE;
+        if (std::fabs(m_value - m_reported) >= m_options.deadband && m_value != m_reported)
+            return report(Report::CHANGE, m_value, now_ms);
+        if (m_options.max_interval_ms != 0 && since_report >= m_options.max_interval_ms)
+        {
+            ++m_stats.heartbeats;
+            return report(Report::HEARTBEAT, m_reported, now_ms);
+        }
+
+        return Report::NONE;
+    }
+
+    float value() const
+    {
+        return m_reported;
+    }
+
+    bool has_reported() const
+    {
+        return m_has_reported;
+    }
+
+    const SamplePipelineStats &get_stats() const
+    {
+        return m_stats;
+    }
+
+  private:
+    bool accept(float sample)
+    {
+        if (std::isnan(sample) || sample < m_options.min_value || sample > m_options.max_value)
+        {
+            ++m_stats.rejected_invalid;
+            return false;
+        }
+
+        if (m_count > 0 && std::fabs(sample - m_value) > m_options.max_step)
+        {
+            if (++m_outliers < MAX_CONSECUTIVE_OUTLIERS)
+            {
+                ++m_stats.rejected_outliers;
+                return false;
+            }
+
+            // The value really jumped, start over from it
+            m_count = 0;
+            m_next = 0;
+        }
+
+        m_outliers = 0;
+        return true;
+    }
+
+    void filter(float sample)
+    {
+        m_window[m_next] = sample;
+        m_next = (m_next + 1) % m_options.median_window;
+        const bool first = m_count == 0;
+        if (m_count < m_options.median_window)
+            ++m_count;
+
+        const float median = get_median();
+        m_value = first ? median : m_value + m_options.ema_alpha * (median - m_value);
+    }
+
+    float get_median() const
+    {
+        float sorted[MAX_MEDIAN_WINDOW];
+        for (size_t i = 0; i < m_count; ++i)
+        {
+            size_t j = i;
+            for (; j > 0 && sorted[j - 1] > m_window[i]; --j)
+                sorted[j] = sorted[j - 1];
+            sorted[j] = m_window[i];
+        }
+
+        return sorted[m_count / 2];
+    }
+
+    Report report(Report report, float value, uint32_t now_ms)
+    {
+        m_reported = value;
+        m_reported_at_ms = now_ms;
+        m_has_reported = true;
+        ++m_stats.reports;
+        return report;
+    }
+
+  private:
+    SamplePipelineOptions m_options;
+
+    float m_window[MAX_MEDIAN_WINDOW] = {};
+    size_t m_next = 0;
+    size_t m_count = 0;
+    uint8_t m_outliers = 0;
+    float m_value = NAN;
+
+    bool m_has_valid = false;
+    uint32_t m_valid_at_ms = 0;
+
+    bool m_has_reported = false;
+    float m_reported = NAN;
+    uint32_t m_reported_at_ms = 0;
+
+    SamplePipelineStats m_stats;
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+// Bounded lock-free queue for exactly one producer and one consumer, e.g. an interrupt handler and loop(), or two
+// tasks. Holds CAPACITY - 1 items.
+template <typename T, size_t CAPACITY> class SpscQueue
+{
+    static_assert(CAPACITY >= 2 && (CAPACITY & (CAPACITY - 1)) == 0, "SpscQueue capacity must be a power of two");
+
+  public:
+    bool push(const T &item)
+    {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        const size_t next = (head + 1) & (CAPACITY - 1);
+        if (next == m_tail.load(std::memory_order_acquire))
+        {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        m_items[head] = item;
+        m_head.store(next, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T &item)
+    {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_head.load(std::memory_order_acquire))
+            return false;
+
+        item = m_items[tail];
+        m_tail.store((tail + 1) & (CAPACITY - 1), std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const
+    {
+        return m_tail.load(std::memory_order_acquire) == m_head.load(std::memory_order_acquire);
+    }
+
+    size_t size() const
+    {
+        return (m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire)) & (CAPACITY - 1);
+    }
+
+    size_t get_dropped() const
+    {
+        return m_dropped.load(std::memory_order_relaxed);
+    }
+
+  private:
+    T m_items[CAPACITY];
+    std::atomic<size_t> m_head{0};
+    std::atomic<size_t> m_tail{0};
+    std::atomic<size_t> m_dropped{0};
+};
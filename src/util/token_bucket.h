@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+
+// Rate limiter that refills `rate` tokens per second up to `burst`
+class TokenBucket
+{
+  public:
+    TokenBucket(uint32_t rate, uint32_t burst) : m_rate(rate), m_burst(burst), m_tokens(burst)
+    {
+    }
+
+    bool consume(uint32_t tokens, uint32_t now_ms)
+    {
+        refill(now_ms);
+        if (tokens > m_tokens)
+            return false;
+
+        m_tokens -= tokens;
+        return true;
+    }
+
+    uint32_t available(uint32_t now_ms)
+    {
+        refill(now_ms);
+        return m_tokens;
+    }
+
+  private:
+    void refill(uint32_t now_ms)
+    {
+        if (!m_started)
+        {
+            m_started = true;
+            m_last_ms = now_ms;
+            return;
+        }
+
+        const uint64_t refill = static_cast<uint64_t>(now_ms - m_last_ms) * m_rate / 1000;
+        if (refill == 0)
+            return;
+
+        if (refill >= m_burst - m_tokens)
+        {
+            m_tokens = m_burst;
+            m_last_ms = now_ms;
+            return;
+        }
+
+        // Only whole tokens are added, the remainder of the interval is carried over
+        m_tokens += static_cast<uint32_t>(refill);
+        m_last_ms += static_cast<uint32_t>(refill * 1000 / m_rate);
+    }
+
+  private:
+    const uint32_t m_rate;
+    const uint32_t m_burst;
+    uint32_t m_tokens;
+    uint32_t m_last_ms = 0;
+    bool m_started = false;
+};
@@ -0,0 +1,127 @@
+#include "controls/button.h"
+
+#include "hal/native/fake_clock.h"
+#include "hal/native/fake_gpio.h"
+
+#include <unity.h>
+
+constexpr static const int BUTTON_PIN = 4;
+
+struct Fixture
+{
+    hal::FakeClock clock;
+    hal::FakeGpio gpio;
+    ButtonEngine engine{gpio, clock};
+    Button button{engine, BUTTON_PIN};
+    unsigned int clicks = 0;
+    unsigned int double_clicks = 0;
+    unsigned int long_presses = 0;
+
+    // Runs loop() every millisecond like the control task
+    void run(uint32_t ms)
+    {
+        for (uint32_t i = 0; i < ms; ++i)
+        {
+            engine.loop();
+            clock.advance(1);
+        }
+    }
+
+    void press(uint32_t ms)
+    {
+        gpio.set_input(BUTTON_PIN, 1);
+        run(ms);
+        gpio.set_input(BUTTON_PIN, 0);
+    }
+};
+
+static Fixture *g_fixture = nullptr;
+
+void setUp()
+{
+    g_fixture = new Fixture();
+    g_fixture->button.set_on_click([]() { ++g_fixture->clicks; });
+    g_fixture->button.set_on_long_press([]() { ++g_fixture->long_presses; });
+    g_fixture->engine.setup();
+    g_fixture->run(10);
+}
+
+void tearDown()
+{
+    delete g_fixture;
+    g_fixture = nullptr;
+}
+
+void test_click_latency_is_recorded()
+{
+    g_fixture->press(100);
+    g_fixture->run(100);
+
+    TEST_ASSERT_EQUAL(1, g_fixture->clicks);
+    const auto &latency = g_fixture->engine.get_gesture_latency_us();
+    TEST_ASSERT_EQUAL(1, latency.count());
+    // The release has to settle for the debounce time before the click is reported
+    const uint32_t debounce_us = GestureOptions().debounce_ms * 1000;
+    TEST_ASSERT_UINT32_WITHIN(1000, debounce_us, latency.max());
+}
+
+void test_every_click_is_recorded()
+{
+    for (int i = 0; i < 5; ++i)
+    {
+        g_fixture->press(50);
+        g_fixture->run(100);
+    }
+
+    TEST_ASSERT_EQUAL(5, g_fixture->clicks);
+    TEST_ASSERT_EQUAL(5, g_fixture->engine.get_gesture_latency_us().count());
+}
+
+void test_timed_gestures_are_not_recorded()
+{
+    g_fixture->press(1000);
+    g_fixture->run(100);
+
+    TEST_ASSERT_EQUAL(1, g_fixture->long_presses);
+    TEST_ASSERT_EQUAL(0, g_fixture->clicks);
+    TEST_ASSERT_EQUAL(0, g_fixture->engine.get_gesture_latency_us().count());
+}
+
+void test_double_click_latency_is_recorded()
+{
+    g_fixture->button.set_on_double_click([]() { ++g_fixture->double_clicks; });
+    g_fixture->press(50);
+    g_fixture->run(50);
+    g_fixture->press(50);
+    g_fixture->run(500);
+
+    // A single click only follows the double-click window, it is not counted
+    g_fixture->press(50);
+    g_fixture->run(500);
+
+    TEST_ASSERT_EQUAL(1, g_fixture->double_clicks);
+    TEST_ASSERT_EQUAL(1, g_fixture->clicks);
+    TEST_ASSERT_EQUAL(1, g_fixture->engine.get_gesture_latency_us().count());
+}
+
+void test_wakeup_keeps_the_edges()
+{
+    g_fixture->engine.enable_wakeup();
+    TEST_ASSERT_TRUE(g_fixture->gpio.is_wakeup_enabled(BUTTON_PIN));
+
+    g_fixture->press(50);
+    g_fixture->run(100);
+    TEST_ASSERT_EQUAL(1, g_fixture->clicks);
+    TEST_ASSERT_EQUAL(1, g_fixture->engine.get_gesture_latency_us().count());
+}
+
+int main(int, char **)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_click_latency_is_recorded);
+    RUN_TEST(test_every_click_is_recorded);
+    RUN_TEST(test_timed_gestures_are_not_recorded);
+    RUN_TEST(test_double_click_latency_is_recorded);
+    RUN_TEST(test_wakeup_keeps_the_edges);
+    return UNITY_END();
+}
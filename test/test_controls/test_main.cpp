@@ -0,0 +1,211 @@
+#include "controls/entity_registry.h"
+#include "controls/light.h"
+#include "controls/switch.h"
+#include "controls/temperature_and_humidity.h"
+#include "telemetry/telemetry.h"
+
+#include "hal/native/fake_climate_sensor.h"
+#include "hal/native/fake_clock.h"
+#include "hal/native/fake_gpio.h"
+#include "hal/native/fake_mqtt_transport.h"
+#include "hal/native/fake_network.h"
+#include "hal/native/fake_pwm.h"
+#include "hal/native/memory_nvs.h"
+
+#include <unity.h>
+
+#include <string>
+
+constexpr static const char *DEVICE_ID = "nosyna-test";
+constexpr static const int SWITCH_PIN = 5;
+constexpr static const int LIGHT_PIN = 25;
+
+// The whole device of main.cpp with the fakes of the native build
+struct Device
+{
+    hal::FakeClock clock;
+    hal::FakeGpio gpio;
+    hal::FakePwm pwm;
+    hal::FakeNetwork network;
+    hal::FakeMqttTransport transport;
+    hal::FakeClimateSensor sensor;
+    hal::MemoryNvs nvs;
+    Scheduler scheduler{clock};
+    mqtt::Client client{transport, network, clock, "user", "password", "broker", 1883, DEVICE_ID, "Nosyna (test)"};
+    SettingsStore settings{nvs, clock};
+    Switch outlet{client, gpio, "outlet", "Outlet", "outlet", SWITCH_PIN, true};
+    Light light{client, pwm, settings, "led", "LED", LIGHT_PIN};
+    TemperatureAndHumidity climate{client, clock, scheduler, sensor, "temperature", "humidity", "Sensor", 17};
+    EntityRegistry<Switch, Light, TemperatureAndHumidity> entities{outlet, light, climate};
+
+    void setup()
+    {
+        client.setup();
+        entities.setup();
+        network.begin();
+    }
+
+    // Runs the client until its queues are empty
+    void run(uint32_t ms)
+    {
+        for (uint32_t i = 0; i < ms; ++i)
+        {
+            client.loop();
+            scheduler.run();
+            clock.advance(1);
+        }
+    }
+
+    std::string last_state() const
+    {
+        const std::string topic = std::string("nosyna/") + DEVICE_ID + "/state";
+        const auto &published = transport.get_published();
+        for (auto message = published.rbegin(); message != published.rend(); ++message)
+        {
+            if (message->topic == topic)
+                return message->payload;
+        }
+        return "";
+    }
+};
+
+static Device *g_device = nullptr;
+
+void setUp()
+{
+    g_device = new Device();
+    g_device->setup();
+}
+
+void tearDown()
+{
+    delete g_device;
+    g_device = nullptr;
+}
+
+static void command(const char *entity, const char *payload)
+{
+    g_device->transport.deliver(std::string("nosyna/") + DEVICE_ID + "/" + entity + "/set", payload);
+}
+
+static bool contains(const std::string &text, const char *part)
+{
+    return text.find(part) != std::string::npos;
+}
+
+void test_registry_counts_slots()
+{
+    TEST_ASSERT_EQUAL(3, (EntityRegistry<Switch, Light, TemperatureAndHumidity>::COUNT));
+    TEST_ASSERT_EQUAL(5, (EntityRegistry<Switch, Light, TemperatureAndHumidity>::STATE_SLOTS));
+    TEST_ASSERT_EQUAL(2, (EntityRegistry<Switch, Light, TemperatureAndHumidity>::SETTINGS));
+    TEST_ASSERT_FALSE((EntityRegistry<Switch, Light, TemperatureAndHumidity>::HAS_LOOP));
+}
+
+void test_entities_are_announced()
+{
+    g_device->run(100);
+
+    TEST_ASSERT_EQUAL(1, g_device->transport.get_connects());
+    const auto &subscriptions = g_device->transport.get_subscriptions();
+    TEST_ASSERT_EQUAL(1, subscriptions.count(std::string("nosyna/") + DEVICE_ID + "/outlet/set"));
+    TEST_ASSERT_EQUAL(1, subscriptions.count(std::string("nosyna/") + DEVICE_ID + "/led/set"));
+
+    size_t discovery = 0;
+    for (const auto &message : g_device->transport.get_published())
+    {
+        if (message.topic.rfind("homeassistant/", 0) == 0)
+        {
+            TEST_ASSERT_TRUE(message.retained);
+            ++discovery;
+        }
+    }
+    TEST_ASSERT_EQUAL(4, discovery);
+    TEST_ASSERT_TRUE(contains(g_device->last_state(), "\"outlet_state\":\"OFF\""));
+    TEST_ASSERT_TRUE(contains(g_device->last_state(), "\"led_state\":\"OFF\""));
+}
+
+void test_switch_follows_commands()
+{
+    g_device->run(100);
+    // Active low, so off drives the pin high
+    TEST_ASSERT_EQUAL(hal::PinMode::DIGITAL_OUTPUT, g_device->gpio.get_mode(SWITCH_PIN));
+    TEST_ASSERT_EQUAL(1, g_device->gpio.get_value(SWITCH_PIN));
+
+    command("outlet", "ON");
+    g_device->run(10);
+    TEST_ASSERT_EQUAL(0, g_device->gpio.get_value(SWITCH_PIN));
+    TEST_ASSERT_TRUE(contains(g_device->last_state(), "\"outlet_state\":\"ON\""));
+
+    g_device->outlet.toggle();
+    g_device->run(10);
+    TEST_ASSERT_EQUAL(1, g_device->gpio.get_value(SWITCH_PIN));
+    TEST_ASSERT_TRUE(contains(g_device->last_state(), "\"outlet_state\":\"OFF\""));
+}
+
+void test_light_fades_and_persists()
+{
+    g_device->run(100);
+    TEST_ASSERT_EQUAL(LIGHT_PIN, g_device->pwm.get_pin(0));
+    TEST_ASSERT_EQUAL(0, g_device->pwm.get_duty(0));
+
+    command("led", "ON");
+    g_device->run(10);
+    TEST_ASSERT_GREATER_THAN(0, g_device->pwm.get_duty(0));
+    TEST_ASSERT_TRUE(contains(g_device->last_state(), "\"led_state\":\"ON\""));
+
+    // The setting is written behind, once the light was left alone
+    TEST_ASSERT_TRUE(g_device->settings.has_dirty());
+    g_device->clock.advance(10000);
+    g_device->settings.loop();
+    TEST_ASSERT_FALSE(g_device->settings.has_dirty());
+    TEST_ASSERT_TRUE(g_device->nvs.get_bool("light.25.st", false));
+}
+
+void test_climate_is_read_by_the_scheduler()
+{
+    g_device->sensor.set(21.5f, 40.0f);
+    g_device->run(2100);
+
+    TEST_ASSERT_EQUAL(1, g_device->sensor.get_reads());
+    TEST_ASSERT_EQUAL(1, g_device->climate.get_read_stats().reads);
+    TEST_ASSERT_EQUAL(0, g_device->climate.get_read_stats().failures);
+    TEST_ASSERT_EQUAL(1, g_device->climate.get_temperature_stats().samples);
+    TEST_ASSERT_EQUAL(1, g_device->climate.get_humidity_stats().reports);
+    TEST_ASSERT_TRUE(contains(g_device->last_state(), "\"temperature_state\":21.5"));
+    TEST_ASSERT_TRUE(contains(g_device->last_state(), "\"humidity_state\":40"));
+}
+
+void test_climate_reads_are_published_by_telemetry()
+{
+    Telemetry telemetry(g_device->client, g_device->clock);
+    telemetry.add_latency("climate_read_latency", "Climate read latency", g_device->climate.get_read_latency_us());
+    telemetry.add_counter("climate_read_failures", "Climate read failures",
+                          g_device->climate.get_read_stats().failures);
+    telemetry.setup();
+
+    g_device->sensor.set_fail(true);
+    g_device->run(TelemetryOptions().interval_ms);
+    const auto stats = g_device->climate.get_read_stats();
+    telemetry.loop();
+    // The window starts over once it was published
+    TEST_ASSERT_EQUAL(0, g_device->climate.get_read_latency_us().count());
+    g_device->run(100);
+
+    TEST_ASSERT_GREATER_THAN(0, stats.failures);
+    TEST_ASSERT_EQUAL(stats.reads, stats.failures);
+    const std::string failures = "\"climate_read_failures_state\":" + std::to_string(stats.failures);
+    TEST_ASSERT_TRUE(contains(g_device->last_state(), failures.c_str()));
+    TEST_ASSERT_TRUE(contains(g_device->last_state(), "\"climate_read_latency_state\":"));
+}
+
+int main(int, char **)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_registry_counts_slots);
+    RUN_TEST(test_entities_are_announced);
+    RUN_TEST(test_switch_follows_commands);
+    RUN_TEST(test_light_fades_and_persists);
+    RUN_TEST(test_climate_is_read_by_the_scheduler);
+    RUN_TEST(test_climate_reads_are_published_by_telemetry);
+    return UNITY_END();
+}
@@ -0,0 +1,132 @@
+#include "hal/dht22_decoder.h"
+
+#include <unity.h>
+
+#include <cstddef>
+#include <cstdint>
+
+using hal::ClimateReading;
+using hal::Dht22Decoder;
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+static uint8_t checksum(const uint8_t *bytes)
+{
+    return static_cast<uint8_t>(bytes[0] + bytes[1] + bytes[2] + bytes[3]);
+}
+
+// Feeds the line levels of a frame as the RMT captures them, cut off after the given number of bits
+static void feed(Dht22Decoder &decoder, const uint8_t *bytes, bool response, size_t bits = Dht22Decoder::FRAME_BITS)
+{
+    decoder.reset();
+    // The host releases the line
+    decoder.add(true, 30);
+    if (response)
+    {
+        decoder.add(false, 80);
+        decoder.add(true, 80);
+    }
+    for (size_t i = 0; i < bits; ++i)
+    {
+        const bool one = (bytes[i / 8] >> (7 - i % 8)) & 1;
+        decoder.add(false, 50);
+        decoder.add(true, one ? 70 : 27);
+    }
+    decoder.add(false, 50);
+    // The idle line after the frame
+    decoder.add(true, 0);
+}
+
+void test_valid_frame()
+{
+    // 65.2 %, 35.1 °C
+    uint8_t bytes[5] = {0x02, 0x8c, 0x01, 0x5f, 0};
+    bytes[4] = checksum(bytes);
+    Dht22Decoder decoder;
+    feed(decoder, bytes, false);
+
+    ClimateReading reading;
+    TEST_ASSERT_TRUE(decoder.finish(reading));
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 65.2f, reading.humidity);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 35.1f, reading.temperature);
+}
+
+void test_response_pulse_is_skipped()
+{
+    uint8_t bytes[5] = {0x02, 0x8c, 0x01, 0x5f, 0};
+    bytes[4] = checksum(bytes);
+    Dht22Decoder decoder;
+    // The 80 us high pulse looks like a one bit in front of the data
+    feed(decoder, bytes, true);
+
+    ClimateReading reading;
+    TEST_ASSERT_TRUE(decoder.finish(reading));
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 65.2f, reading.humidity);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 35.1f, reading.temperature);
+}
+
+void test_negative_temperature()
+{
+    // 40.0 %, -10.1 °C, the sign is the top bit
+    uint8_t bytes[5] = {0x01, 0x90, 0x80, 0x65, 0};
+    bytes[4] = checksum(bytes);
+    Dht22Decoder decoder;
+    feed(decoder, bytes, false);
+
+    ClimateReading reading;
+    TEST_ASSERT_TRUE(decoder.finish(reading));
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 40.0f, reading.humidity);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, -10.1f, reading.temperature);
+}
+
+void test_checksum_failure()
+{
+    uint8_t bytes[5] = {0x02, 0x8c, 0x01, 0x5f, 0};
+    bytes[4] = static_cast<uint8_t>(checksum(bytes) + 1);
+    Dht22Decoder decoder;
+    feed(decoder, bytes, false);
+
+    ClimateReading reading;
+    TEST_ASSERT_FALSE(decoder.finish(reading));
+}
+
+void test_short_frame()
+{
+    uint8_t bytes[5] = {0x02, 0x8c, 0x01, 0x5f, 0};
+    bytes[4] = checksum(bytes);
+    Dht22Decoder decoder;
+    feed(decoder, bytes, false, Dht22Decoder::FRAME_BITS - 1);
+
+    ClimateReading reading;
+    TEST_ASSERT_FALSE(decoder.finish(reading));
+}
+
+void test_reset_drops_the_previous_frame()
+{
+    uint8_t bytes[5] = {0x02, 0x8c, 0x01, 0x5f, 0};
+    bytes[4] = checksum(bytes);
+    Dht22Decoder decoder;
+    feed(decoder, bytes, false);
+    decoder.reset();
+
+    ClimateReading reading;
+    TEST_ASSERT_FALSE(decoder.finish(reading));
+}
+
+int main(int, char **)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_valid_frame);
+    RUN_TEST(test_response_pulse_is_skipped);
+    RUN_TEST(test_negative_temperature);
+    RUN_TEST(test_checksum_failure);
+    RUN_TEST(test_short_frame);
+    RUN_TEST(test_reset_drops_the_previous_frame);
+    return UNITY_END();
+}
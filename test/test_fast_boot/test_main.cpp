@@ -0,0 +1,87 @@
+#include "boot/fast_boot.h"
+
+#include "hal/native/fake_clock.h"
+#include "hal/native/fake_mqtt_transport.h"
+#include "hal/native/fake_network.h"
+#include "hal/native/memory_nvs.h"
+
+#include <unity.h>
+
+struct Fixture
+{
+    hal::FakeClock clock;
+    hal::FakeNetwork network;
+    hal::FakeMqttTransport transport;
+    hal::MemoryNvs nvs;
+    mqtt::Client client{transport, network, clock, "user", "password", "broker", 1883, "nosyna-test", "Nosyna"};
+    SettingsStore settings{nvs, clock};
+    FastBoot fast_boot{clock, settings, network, client};
+};
+
+static Fixture *g_fixture = nullptr;
+
+void setUp()
+{
+    g_fixture = new Fixture();
+}
+
+void tearDown()
+{
+    delete g_fixture;
+    g_fixture = nullptr;
+}
+
+void test_joins_with_the_stored_access_point()
+{
+    g_fixture->nvs.put_int("boot.ch", 6);
+    g_fixture->nvs.put_int("boot.bssid_h", 0x0a0b0c0d);
+    g_fixture->nvs.put_int("boot.bssid_l", 0x0e0f);
+    g_fixture->fast_boot.load_network();
+    g_fixture->network.begin();
+
+    hal::NetworkCache cache;
+    TEST_ASSERT_TRUE(g_fixture->network.get_cache(cache));
+    TEST_ASSERT_EQUAL(6, cache.channel);
+    const uint8_t bssid[] = {0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f};
+    TEST_ASSERT_EQUAL_MEMORY(bssid, cache.bssid, sizeof(bssid));
+}
+
+void test_saves_through_the_settings_store()
+{
+    g_fixture->fast_boot.load_network();
+    hal::NetworkCache cache;
+    cache.channel = 11;
+    cache.bssid[5] = 0x42;
+    g_fixture->network.set_cache(cache);
+    g_fixture->network.begin();
+    const unsigned int writes = g_fixture->nvs.get_writes();
+
+    // The new access point is only written by the settings store, along with its other changes
+    g_fixture->fast_boot.loop();
+    TEST_ASSERT_TRUE(g_fixture->settings.has_dirty());
+    TEST_ASSERT_EQUAL(writes, g_fixture->nvs.get_writes());
+
+    TEST_ASSERT_TRUE(g_fixture->settings.flush());
+    TEST_ASSERT_EQUAL(1, g_fixture->nvs.get_commits());
+    TEST_ASSERT_EQUAL(11, g_fixture->nvs.get_int("boot.ch", 0));
+    TEST_ASSERT_EQUAL(0x42, g_fixture->nvs.get_int("boot.bssid_l", 0));
+}
+
+void test_unchanged_access_point_is_not_written()
+{
+    g_fixture->nvs.put_int("boot.ch", 6);
+    g_fixture->fast_boot.load_network();
+    g_fixture->network.begin();
+
+    g_fixture->fast_boot.loop();
+    TEST_ASSERT_FALSE(g_fixture->settings.has_dirty());
+}
+
+int main(int, char **)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_joins_with_the_stored_access_point);
+    RUN_TEST(test_saves_through_the_settings_store);
+    RUN_TEST(test_unchanged_access_point_is_not_written);
+    return UNITY_END();
+}
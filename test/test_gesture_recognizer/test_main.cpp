@@ -0,0 +1,196 @@
+#include "controls/gesture_recognizer.h"
+
+#include <unity.h>
+
+#include <cstddef>
+#include <vector>
+
+// One raw edge of a recorded trace
+struct Edge
+{
+    uint32_t time_ms;
+    bool pressed;
+};
+
+struct Event
+{
+    uint32_t time_ms;
+    Gesture gesture;
+};
+
+// Contact bounce as it was recorded on the board: a few edges within 3 ms before the level settles
+static void bounce(std::vector<Edge> &trace, uint32_t time_ms, bool pressed)
+{
+    trace.push_back({time_ms, pressed});
+    trace.push_back({time_ms + 1, !pressed});
+    trace.push_back({time_ms + 2, pressed});
+    trace.push_back({time_ms + 3, !pressed});
+    trace.push_back({time_ms + 3, pressed});
+}
+
+// Replays the trace and polls every millisecond until end_ms
+static std::vector<Event> replay(GestureRecognizer &recognizer, const std::vector<Edge> &trace, uint32_t end_ms)
+{
+    std::vector<Event> events;
+    size_t next = 0;
+    for (uint32_t now = 0; now <= end_ms; ++now)
+    {
+        for (; next < trace.size() && trace[next].time_ms <= now; ++next)
+            recognizer.on_edge(trace[next].pressed, trace[next].time_ms);
+        for (Gesture gesture = recognizer.poll(now); gesture != Gesture::NONE; gesture = recognizer.poll(now))
+            events.push_back({now, gesture});
+    }
+    return events;
+}
+
+// Replays the trace the way the button task does: it only wakes on edges and at the reported deadlines
+static std::vector<Event> replay_on_deadlines(GestureRecognizer &recognizer, const std::vector<Edge> &trace,
+                                              uint32_t end_ms)
+{
+    std::vector<Event> events;
+    size_t next = 0;
+    uint32_t now = 0;
+    while (now <= end_ms)
+    {
+        for (; next < trace.size() && trace[next].time_ms <= now; ++next)
+            recognizer.on_edge(trace[next].pressed, trace[next].time_ms);
+        for (Gesture gesture = recognizer.poll(now); gesture != Gesture::NONE; gesture = recognizer.poll(now))
+            events.push_back({now, gesture});
+
+        uint32_t wake_ms = end_ms + 1;
+        uint32_t deadline_ms = 0;
+        if (recognizer.get_deadline(deadline_ms) && deadline_ms < wake_ms)
+            wake_ms = deadline_ms;
+        if (next < trace.size() && trace[next].time_ms < wake_ms)
+            wake_ms = trace[next].time_ms;
+        now = wake_ms > now ? wake_ms : now + 1;
+    }
+    return events;
+}
+
+static GestureRecognizer make_recognizer(bool double_click, bool hold_repeat)
+{
+    GestureRecognizer recognizer;
+    recognizer.reset(false, 0);
+    recognizer.set_double_click_enabled(double_click);
+    recognizer.set_hold_repeat_enabled(hold_repeat);
+    return recognizer;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_bouncy_click()
+{
+    std::vector<Edge> trace;
+    bounce(trace, 100, true);
+    bounce(trace, 220, false);
+
+    GestureRecognizer recognizer = make_recognizer(false, false);
+    const auto events = replay(recognizer, trace, 1000);
+    TEST_ASSERT_EQUAL(1, events.size());
+    TEST_ASSERT_EQUAL(Gesture::CLICK, events[0].gesture);
+    // Reported once the release settled for the debounce time
+    TEST_ASSERT_EQUAL(223 + 15, events[0].time_ms);
+    TEST_ASSERT_EQUAL(10, recognizer.get_edges());
+    TEST_ASSERT_FALSE(recognizer.is_pressed());
+}
+
+void test_click_waits_for_double_click_window()
+{
+    std::vector<Edge> trace;
+    bounce(trace, 100, true);
+    bounce(trace, 200, false);
+
+    GestureRecognizer recognizer = make_recognizer(true, false);
+    const auto events = replay(recognizer, trace, 1000);
+    TEST_ASSERT_EQUAL(1, events.size());
+    TEST_ASSERT_EQUAL(Gesture::CLICK, events[0].gesture);
+    TEST_ASSERT_EQUAL(203 + 250, events[0].time_ms);
+}
+
+void test_double_click()
+{
+    std::vector<Edge> trace;
+    bounce(trace, 100, true);
+    bounce(trace, 180, false);
+    bounce(trace, 300, true);
+    bounce(trace, 380, false);
+
+    GestureRecognizer recognizer = make_recognizer(true, false);
+    const auto events = replay(recognizer, trace, 1500);
+    TEST_ASSERT_EQUAL(1, events.size());
+    TEST_ASSERT_EQUAL(Gesture::DOUBLE_CLICK, events[0].gesture);
+    TEST_ASSERT_EQUAL(383 + 15, events[0].time_ms);
+}
+
+void test_long_press_with_hold_repeat()
+{
+    std::vector<Edge> trace;
+    bounce(trace, 100, true);
+    bounce(trace, 1200, false);
+
+    GestureRecognizer recognizer = make_recognizer(true, true);
+    const auto events = replay(recognizer, trace, 2000);
+    // Long press at 703, then repeats every 200 ms until the release, and no click afterwards
+    TEST_ASSERT_EQUAL(3, events.size());
+    TEST_ASSERT_EQUAL(Gesture::LONG_PRESS, events[0].gesture);
+    TEST_ASSERT_EQUAL(103 + 600, events[0].time_ms);
+    TEST_ASSERT_EQUAL(Gesture::HOLD_REPEAT, events[1].gesture);
+    TEST_ASSERT_EQUAL(903, events[1].time_ms);
+    TEST_ASSERT_EQUAL(Gesture::HOLD_REPEAT, events[2].gesture);
+    TEST_ASSERT_EQUAL(1103, events[2].time_ms);
+}
+
+void test_glitch_is_ignored()
+{
+    // A spike shorter than the debounce time, as induced by a nearby relay
+    const std::vector<Edge> trace = {{100, true}, {104, false}, {500, true}, {501, false}};
+
+    GestureRecognizer recognizer = make_recognizer(true, true);
+    const auto events = replay(recognizer, trace, 1500);
+    TEST_ASSERT_EQUAL(0, events.size());
+    TEST_ASSERT_EQUAL(2, recognizer.get_glitches());
+}
+
+void test_deadlines_match_polling()
+{
+    std::vector<Edge> trace;
+    bounce(trace, 100, true);
+    bounce(trace, 180, false);
+    bounce(trace, 300, true);
+    bounce(trace, 380, false);
+    bounce(trace, 1000, true);
+    bounce(trace, 1100, false);
+    bounce(trace, 2000, true);
+    bounce(trace, 3000, false);
+
+    GestureRecognizer polled = make_recognizer(true, true);
+    GestureRecognizer woken = make_recognizer(true, true);
+    const auto expected = replay(polled, trace, 4000);
+    const auto events = replay_on_deadlines(woken, trace, 4000);
+    TEST_ASSERT_EQUAL(5, expected.size());
+    TEST_ASSERT_EQUAL(expected.size(), events.size());
+    for (size_t i = 0; i < events.size(); ++i)
+    {
+        TEST_ASSERT_EQUAL(expected[i].gesture, events[i].gesture);
+        TEST_ASSERT_EQUAL(expected[i].time_ms, events[i].time_ms);
+    }
+}
+
+int main(int, char **)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_bouncy_click);
+    RUN_TEST(test_click_waits_for_double_click_window);
+    RUN_TEST(test_double_click);
+    RUN_TEST(test_long_press_with_hold_repeat);
+    RUN_TEST(test_glitch_is_ignored);
+    RUN_TEST(test_deadlines_match_polling);
+    return UNITY_END();
+}
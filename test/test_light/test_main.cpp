@@ -0,0 +1,151 @@
+#include "controls/light.h"
+
+#include "hal/native/fake_clock.h"
+#include "hal/native/fake_mqtt_transport.h"
+#include "hal/native/fake_network.h"
+#include "hal/native/fake_pwm.h"
+#include "hal/native/memory_nvs.h"
+
+#include <unity.h>
+
+constexpr static const int LIGHT_PIN = 25;
+
+struct Fixture
+{
+    hal::FakeClock clock;
+    hal::FakePwm pwm;
+    hal::FakeNetwork network;
+    hal::FakeMqttTransport transport;
+    hal::MemoryNvs nvs;
+    mqtt::Client client{transport, network, clock, "user", "password", "broker", 1883, "nosyna-test", "Nosyna"};
+    SettingsStore settings{nvs, clock};
+    Light light{client, pwm, settings, "led", "LED", LIGHT_PIN};
+};
+
+static Fixture *g_fixture = nullptr;
+
+void setUp()
+{
+    g_fixture = new Fixture();
+}
+
+void tearDown()
+{
+    delete g_fixture;
+    g_fixture = nullptr;
+}
+
+static const hal::FakePwm::Fade &last_fade()
+{
+    const auto &fades = g_fixture->pwm.get_fades();
+    TEST_ASSERT_GREATER_THAN(0, fades.size());
+    return fades.back();
+}
+
+static uint32_t duty(uint8_t brightness)
+{
+    return gamma_duty(brightness, hal::PwmConfig().resolution_bits);
+}
+
+static mqtt::LightCommand make_command(bool state, int brightness = -1, int transition_ms = -1)
+{
+    mqtt::LightCommand command;
+    command.has_state = true;
+    command.state = state;
+    command.has_brightness = brightness >= 0;
+    command.brightness = brightness;
+    command.has_transition = transition_ms >= 0;
+    command.transition_ms = static_cast<uint32_t>(transition_ms);
+    return command;
+}
+
+void test_gamma_duties()
+{
+    constexpr uint8_t BITS = 13;
+    TEST_ASSERT_EQUAL(0, gamma_duty(0, BITS));
+    // The lowest levels stay visible
+    TEST_ASSERT_EQUAL(1, gamma_duty(1, BITS));
+    TEST_ASSERT_EQUAL(8191, gamma_duty(255, BITS));
+    // Half the perceived brightness is about a fifth of the power
+    TEST_ASSERT_UINT32_WITHIN(20, 1793, gamma_duty(128, BITS));
+    for (int level = 1; level < 256; ++level)
+        TEST_ASSERT_TRUE(gamma_duty(level, BITS) >= gamma_duty(level - 1, BITS));
+}
+
+void test_setup_restores_the_stored_level_right_away()
+{
+    g_fixture->nvs.put_bool("light.25.st", true);
+    g_fixture->nvs.put_int("light.25.bri", 100);
+    g_fixture->client.setup();
+    g_fixture->light.setup();
+
+    const auto &fade = last_fade();
+    TEST_ASSERT_EQUAL(1, g_fixture->pwm.get_fades().size());
+    TEST_ASSERT_EQUAL(LIGHT_PIN, g_fixture->pwm.get_pin(fade.channel));
+    TEST_ASSERT_EQUAL(13, g_fixture->pwm.get_config(fade.channel).resolution_bits);
+    TEST_ASSERT_EQUAL(duty(100), fade.duty);
+    TEST_ASSERT_EQUAL(0, fade.duration_ms);
+}
+
+void test_commands_fade_with_their_transition()
+{
+    g_fixture->client.setup();
+    g_fixture->light.setup();
+
+    g_fixture->light.handle(make_command(true, 128, 2000));
+    TEST_ASSERT_EQUAL(duty(128), last_fade().duty);
+    TEST_ASSERT_EQUAL(2000, last_fade().duration_ms);
+
+    g_fixture->light.handle(make_command(false, -1, 0));
+    TEST_ASSERT_EQUAL(0, last_fade().duty);
+    TEST_ASSERT_EQUAL(0, last_fade().duration_ms);
+
+    // Brightness survives switching off
+    g_fixture->light.handle(make_command(true, -1, 500));
+    TEST_ASSERT_EQUAL(duty(128), last_fade().duty);
+    TEST_ASSERT_EQUAL(500, last_fade().duration_ms);
+}
+
+void test_default_transition()
+{
+    g_fixture->client.setup();
+    g_fixture->light.setup();
+    const uint32_t transition_ms = LightOutputOptions().default_transition_ms;
+
+    g_fixture->light.handle(make_command(true));
+    TEST_ASSERT_EQUAL(duty(255), last_fade().duty);
+    TEST_ASSERT_EQUAL(transition_ms, last_fade().duration_ms);
+
+    g_fixture->light.toggle();
+    TEST_ASSERT_EQUAL(0, last_fade().duty);
+    TEST_ASSERT_EQUAL(transition_ms, last_fade().duration_ms);
+
+    g_fixture->light.set_brightness(1000);
+    g_fixture->light.set_state(true);
+    TEST_ASSERT_EQUAL(duty(255), last_fade().duty);
+    TEST_ASSERT_EQUAL(transition_ms, last_fade().duration_ms);
+}
+
+void test_every_command_is_one_fade()
+{
+    g_fixture->client.setup();
+    g_fixture->light.setup();
+    const size_t fades = g_fixture->pwm.get_fades().size();
+
+    // A dragged slider: one fade per command, the last target wins
+    for (int brightness = 10; brightness <= 250; brightness += 10)
+        g_fixture->light.handle(make_command(true, brightness, 100));
+    TEST_ASSERT_EQUAL(fades + 25, g_fixture->pwm.get_fades().size());
+    TEST_ASSERT_EQUAL(duty(250), g_fixture->pwm.get_duty(last_fade().channel));
+}
+
+int main(int, char **)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_gamma_duties);
+    RUN_TEST(test_setup_restores_the_stored_level_right_away);
+    RUN_TEST(test_commands_fade_with_their_transition);
+    RUN_TEST(test_default_transition);
+    RUN_TEST(test_every_command_is_one_fade);
+    return UNITY_END();
+}
@@ -0,0 +1,155 @@
+#include "esp_log_ex/log_batcher.h"
+#include "mqtt/log_lane.h"
+
+#include <unity.h>
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static LogRecord make_record(uint32_t timestamp_ms, const char *message)
+{
+    LogRecord record;
+    snprintf(record.text, sizeof(record.text), "I (%u) test: %s", static_cast<unsigned int>(timestamp_ms), message);
+    record.length = static_cast<uint16_t>(strlen(record.text));
+    record.timestamp_ms = timestamp_ms;
+    record.truncated = false;
+    return record;
+}
+
+// Sink that answers with a configurable result and keeps what it was handed
+struct Sink
+{
+    LogSinkResult result = LogSinkResult::SENT;
+    std::vector<std::string> batches;
+
+    LogBatcher::Sink make()
+    {
+        return [this](const uint8_t *data, size_t length) {
+            if (result != LogSinkResult::REFUSED)
+                batches.emplace_back(reinterpret_cast<const char *>(data), length);
+            return result;
+        };
+    }
+};
+
+static LogBatcherOptions make_options()
+{
+    LogBatcherOptions options;
+    options.encoding = LogEncoding::TEXT;
+    options.max_batch_size = 64;
+    options.max_delay_ms = 100;
+    options.bytes_per_second = 100;
+    options.burst_bytes = 100;
+    return options;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_batches_until_due()
+{
+    Sink sink;
+    LogBatcher batcher(make_options(), sink.make());
+    batcher.add(make_record(0, "one"), 0);
+    batcher.add(make_record(10, "two"), 10);
+    batcher.flush_if_due(50);
+    TEST_ASSERT_EQUAL(0, sink.batches.size());
+
+    batcher.flush_if_due(100);
+    TEST_ASSERT_EQUAL(1, sink.batches.size());
+    TEST_ASSERT_EQUAL_STRING("I (0) test: one\nI (10) test: two", sink.batches[0].c_str());
+    TEST_ASSERT_EQUAL(2, batcher.get_stats().records);
+}
+
+void test_refused_batches_keep_their_tokens()
+{
+    Sink sink;
+    sink.result = LogSinkResult::REFUSED;
+    LogBatcher batcher(make_options(), sink.make());
+
+    // Each batch of 40 bytes is refused over and over while the sink is offline
+    batcher.add(make_record(0, "0123456789012345678901234"), 0);
+    for (uint32_t now = 100; now < 1000; now += 100)
+        batcher.flush_if_due(now);
+    TEST_ASSERT_EQUAL(0, batcher.get_stats().batches);
+    TEST_ASSERT_EQUAL(0, batcher.get_stats().throttled);
+
+    // The full burst is still there once it is back
+    sink.result = LogSinkResult::SENT;
+    batcher.flush_if_due(1000);
+    batcher.add(make_record(1000, "0123456789012345678901234"), 1000);
+    batcher.flush_if_due(1100);
+    TEST_ASSERT_EQUAL(2, batcher.get_stats().batches);
+    TEST_ASSERT_EQUAL(0, batcher.get_stats().throttled);
+}
+
+void test_stored_batches_do_not_count_as_sent()
+{
+    Sink sink;
+    sink.result = LogSinkResult::STORED;
+    LogBatcher batcher(make_options(), sink.make());
+
+    // Far more than the burst goes to the spool without being throttled
+    for (uint32_t i = 0; i < 10; ++i)
+    {
+        batcher.add(make_record(i * 100, "0123456789012345678901234"), i * 100);
+        batcher.flush_if_due(i * 100 + 100);
+    }
+    size_t stored = 0;
+    for (const auto &batch : sink.batches)
+        stored += batch.size();
+    TEST_ASSERT_EQUAL(10, sink.batches.size());
+    TEST_ASSERT_EQUAL(0, batcher.get_stats().throttled);
+    TEST_ASSERT_EQUAL(0, batcher.get_stats().bytes);
+    TEST_ASSERT_EQUAL(stored, batcher.get_stats().stored_bytes);
+}
+
+void test_sent_batches_are_rate_limited()
+{
+    Sink sink;
+    LogBatcher batcher(make_options(), sink.make());
+    for (uint32_t i = 0; i < 3; ++i)
+    {
+        batcher.add(make_record(0, "0123456789012345678901234"), 0);
+        batcher.flush_if_due(100 + i);
+    }
+
+    // 100 bytes of burst cover two batches of 40, the third waits for the refill
+    TEST_ASSERT_EQUAL(2, sink.batches.size());
+    TEST_ASSERT_EQUAL(1, batcher.get_stats().throttled);
+    batcher.flush_if_due(1000);
+    TEST_ASSERT_EQUAL(3, sink.batches.size());
+}
+
+void test_log_lane_rejects_oversize_batches()
+{
+    mqtt::LogLane lane;
+    std::string batch(mqtt::LogLane::MESSAGE_SIZE + 1, 'x');
+    TEST_ASSERT_FALSE(lane.push(batch.data(), batch.size()));
+    TEST_ASSERT_EQUAL(1, lane.get_dropped());
+
+    batch.resize(LogBatcher::MAX_BATCH_SIZE);
+    TEST_ASSERT_TRUE(lane.push(batch.data(), batch.size()));
+    char message[mqtt::LogLane::MESSAGE_SIZE];
+    size_t length = 0;
+    TEST_ASSERT_TRUE(lane.pop(message, length));
+    TEST_ASSERT_EQUAL(LogBatcher::MAX_BATCH_SIZE, length);
+}
+
+int main(int, char **)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_batches_until_due);
+    RUN_TEST(test_refused_batches_keep_their_tokens);
+    RUN_TEST(test_stored_batches_do_not_count_as_sent);
+    RUN_TEST(test_sent_batches_are_rate_limited);
+    RUN_TEST(test_log_lane_rejects_oversize_batches);
+    return UNITY_END();
+}
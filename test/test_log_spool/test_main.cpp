@@ -0,0 +1,120 @@
+#include "esp_log_ex/log_spool.h"
+
+#include "hal/native/fake_clock.h"
+
+#include <unity.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static std::string g_directory;
+
+void setUp()
+{
+    char directory[] = "/tmp/log_spool_XXXXXX";
+    g_directory = mkdtemp(directory);
+}
+
+void tearDown()
+{
+    const std::string command = "rm -rf " + g_directory;
+    TEST_ASSERT_EQUAL(0, system(command.c_str()));
+}
+
+static bool append(LogSpool &spool, const std::string &batch)
+{
+    return spool.append(reinterpret_cast<const uint8_t *>(batch.data()), batch.size());
+}
+
+static size_t replay(LogSpool &spool, std::vector<std::string> &batches, size_t max_batches = 100)
+{
+    return spool.replay(
+        [&batches](const uint8_t *data, size_t length) {
+            batches.emplace_back(reinterpret_cast<const char *>(data), length);
+            return true;
+        },
+        max_batches);
+}
+
+void test_replays_partial_page_without_writing()
+{
+    hal::FakeClock clock;
+    LogSpool spool(clock, g_directory);
+    TEST_ASSERT_TRUE(spool.open());
+    TEST_ASSERT_TRUE(append(spool, "one"));
+    TEST_ASSERT_TRUE(append(spool, "two"));
+
+    std::vector<std::string> batches;
+    TEST_ASSERT_EQUAL(1, replay(spool, batches, 1));
+    TEST_ASSERT_FALSE(spool.empty());
+    TEST_ASSERT_EQUAL(1, replay(spool, batches));
+    TEST_ASSERT_TRUE(spool.empty());
+    TEST_ASSERT_EQUAL(2, batches.size());
+    TEST_ASSERT_EQUAL_STRING("one", batches[0].c_str());
+    TEST_ASSERT_EQUAL_STRING("two", batches[1].c_str());
+    TEST_ASSERT_EQUAL(0, spool.get_stats().flash_writes);
+
+    // Nothing is left for the delayed flush either
+    clock.advance(LogSpoolOptions().flush_delay_ms);
+    spool.flush_if_due();
+    TEST_ASSERT_EQUAL(0, spool.get_stats().flash_writes);
+}
+
+void test_writes_full_pages_and_replays_in_order()
+{
+    hal::FakeClock clock;
+    LogSpool spool(clock, g_directory);
+    TEST_ASSERT_TRUE(spool.open());
+
+    // Three batches fill a page, the fourth starts the next one
+    const std::string batch(400, 'x');
+    for (char tag = 'a'; tag < 'e'; ++tag)
+        TEST_ASSERT_TRUE(append(spool, std::string(1, tag) + batch));
+    TEST_ASSERT_EQUAL(1, spool.get_stats().flash_writes);
+
+    // The remaining batch of the page in RAM is only sent after those on flash
+    std::vector<std::string> batches;
+    TEST_ASSERT_EQUAL(3, replay(spool, batches, 3));
+    TEST_ASSERT_TRUE(append(spool, "e"));
+    TEST_ASSERT_EQUAL(2, replay(spool, batches));
+    TEST_ASSERT_TRUE(spool.empty());
+    TEST_ASSERT_EQUAL(5, batches.size());
+    for (size_t i = 0; i < batches.size(); ++i)
+        TEST_ASSERT_EQUAL('a' + i, batches[i][0]);
+    TEST_ASSERT_EQUAL(1, spool.get_stats().flash_writes);
+}
+
+void test_flushes_unsent_part_after_delay()
+{
+    hal::FakeClock clock;
+    LogSpool spool(clock, g_directory);
+    TEST_ASSERT_TRUE(spool.open());
+    TEST_ASSERT_TRUE(append(spool, "one"));
+    TEST_ASSERT_TRUE(append(spool, "two"));
+
+    std::vector<std::string> batches;
+    TEST_ASSERT_EQUAL(1, replay(spool, batches, 1));
+    clock.advance(LogSpoolOptions().flush_delay_ms);
+    spool.flush_if_due();
+    TEST_ASSERT_EQUAL(1, spool.get_stats().flash_writes);
+    TEST_ASSERT_EQUAL(5, spool.get_stats().flash_bytes);
+
+    // The flushed batch survives a reboot
+    LogSpool rebooted(clock, g_directory);
+    TEST_ASSERT_TRUE(rebooted.open());
+    TEST_ASSERT_EQUAL(1, replay(rebooted, batches));
+    TEST_ASSERT_EQUAL_STRING("two", batches[1].c_str());
+    TEST_ASSERT_TRUE(rebooted.empty());
+}
+
+int main(int, char **)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_replays_partial_page_without_writing);
+    RUN_TEST(test_writes_full_pages_and_replays_in_order);
+    RUN_TEST(test_flushes_unsent_part_after_delay);
+    return UNITY_END();
+}
@@ -0,0 +1,167 @@
+#include "ota/ota_updater.h"
+
+#include "hal/native/fake_clock.h"
+#include "hal/native/fake_firmware.h"
+#include "hal/native/fake_mqtt_transport.h"
+#include "hal/native/fake_network.h"
+
+#include <unity.h>
+
+#include <cstring>
+
+struct Fixture
+{
+    hal::FakeClock clock;
+    hal::FakeNetwork network;
+    hal::FakeMqttTransport transport;
+    mqtt::Client client{transport, network, clock, "user", "password", "broker", 1883, "nosyna-test", "Nosyna"};
+    OtaUpdater updater{clock, client, "http://updates/nosyna.ota"};
+    unsigned int restarts_announced = 0;
+
+    // Runs the client and the updater every millisecond like their tasks
+    void run(uint32_t ms)
+    {
+        for (uint32_t i = 0; i < ms; ++i)
+        {
+            client.loop();
+            updater.loop();
+            clock.advance(1);
+        }
+    }
+};
+
+static Fixture *g_fixture = nullptr;
+
+void setUp()
+{
+    g_fixture = new Fixture();
+    g_fixture->updater.set_on_restart([]() { ++g_fixture->restarts_announced; });
+    g_fixture->client.setup();
+}
+
+void tearDown()
+{
+    delete g_fixture;
+    g_fixture = nullptr;
+    hal::set_fake_firmware_state(hal::FirmwareState::VALID);
+}
+
+static void make_header(uint8_t (&data)[OtaImageHeader::SIZE])
+{
+    memset(data, 0, sizeof(data));
+    memcpy(data, "NOTA", 4);
+    data[4] = OtaImageHeader::VERSION;
+    data[5] = 12;
+    // 0x00123456 bytes
+    data[8] = 0x56;
+    data[9] = 0x34;
+    data[10] = 0x12;
+    for (size_t i = 0; i < hal::FIRMWARE_SHA256_SIZE; ++i)
+    {
+        data[12 + i] = static_cast<uint8_t>(i);
+        data[44 + i] = static_cast<uint8_t>(0xff - i);
+    }
+}
+
+void test_parses_header()
+{
+    uint8_t data[OtaImageHeader::SIZE];
+    make_header(data);
+
+    OtaImageHeader header;
+    TEST_ASSERT_TRUE(OtaImageHeader::parse(data, sizeof(data), header));
+    TEST_ASSERT_EQUAL(12, header.window_bits);
+    TEST_ASSERT_EQUAL(0x00123456, header.image_size);
+    TEST_ASSERT_EQUAL(0, header.sha256[0]);
+    TEST_ASSERT_EQUAL(31, header.sha256[31]);
+    TEST_ASSERT_EQUAL(0xff, header.app_digest[0]);
+    TEST_ASSERT_EQUAL(0xe0, header.app_digest[31]);
+
+    // An uncompressed image
+    data[5] = 0;
+    TEST_ASSERT_TRUE(OtaImageHeader::parse(data, sizeof(data), header));
+    TEST_ASSERT_EQUAL(0, header.window_bits);
+}
+
+void test_rejects_invalid_headers()
+{
+    uint8_t data[OtaImageHeader::SIZE];
+    OtaImageHeader header;
+
+    make_header(data);
+    TEST_ASSERT_FALSE(OtaImageHeader::parse(data, sizeof(data) - 1, header));
+
+    data[0] = 'X';
+    TEST_ASSERT_FALSE(OtaImageHeader::parse(data, sizeof(data), header));
+
+    make_header(data);
+    data[4] = OtaImageHeader::VERSION + 1;
+    TEST_ASSERT_FALSE(OtaImageHeader::parse(data, sizeof(data), header));
+
+    // Windows the inflater can not use
+    make_header(data);
+    data[5] = 7;
+    TEST_ASSERT_FALSE(OtaImageHeader::parse(data, sizeof(data), header));
+    data[5] = 16;
+    TEST_ASSERT_FALSE(OtaImageHeader::parse(data, sizeof(data), header));
+
+    make_header(data);
+    memset(data + 8, 0, 4);
+    TEST_ASSERT_FALSE(OtaImageHeader::parse(data, sizeof(data), header));
+}
+
+void test_new_image_is_kept_once_connected()
+{
+    hal::set_fake_firmware_state(hal::FirmwareState::PENDING_VERIFY);
+    g_fixture->updater.setup();
+    g_fixture->network.begin();
+
+    g_fixture->run(1000);
+
+    TEST_ASSERT_TRUE(g_fixture->client.is_connected());
+    TEST_ASSERT_EQUAL(1, hal::get_fake_firmware_calls().confirms);
+    TEST_ASSERT_EQUAL(0, hal::get_fake_firmware_calls().rejects);
+    TEST_ASSERT_TRUE(hal::get_firmware_state() == hal::FirmwareState::VALID);
+    TEST_ASSERT_EQUAL(0, g_fixture->restarts_announced);
+}
+
+void test_new_image_is_rolled_back_without_broker()
+{
+    hal::set_fake_firmware_state(hal::FirmwareState::PENDING_VERIFY);
+    g_fixture->updater.setup();
+    g_fixture->network.set_available(false);
+
+    const uint32_t timeout_ms = OtaOptions().validation_timeout_ms;
+    // The last loop runs 1 ms before the timeout
+    g_fixture->run(timeout_ms);
+    TEST_ASSERT_EQUAL(0, hal::get_fake_firmware_calls().rejects);
+
+    g_fixture->run(1);
+    TEST_ASSERT_EQUAL(1, hal::get_fake_firmware_calls().rejects);
+    TEST_ASSERT_EQUAL(0, hal::get_fake_firmware_calls().confirms);
+    // The settings are saved before the restart
+    TEST_ASSERT_EQUAL(1, g_fixture->restarts_announced);
+}
+
+void test_valid_image_is_left_alone()
+{
+    g_fixture->updater.setup();
+    g_fixture->network.set_available(false);
+
+    g_fixture->run(OtaOptions().validation_timeout_ms + 1);
+
+    TEST_ASSERT_EQUAL(0, hal::get_fake_firmware_calls().confirms);
+    TEST_ASSERT_EQUAL(0, hal::get_fake_firmware_calls().rejects);
+    TEST_ASSERT_TRUE(g_fixture->updater.get_state() == OtaState::IDLE);
+}
+
+int main(int, char **)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_parses_header);
+    RUN_TEST(test_rejects_invalid_headers);
+    RUN_TEST(test_new_image_is_kept_once_connected);
+    RUN_TEST(test_new_image_is_rolled_back_without_broker);
+    RUN_TEST(test_valid_image_is_left_alone);
+    return UNITY_END();
+}
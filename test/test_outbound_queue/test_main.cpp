@@ -0,0 +1,315 @@
+#include "mqtt/client.h"
+#include "mqtt/outbound_queue.h"
+
+#include "hal/native/fake_clock.h"
+#include "hal/native/fake_mqtt_transport.h"
+#include "hal/native/fake_network.h"
+
+#include <unity.h>
+
+#include <cstring>
+#include <string>
+
+using mqtt::OutboundQueue;
+using mqtt::Priority;
+
+static hal::FakeMqttTransport *g_transport = nullptr;
+static OutboundQueue *g_queue = nullptr;
+static uint32_t g_now_ms = 0;
+
+void setUp()
+{
+    g_transport = new hal::FakeMqttTransport();
+    g_transport->connect("test", "", "");
+    g_transport->set_hold_acks(true);
+    g_queue = new OutboundQueue();
+    g_now_ms = 0;
+    g_transport->set_ack_callback([](uint16_t packet_id) { g_queue->on_ack(packet_id, g_now_ms); });
+}
+
+void tearDown()
+{
+    delete g_queue;
+    delete g_transport;
+}
+
+static bool enqueue(Priority priority, const char *topic, const char *payload, uint16_t key = OutboundQueue::NO_KEY,
+                    bool reliable = false)
+{
+    return g_queue->enqueue(priority, key, topic, payload, strlen(payload), false, reliable, g_now_ms);
+}
+
+static bool enqueue_reliable(Priority priority, const char *topic, const char *payload,
+                             uint16_t key = OutboundQueue::NO_KEY)
+{
+    return enqueue(priority, topic, payload, key, true);
+}
+
+static std::string published(size_t index)
+{
+    const auto &messages = g_transport->get_published();
+    TEST_ASSERT_TRUE(index < messages.size());
+    return messages[index].topic + " " + messages[index].payload;
+}
+
+void test_sends_by_priority_and_in_order()
+{
+    TEST_ASSERT_TRUE(enqueue(Priority::LOG, "log", "1"));
+    TEST_ASSERT_TRUE(enqueue(Priority::DISCOVERY, "config", "a"));
+    TEST_ASSERT_TRUE(enqueue(Priority::STATE, "state", "1"));
+    TEST_ASSERT_TRUE(enqueue(Priority::DISCOVERY, "config", "b"));
+    TEST_ASSERT_TRUE(enqueue(Priority::ACK, "state", "2"));
+
+    TEST_ASSERT_EQUAL(2, g_queue->send(*g_transport, 2, 10));
+    TEST_ASSERT_EQUAL(3, g_queue->depth());
+    TEST_ASSERT_EQUAL(3, g_queue->send(*g_transport, 10, 20));
+    TEST_ASSERT_EQUAL(0, g_queue->depth());
+
+    TEST_ASSERT_EQUAL_STRING("state 2", published(0).c_str());
+    TEST_ASSERT_EQUAL_STRING("state 1", published(1).c_str());
+    TEST_ASSERT_EQUAL_STRING("config a", published(2).c_str());
+    TEST_ASSERT_EQUAL_STRING("config b", published(3).c_str());
+    TEST_ASSERT_EQUAL_STRING("log 1", published(4).c_str());
+    TEST_ASSERT_EQUAL(5, g_queue->get_stats().sent);
+}
+
+void test_coalesces_by_key()
+{
+    TEST_ASSERT_TRUE(enqueue(Priority::STATE, "led", "ON", 7));
+    TEST_ASSERT_TRUE(enqueue(Priority::STATE, "led", "OFF", 7));
+    TEST_ASSERT_EQUAL(1, g_queue->depth());
+    TEST_ASSERT_EQUAL(1, g_queue->get_stats().coalesced);
+
+    // Moves to the priority of the newer message
+    TEST_ASSERT_TRUE(enqueue(Priority::ACK, "led", "ON", 7));
+    TEST_ASSERT_EQUAL(0, g_queue->depth(Priority::STATE));
+    TEST_ASSERT_EQUAL(1, g_queue->depth(Priority::ACK));
+
+    TEST_ASSERT_EQUAL(1, g_queue->send(*g_transport, 10, 0));
+    TEST_ASSERT_EQUAL_STRING("led ON", published(0).c_str());
+}
+
+void test_evicts_less_important_messages_when_full()
+{
+    for (size_t i = 0; i < OutboundQueue::CAPACITY; ++i)
+        TEST_ASSERT_TRUE(enqueue(Priority::LOG, "log", std::to_string(i).c_str()));
+
+    TEST_ASSERT_FALSE(enqueue(Priority::LOG, "log", "rejected"));
+    TEST_ASSERT_TRUE(enqueue(Priority::STATE, "state", "1"));
+    TEST_ASSERT_EQUAL(OutboundQueue::CAPACITY, g_queue->depth());
+    TEST_ASSERT_EQUAL(2, g_queue->get_stats().dropped[static_cast<size_t>(Priority::LOG)]);
+
+    // The oldest log made room
+    g_queue->send(*g_transport, OutboundQueue::CAPACITY, 0);
+    TEST_ASSERT_EQUAL_STRING("state 1", published(0).c_str());
+    TEST_ASSERT_EQUAL_STRING("log 1", published(1).c_str());
+}
+
+void test_failed_publish_stays_queued()
+{
+    TEST_ASSERT_TRUE(enqueue(Priority::STATE, "state", "1"));
+    g_transport->set_fail_publishes(true);
+    TEST_ASSERT_EQUAL(0, g_queue->send(*g_transport, 10, 0));
+    TEST_ASSERT_EQUAL(1, g_queue->depth());
+
+    g_transport->set_fail_publishes(false);
+    TEST_ASSERT_EQUAL(1, g_queue->send(*g_transport, 10, 0));
+    TEST_ASSERT_EQUAL(1, g_queue->get_stats().retries);
+    TEST_ASSERT_EQUAL(0, g_queue->depth());
+}
+
+void test_dropped_messages_do_not_count_as_sent()
+{
+    TEST_ASSERT_TRUE(enqueue(Priority::STATE, "state", "1"));
+    TEST_ASSERT_TRUE(enqueue(Priority::LOG, "log", "1"));
+    g_transport->set_fail_publishes(true);
+    for (uint8_t i = 0; i < OutboundQueue::MAX_ATTEMPTS; ++i)
+        TEST_ASSERT_EQUAL(0, g_queue->send(*g_transport, 10, 0));
+
+    // The state is given up and the log behind it goes out
+    g_transport->set_fail_publishes(false);
+    TEST_ASSERT_EQUAL(1, g_queue->send(*g_transport, 10, 0));
+    TEST_ASSERT_EQUAL(1, g_transport->get_published().size());
+    TEST_ASSERT_EQUAL_STRING("log 1", published(0).c_str());
+    TEST_ASSERT_EQUAL(1, g_queue->get_stats().sent);
+    TEST_ASSERT_EQUAL(1, g_queue->get_stats().dropped[static_cast<size_t>(Priority::STATE)]);
+    TEST_ASSERT_EQUAL(0, g_queue->depth());
+}
+
+void test_clear_keeps_other_priorities()
+{
+    TEST_ASSERT_TRUE(enqueue(Priority::STATE, "state", "1"));
+    TEST_ASSERT_TRUE(enqueue(Priority::DISCOVERY, "config", "a"));
+    TEST_ASSERT_TRUE(enqueue(Priority::LOG, "log", "1"));
+    g_queue->clear(Priority::STATE);
+    g_queue->clear(Priority::DISCOVERY);
+    TEST_ASSERT_EQUAL(1, g_queue->depth());
+    TEST_ASSERT_EQUAL(1, g_queue->depth(Priority::LOG));
+}
+
+void test_reliable_message_stays_until_acknowledged()
+{
+    TEST_ASSERT_TRUE(enqueue_reliable(Priority::STATE, "state", "1"));
+    g_now_ms = 10;
+    TEST_ASSERT_EQUAL(1, g_queue->send(*g_transport, 10, g_now_ms));
+    TEST_ASSERT_EQUAL(1, g_queue->depth());
+    TEST_ASSERT_EQUAL(1, g_queue->in_flight());
+    TEST_ASSERT_EQUAL(1, g_transport->get_unacknowledged().size());
+    const uint16_t packet_id = g_transport->get_published()[0].packet_id;
+    TEST_ASSERT_TRUE(packet_id != 0);
+
+    // Nothing is sent again before the acknowledgement is overdue
+    g_now_ms = 100;
+    TEST_ASSERT_EQUAL(0, g_queue->send(*g_transport, 10, g_now_ms));
+    g_transport->ack(packet_id);
+    TEST_ASSERT_EQUAL(0, g_queue->depth());
+    TEST_ASSERT_EQUAL(0, g_queue->in_flight());
+    TEST_ASSERT_EQUAL(1, g_queue->get_stats().acked);
+
+    // Latency runs until the acknowledgement
+    TEST_ASSERT_EQUAL(100, g_queue->get_stats().latency_ms.max());
+}
+
+void test_unacknowledged_message_is_sent_again()
+{
+    TEST_ASSERT_TRUE(enqueue_reliable(Priority::STATE, "state", "1"));
+    TEST_ASSERT_EQUAL(1, g_queue->send(*g_transport, 10, g_now_ms));
+
+    g_now_ms = OutboundQueue::RETRY_TIMEOUT_MS - 1;
+    TEST_ASSERT_EQUAL(0, g_queue->send(*g_transport, 10, g_now_ms));
+    g_now_ms = OutboundQueue::RETRY_TIMEOUT_MS;
+    TEST_ASSERT_EQUAL(1, g_queue->send(*g_transport, 10, g_now_ms));
+    TEST_ASSERT_EQUAL(2, g_transport->get_published().size());
+    TEST_ASSERT_EQUAL_STRING("state 1", published(1).c_str());
+    TEST_ASSERT_EQUAL(1, g_queue->get_stats().retries);
+
+    // Only the acknowledgement of the last publish releases it
+    const uint16_t first = g_transport->get_published()[0].packet_id;
+    const uint16_t second = g_transport->get_published()[1].packet_id;
+    TEST_ASSERT_TRUE(first != second);
+    g_transport->ack(first);
+    TEST_ASSERT_EQUAL(1, g_queue->depth());
+    g_transport->ack(second);
+    TEST_ASSERT_EQUAL(0, g_queue->depth());
+}
+
+void test_unacknowledged_message_is_given_up()
+{
+    TEST_ASSERT_TRUE(enqueue_reliable(Priority::STATE, "state", "1"));
+    for (uint8_t i = 0; i < OutboundQueue::MAX_ATTEMPTS; ++i)
+    {
+        TEST_ASSERT_EQUAL(1, g_queue->send(*g_transport, 10, g_now_ms));
+        g_now_ms += OutboundQueue::RETRY_TIMEOUT_MS;
+    }
+
+    TEST_ASSERT_EQUAL(0, g_queue->send(*g_transport, 10, g_now_ms));
+    TEST_ASSERT_EQUAL(OutboundQueue::MAX_ATTEMPTS, g_transport->get_published().size());
+    TEST_ASSERT_EQUAL(1, g_queue->get_stats().dropped[static_cast<size_t>(Priority::STATE)]);
+    TEST_ASSERT_EQUAL(0, g_queue->depth());
+    TEST_ASSERT_EQUAL(0, g_queue->in_flight());
+}
+
+void test_in_flight_messages_are_limited()
+{
+    for (size_t i = 0; i <= OutboundQueue::MAX_IN_FLIGHT; ++i)
+        TEST_ASSERT_TRUE(enqueue_reliable(Priority::DISCOVERY, "config", std::to_string(i).c_str()));
+    TEST_ASSERT_TRUE(enqueue(Priority::LOG, "log", "1"));
+
+    // QoS 0 messages are not held up by the window
+    TEST_ASSERT_EQUAL(OutboundQueue::MAX_IN_FLIGHT + 1, g_queue->send(*g_transport, 10, g_now_ms));
+    TEST_ASSERT_EQUAL_STRING("log 1", published(OutboundQueue::MAX_IN_FLIGHT).c_str());
+    TEST_ASSERT_EQUAL(OutboundQueue::MAX_IN_FLIGHT, g_queue->in_flight());
+
+    g_transport->ack(g_transport->get_published()[0].packet_id);
+    TEST_ASSERT_EQUAL(1, g_queue->send(*g_transport, 10, g_now_ms));
+    TEST_ASSERT_EQUAL_STRING(("config " + std::to_string(OutboundQueue::MAX_IN_FLIGHT)).c_str(),
+                             published(OutboundQueue::MAX_IN_FLIGHT + 1).c_str());
+}
+
+void test_in_flight_message_is_not_replaced()
+{
+    TEST_ASSERT_TRUE(enqueue_reliable(Priority::STATE, "led", "ON", 7));
+    TEST_ASSERT_EQUAL(1, g_queue->send(*g_transport, 10, g_now_ms));
+    TEST_ASSERT_TRUE(enqueue_reliable(Priority::STATE, "led", "OFF", 7));
+    TEST_ASSERT_EQUAL(2, g_queue->depth());
+    TEST_ASSERT_EQUAL(0, g_queue->get_stats().coalesced);
+
+    TEST_ASSERT_EQUAL(1, g_queue->send(*g_transport, 10, g_now_ms));
+    TEST_ASSERT_EQUAL_STRING("led OFF", published(1).c_str());
+}
+
+void test_in_flight_messages_are_sent_after_reconnect()
+{
+    TEST_ASSERT_TRUE(enqueue_reliable(Priority::STATE, "state", "1"));
+    TEST_ASSERT_EQUAL(1, g_queue->send(*g_transport, 10, g_now_ms));
+    g_transport->drop_connection();
+    g_queue->on_disconnected();
+    TEST_ASSERT_EQUAL(0, g_queue->in_flight());
+
+    g_transport->connect("test", "", "");
+    TEST_ASSERT_EQUAL(1, g_queue->send(*g_transport, 10, g_now_ms));
+    TEST_ASSERT_EQUAL(2, g_transport->get_published().size());
+    g_transport->ack_all();
+    TEST_ASSERT_EQUAL(0, g_queue->depth());
+}
+
+// The client holds the next state back until the broker acknowledged the previous one and sends it again if the
+// acknowledgement is lost
+void test_client_waits_for_the_acknowledgement()
+{
+    hal::FakeClock clock;
+    hal::FakeNetwork network;
+    hal::FakeMqttTransport transport;
+    mqtt::Client client(transport, network, clock, "user", "password", "broker", 1883, "nosyna-test", "Nosyna");
+    client.setup();
+    const auto temperature = client.add_sensor("temperature", "Temperature", "temperature", "°C");
+    client.set(temperature, 20.0f);
+    network.begin();
+    for (size_t i = 0; i < 20; ++i)
+    {
+        client.loop();
+        clock.advance(1);
+    }
+    TEST_ASSERT_EQUAL(0, client.get_outbound_depth());
+
+    transport.set_hold_acks(true);
+    transport.clear_published();
+    client.set(temperature, 21.0f);
+    client.loop();
+    client.set(temperature, 22.0f);
+    client.loop();
+    TEST_ASSERT_EQUAL(1, transport.get_published().size());
+    TEST_ASSERT_NOT_NULL(strstr(transport.get_published()[0].payload.c_str(), "\"temperature_state\":21.0"));
+
+    // The lost acknowledgement is waited for, then the same message goes out again
+    clock.advance(OutboundQueue::RETRY_TIMEOUT_MS);
+    client.loop();
+    TEST_ASSERT_EQUAL(2, transport.get_published().size());
+    const auto &published = transport.get_published();
+    TEST_ASSERT_EQUAL_STRING(published[0].payload.c_str(), published[1].payload.c_str());
+
+    transport.ack_all();
+    client.loop();
+    TEST_ASSERT_EQUAL(3, transport.get_published().size());
+    TEST_ASSERT_NOT_NULL(strstr(published[2].payload.c_str(), "\"temperature_state\":22.0"));
+    TEST_ASSERT_EQUAL(1, client.get_outbound_stats().retries);
+}
+
+int main(int, char **)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_sends_by_priority_and_in_order);
+    RUN_TEST(test_coalesces_by_key);
+    RUN_TEST(test_evicts_less_important_messages_when_full);
+    RUN_TEST(test_failed_publish_stays_queued);
+    RUN_TEST(test_dropped_messages_do_not_count_as_sent);
+    RUN_TEST(test_clear_keeps_other_priorities);
+    RUN_TEST(test_reliable_message_stays_until_acknowledged);
+    RUN_TEST(test_unacknowledged_message_is_sent_again);
+    RUN_TEST(test_unacknowledged_message_is_given_up);
+    RUN_TEST(test_in_flight_messages_are_limited);
+    RUN_TEST(test_in_flight_message_is_not_replaced);
+    RUN_TEST(test_in_flight_messages_are_sent_after_reconnect);
+    RUN_TEST(test_client_waits_for_the_acknowledgement);
+    return UNITY_END();
+}
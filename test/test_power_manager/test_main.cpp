@@ -0,0 +1,200 @@
+#include "power/power_manager.h"
+
+#include "hal/native/fake_clock.h"
+#include "hal/native/fake_network.h"
+
+#include <unity.h>
+
+struct Fixture
+{
+    hal::FakeClock clock;
+    hal::FakeNetwork network;
+    PowerManager power{clock, network};
+
+    // Moves the clock to the given millisecond since the start of the test
+    void at(uint32_t ms)
+    {
+        clock.advance(ms - clock.millis());
+    }
+};
+
+static Fixture *g_fixture = nullptr;
+
+void setUp()
+{
+    g_fixture = new Fixture();
+    g_fixture->power.setup();
+}
+
+void tearDown()
+{
+    delete g_fixture;
+    g_fixture = nullptr;
+}
+
+void test_two_tasks_sleep_only_while_both_wait()
+{
+    auto &power = g_fixture->power;
+    power.add_task();
+    power.add_task();
+
+    g_fixture->at(10);
+    power.begin_idle();
+    g_fixture->at(20);
+    power.begin_idle();
+    g_fixture->at(60);
+    power.end_idle();
+    g_fixture->at(80);
+    power.end_idle();
+    g_fixture->at(100);
+
+    const PowerStats stats = power.take_stats();
+    TEST_ASSERT_EQUAL(100, stats.window_ms);
+    TEST_ASSERT_EQUAL(60, stats.awake_ms);
+    TEST_ASSERT_EQUAL(1, stats.wakeups);
+}
+
+void test_three_tasks_count_every_wakeup()
+{
+    auto &power = g_fixture->power;
+    for (int i = 0; i < 3; ++i)
+        power.add_task();
+
+    // The first task waits from 0 to 50, the second from 10 to 90, the third from 20 to 40 and from 45 to 95
+    power.begin_idle();
+    g_fixture->at(10);
+    power.begin_idle();
+    g_fixture->at(20);
+    power.begin_idle();
+    g_fixture->at(40);
+    power.end_idle();
+    g_fixture->at(45);
+    power.begin_idle();
+    g_fixture->at(50);
+    power.end_idle();
+    g_fixture->at(90);
+    power.end_idle();
+    g_fixture->at(95);
+    power.end_idle();
+    g_fixture->at(100);
+
+    // Asleep from 20 to 40 and from 45 to 50
+    const PowerStats stats = power.take_stats();
+    TEST_ASSERT_EQUAL(100, stats.window_ms);
+    TEST_ASSERT_EQUAL(75, stats.awake_ms);
+    TEST_ASSERT_EQUAL(2, stats.wakeups);
+}
+
+void test_waits_while_another_task_runs_are_no_wakeups()
+{
+    auto &power = g_fixture->power;
+    power.add_task();
+    power.add_task();
+
+    power.begin_idle();
+    for (uint32_t ms = 10; ms < 100; ms += 10)
+    {
+        g_fixture->at(ms);
+        power.begin_idle();
+        g_fixture->at(ms + 5);
+        power.end_idle();
+    }
+    g_fixture->at(100);
+    power.end_idle();
+
+    const PowerStats stats = power.take_stats();
+    TEST_ASSERT_EQUAL(9, stats.wakeups);
+    TEST_ASSERT_EQUAL(55, stats.awake_ms);
+}
+
+void test_sleep_spanning_the_window_is_split()
+{
+    auto &power = g_fixture->power;
+    power.add_task();
+    power.add_task();
+
+    g_fixture->at(30);
+    power.begin_idle();
+    power.begin_idle();
+    g_fixture->at(50);
+    // Taken by a task that does not wait through the manager
+    PowerStats stats = power.take_stats();
+    TEST_ASSERT_EQUAL(50, stats.window_ms);
+    TEST_ASSERT_EQUAL(30, stats.awake_ms);
+    TEST_ASSERT_EQUAL(0, stats.wakeups);
+
+    g_fixture->at(80);
+    power.end_idle();
+    power.end_idle();
+    g_fixture->at(100);
+    stats = power.take_stats();
+    TEST_ASSERT_EQUAL(50, stats.window_ms);
+    TEST_ASSERT_EQUAL(20, stats.awake_ms);
+    TEST_ASSERT_EQUAL(1, stats.wakeups);
+}
+
+void test_take_stats_starts_a_new_window()
+{
+    auto &power = g_fixture->power;
+    power.add_task();
+
+    g_fixture->at(10);
+    power.begin_idle();
+    g_fixture->at(40);
+    power.end_idle();
+    g_fixture->at(50);
+    PowerStats stats = power.take_stats();
+    TEST_ASSERT_EQUAL(50, stats.window_ms);
+    TEST_ASSERT_EQUAL(20, stats.awake_ms);
+    TEST_ASSERT_EQUAL(1, stats.wakeups);
+
+    stats = power.take_stats();
+    TEST_ASSERT_EQUAL(0, stats.window_ms);
+    TEST_ASSERT_EQUAL(0, stats.awake_ms);
+    TEST_ASSERT_EQUAL(0, stats.wakeups);
+
+    g_fixture->at(70);
+    stats = power.take_stats();
+    TEST_ASSERT_EQUAL(20, stats.window_ms);
+    TEST_ASSERT_EQUAL(20, stats.awake_ms);
+    TEST_ASSERT_EQUAL(0, stats.wakeups);
+}
+
+void test_idle_returns_on_notify_and_timeout()
+{
+    auto &power = g_fixture->power;
+    power.add_task();
+    hal::Event event;
+
+    event.notify();
+    TEST_ASSERT_TRUE(power.idle(event, 1000));
+    TEST_ASSERT_FALSE(power.idle(event, 1));
+    TEST_ASSERT_EQUAL(2, power.take_stats().wakeups);
+}
+
+void test_power_save_falls_back_without_power_management()
+{
+    hal::FakeClock clock;
+    hal::FakeNetwork network;
+    PowerOptions options;
+    options.mode = PowerMode::POWER_SAVE;
+    PowerManager power(clock, network, options);
+    power.setup();
+
+    TEST_ASSERT_TRUE(power.get_mode() == PowerMode::PERFORMANCE);
+    TEST_ASSERT_FALSE(network.get_power_save());
+    TEST_ASSERT_EQUAL(options.performance_poll_ms, power.get_network_poll_ms());
+}
+
+int main(int, char **)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_two_tasks_sleep_only_while_both_wait);
+    RUN_TEST(test_three_tasks_count_every_wakeup);
+    RUN_TEST(test_waits_while_another_task_runs_are_no_wakeups);
+    RUN_TEST(test_sleep_spanning_the_window_is_split);
+    RUN_TEST(test_take_stats_starts_a_new_window);
+    RUN_TEST(test_idle_returns_on_notify_and_timeout);
+    RUN_TEST(test_power_save_falls_back_without_power_management);
+    return UNITY_END();
+}
@@ -0,0 +1,205 @@
+#include "util/sample_pipeline.h"
+
+#include <unity.h>
+
+#include <cmath>
+
+typedef SamplePipeline::Report Report;
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+// No median and no smoothing, every accepted sample is the filtered value
+static SamplePipelineOptions raw_options()
+{
+    SamplePipelineOptions options;
+    options.median_window = 1;
+    options.ema_alpha = 1;
+    return options;
+}
+
+void test_median_drops_a_single_spike()
+{
+    SamplePipelineOptions options = raw_options();
+    options.median_window = 3;
+    SamplePipeline pipeline(options);
+
+    TEST_ASSERT_TRUE(pipeline.add(10, 0) == Report::CHANGE);
+    TEST_ASSERT_TRUE(pipeline.add(10, 1000) == Report::NONE);
+    TEST_ASSERT_TRUE(pipeline.add(40, 2000) == Report::NONE);
+    TEST_ASSERT_EQUAL_FLOAT(10, pipeline.value());
+    // The oldest sample leaves the window
+    TEST_ASSERT_TRUE(pipeline.add(12, 3000) == Report::CHANGE);
+    TEST_ASSERT_EQUAL_FLOAT(12, pipeline.value());
+}
+
+void test_moving_average()
+{
+    SamplePipelineOptions options = raw_options();
+    options.ema_alpha = 0.5f;
+    SamplePipeline pipeline(options);
+
+    pipeline.add(10, 0);
+    TEST_ASSERT_EQUAL_FLOAT(10, pipeline.value());
+    pipeline.add(20, 1000);
+    TEST_ASSERT_EQUAL_FLOAT(15, pipeline.value());
+    pipeline.add(20, 2000);
+    TEST_ASSERT_EQUAL_FLOAT(17.5f, pipeline.value());
+}
+
+void test_invalid_samples_are_rejected()
+{
+    SamplePipelineOptions options = raw_options();
+    options.min_value = -40;
+    options.max_value = 80;
+    SamplePipeline pipeline(options);
+
+    TEST_ASSERT_TRUE(pipeline.add(NAN, 0) == Report::NONE);
+    TEST_ASSERT_TRUE(pipeline.add(-41, 0) == Report::NONE);
+    TEST_ASSERT_TRUE(pipeline.add(81, 0) == Report::NONE);
+    TEST_ASSERT_FALSE(pipeline.has_reported());
+    TEST_ASSERT_TRUE(pipeline.add(80, 0) == Report::CHANGE);
+    TEST_ASSERT_EQUAL(3, pipeline.get_stats().rejected_invalid);
+}
+
+void test_outliers_are_rejected_until_they_persist()
+{
+    SamplePipelineOptions options = raw_options();
+    options.max_step = 5;
+    SamplePipeline pipeline(options);
+
+    TEST_ASSERT_TRUE(pipeline.add(20, 0) == Report::CHANGE);
+    TEST_ASSERT_TRUE(pipeline.add(40, 1000) == Report::NONE);
+    TEST_ASSERT_TRUE(pipeline.add(41, 2000) == Report::NONE);
+    // A sample in range in between starts the count again
+    TEST_ASSERT_TRUE(pipeline.add(21, 3000) == Report::CHANGE);
+    TEST_ASSERT_EQUAL_FLOAT(21, pipeline.value());
+
+    TEST_ASSERT_TRUE(pipeline.add(40, 4000) == Report::NONE);
+    TEST_ASSERT_TRUE(pipeline.add(40, 5000) == Report::NONE);
+    // The third one in a row is a real step
+    TEST_ASSERT_TRUE(pipeline.add(40, 6000) == Report::CHANGE);
+    TEST_ASSERT_EQUAL_FLOAT(40, pipeline.value());
+    TEST_ASSERT_EQUAL(4, pipeline.get_stats().rejected_outliers);
+
+    // The filter starts over from the new level
+    TEST_ASSERT_TRUE(pipeline.add(42, 7000) == Report::CHANGE);
+    TEST_ASSERT_EQUAL_FLOAT(42, pipeline.value());
+}
+
+void test_step_restarts_the_median()
+{
+    SamplePipelineOptions options = raw_options();
+    options.median_window = 5;
+    options.max_step = 5;
+    SamplePipeline pipeline(options);
+
+    for (uint32_t i = 0; i < 5; ++i)
+        pipeline.add(20, i * 1000);
+    for (uint32_t i = 5; i < 8; ++i)
+        pipeline.add(40, i * 1000);
+
+    // Not the median of the old samples
+    TEST_ASSERT_EQUAL_FLOAT(40, pipeline.value());
+}
+
+void test_deadband()
+{
+    SamplePipelineOptions options = raw_options();
+    options.deadband = 0.5f;
+    SamplePipeline pipeline(options);
+
+    TEST_ASSERT_TRUE(pipeline.add(20, 0) == Report::CHANGE);
+    TEST_ASSERT_TRUE(pipeline.add(20.3f, 1000) == Report::NONE);
+    TEST_ASSERT_EQUAL_FLOAT(20, pipeline.value());
+    TEST_ASSERT_TRUE(pipeline.add(20.6f, 2000) == Report::CHANGE);
+    TEST_ASSERT_EQUAL_FLOAT(20.6f, pipeline.value());
+    TEST_ASSERT_TRUE(pipeline.add(20.2f, 3000) == Report::NONE);
+    TEST_ASSERT_TRUE(pipeline.add(20.0f, 4000) == Report::CHANGE);
+    TEST_ASSERT_EQUAL(3, pipeline.get_stats().reports);
+}
+
+void test_min_interval()
+{
+    SamplePipelineOptions options = raw_options();
+    options.min_interval_ms = 1000;
+    SamplePipeline pipeline(options);
+
+    TEST_ASSERT_TRUE(pipeline.add(20, 0) == Report::CHANGE);
+    TEST_ASSERT_TRUE(pipeline.add(25, 500) == Report::NONE);
+    TEST_ASSERT_EQUAL_FLOAT(20, pipeline.value());
+    TEST_ASSERT_TRUE(pipeline.add(25, 999) == Report::NONE);
+    TEST_ASSERT_TRUE(pipeline.add(25, 1000) == Report::CHANGE);
+    TEST_ASSERT_EQUAL_FLOAT(25, pipeline.value());
+}
+
+void test_heartbeat()
+{
+    SamplePipelineOptions options = raw_options();
+    options.max_interval_ms = 5000;
+    SamplePipeline pipeline(options);
+
+    TEST_ASSERT_TRUE(pipeline.add(20, 0) == Report::CHANGE);
+    TEST_ASSERT_TRUE(pipeline.add(20, 2000) == Report::NONE);
+    TEST_ASSERT_TRUE(pipeline.add(20, 5000) == Report::HEARTBEAT);
+    TEST_ASSERT_EQUAL_FLOAT(20, pipeline.value());
+    TEST_ASSERT_TRUE(pipeline.add(20, 7000) == Report::NONE);
+    // A change restarts the interval
+    TEST_ASSERT_TRUE(pipeline.add(21, 8000) == Report::CHANGE);
+    TEST_ASSERT_TRUE(pipeline.add(21, 12000) == Report::NONE);
+    TEST_ASSERT_TRUE(pipeline.add(21, 13000) == Report::HEARTBEAT);
+    TEST_ASSERT_EQUAL(2, pipeline.get_stats().heartbeats);
+    TEST_ASSERT_EQUAL(4, pipeline.get_stats().reports);
+}
+
+void test_stale_value_is_reported_once()
+{
+    SamplePipelineOptions options = raw_options();
+    options.max_age_ms = 3000;
+    SamplePipeline pipeline(options);
+
+    TEST_ASSERT_TRUE(pipeline.add(20, 0) == Report::CHANGE);
+    TEST_ASSERT_TRUE(pipeline.add(NAN, 1000) == Report::NONE);
+    TEST_ASSERT_TRUE(pipeline.add(NAN, 3000) == Report::STALE);
+    TEST_ASSERT_TRUE(std::isnan(pipeline.value()));
+    TEST_ASSERT_TRUE(pipeline.add(NAN, 4000) == Report::NONE);
+    TEST_ASSERT_TRUE(pipeline.add(NAN, 10000) == Report::NONE);
+
+    // The next valid sample is reported right away
+    TEST_ASSERT_TRUE(pipeline.add(21, 11000) == Report::CHANGE);
+    TEST_ASSERT_EQUAL_FLOAT(21, pipeline.value());
+    TEST_ASSERT_EQUAL(4, pipeline.get_stats().rejected_invalid);
+    TEST_ASSERT_EQUAL(3, pipeline.get_stats().reports);
+}
+
+void test_never_stale_without_a_valid_sample()
+{
+    SamplePipelineOptions options = raw_options();
+    options.max_age_ms = 3000;
+    SamplePipeline pipeline(options);
+
+    TEST_ASSERT_TRUE(pipeline.add(NAN, 0) == Report::NONE);
+    TEST_ASSERT_TRUE(pipeline.add(NAN, 5000) == Report::NONE);
+    TEST_ASSERT_FALSE(pipeline.has_reported());
+}
+
+int main(int, char **)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_median_drops_a_single_spike);
+    RUN_TEST(test_moving_average);
+    RUN_TEST(test_invalid_samples_are_rejected);
+    RUN_TEST(test_outliers_are_rejected_until_they_persist);
+    RUN_TEST(test_step_restarts_the_median);
+    RUN_TEST(test_deadband);
+    RUN_TEST(test_min_interval);
+    RUN_TEST(test_heartbeat);
+    RUN_TEST(test_stale_value_is_reported_once);
+    RUN_TEST(test_never_stale_without_a_valid_sample);
+    return UNITY_END();
+}
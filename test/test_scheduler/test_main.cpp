@@ -0,0 +1,247 @@
+#include "scheduler/scheduler.h"
+
+#include "hal/native/fake_clock.h"
+
+#include <unity.h>
+
+#include <vector>
+
+static hal::FakeClock *g_clock = nullptr;
+
+void setUp()
+{
+    g_clock = new hal::FakeClock();
+}
+
+void tearDown()
+{
+    delete g_clock;
+    g_clock = nullptr;
+}
+
+// Runs the scheduler every millisecond like the control loop
+static void run(Scheduler &scheduler, uint32_t ms)
+{
+    for (uint32_t i = 0; i < ms; ++i)
+    {
+        g_clock->advance(1);
+        scheduler.run();
+    }
+}
+
+void test_one_shots_cascade_from_every_level()
+{
+    // Off the slot boundaries, so the cascades start in the middle of a slot
+    g_clock->advance(37);
+    Scheduler scheduler(*g_clock);
+    const uint32_t start = g_clock->millis();
+    // Level 0, 1, 2 and 3
+    const uint32_t delays[] = {10, 100, 5000, 300000};
+    std::vector<uint32_t> ran;
+    TaskId tasks[4];
+    for (size_t i = 0; i < 4; ++i)
+    {
+        tasks[i] = scheduler.add_one_shot("once", [&ran]() { ran.push_back(g_clock->millis()); }, 1);
+        scheduler.schedule(tasks[i], delays[i]);
+    }
+
+    run(scheduler, 300001);
+
+    TEST_ASSERT_EQUAL(4, ran.size());
+    for (size_t i = 0; i < 4; ++i)
+    {
+        TEST_ASSERT_EQUAL(start + delays[i], ran[i]);
+        TEST_ASSERT_EQUAL(1, scheduler.get_stats(tasks[i]).runs);
+    }
+    TEST_ASSERT_EQUAL(0, scheduler.get_deadline_misses());
+}
+
+void test_periodic_task_stays_on_its_grid()
+{
+    Scheduler scheduler(*g_clock);
+    std::vector<uint32_t> ran;
+    const TaskId task = scheduler.add_periodic("periodic", 70, [&ran]() { ran.push_back(g_clock->millis()); });
+
+    // Sparse calls, the runs are late but the grid does not drift
+    for (int i = 0; i < 10; ++i)
+    {
+        g_clock->advance(33);
+        scheduler.run();
+    }
+
+    TEST_ASSERT_EQUAL(4, ran.size());
+    TEST_ASSERT_EQUAL(99, ran[0]);
+    TEST_ASSERT_EQUAL(165, ran[1]);
+    TEST_ASSERT_EQUAL(231, ran[2]);
+    TEST_ASSERT_EQUAL(297, ran[3]);
+    TEST_ASSERT_EQUAL(0, scheduler.get_stats(task).deadline_misses);
+}
+
+void test_skipped_periods_count_as_misses()
+{
+    Scheduler scheduler(*g_clock);
+    std::vector<uint32_t> ran;
+    const TaskId task = scheduler.add_periodic("slow", 10, [&ran]() {
+        ran.push_back(g_clock->millis());
+        // The first run takes 35 ms
+        if (ran.size() == 1)
+            g_clock->advance(35);
+    });
+
+    run(scheduler, 60);
+
+    // Due at 10 and finished at 45, the runs due at 20, 30 and 40 are skipped
+    TEST_ASSERT_TRUE(ran.size() >= 2);
+    TEST_ASSERT_EQUAL(10, ran[0]);
+    TEST_ASSERT_EQUAL(50, ran[1]);
+    TEST_ASSERT_EQUAL(4, scheduler.get_stats(task).deadline_misses);
+}
+
+void test_task_cancels_itself()
+{
+    Scheduler scheduler(*g_clock);
+    unsigned int runs = 0;
+    TaskId task = INVALID_TASK_ID;
+    task = scheduler.add_periodic("cancel", 10, [&]() {
+        if (++runs == 3)
+            scheduler.cancel(task);
+    });
+
+    run(scheduler, 100);
+
+    TEST_ASSERT_EQUAL(3, runs);
+    TEST_ASSERT_EQUAL(Scheduler::MAX_IDLE_MS, scheduler.get_idle_ms());
+
+    // Armed again from outside
+    scheduler.schedule(task, 5);
+    run(scheduler, 5);
+    TEST_ASSERT_EQUAL(4, runs);
+}
+
+void test_task_rearms_itself()
+{
+    Scheduler scheduler(*g_clock);
+    std::vector<uint32_t> ran;
+    TaskId periodic = INVALID_TASK_ID;
+    // Replaces its period with a longer delay once
+    periodic = scheduler.add_periodic("rearm", 10, [&]() {
+        ran.push_back(g_clock->millis());
+        if (ran.size() == 1)
+            scheduler.schedule(periodic, 25);
+    });
+    std::vector<uint32_t> retried;
+    TaskId one_shot = INVALID_TASK_ID;
+    one_shot = scheduler.add_one_shot("retry", [&]() {
+        retried.push_back(g_clock->millis());
+        if (retried.size() < 3)
+            scheduler.schedule(one_shot, 7);
+    }, 1);
+    scheduler.schedule(one_shot, 7);
+
+    run(scheduler, 60);
+
+    TEST_ASSERT_EQUAL(10, ran[0]);
+    TEST_ASSERT_EQUAL(35, ran[1]);
+    TEST_ASSERT_EQUAL(45, ran[2]);
+    TEST_ASSERT_EQUAL(3, retried.size());
+    TEST_ASSERT_EQUAL(7, retried[0]);
+    TEST_ASSERT_EQUAL(14, retried[1]);
+    TEST_ASSERT_EQUAL(21, retried[2]);
+}
+
+void test_delay_of_zero_runs_with_the_next_tick()
+{
+    Scheduler scheduler(*g_clock);
+    g_clock->advance(5);
+    scheduler.run();
+    unsigned int runs = 0;
+    TaskId task = INVALID_TASK_ID;
+    task = scheduler.add_one_shot("now", [&]() {
+        // Scheduling itself with no delay from its callback does not loop within one tick
+        if (++runs == 1)
+            scheduler.schedule(task, 0);
+    }, 1);
+
+    // The current tick was processed already
+    scheduler.schedule(task, 0);
+    TEST_ASSERT_EQUAL(1, scheduler.get_idle_ms());
+    scheduler.run();
+    TEST_ASSERT_EQUAL(0, runs);
+
+    run(scheduler, 1);
+    TEST_ASSERT_EQUAL(1, runs);
+    run(scheduler, 1);
+    TEST_ASSERT_EQUAL(2, runs);
+    run(scheduler, 10);
+    TEST_ASSERT_EQUAL(2, runs);
+}
+
+void test_idle_time()
+{
+    Scheduler scheduler(*g_clock);
+    TEST_ASSERT_EQUAL(Scheduler::MAX_IDLE_MS, scheduler.get_idle_ms());
+
+    const TaskId slow = scheduler.add_periodic("slow", 5000, []() {});
+    TEST_ASSERT_EQUAL(Scheduler::MAX_IDLE_MS, scheduler.get_idle_ms());
+
+    scheduler.add_periodic("fast", 250, []() {});
+    TEST_ASSERT_EQUAL(250, scheduler.get_idle_ms());
+    g_clock->advance(100);
+    TEST_ASSERT_EQUAL(150, scheduler.get_idle_ms());
+
+    // Overdue until run() catches up
+    g_clock->advance(200);
+    TEST_ASSERT_EQUAL(0, scheduler.get_idle_ms());
+    scheduler.run();
+    TEST_ASSERT_EQUAL(200, scheduler.get_idle_ms());
+
+    scheduler.cancel(slow);
+    g_clock->advance(200);
+    scheduler.run();
+    TEST_ASSERT_EQUAL(250, scheduler.get_idle_ms());
+}
+
+void test_deadlines_across_the_wrap()
+{
+    // 50 ms before millis() wraps
+    g_clock->advance(UINT32_MAX - 49);
+    Scheduler scheduler(*g_clock);
+    const uint32_t start = g_clock->millis();
+    std::vector<uint32_t> ran;
+    bool slow = false;
+    const TaskId task = scheduler.add_periodic("wrap", 20, [&]() {
+        ran.push_back(g_clock->millis());
+        if (slow)
+        {
+            slow = false;
+            g_clock->advance(8);
+        }
+    }, 5);
+
+    run(scheduler, 100);
+    TEST_ASSERT_EQUAL(5, ran.size());
+    for (size_t i = 0; i < ran.size(); ++i)
+        TEST_ASSERT_EQUAL(static_cast<uint32_t>(start + 20 * (i + 1)), ran[i]);
+    TEST_ASSERT_EQUAL(0, scheduler.get_stats(task).deadline_misses);
+    TEST_ASSERT_EQUAL(0, scheduler.get_stats(task).lateness_ms.max());
+
+    // One run over its deadline right after the wrap counts once, the grid stays
+    slow = true;
+    run(scheduler, 40);
+    TEST_ASSERT_EQUAL(1, scheduler.get_stats(task).deadline_misses);
+    TEST_ASSERT_EQUAL(static_cast<uint32_t>(start + 140), ran.back());
+}
+
+int main(int, char **)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_one_shots_cascade_from_every_level);
+    RUN_TEST(test_periodic_task_stays_on_its_grid);
+    RUN_TEST(test_skipped_periods_count_as_misses);
+    RUN_TEST(test_task_cancels_itself);
+    RUN_TEST(test_task_rearms_itself);
+    RUN_TEST(test_delay_of_zero_runs_with_the_next_tick);
+    RUN_TEST(test_idle_time);
+    RUN_TEST(test_deadlines_across_the_wrap);
+    return UNITY_END();
+}
@@ -0,0 +1,157 @@
+#include "storage/settings_store.h"
+
+#include "hal/native/fake_clock.h"
+#include "hal/native/memory_nvs.h"
+
+#include <unity.h>
+
+#include <string>
+
+static hal::FakeClock *g_clock = nullptr;
+static hal::MemoryNvs *g_nvs = nullptr;
+static SettingsStore *g_store = nullptr;
+
+void setUp()
+{
+    g_clock = new hal::FakeClock();
+    g_nvs = new hal::MemoryNvs();
+    g_store = new SettingsStore(*g_nvs, *g_clock);
+}
+
+void tearDown()
+{
+    delete g_store;
+    delete g_nvs;
+    delete g_clock;
+}
+
+// Runs loop() every millisecond like the control task
+static void run(uint32_t ms)
+{
+    for (uint32_t i = 0; i < ms; ++i)
+    {
+        g_store->loop();
+        g_clock->advance(1);
+    }
+}
+
+void test_loads_stored_values()
+{
+    g_nvs->put_bool("light.25.st", true);
+    g_nvs->put_int("light.25.br", 77);
+    const auto state = g_store->add_bool("light.25.st", false);
+    const auto brightness = g_store->add_int("light.25.br", 255);
+    const auto transition = g_store->add_int("light.25.tr", 500);
+
+    TEST_ASSERT_TRUE(g_store->get_bool(state));
+    TEST_ASSERT_EQUAL(77, g_store->get_int(brightness));
+    TEST_ASSERT_EQUAL(500, g_store->get_int(transition));
+    TEST_ASSERT_FALSE(g_store->has_dirty());
+    TEST_ASSERT_EQUAL_STRING("light.25.br", g_store->get_key(brightness));
+}
+
+void test_rejects_long_keys_and_full_store()
+{
+    TEST_ASSERT_EQUAL(INVALID_SETTING_HANDLE, g_store->add_bool("a.key.that.is.too.long", false));
+    for (size_t i = 0; i < SettingsStore::MAX_SETTINGS; ++i)
+        TEST_ASSERT_EQUAL(i, g_store->add_int(("k" + std::to_string(i)).c_str(), 0));
+    TEST_ASSERT_EQUAL(INVALID_SETTING_HANDLE, g_store->add_int("full", 0));
+}
+
+void test_commits_once_idle()
+{
+    const auto brightness = g_store->add_int("light.25.br", 255);
+    const uint32_t writes = g_nvs->get_writes();
+
+    // A dimmer being dragged: only the last value is written, with a single commit
+    for (int32_t value = 200; value > 100; value -= 10)
+    {
+        g_store->set(brightness, value);
+        run(100);
+    }
+    TEST_ASSERT_EQUAL(0, g_nvs->get_commits());
+    run(SettingsStoreOptions().idle_delay_ms);
+
+    TEST_ASSERT_EQUAL(1, g_nvs->get_commits());
+    TEST_ASSERT_EQUAL(writes + 1, g_nvs->get_writes());
+    TEST_ASSERT_EQUAL(110, g_nvs->get_int("light.25.br", 0));
+    TEST_ASSERT_EQUAL(1, g_store->get_writes(brightness));
+    TEST_ASSERT_EQUAL(9, g_store->get_stats().writes_avoided);
+    TEST_ASSERT_FALSE(g_store->has_dirty());
+}
+
+void test_changing_back_needs_no_write()
+{
+    const auto state = g_store->add_bool("light.25.st", false);
+    g_store->set(state, true);
+    g_store->set(state, false);
+    TEST_ASSERT_FALSE(g_store->has_dirty());
+    run(SettingsStoreOptions().max_delay_ms);
+    TEST_ASSERT_EQUAL(0, g_nvs->get_commits());
+}
+
+void test_busy_settings_are_committed_after_max_delay()
+{
+    const auto brightness = g_store->add_int("light.25.br", 0);
+
+    // Changes every 500 ms never leave the store idle
+    for (int32_t value = 1; value <= 42; ++value)
+    {
+        g_store->set(brightness, value);
+        run(500);
+    }
+
+    // Committed every max_delay_ms of 10 s although the store never went idle
+    TEST_ASSERT_EQUAL(2, g_nvs->get_commits());
+    TEST_ASSERT_EQUAL(42, g_nvs->get_int("light.25.br", 0));
+}
+
+void test_failed_commit_is_retried()
+{
+    const auto state = g_store->add_bool("light.25.st", false);
+    g_nvs->set_fail_commits(true);
+    g_store->set(state, true);
+    run(SettingsStoreOptions().idle_delay_ms + 1);
+    TEST_ASSERT_EQUAL(1, g_nvs->get_commits());
+    TEST_ASSERT_EQUAL(1, g_store->get_stats().failed_commits);
+    TEST_ASSERT_TRUE(g_store->has_dirty());
+
+    // Not before the commit interval
+    g_nvs->set_fail_commits(false);
+    run(SettingsStoreOptions().min_commit_interval_ms - 10);
+    TEST_ASSERT_EQUAL(1, g_nvs->get_commits());
+    run(10);
+    TEST_ASSERT_EQUAL(2, g_nvs->get_commits());
+    TEST_ASSERT_FALSE(g_store->has_dirty());
+    TEST_ASSERT_TRUE(g_nvs->get_bool("light.25.st", false));
+}
+
+void test_flush_commits_right_away()
+{
+    const auto state = g_store->add_bool("light.25.st", false);
+    const auto brightness = g_store->add_int("light.25.br", 255);
+    g_store->set(state, true);
+    g_store->set(brightness, 10);
+
+    TEST_ASSERT_TRUE(g_store->flush());
+    TEST_ASSERT_EQUAL(1, g_nvs->get_commits());
+    TEST_ASSERT_TRUE(g_nvs->get_bool("light.25.st", false));
+    TEST_ASSERT_EQUAL(10, g_nvs->get_int("light.25.br", 0));
+
+    // Nothing left to commit
+    TEST_ASSERT_TRUE(g_store->flush());
+    TEST_ASSERT_EQUAL(1, g_nvs->get_commits());
+}
+
+int main(int, char **)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_loads_stored_values);
+    RUN_TEST(test_rejects_long_keys_and_full_store);
+    RUN_TEST(test_commits_once_idle);
+    RUN_TEST(test_changing_back_needs_no_write);
+    RUN_TEST(test_busy_settings_are_committed_after_max_delay);
+    RUN_TEST(test_failed_commit_is_retried);
+    RUN_TEST(test_flush_commits_right_away);
+    return UNITY_END();
+}
@@ -0,0 +1,104 @@
+#include "util/spsc_queue.h"
+
+#include <unity.h>
+
+#include <cstdint>
+#include <thread>
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+struct Item
+{
+    uint32_t sequence;
+    // Both halves are written together, a torn read shows up as a mismatch
+    uint32_t check;
+};
+
+void test_holds_capacity_minus_one()
+{
+    SpscQueue<int, 8> queue;
+    TEST_ASSERT_TRUE(queue.empty());
+    for (int i = 0; i < 7; ++i)
+        TEST_ASSERT_TRUE(queue.push(i));
+    TEST_ASSERT_FALSE(queue.push(7));
+    TEST_ASSERT_EQUAL(7, queue.size());
+    TEST_ASSERT_EQUAL(1, queue.get_dropped());
+
+    int item = -1;
+    for (int i = 0; i < 7; ++i)
+    {
+        TEST_ASSERT_TRUE(queue.pop(item));
+        TEST_ASSERT_EQUAL(i, item);
+    }
+    TEST_ASSERT_FALSE(queue.pop(item));
+    TEST_ASSERT_TRUE(queue.empty());
+}
+
+void test_wraps_around()
+{
+    SpscQueue<int, 4> queue;
+    int item = -1;
+    for (int i = 0; i < 100; ++i)
+    {
+        TEST_ASSERT_TRUE(queue.push(i));
+        TEST_ASSERT_TRUE(queue.push(i + 1000));
+        TEST_ASSERT_TRUE(queue.pop(item));
+        TEST_ASSERT_EQUAL(i, item);
+        TEST_ASSERT_TRUE(queue.pop(item));
+        TEST_ASSERT_EQUAL(i + 1000, item);
+    }
+}
+
+// A producer and a consumer thread like the interrupt handler and the control loop. Also meant to be run with
+// -fsanitize=thread.
+void test_concurrent_producer_and_consumer()
+{
+    constexpr uint32_t ITEMS = 200000;
+    SpscQueue<Item, 16> queue;
+
+    std::thread producer([&queue]() {
+        for (uint32_t i = 0; i < ITEMS; ++i)
+        {
+            while (!queue.push(Item{i, ~i}))
+                std::this_thread::yield();
+        }
+    });
+
+    uint32_t expected = 0;
+    uint32_t out_of_order = 0;
+    uint32_t torn = 0;
+    while (expected < ITEMS)
+    {
+        Item item;
+        if (!queue.pop(item))
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        if (item.sequence != expected)
+            ++out_of_order;
+        if (item.check != ~item.sequence)
+            ++torn;
+        expected = item.sequence + 1;
+    }
+    producer.join();
+
+    TEST_ASSERT_EQUAL(0, out_of_order);
+    TEST_ASSERT_EQUAL(0, torn);
+    TEST_ASSERT_TRUE(queue.empty());
+}
+
+int main(int, char **)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_holds_capacity_minus_one);
+    RUN_TEST(test_wraps_around);
+    RUN_TEST(test_concurrent_producer_and_consumer);
+    return UNITY_END();
+}
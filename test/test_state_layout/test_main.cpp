@@ -0,0 +1,136 @@
+#include "mqtt/client.h"
+
+#include "hal/native/fake_clock.h"
+#include "hal/native/fake_mqtt_transport.h"
+#include "hal/native/fake_network.h"
+
+#include <unity.h>
+
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <string>
+
+constexpr static const size_t SENSORS = 8;
+constexpr static const size_t ITERATIONS = 2000;
+
+struct Result
+{
+    size_t messages = 0;
+    size_t bytes = 0;
+    double ns_per_loop = 0;
+};
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+static void report(const char *format, ...) __attribute__((format(printf, 1, 2)));
+static void report(const char *format, ...)
+{
+    char message[160];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    TEST_MESSAGE(message);
+}
+
+// Publishes ITERATIONS rounds in which changed_per_round of the sensors change and counts the state messages on the
+// wire, topic and payload, after the first snapshot. The time covers encoding and publishing.
+static Result run(mqtt::StateLayout layout, size_t changed_per_round)
+{
+    hal::FakeClock clock;
+    hal::FakeNetwork network;
+    hal::FakeMqttTransport transport;
+    mqtt::Client client(transport, network, clock, "user", "password", "broker", 1883, "nosyna-test", "Nosyna");
+    client.set_state_layout(layout);
+    client.setup();
+    mqtt::StateHandle handles[SENSORS];
+    for (size_t i = 0; i < SENSORS; ++i)
+    {
+        const std::string id = "sensor_" + std::to_string(i);
+        client.add_sensor(id, "Sensor " + std::to_string(i), "temperature", "°C");
+        handles[i] = client.find_state(id, mqtt::prop::STATE);
+        client.set(handles[i], 20.0f);
+    }
+    network.begin();
+
+    for (size_t i = 0; i < 200; ++i)
+    {
+        client.loop();
+        clock.advance(1);
+    }
+    TEST_ASSERT_TRUE(client.is_connected());
+    transport.clear_published();
+
+    const auto started = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < ITERATIONS; ++i)
+    {
+        for (size_t j = 0; j < changed_per_round; ++j)
+            client.set(handles[(i + j) % SENSORS], 21.0f + static_cast<float>(i % 100) / 10);
+        // Every round has to leave before the next one starts
+        for (size_t k = 0; k < SENSORS; ++k)
+            client.loop();
+        clock.advance(1);
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - started;
+
+    Result result;
+    for (const auto &message : transport.get_published())
+    {
+        if (message.topic.rfind("homeassistant/", 0) == 0)
+            continue;
+        ++result.messages;
+        result.bytes += message.topic.size() + message.payload.size();
+    }
+    result.ns_per_loop =
+        static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / ITERATIONS;
+    return result;
+}
+
+static void compare(size_t changed_per_round, Result &shared, Result &per_entity)
+{
+    shared = run(mqtt::StateLayout::SHARED, changed_per_round);
+    per_entity = run(mqtt::StateLayout::PER_ENTITY, changed_per_round);
+    report("%zu of %zu changed: SHARED %zu messages, %zu bytes, %.0f ns per round", changed_per_round, SENSORS,
+           shared.messages, shared.bytes, shared.ns_per_loop);
+    report("%zu of %zu changed: PER_ENTITY %zu messages, %zu bytes, %.0f ns per round", changed_per_round, SENSORS,
+           per_entity.messages, per_entity.bytes, per_entity.ns_per_loop);
+}
+
+void test_single_changes()
+{
+    Result shared;
+    Result per_entity;
+    compare(1, shared, per_entity);
+
+    // One message per change either way, the shared one also carries the sequence number and the key
+    TEST_ASSERT_EQUAL(ITERATIONS, per_entity.messages);
+    TEST_ASSERT_EQUAL(ITERATIONS, shared.messages);
+    TEST_ASSERT_TRUE(per_entity.bytes < shared.bytes);
+}
+
+void test_all_values_change()
+{
+    Result shared;
+    Result per_entity;
+    compare(SENSORS, shared, per_entity);
+
+    // A delta of all values is one message instead of one per entity
+    TEST_ASSERT_EQUAL(SENSORS * ITERATIONS, per_entity.messages);
+    TEST_ASSERT_TRUE(shared.messages < per_entity.messages);
+    TEST_ASSERT_TRUE(shared.bytes < per_entity.bytes);
+}
+
+int main(int, char **)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_single_changes);
+    RUN_TEST(test_all_values_change);
+    return UNITY_END();
+}
@@ -0,0 +1,261 @@
+#include "mqtt/client.h"
+#include "mqtt/state_store.h"
+
+#include "hal/native/fake_clock.h"
+#include "hal/native/fake_network.h"
+
+#include <unity.h>
+
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+// Heap counter for the benchmarks: every allocation made while counting is enabled is counted
+static bool g_counting = false;
+static size_t g_allocations = 0;
+
+void *operator new(size_t size)
+{
+    if (g_counting)
+        ++g_allocations;
+    void *memory = malloc(size != 0 ? size : 1);
+    if (memory == nullptr)
+        throw std::bad_alloc();
+    return memory;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void *memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void *memory, size_t) noexcept
+{
+    free(memory);
+}
+
+static void start_counting()
+{
+    g_allocations = 0;
+    g_counting = true;
+}
+
+static size_t stop_counting()
+{
+    g_counting = false;
+    return g_allocations;
+}
+
+// Broker that only counts, so the transport itself does not allocate. QoS 1 messages are acknowledged with the next
+// loop().
+class CountingTransport final : public hal::MqttTransport
+{
+  public:
+    void set_server(const char *, uint16_t) override
+    {
+    }
+
+    void set_callback(hal::MqttCallback) override
+    {
+    }
+
+    void set_ack_callback(hal::MqttAckCallback callback) override
+    {
+        m_ack_callback = callback;
+    }
+
+    bool connect(const char *, const char *, const char *) override
+    {
+        return true;
+    }
+
+    bool connected() override
+    {
+        return true;
+    }
+
+    void loop() override
+    {
+        for (size_t i = 0; i < m_unacknowledged; ++i)
+            m_ack_callback(m_packet_ids[i]);
+        m_unacknowledged = 0;
+    }
+
+    bool publish(const char *, const uint8_t *, size_t length, bool) override
+    {
+        ++messages;
+        bytes += length;
+        return true;
+    }
+
+    uint16_t publish_reliable(const char *topic, const uint8_t *payload, size_t length, bool retained) override
+    {
+        if (m_unacknowledged == mqtt::OutboundQueue::MAX_IN_FLIGHT)
+            return 0;
+
+        publish(topic, payload, length, retained);
+        if (++m_packet_id == 0)
+            m_packet_id = 1;
+        m_packet_ids[m_unacknowledged++] = m_packet_id;
+        return m_packet_id;
+    }
+
+    bool subscribe(const char *) override
+    {
+        return true;
+    }
+
+    size_t messages = 0;
+    size_t bytes = 0;
+
+  private:
+    hal::MqttAckCallback m_ack_callback;
+    uint16_t m_packet_id = 0;
+    uint16_t m_packet_ids[mqtt::OutboundQueue::MAX_IN_FLIGHT];
+    size_t m_unacknowledged = 0;
+};
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+static void report(const char *format, ...) __attribute__((format(printf, 1, 2)));
+static void report(const char *format, ...)
+{
+    char message[160];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    TEST_MESSAGE(message);
+}
+
+static double elapsed_ns(std::chrono::steady_clock::time_point started, size_t iterations)
+{
+    const auto elapsed = std::chrono::steady_clock::now() - started;
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / iterations;
+}
+
+void test_writes_typed_deltas()
+{
+    mqtt::StateStore store;
+    const auto light = store.add("led", mqtt::prop::STATE);
+    const auto brightness = store.add("led", mqtt::prop::BRIGHTNESS);
+    const auto temperature = store.add("temperature", mqtt::prop::STATE);
+    TEST_ASSERT_EQUAL(light, store.find("led", mqtt::prop::STATE));
+    TEST_ASSERT_EQUAL(mqtt::INVALID_STATE_HANDLE, store.find("led", "color"));
+
+    store.set(light, true);
+    store.set(brightness, 128);
+    store.set(temperature, 21.46f);
+    TEST_ASSERT_GREATER_THAN(0, store.write_dirty());
+    TEST_ASSERT_EQUAL_STRING("{\"seq\":1,\"led_state\":\"ON\",\"led_brightness\":128,\"temperature_state\":21.5}",
+                             store.payload());
+    TEST_ASSERT_FALSE(store.has_dirty());
+
+    // Unchanged values are not dirty again
+    store.set(brightness, 128);
+    TEST_ASSERT_FALSE(store.has_dirty());
+    store.set(light, false);
+    store.write_dirty();
+    TEST_ASSERT_EQUAL_STRING("{\"seq\":2,\"led_state\":\"OFF\"}", store.payload());
+}
+
+void test_store_does_not_allocate()
+{
+    mqtt::StateStore store;
+    mqtt::StateHandle handles[8];
+    for (size_t i = 0; i < 8; ++i)
+        handles[i] = store.add("sensor_" + std::to_string(i), mqtt::prop::STATE);
+
+    constexpr size_t ITERATIONS = 100000;
+    size_t bytes = 0;
+    const auto started = std::chrono::steady_clock::now();
+    start_counting();
+    for (size_t i = 0; i < ITERATIONS; ++i)
+    {
+        store.set(handles[i % 8], static_cast<int>(i));
+        store.set(handles[(i + 3) % 8], static_cast<float>(i) / 10);
+        bytes += i % 64 == 0 ? store.write_snapshot() : store.write_dirty();
+    }
+    const size_t allocations = stop_counting();
+
+    report("StateStore: %zu allocations in %zu writes, %.0f ns per write, %zu bytes", allocations, ITERATIONS,
+           elapsed_ns(started, ITERATIONS), bytes);
+    TEST_ASSERT_EQUAL(0, allocations);
+}
+
+void test_client_publishing_does_not_allocate()
+{
+    hal::FakeClock clock;
+    hal::FakeNetwork network;
+    CountingTransport transport;
+    mqtt::Client client(transport, network, clock, "user", "password", "broker", 1883, "nosyna-test", "Nosyna");
+    client.setup();
+    const auto temperature = client.add_sensor("temperature", "Temperature", "temperature", "°C");
+    const auto light = client.add_light("led", "LED", "light", [](const mqtt::LightCommand &) {});
+    const auto brightness = static_cast<mqtt::StateHandle>(light + 1);
+    TEST_ASSERT_EQUAL(temperature, client.find_state("temperature", mqtt::prop::STATE));
+    TEST_ASSERT_EQUAL(light, client.find_state("led", mqtt::prop::STATE));
+    TEST_ASSERT_EQUAL(brightness, client.find_state("led", mqtt::prop::BRIGHTNESS));
+    network.begin();
+
+    // Connects, announces and publishes the first snapshot, which grows the payload buffers once
+    for (size_t i = 0; i < 100; ++i)
+    {
+        client.loop();
+        clock.advance(1);
+    }
+    TEST_ASSERT_TRUE(client.is_connected());
+    const size_t warmup_messages = transport.messages;
+
+    constexpr size_t ITERATIONS = 10000;
+    const auto started = std::chrono::steady_clock::now();
+    start_counting();
+    for (size_t i = 0; i < ITERATIONS; ++i)
+    {
+        client.set(temperature, static_cast<float>(i % 400) / 10);
+        client.set(light, i % 2 == 0);
+        client.set(brightness, static_cast<int>(i % 256));
+        client.loop();
+        clock.advance(1);
+    }
+    const size_t allocations = stop_counting();
+    const size_t messages = transport.messages - warmup_messages;
+
+    report("Client: %zu allocations in %zu state messages, %.0f ns per loop", allocations, messages,
+           elapsed_ns(started, ITERATIONS));
+    TEST_ASSERT_EQUAL(ITERATIONS, messages);
+    TEST_ASSERT_EQUAL(0, allocations);
+}
+
+int main(int, char **)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_writes_typed_deltas);
+    RUN_TEST(test_store_does_not_allocate);
+    RUN_TEST(test_client_publishing_does_not_allocate);
+    return UNITY_END();
+}
@@ -0,0 +1,134 @@
+#include "mqtt/topic_router.h"
+
+#include <unity.h>
+
+#include <string>
+#include <vector>
+
+constexpr static const char *DEVICE_PREFIX = "nosyna/dev1/";
+
+static mqtt::TopicRouter *g_router = nullptr;
+static std::vector<std::string> g_calls;
+
+// Every handler records its filter, so a test can tell which ones matched
+static void add(const char *filter, bool expected = true)
+{
+    const std::string name(filter);
+    TEST_ASSERT_EQUAL(expected, g_router->add(name, [name](std::string_view, std::string_view) {
+        g_calls.push_back(name);
+    }));
+}
+
+static size_t dispatch(const char *topic)
+{
+    g_calls.clear();
+    return g_router->dispatch(topic, "payload");
+}
+
+static bool called(const char *filter)
+{
+    for (const auto &call : g_calls)
+    {
+        if (call == filter)
+            return true;
+    }
+    return false;
+}
+
+void setUp()
+{
+    g_router = new mqtt::TopicRouter(DEVICE_PREFIX);
+    g_calls.clear();
+}
+
+void tearDown()
+{
+    delete g_router;
+    g_router = nullptr;
+}
+
+void test_matches_device_topics()
+{
+    add("nosyna/dev1/led/set");
+    add("nosyna/dev1/+/set");
+    add("nosyna/dev1/ota/#");
+
+    TEST_ASSERT_EQUAL(2, dispatch("nosyna/dev1/led/set"));
+    TEST_ASSERT_TRUE(called("nosyna/dev1/led/set"));
+    TEST_ASSERT_TRUE(called("nosyna/dev1/+/set"));
+    TEST_ASSERT_EQUAL(1, dispatch("nosyna/dev1/ota"));
+    TEST_ASSERT_EQUAL(1, dispatch("nosyna/dev1/ota/url"));
+    TEST_ASSERT_EQUAL(0, dispatch("nosyna/dev1/led"));
+    TEST_ASSERT_EQUAL(0, dispatch("nosyna/dev2/led/set"));
+}
+
+void test_root_filters_match_device_topics()
+{
+    add("nosyna/dev1/led/set");
+    add("nosyna/+/led/set");
+    add("nosyna/#");
+    add("+/dev1/led/+");
+
+    TEST_ASSERT_EQUAL(4, dispatch("nosyna/dev1/led/set"));
+    TEST_ASSERT_TRUE(called("nosyna/+/led/set"));
+    TEST_ASSERT_TRUE(called("nosyna/#"));
+    TEST_ASSERT_TRUE(called("+/dev1/led/+"));
+    TEST_ASSERT_EQUAL(2, dispatch("nosyna/dev2/led/set"));
+}
+
+void test_each_root_filter_alone_matches_device_topics()
+{
+    const char *filters[] = {"nosyna/+/led/set", "nosyna/#", "#", "+/+/led/set", "nosyna/dev1/#/"};
+    for (const char *filter : filters)
+    {
+        delete g_router;
+        g_router = new mqtt::TopicRouter(DEVICE_PREFIX);
+        // '#' must be the last level
+        const bool valid = std::string(filter) != "nosyna/dev1/#/";
+        add(filter, valid);
+        TEST_ASSERT_EQUAL_MESSAGE(valid ? 1 : 0, dispatch("nosyna/dev1/led/set"), filter);
+    }
+}
+
+void test_root_filters_that_can_not_match_device_topics()
+{
+    add("nosyna/dev1/led/set");
+    add("nosyna/dev2/#");
+    add("nosyna/+");
+    add("homeassistant/status");
+
+    TEST_ASSERT_EQUAL(1, dispatch("nosyna/dev1/led/set"));
+    TEST_ASSERT_EQUAL(1, dispatch("nosyna/dev1"));
+    TEST_ASSERT_EQUAL(1, dispatch("homeassistant/status"));
+}
+
+void test_wildcards_skip_system_topics()
+{
+    add("#");
+    add("+/broker/uptime");
+
+    TEST_ASSERT_EQUAL(0, dispatch("$SYS/broker/uptime"));
+    TEST_ASSERT_EQUAL(2, dispatch("sys/broker/uptime"));
+}
+
+void test_rejects_invalid_filters()
+{
+    add("nosyna/dev1/led/set");
+    add("nosyna/dev1/led/set", false);
+    add("", false);
+    add("nosyna/#/set", false);
+    add("nosyna/a+/set", false);
+    TEST_ASSERT_EQUAL(1, g_router->get_filters().size());
+}
+
+int main(int, char **)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_matches_device_topics);
+    RUN_TEST(test_root_filters_match_device_topics);
+    RUN_TEST(test_each_root_filter_alone_matches_device_topics);
+    RUN_TEST(test_root_filters_that_can_not_match_device_topics);
+    RUN_TEST(test_wildcards_skip_system_topics);
+    RUN_TEST(test_rejects_invalid_filters);
+    return UNITY_END();
+}
@@ -0,0 +1,53 @@
+#!/usr/bin/env python3
+"""Turns nosyna log batches back into text.
+
+Reads one MQTT payload per line as hex, which is what mosquitto_sub prints with -F %x:
+
+    mosquitto_sub -h <broker> -t logs/nosyna -F %x | tools/decode_logs.py
+
+Text batches (LogEncoding::TEXT) are printed as they are.
+"""
+
+import struct
+import sys
+
+MAGIC = b"NL"
+VERSION = 1
+
+
+def decode_batch(payload):
+    if not payload.startswith(MAGIC):
+        yield from payload.decode("utf-8", "replace").splitlines()
+        return
+
+    if payload[2] != VERSION:
+        raise ValueError("unsupported batch version %d" % payload[2])
+
+    offset = 3
+    while offset < len(payload):
+        timestamp, level, tag_length = struct.unpack_from("<IcB", payload, offset)
+        offset += 6
+        tag = payload[offset : offset + tag_length].decode("utf-8", "replace")
+        offset += tag_length
+        (message_length,) = struct.unpack_from("<H", payload, offset)
+        offset += 2
+        message = payload[offset : offset + message_length].decode("utf-8", "replace")
+        offset += message_length
+        yield "%s (%d) %s: %s" % (level.decode("ascii", "replace"), timestamp, tag, message)
+
+
+def main():
+    for line in sys.stdin:
+        line = line.strip()
+        if not line:
+            continue
+        try:
+            for text in decode_batch(bytes.fromhex(line)):
+                print(text)
+        except (ValueError, struct.error) as error:
+            print("<undecodable batch: %s>" % error, file=sys.stderr)
+        sys.stdout.flush()
+
+
+if __name__ == "__main__":
+    main()
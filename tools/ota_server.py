@@ -0,0 +1,50 @@
+#!/usr/bin/env python3
+"""Serves packed images to the OTA updater of nosyna on the local network.
+
+    tools/pack_ota.py .pio/build/lolin_d32/firmware.bin nosyna.ota
+    tools/ota_server.py --directory . --port 8000
+
+OTA_URL in config.h then points to http://<host>:8000/nosyna.ota. --rate slows the download down to see how the
+device behaves on a weak connection.
+"""
+
+import argparse
+import functools
+import http.server
+import time
+
+CHUNK_SIZE = 1024
+
+
+class ImageHandler(http.server.SimpleHTTPRequestHandler):
+    rate = 0
+
+    def copyfile(self, source, output):
+        if not self.rate:
+            super().copyfile(source, output)
+            return
+
+        while True:
+            chunk = source.read(CHUNK_SIZE)
+            if not chunk:
+                break
+            output.write(chunk)
+            time.sleep(len(chunk) / self.rate)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--directory", default=".", help="directory with the packed images")
+    parser.add_argument("--port", type=int, default=8000)
+    parser.add_argument("--rate", type=int, default=0, help="bytes per second, 0 for no limit")
+    arguments = parser.parse_args()
+
+    ImageHandler.rate = arguments.rate
+    handler = functools.partial(ImageHandler, directory=arguments.directory)
+    server = http.server.ThreadingHTTPServer(("", arguments.port), handler)
+    print("Serving %s on port %d" % (arguments.directory, arguments.port))
+    server.serve_forever()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,60 @@
+#!/usr/bin/env python3
+"""Packs a firmware image for the OTA updater of nosyna.
+
+Writes the header OtaImageHeader parses, followed by the image as a zlib stream:
+
+    tools/pack_ota.py .pio/build/lolin_d32/firmware.bin nosyna.ota
+
+The device inflates with a window of 2^wbits bytes, smaller windows need less RAM and compress a little worse.
+"""
+
+import argparse
+import hashlib
+import struct
+import sys
+import zlib
+
+MAGIC = b"NOTA"
+VERSION = 1
+# Byte of the ESP32 image header that says whether a SHA-256 digest is appended to the image
+HASH_APPENDED_OFFSET = 23
+DIGEST_SIZE = 32
+
+
+def app_digest(image):
+    if len(image) > HASH_APPENDED_OFFSET + DIGEST_SIZE and image[HASH_APPENDED_OFFSET] == 1:
+        return image[-DIGEST_SIZE:]
+    return bytes(DIGEST_SIZE)
+
+
+def pack(image, wbits, level):
+    if wbits:
+        compressor = zlib.compressobj(level, zlib.DEFLATED, wbits)
+        body = compressor.compress(image) + compressor.flush()
+    else:
+        body = image
+    header = MAGIC + struct.pack("<BBHI", VERSION, wbits, 0, len(image))
+    return header + hashlib.sha256(image).digest() + app_digest(image) + body
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("image", help="firmware.bin of the build")
+    parser.add_argument("output", help="file the server offers")
+    parser.add_argument("--wbits", type=int, default=15, help="zlib window bits, 8 to 15, 0 to not compress")
+    parser.add_argument("--level", type=int, default=9, help="zlib compression level")
+    arguments = parser.parse_args()
+    if arguments.wbits and not 8 <= arguments.wbits <= 15:
+        parser.error("wbits must be between 8 and 15")
+
+    with open(arguments.image, "rb") as file:
+        image = file.read()
+    packed = pack(image, arguments.wbits, arguments.level)
+    with open(arguments.output, "wb") as file:
+        file.write(packed)
+    print("%d bytes packed into %d (%.0f%%)" % (len(image), len(packed), 100.0 * len(packed) / len(image)),
+          file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()